@@ -0,0 +1,465 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+/*
+ * Glass-to-glass latency of the output stream, from the stamps test_liveview
+ * puts in it with --latency-probe on (see common/latency_probe.h).
+ *
+ *   latency_probe receive URL
+ *       Reads the stream like a viewer on this host, e.g. back from the
+ *       media server (rtsp://localhost:8554/drone), until Ctrl-C.
+ *   latency_probe replay FILE.h264
+ *       Benchmark without a drone: plays a recorded stream into the
+ *       pipeline as the SDK callback would, streams it to a local UDP sink
+ *       and receives it in the same process.
+ *
+ * Each frame is timed at the SDK callback, out of the decoder, at the
+ * output encoder, when its packet is received and when the receiver has
+ * decoded it. All times are CLOCK_MONOTONIC.
+ */
+#include <signal.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#include "frame_info.h"
+#include "image_processor_stream.h"
+#include "latency_probe.h"
+#include "liveview/h264_bitstream.h"
+#include "liveview/image_processor_thread.h"
+#include "liveview/stream_decoder.h"
+#include "liveview/stream_processor_thread.h"
+
+using namespace edge_app;
+
+namespace {
+
+std::atomic<bool> g_stop{false};
+
+struct Sample {
+    LatencyStamp stamp;
+    int64_t received_us = 0;
+    int64_t displayed_us = 0;
+};
+
+/*
+ * Reads a stamped stream and decodes it with the lowest delay FFmpeg
+ * allows, standing for the viewer.
+ */
+class LatencyReceiver {
+   public:
+    ~LatencyReceiver() {
+        if (codec_ctx_) avcodec_free_context(&codec_ctx_);
+        if (format_ctx_) avformat_close_input(&format_ctx_);
+    }
+
+    // Blocks until the stream is found, or Stop()
+    int32_t Open(const std::string& url) {
+        format_ctx_ = avformat_alloc_context();
+        format_ctx_->interrupt_callback.callback = &LatencyReceiver::Interrupt;
+        format_ctx_->interrupt_callback.opaque = this;
+
+        AVDictionary* opts = nullptr;
+        av_dict_set(&opts, "fflags", "nobuffer", 0);
+        av_dict_set(&opts, "analyzeduration", "1000000", 0);
+        if (url.find("rtsp://") == 0) {
+            av_dict_set(&opts, "rtsp_transport", "tcp", 0);
+        }
+        int ret =
+            avformat_open_input(&format_ctx_, url.c_str(), nullptr, &opts);
+        av_dict_free(&opts);
+        if (ret < 0) {
+            printf("could not open %s\n", url.c_str());
+            return -1;
+        }
+        if (avformat_find_stream_info(format_ctx_, nullptr) < 0) {
+            printf("no stream info in %s\n", url.c_str());
+            return -1;
+        }
+        video_stream_ = av_find_best_stream(format_ctx_, AVMEDIA_TYPE_VIDEO,
+                                            -1, -1, nullptr, 0);
+        if (video_stream_ < 0) {
+            printf("no video stream in %s\n", url.c_str());
+            return -1;
+        }
+
+        const AVCodec* codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+        codec_ctx_ = avcodec_alloc_context3(codec);
+        avcodec_parameters_to_context(
+            codec_ctx_, format_ctx_->streams[video_stream_]->codecpar);
+        codec_ctx_->flags |= AV_CODEC_FLAG_LOW_DELAY;
+        // Frame threads would hold frames back
+        codec_ctx_->thread_count = 1;
+        if (avcodec_open2(codec_ctx_, codec, nullptr) < 0) {
+            printf("could not open the H.264 decoder\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    // Until Stop() or the end of the stream
+    void Run() {
+        AVPacket* packet = av_packet_alloc();
+        AVFrame* frame = av_frame_alloc();
+        // Stamps by pts, until their frame is decoded
+        std::map<int64_t, Sample> pending;
+        while (!stop_) {
+            int ret = av_read_frame(format_ctx_, packet);
+            if (ret == AVERROR(EAGAIN)) {
+                continue;
+            }
+            if (ret < 0) {
+                break;
+            }
+            if (packet->stream_index != video_stream_) {
+                av_packet_unref(packet);
+                continue;
+            }
+
+            Sample sample;
+            sample.received_us = GetMonotonicTimeUs();
+            if (FindLatencyStamp(packet->data, packet->size, &sample.stamp)) {
+                pending[packet->pts] = sample;
+            } else {
+                unstamped_++;
+            }
+            avcodec_send_packet(codec_ctx_, packet);
+            av_packet_unref(packet);
+
+            while (avcodec_receive_frame(codec_ctx_, frame) == 0) {
+                int64_t displayed_us = GetMonotonicTimeUs();
+                auto it = pending.find(frame->pts);
+                if (it != pending.end()) {
+                    it->second.displayed_us = displayed_us;
+                    std::lock_guard<std::mutex> l(mutex_);
+                    samples_.push_back(it->second);
+                }
+                // Older stamps belong to frames the decoder dropped
+                pending.erase(pending.begin(), pending.upper_bound(frame->pts));
+                av_frame_unref(frame);
+            }
+        }
+        av_frame_free(&frame);
+        av_packet_free(&packet);
+    }
+
+    void Stop() { stop_ = true; }
+
+    std::vector<Sample> Samples() {
+        std::lock_guard<std::mutex> l(mutex_);
+        return samples_;
+    }
+
+    uint64_t Unstamped() const { return unstamped_; }
+
+   private:
+    static int Interrupt(void* opaque) {
+        return ((LatencyReceiver*)opaque)->stop_ || g_stop ? 1 : 0;
+    }
+
+    AVFormatContext* format_ctx_ = nullptr;
+    AVCodecContext* codec_ctx_ = nullptr;
+    int video_stream_ = -1;
+    std::atomic<bool> stop_{false};
+    std::atomic<uint64_t> unstamped_{0};
+    std::mutex mutex_;
+    std::vector<Sample> samples_;
+};
+
+void PrintDistribution(const char* name, std::vector<int64_t> values) {
+    if (values.empty()) {
+        printf("%-10s %8s\n", name, "-");
+        return;
+    }
+    std::sort(values.begin(), values.end());
+    auto percentile = [&](double q) {
+        return values[std::min(values.size() - 1,
+                               (size_t)(q * values.size()))] /
+               1000.0;
+    };
+    double sum = 0;
+    for (auto value : values) sum += value;
+    printf("%-10s %8zu %8.1f %8.1f %8.1f %8.1f %8.1f\n", name, values.size(),
+           sum / values.size() / 1000.0, percentile(0.5), percentile(0.9),
+           percentile(0.99), values.back() / 1000.0);
+}
+
+void Report(const std::vector<Sample>& samples, uint64_t unstamped,
+            const std::string& csv) {
+    std::vector<int64_t> decode, process, output, display, total;
+    uint64_t first = UINT64_MAX;
+    uint64_t last = 0;
+    for (const auto& sample : samples) {
+        const auto& stamp = sample.stamp;
+        // Without the SDK callback time, the decoder's is the start
+        int64_t start_us = stamp.arrival_us ? stamp.arrival_us
+                                            : stamp.decoded_us;
+        if (stamp.arrival_us) {
+            decode.push_back(stamp.decoded_us - stamp.arrival_us);
+        }
+        process.push_back(stamp.encode_us - stamp.decoded_us);
+        output.push_back(sample.received_us - stamp.encode_us);
+        display.push_back(sample.displayed_us - sample.received_us);
+        total.push_back(sample.displayed_us - start_us);
+        first = std::min(first, stamp.sequence);
+        last = std::max(last, stamp.sequence);
+    }
+
+    uint64_t missing =
+        samples.empty() ? 0 : last - first + 1 - (uint64_t)samples.size();
+    printf("%zu frames received, %llu missing, %llu packets without stamp\n",
+           samples.size(), (unsigned long long)missing,
+           (unsigned long long)unstamped);
+    printf("%-10s %8s %8s %8s %8s %8s %8s  (ms)\n", "stage", "frames", "mean",
+           "p50", "p90", "p99", "max");
+    // SDK callback to decoded frame, queue included
+    PrintDistribution("decode", decode);
+    // Image processors before the output encoder
+    PrintDistribution("process", process);
+    // Encoding, muxing, transport and server
+    PrintDistribution("output", output);
+    // Receiver's decoding
+    PrintDistribution("display", display);
+    PrintDistribution("total", total);
+
+    if (csv.empty()) {
+        return;
+    }
+    FILE* file = fopen(csv.c_str(), "w");
+    if (!file) {
+        printf("could not write %s\n", csv.c_str());
+        return;
+    }
+    fprintf(file,
+            "sequence,lens,arrival_us,decoded_us,encode_us,received_us,"
+            "displayed_us\n");
+    for (const auto& sample : samples) {
+        const auto& stamp = sample.stamp;
+        fprintf(file, "%llu,%d,%lld,%lld,%lld,%lld,%lld\n",
+                (unsigned long long)stamp.sequence, stamp.lens,
+                (long long)stamp.arrival_us, (long long)stamp.decoded_us,
+                (long long)stamp.encode_us, (long long)sample.received_us,
+                (long long)sample.displayed_us);
+    }
+    fclose(file);
+    printf("per-frame times written to %s\n", csv.c_str());
+}
+
+int32_t ReadAccessUnits(const std::string& path,
+                        std::vector<std::vector<uint8_t>>* units) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        printf("could not open %s\n", path.c_str());
+        return -1;
+    }
+    H264AccessUnitSplitter splitter;
+    uint8_t buffer[64 * 1024];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        splitter.Input(buffer, size,
+                       [&](const H264AccessUnitSplitter::AccessUnit& unit) {
+                           units->emplace_back(unit.data,
+                                               unit.data + unit.size);
+                       });
+    }
+    fclose(file);
+    if (units->empty()) {
+        printf("no H.264 access unit in %s\n", path.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+int32_t Replay(const std::string& path, int32_t fps, int32_t seconds,
+               int32_t port, int32_t bitrate_kbps, size_t chunk,
+               const std::string& csv) {
+    std::vector<std::vector<uint8_t>> units;
+    if (ReadAccessUnits(path, &units) != 0) {
+        return -1;
+    }
+    printf("%s: %zu access units, replayed at %d fps for %d s to udp port "
+           "%d\n",
+           path.c_str(), units.size(), fps, seconds, port);
+
+    LatencyReceiver receiver;
+    std::thread receive_thread([&] {
+        std::string url = "udp://127.0.0.1:" + std::to_string(port) +
+                          "?overrun_nonfatal=1&fifo_size=65536";
+        if (receiver.Open(url) == 0) {
+            receiver.Run();
+        }
+    });
+    // Bound before the first packet
+    usleep(200 * 1000);
+
+    std::string sink = "udp://127.0.0.1:" + std::to_string(port) +
+                       "?pkt_size=1316";
+    auto output = std::make_shared<ImageStreamProcessor>("replay", sink);
+    output->SetLatencyProbe(true);
+    if (bitrate_kbps > 0) {
+        output->SetBitrate(bitrate_kbps);
+    }
+    auto image_thread = std::make_shared<ImageProcessorThread>("replay");
+    image_thread->SetImageProcessor(output);
+
+    StreamDecoder::Options decoder_option;
+    decoder_option.name = "ffmpeg";
+    auto stream_thread = std::make_shared<StreamProcessorThread>("replay");
+    stream_thread->SetStreamDecoder(CreateStreamDecoder(decoder_option));
+    stream_thread->SetImageProcessorThread(image_thread);
+    if (stream_thread->Start() != 0) {
+        receiver.Stop();
+        receive_thread.join();
+        return -1;
+    }
+
+    // Access units at the stream rate, each in |chunk| byte callbacks
+    int64_t start_us = GetMonotonicTimeUs();
+    int64_t end_us = start_us + (int64_t)seconds * 1000000;
+    for (uint64_t i = 0; !g_stop; i++) {
+        int64_t due_us = start_us + (int64_t)(i * 1000000 / fps);
+        if (due_us >= end_us) break;
+        int64_t wait_us = due_us - GetMonotonicTimeUs();
+        if (wait_us > 0) usleep(wait_us);
+
+        const auto& unit = units[i % units.size()];
+        for (size_t offset = 0; offset < unit.size(); offset += chunk) {
+            stream_thread->InputStream(unit.data() + offset,
+                                       std::min(chunk, unit.size() - offset));
+        }
+    }
+
+    // Frames still in flight
+    usleep(1000 * 1000);
+    receiver.Stop();
+    receive_thread.join();
+    stream_thread->Stop();
+    image_thread->Stop();
+
+    Report(receiver.Samples(), receiver.Unstamped(), csv);
+    return 0;
+}
+
+int32_t Receive(const std::string& url, int32_t seconds,
+                const std::string& csv) {
+    LatencyReceiver receiver;
+    printf("waiting for %s\n", url.c_str());
+    if (receiver.Open(url) != 0) {
+        return -1;
+    }
+    std::thread receive_thread([&] { receiver.Run(); });
+    int64_t end_us = GetMonotonicTimeUs() + (int64_t)seconds * 1000000;
+    size_t reported = 0;
+    while (!g_stop && (seconds <= 0 || GetMonotonicTimeUs() < end_us)) {
+        sleep(1);
+        auto samples = receiver.Samples();
+        if (samples.size() >= reported + 150) {
+            const auto& stamp = samples.back().stamp;
+            int64_t start_us =
+                stamp.arrival_us ? stamp.arrival_us : stamp.decoded_us;
+            printf("frame %llu: %.1f ms\n",
+                   (unsigned long long)stamp.sequence,
+                   (samples.back().displayed_us - start_us) / 1000.0);
+            reported = samples.size();
+        }
+    }
+    receiver.Stop();
+    receive_thread.join();
+    Report(receiver.Samples(), receiver.Unstamped(), csv);
+    return 0;
+}
+
+void Usage(const char* name) {
+    printf(
+        "usage: %s receive URL [--seconds N] [--csv FILE]\n"
+        "       %s replay FILE.h264 [--fps 30] [--seconds 30] [--port 5600]\n"
+        "              [--bitrate KBPS] [--chunk BYTES] [--csv FILE]\n"
+        "  receive: stream of test_liveview --latency-probe on, e.g.\n"
+        "           rtsp://localhost:8554/drone, until Ctrl-C or --seconds\n"
+        "  replay:  recorded stream through decoder, output encoder and a\n"
+        "           local UDP sink, in chunks of BYTES (whole access units\n"
+        "           by default)\n",
+        name, name);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        Usage(argv[0]);
+        return 1;
+    }
+    std::string mode = argv[1];
+    std::string target = argv[2];
+    int32_t fps = 30;
+    int32_t seconds = mode == "replay" ? 30 : 0;
+    int32_t port = 5600;
+    int32_t bitrate_kbps = 0;
+    size_t chunk = SIZE_MAX;
+    std::string csv;
+    for (int i = 3; i < argc; i++) {
+        if (i + 1 >= argc) {
+            Usage(argv[0]);
+            return 1;
+        } else if (strcmp(argv[i], "--fps") == 0) {
+            fps = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--seconds") == 0) {
+            seconds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--port") == 0) {
+            port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bitrate") == 0) {
+            bitrate_kbps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--chunk") == 0) {
+            chunk = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--csv") == 0) {
+            csv = argv[++i];
+        } else {
+            printf("unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    signal(SIGINT, [](int) { g_stop = true; });
+    avformat_network_init();
+    int32_t rc = -1;
+    if (mode == "receive") {
+        rc = Receive(target, seconds, csv);
+    } else if (mode == "replay") {
+        rc = Replay(target, fps, seconds, port, bitrate_kbps, chunk, csv);
+    } else {
+        Usage(argv[0]);
+    }
+    return rc == 0 ? 0 : 1;
+}
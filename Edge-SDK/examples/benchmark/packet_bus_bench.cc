@@ -0,0 +1,215 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame_info.h"
+#include "liveview/packet_bus.h"
+
+using namespace edge_app;
+
+struct ReaderRun {
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    uint64_t lagged = 0;
+    std::vector<int64_t> latency_us;
+};
+
+// One GOP of a synthetic Annex B stream: SPS, PPS and an IDR, then P
+// slices, with payload bytes that never form a start code
+static std::vector<uint8_t> MakeGop(int32_t bitrate_kbps, int32_t fps,
+                                    int32_t gop) {
+    std::vector<uint8_t> stream;
+    size_t frame_size = (size_t)bitrate_kbps * 1000 / 8 / fps;
+    auto nal = [&](uint8_t header, size_t size) {
+        const uint8_t start_code[] = {0, 0, 0, 1, header, 0x88};
+        stream.insert(stream.end(), start_code, start_code + sizeof(start_code));
+        for (size_t i = 0; i < size; i++) {
+            stream.push_back(1 + rand() % 255);
+        }
+    };
+    nal(0x67, 12);
+    nal(0x68, 4);
+    // Keyframes about 5 times the size of a P frame
+    nal(0x65, frame_size * 5 * gop / (gop + 4));
+    for (int32_t i = 1; i < gop; i++) {
+        nal(0x41, frame_size * gop / (gop + 4));
+    }
+    return stream;
+}
+
+static void ReadPackets(const std::string& name, std::atomic<bool>& stop,
+                        ReaderRun& run) {
+    PacketBusReader reader(name);
+    if (reader.Open() != 0) {
+        printf("failed to open %s\n", name.c_str());
+        return;
+    }
+    PacketBusReader::Packet packet;
+    while (!stop) {
+        int32_t rc = reader.Next(&packet);
+        if (rc == 1) {
+            reader.Wait(100);
+            continue;
+        }
+        if (rc != 0) {
+            break;
+        }
+        run.packets++;
+        run.bytes += packet.data.size();
+        run.latency_us.push_back(GetMonotonicTimeUs() -
+                                 packet.header.timestamp_us);
+    }
+    run.lagged = reader.Lagged();
+}
+
+static int64_t Percentile(std::vector<int64_t>& values, double p) {
+    if (values.empty()) return 0;
+    size_t n = std::min(values.size() - 1, (size_t)(values.size() * p));
+    std::nth_element(values.begin(), values.begin() + n, values.end());
+    return values[n];
+}
+
+int main(int argc, char** argv) {
+    int32_t bitrate_kbps = 8000;
+    int32_t fps = 30;
+    int32_t gop = 30;
+    int32_t seconds = 3;
+    size_t chunk = 4096;
+    bool paced = false;
+    std::string readers = "1,2,4";
+    std::string name = "/packet_bus_bench";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--paced") == 0) {
+            paced = true;
+        } else if (i + 1 >= argc) {
+            printf(
+                "Usage: %s [--bitrate KBPS] [--fps 30] [--gop 30] "
+                "[--readers 1,2,4] [--seconds 3] [--chunk 4096] [--paced] "
+                "[--name /packet_bus_bench]\n"
+                " publish a synthetic H.264 stream on a packet bus as fast "
+                "as possible, or at\n its real rate with --paced, and read "
+                "it back with each number of readers\n",
+                argv[0]);
+            return -1;
+        } else if (strcmp(argv[i], "--bitrate") == 0) {
+            bitrate_kbps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--fps") == 0) {
+            fps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--gop") == 0) {
+            gop = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--readers") == 0) {
+            readers = argv[++i];
+        } else if (strcmp(argv[i], "--seconds") == 0) {
+            seconds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--chunk") == 0) {
+            chunk = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--name") == 0) {
+            name = argv[++i];
+        } else {
+            printf("unknown option: %s\n", argv[i]);
+            return -1;
+        }
+    }
+
+    std::vector<int32_t> reader_nums;
+    std::istringstream list(readers);
+    std::string n;
+    while (std::getline(list, n, ',')) reader_nums.push_back(atoi(n.c_str()));
+
+    auto gop_stream = MakeGop(bitrate_kbps, fps, gop);
+    // Chunks per frame when paced
+    int64_t chunk_interval_us =
+        (int64_t)1000000 * gop / fps * chunk / gop_stream.size();
+
+    printf("%d kbps, %d fps, GOP %d, %zu byte chunks, %s, %d s per run\n",
+           bitrate_kbps, fps, gop, chunk, paced ? "paced" : "unpaced",
+           seconds);
+    printf("%-8s %10s %10s %10s %10s %8s %10s %10s\n", "readers", "MB/s",
+           "packets/s", "read MB/s", "read/s", "lagged", "p50 us",
+           "p99 us");
+
+    for (auto reader_num : reader_nums) {
+        PacketBusPublisher::Options options;
+        options.name = name;
+        PacketBusPublisher publisher(options);
+        if (publisher.Init() != 0) {
+            return -1;
+        }
+
+        std::atomic<bool> stop(false);
+        std::vector<ReaderRun> runs(reader_num);
+        std::vector<std::thread> threads;
+        for (int32_t i = 0; i < reader_num; i++) {
+            threads.emplace_back(ReadPackets, name, std::ref(stop),
+                                 std::ref(runs[i]));
+        }
+
+        uint64_t first = publisher.Published();
+        uint64_t bytes = 0;
+        int64_t start = GetMonotonicTimeUs();
+        int64_t end = start + (int64_t)seconds * 1000000;
+        int64_t now = start;
+        while (now < end) {
+            for (size_t offset = 0; offset < gop_stream.size();
+                 offset += chunk) {
+                size_t size = std::min(chunk, gop_stream.size() - offset);
+                publisher.Input(gop_stream.data() + offset, size);
+                bytes += size;
+                if (paced) {
+                    std::this_thread::sleep_for(
+                        std::chrono::microseconds(chunk_interval_us));
+                }
+            }
+            now = GetMonotonicTimeUs();
+        }
+        double elapsed = (now - start) / 1e6;
+        stop = true;
+        for (auto& t : threads) t.join();
+
+        ReaderRun total;
+        for (auto& run : runs) {
+            total.packets += run.packets;
+            total.bytes += run.bytes;
+            total.lagged += run.lagged;
+            total.latency_us.insert(total.latency_us.end(),
+                                    run.latency_us.begin(),
+                                    run.latency_us.end());
+        }
+        printf("%-8d %10.1f %10.0f %10.1f %10.0f %8lu %10ld %10ld\n",
+               reader_num, bytes / elapsed / 1e6,
+               (publisher.Published() - first) / elapsed,
+               total.bytes / elapsed / 1e6 / reader_num,
+               total.packets / elapsed / reader_num,
+               (unsigned long)total.lagged,
+               (long)Percentile(total.latency_us, 0.5),
+               (long)Percentile(total.latency_us, 0.99));
+    }
+    return 0;
+}
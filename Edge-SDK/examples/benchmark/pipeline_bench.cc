@@ -0,0 +1,592 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+/*
+ * End-to-end benchmark of the liveview pipeline without a drone: recorded
+ * H.264 files are fed as the SDK callback would feed them through
+ * StreamProcessorThread, FFmpegStreamDecoder and ImageProcessorThread to
+ * one of the image processors, on N streams at once.
+ *
+ *   pipeline_bench FILE.h264 [FILE.h264 ...] --streams 4 --processor null
+ *
+ * Stream i replays file i % count. The results are written as JSON, to
+ * compare runs: frame rates, the PipelineMetrics stage latencies of each
+ * stream plus the total from the SDK callback to the end of processing,
+ * the CPU time of every thread and the peak RSS.
+ */
+#include <dirent.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame_info.h"
+#include "image_processor.h"
+#include "image_processor_stream.h"
+#include "liveview/h264_bitstream.h"
+#include "liveview/image_processor_thread.h"
+#include "liveview/stream_decoder.h"
+#include "liveview/stream_processor_thread.h"
+#include "pipeline_metrics.h"
+#include "pipeline_trace.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+using namespace edge_app;
+
+namespace {
+
+std::atomic<bool> g_stop{false};
+
+const char* kStageNames[kMetricsStageCount] = {
+    "queue", "decode", "convert", "process", "encode", "write",
+};
+
+// Access units fed ahead of the processed ones at --speed max: the
+// decoder delay plus a few, below the image queue limit so that nothing
+// is dropped for the benchmark's sake
+const uint64_t kMaxInFlightFrames = 8;
+
+/*
+ * Wraps the processor under test and times each frame from its SDK
+ * callback to the end of processing.
+ */
+class BenchProcessor : public ImageProcessor {
+   public:
+    explicit BenchProcessor(std::shared_ptr<ImageProcessor> inner)
+        : inner_(inner) {}
+
+    int32_t Init() override { return inner_ ? inner_->Init() : 0; }
+
+    void SetMetrics(std::shared_ptr<PipelineMetrics> metrics) override {
+        ImageProcessor::SetMetrics(metrics);
+        if (inner_) inner_->SetMetrics(metrics);
+    }
+
+    void Process(const std::shared_ptr<Image> image) override {
+        Process(image, FrameInfo());
+    }
+
+    void Process(const std::shared_ptr<Image> image,
+                 const FrameInfo& info) override {
+        if (inner_) inner_->Process(image, info);
+        int64_t now_us = GetMonotonicTimeUs();
+        if (info.arrival_us != 0) {
+            total_.Record(now_us - info.arrival_us);
+        }
+        last_processed_us_.store(now_us, std::memory_order_relaxed);
+    }
+
+    const LatencyHistogram& Total() const { return total_; }
+
+    int64_t LastProcessedUs() const {
+        return last_processed_us_.load(std::memory_order_relaxed);
+    }
+
+   private:
+    std::shared_ptr<ImageProcessor> inner_;
+    LatencyHistogram total_;
+    std::atomic<int64_t> last_processed_us_{0};
+};
+
+struct BenchStream {
+    std::string name;
+    std::string file;
+    const std::vector<std::vector<uint8_t>>* units = nullptr;
+    std::shared_ptr<PipelineMetrics> metrics;
+    std::shared_ptr<BenchProcessor> processor;
+    std::shared_ptr<ImageProcessorThread> image_thread;
+    std::shared_ptr<StreamProcessorThread> stream_thread;
+    std::thread feeder;
+    uint64_t fed = 0;
+    int64_t fed_until_us = 0;
+
+    uint64_t Done() const {
+        return metrics->Counter(kMetricsFramesProcessed) +
+               metrics->Counter(kMetricsFramesDropped);
+    }
+};
+
+struct BenchOptions {
+    std::vector<std::string> files;
+    int32_t streams = 1;
+    std::string processor = "null";
+    bool max_speed = false;
+    int32_t fps = 30;
+    // 30 s, or unlimited with |frames|
+    int32_t seconds = 0;
+    uint64_t frames = 0;
+    size_t chunk = SIZE_MAX;
+    int32_t port = 5600;
+    int32_t decoder_threads = 4;
+    std::string json;
+    std::string trace;
+};
+
+struct ThreadCpu {
+    std::string name;
+    uint64_t ticks = 0;
+};
+
+int32_t ReadAccessUnits(const std::string& path,
+                        std::vector<std::vector<uint8_t>>* units) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        fprintf(stderr, "could not open %s\n", path.c_str());
+        return -1;
+    }
+    H264AccessUnitSplitter splitter;
+    uint8_t buffer[64 * 1024];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        splitter.Input(buffer, size,
+                       [&](const H264AccessUnitSplitter::AccessUnit& unit) {
+                           units->emplace_back(unit.data,
+                                               unit.data + unit.size);
+                       });
+    }
+    fclose(file);
+    if (units->empty()) {
+        fprintf(stderr, "no H.264 access unit in %s\n", path.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+// utime + stime of every thread of the process, in clock ticks
+std::map<int32_t, ThreadCpu> ReadThreadCpu() {
+    std::map<int32_t, ThreadCpu> threads;
+    DIR* dir = opendir("/proc/self/task");
+    if (!dir) {
+        return threads;
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        int32_t tid = atoi(entry->d_name);
+        if (tid <= 0) continue;
+        std::string path = std::string("/proc/self/task/") + entry->d_name +
+                           "/stat";
+        FILE* file = fopen(path.c_str(), "r");
+        if (!file) continue;
+        char line[1024];
+        size_t size = fread(line, 1, sizeof(line) - 1, file);
+        fclose(file);
+        line[size] = '\0';
+        // The name may hold spaces and parentheses: up to the last ')'
+        char* open = strchr(line, '(');
+        char* close = strrchr(line, ')');
+        if (!open || !close) continue;
+        ThreadCpu cpu;
+        cpu.name.assign(open + 1, close);
+        unsigned long long utime = 0, stime = 0;
+        // Fields 14 and 15, the state being field 3
+        if (sscanf(close + 2,
+                   "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+                   &utime, &stime) != 2) {
+            continue;
+        }
+        cpu.ticks = utime + stime;
+        threads[tid] = cpu;
+    }
+    closedir(dir);
+    return threads;
+}
+
+std::string JsonString(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char)c >= 0x20) {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+void WriteHistogram(FILE* out, const char* name,
+                    const LatencyHistogram& histogram, bool last) {
+    uint64_t count = histogram.Count();
+    fprintf(out,
+            "        %s: {\"count\": %llu, \"mean_ms\": %.3f, "
+            "\"p50_ms\": %.3f, \"p90_ms\": %.3f, \"p99_ms\": %.3f, "
+            "\"max_ms\": %.3f}%s\n",
+            JsonString(name).c_str(), (unsigned long long)count,
+            count ? histogram.SumUs() / 1000.0 / count : 0.0,
+            histogram.Percentile(0.5) / 1000.0,
+            histogram.Percentile(0.9) / 1000.0,
+            histogram.Percentile(0.99) / 1000.0,
+            histogram.Percentile(1.0) / 1000.0, last ? "" : ",");
+}
+
+std::shared_ptr<ImageProcessor> CreateProcessor(const BenchOptions& options,
+                                                int32_t index) {
+    ImageProcessor::Options option;
+    option.alias = "bench" + std::to_string(index);
+    if (options.processor == "stream") {
+        // Nobody needs to listen: the datagrams are simply lost
+        option.name = "stream";
+        option.stream_url = "udp://127.0.0.1:" +
+                            std::to_string(options.port + index) +
+                            "?pkt_size=1316";
+    } else if (options.processor.compare(0, 4, "yolo") == 0) {
+        // yolo or yolo:PRECISION, headless
+        option.name = "yolovfastest";
+        if (options.processor.size() > 5) {
+            option.name += "_" + options.processor.substr(5);
+        }
+        option.result_sink = "json_file:/dev/null";
+    } else {
+        return nullptr;
+    }
+    return CreateImageProcessor(option);
+}
+
+// Access units at the stream rate, or as fast as the pipeline takes them
+void Feed(BenchStream* stream, const BenchOptions& options, int64_t start_us,
+          int64_t end_us) {
+    const auto& units = *stream->units;
+    uint64_t i = 0;
+    for (; !g_stop; i++) {
+        if (options.frames != 0 && i >= options.frames) break;
+        if (options.max_speed) {
+            if (GetMonotonicTimeUs() >= end_us) break;
+            // A frame the decoder swallowed must not stall the feed
+            int64_t wait_until_us = GetMonotonicTimeUs() + 1000 * 1000;
+            while (i >= stream->Done() + kMaxInFlightFrames && !g_stop &&
+                   GetMonotonicTimeUs() < wait_until_us) {
+                usleep(200);
+            }
+        } else {
+            int64_t due_us =
+                start_us + (int64_t)(i * 1000000 / options.fps);
+            if (due_us >= end_us) break;
+            int64_t wait_us = due_us - GetMonotonicTimeUs();
+            if (wait_us > 0) usleep(wait_us);
+        }
+
+        const auto& unit = units[i % units.size()];
+        for (size_t offset = 0; offset < unit.size(); offset += options.chunk) {
+            stream->stream_thread->InputStream(
+                unit.data() + offset,
+                std::min(options.chunk, unit.size() - offset));
+        }
+    }
+    stream->fed = i;
+    stream->fed_until_us = GetMonotonicTimeUs();
+}
+
+void WriteReport(FILE* out, const BenchOptions& options,
+                 const std::vector<std::unique_ptr<BenchStream>>& streams,
+                 int64_t start_us, int64_t end_us,
+                 const std::map<int32_t, ThreadCpu>& cpu_before,
+                 const std::map<int32_t, ThreadCpu>& cpu_after) {
+    double wall_s = (end_us - start_us) / 1e6;
+    long ticks_per_s = sysconf(_SC_CLK_TCK);
+
+    fprintf(out, "{\n  \"config\": {\"files\": [");
+    for (size_t i = 0; i < options.files.size(); i++) {
+        fprintf(out, "%s%s", i ? ", " : "",
+                JsonString(options.files[i]).c_str());
+    }
+    fprintf(out,
+            "], \"streams\": %d, \"processor\": %s, \"speed\": \"%s\", "
+            "\"fps\": %d, \"seconds\": %d, \"frames\": %llu, "
+            "\"decoder_threads\": %d},\n",
+            options.streams, JsonString(options.processor).c_str(),
+            options.max_speed ? "max" : "realtime", options.fps,
+            options.seconds, (unsigned long long)options.frames,
+            options.decoder_threads);
+    fprintf(out, "  \"wall_s\": %.3f,\n", wall_s);
+
+    uint64_t total_processed = 0;
+    uint64_t total_dropped = 0;
+    double total_fps = 0;
+    fprintf(out, "  \"streams\": [\n");
+    for (size_t i = 0; i < streams.size(); i++) {
+        const BenchStream& stream = *streams[i];
+        const auto& metrics = *stream.metrics;
+        uint64_t decoded = metrics.Counter(kMetricsFramesDecoded);
+        uint64_t processed = metrics.Counter(kMetricsFramesProcessed);
+        uint64_t dropped = metrics.Counter(kMetricsFramesDropped);
+        int64_t last_us = std::max(stream.processor->LastProcessedUs(),
+                                   start_us + 1);
+        double fps = processed / ((last_us - start_us) / 1e6);
+        total_processed += processed;
+        total_dropped += dropped;
+        total_fps += fps;
+
+        fprintf(out,
+                "    {\"name\": %s, \"file\": %s, \"fed\": %llu, "
+                "\"decoded\": %llu, \"processed\": %llu, \"dropped\": %llu, "
+                "\"encoded\": %llu, \"fps\": %.2f,\n",
+                JsonString(stream.name).c_str(),
+                JsonString(stream.file).c_str(),
+                (unsigned long long)stream.fed, (unsigned long long)decoded,
+                (unsigned long long)processed, (unsigned long long)dropped,
+                (unsigned long long)metrics.Counter(kMetricsFramesEncoded),
+                fps);
+        fprintf(out, "      \"stages\": {\n");
+        for (int32_t stage = 0; stage < kMetricsStageCount; stage++) {
+            const auto& histogram = metrics.Stage((MetricsStage)stage);
+            if (histogram.Count() != 0) {
+                WriteHistogram(out, kStageNames[stage], histogram, false);
+            }
+        }
+        WriteHistogram(out, "total", stream.processor->Total(), true);
+        fprintf(out, "      }}%s\n", i + 1 < streams.size() ? "," : "");
+    }
+    fprintf(out, "  ],\n");
+    fprintf(out,
+            "  \"totals\": {\"processed\": %llu, \"dropped\": %llu, "
+            "\"fps\": %.2f},\n",
+            (unsigned long long)total_processed,
+            (unsigned long long)total_dropped, total_fps);
+
+    // Threads by CPU time over the run, those started during the run too
+    std::vector<std::pair<uint64_t, int32_t>> order;
+    for (const auto& thread : cpu_after) {
+        auto before = cpu_before.find(thread.first);
+        uint64_t ticks = thread.second.ticks;
+        if (before != cpu_before.end()) ticks -= before->second.ticks;
+        order.emplace_back(ticks, thread.first);
+    }
+    std::sort(order.rbegin(), order.rend());
+    fprintf(out, "  \"threads\": [\n");
+    for (size_t i = 0; i < order.size(); i++) {
+        double cpu_s = (double)order[i].first / ticks_per_s;
+        fprintf(out,
+                "    {\"tid\": %d, \"name\": %s, \"cpu_s\": %.2f, "
+                "\"cpu_percent\": %.1f}%s\n",
+                order[i].second,
+                JsonString(cpu_after.at(order[i].second).name).c_str(),
+                cpu_s, wall_s > 0 ? cpu_s * 100 / wall_s : 0.0,
+                i + 1 < order.size() ? "," : "");
+    }
+    fprintf(out, "  ],\n");
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double process_cpu_s = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+                           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) /
+                               1e6;
+    fprintf(out, "  \"process_cpu_s\": %.2f,\n", process_cpu_s);
+    fprintf(out, "  \"peak_rss_kb\": %ld\n}\n", usage.ru_maxrss);
+}
+
+int32_t Run(const BenchOptions& options) {
+    std::vector<std::vector<std::vector<uint8_t>>> files(options.files.size());
+    for (size_t i = 0; i < options.files.size(); i++) {
+        if (ReadAccessUnits(options.files[i], &files[i]) != 0) {
+            return -1;
+        }
+        fprintf(stderr, "%s: %zu access units\n", options.files[i].c_str(),
+                files[i].size());
+    }
+
+    std::vector<std::unique_ptr<BenchStream>> streams;
+    for (int32_t i = 0; i < options.streams; i++) {
+        std::unique_ptr<BenchStream> stream(new BenchStream());
+        stream->name = "bench" + std::to_string(i);
+        stream->file = options.files[i % options.files.size()];
+        stream->units = &files[i % files.size()];
+        stream->metrics = PipelineMetrics::Get(stream->name);
+
+        stream->processor =
+            std::make_shared<BenchProcessor>(CreateProcessor(options, i));
+        stream->image_thread =
+            std::make_shared<ImageProcessorThread>(stream->name);
+        stream->image_thread->SetImageProcessor(stream->processor);
+
+        StreamDecoder::Options decoder_option;
+        decoder_option.name = "ffmpeg";
+        decoder_option.thread_count = options.decoder_threads;
+        stream->stream_thread =
+            std::make_shared<StreamProcessorThread>(stream->name);
+        stream->stream_thread->SetStreamDecoder(
+            CreateStreamDecoder(decoder_option));
+        stream->stream_thread->SetImageProcessorThread(stream->image_thread);
+        if (stream->stream_thread->Start() != 0) {
+            fprintf(stderr, "%s: pipeline start failed\n",
+                    stream->name.c_str());
+            return -1;
+        }
+        streams.push_back(std::move(stream));
+    }
+
+    std::string pace = options.max_speed
+                           ? std::string("max speed")
+                           : std::to_string(options.fps) + " fps";
+    if (options.frames != 0) {
+        pace += ", " + std::to_string(options.frames) + " frames";
+    }
+    if (options.seconds > 0) {
+        pace += ", " + std::to_string(options.seconds) + " s";
+    }
+    fprintf(stderr, "%d streams, %s processor, %s\n", options.streams,
+            options.processor.c_str(), pace.c_str());
+    auto cpu_before = ReadThreadCpu();
+    int64_t start_us = GetMonotonicTimeUs();
+    int64_t end_us = options.seconds > 0
+                         ? start_us + (int64_t)options.seconds * 1000000
+                         : INT64_MAX;
+    for (auto& stream : streams) {
+        BenchStream* s = stream.get();
+        s->feeder = std::thread(
+            [s, &options, start_us, end_us] {
+                Feed(s, options, start_us, end_us);
+            });
+    }
+    for (auto& stream : streams) {
+        stream->feeder.join();
+    }
+
+    // Frames still in the queues; those held in the decoder never come out
+    uint64_t done = 0;
+    int64_t idle_since_us = GetMonotonicTimeUs();
+    while (GetMonotonicTimeUs() - idle_since_us < 500 * 1000) {
+        usleep(50 * 1000);
+        uint64_t now_done = 0;
+        for (auto& stream : streams) now_done += stream->Done();
+        if (now_done != done) {
+            done = now_done;
+            idle_since_us = GetMonotonicTimeUs();
+        }
+    }
+    int64_t finished_us = GetMonotonicTimeUs();
+    auto cpu_after = ReadThreadCpu();
+
+    if (!options.trace.empty()) {
+        PipelineTrace::Dump(options.trace);
+    }
+    for (auto& stream : streams) {
+        stream->stream_thread->Stop();
+        stream->image_thread->Stop();
+    }
+
+    FILE* out = stdout;
+    if (!options.json.empty()) {
+        out = fopen(options.json.c_str(), "w");
+        if (!out) {
+            fprintf(stderr, "could not open %s\n", options.json.c_str());
+            return -1;
+        }
+    }
+    WriteReport(out, options, streams, start_us, finished_us, cpu_before,
+                cpu_after);
+    if (out != stdout) {
+        fclose(out);
+        fprintf(stderr, "results written to %s\n", options.json.c_str());
+    }
+    return 0;
+}
+
+void Usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s FILE.h264 [FILE.h264 ...] [--streams 1]\n"
+            "              [--processor null|stream|yolo[:PRECISION]]\n"
+            "              [--speed realtime|max] [--fps 30] [--seconds 30]\n"
+            "              [--frames N] [--chunk BYTES] [--port 5600]\n"
+            "              [--decoder-threads 4] [--json FILE] [--trace FILE]\n"
+            "  --processor: null only counts the frames, stream encodes them\n"
+            "               to udp://127.0.0.1:PORT+i, yolo runs headless\n"
+            "               detection\n"
+            "  --speed:     realtime feeds each stream at --fps, max as fast\n"
+            "               as the pipeline processes without dropping, the\n"
+            "               total latency then includes %d queued frames\n"
+            "  --frames:    stop each stream after N access units, within\n"
+            "               --seconds if given\n"
+            "  --chunk:     callback size, whole access units by default\n"
+            "  --json:      results file, stdout by default\n"
+            "  --trace:     Chrome/Perfetto trace of the end of the run\n",
+            name, (int)kMaxInFlightFrames);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--", 2) != 0) {
+            options.files.push_back(argv[i]);
+            continue;
+        }
+        if (i + 1 >= argc) {
+            Usage(argv[0]);
+            return 1;
+        } else if (strcmp(argv[i], "--streams") == 0) {
+            options.streams = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--processor") == 0) {
+            options.processor = argv[++i];
+        } else if (strcmp(argv[i], "--speed") == 0) {
+            std::string speed = argv[++i];
+            if (speed != "realtime" && speed != "max") {
+                Usage(argv[0]);
+                return 1;
+            }
+            options.max_speed = speed == "max";
+        } else if (strcmp(argv[i], "--fps") == 0) {
+            options.fps = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--seconds") == 0) {
+            options.seconds = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--frames") == 0) {
+            options.frames = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--chunk") == 0) {
+            options.chunk = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--port") == 0) {
+            options.port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--decoder-threads") == 0) {
+            options.decoder_threads = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--json") == 0) {
+            options.json = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0) {
+            options.trace = argv[++i];
+        } else {
+            fprintf(stderr, "unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    const std::string& processor = options.processor;
+    if (options.files.empty() ||
+        (processor != "null" && processor != "stream" &&
+         processor != "yolo" && processor.compare(0, 5, "yolo:") != 0)) {
+        Usage(argv[0]);
+        return 1;
+    }
+    if (options.seconds == 0 && options.frames == 0) {
+        options.seconds = 30;
+    }
+
+    signal(SIGINT, [](int) { g_stop = true; });
+    avformat_network_init();
+    return Run(options) == 0 ? 0 : 1;
+}
@@ -0,0 +1,383 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "opencv2/dnn.hpp"
+#include "opencv2/imgcodecs.hpp"
+#include "yolo_detection.h"
+#include "yolo_model_cache.h"
+#include "yolo_post_processor.h"
+#include "yolo_precision.h"
+
+using namespace cv;
+using namespace edge_app;
+
+/*
+ * Offline check of a reduced-precision detector: runs the images of a
+ * Darknet-style list (labels in "labels/" next to "images/", one
+ * "class cx cy w h" row per object) with every requested precision, reports
+ * mAP@0.50 with the same area-under-curve rule as the shipped mAP logs, and
+ * the latency per frame. INT8 is calibrated on images kept out of the
+ * evaluation: --calibration LIST, or else the last images of IMAGE_LIST.
+ */
+
+namespace {
+
+struct GroundTruth {
+    int32_t class_id;
+    Rect2f box;
+};
+
+struct ScoredDetection {
+    float confidence;
+    bool true_positive;
+};
+
+struct EvalResult {
+    YoloPrecision precision;
+    double map = 0;
+    double mean_ms = 0;
+    double p95_ms = 0;
+    std::string error;
+};
+
+std::vector<std::string> ReadImageList(const std::string& list_path) {
+    std::vector<std::string> images;
+    std::ifstream list(list_path);
+    std::string line;
+    while (std::getline(list, line)) {
+        if (!line.empty()) images.push_back(line);
+    }
+    return images;
+}
+
+std::string LabelPath(const std::string& image_path) {
+    std::string path = image_path;
+    auto pos = path.rfind("/images/");
+    if (pos != std::string::npos) {
+        path.replace(pos, 8, "/labels/");
+    }
+    auto dot = path.rfind('.');
+    if (dot != std::string::npos && dot > path.rfind('/')) {
+        path.erase(dot);
+    }
+    return path + ".txt";
+}
+
+void LoadGroundTruth(const std::string& image_path, const Size& frame_size,
+                     std::vector<GroundTruth>& truths) {
+    truths.clear();
+    std::ifstream labels(LabelPath(image_path));
+    GroundTruth truth;
+    float cx, cy, w, h;
+    while (labels >> truth.class_id >> cx >> cy >> w >> h) {
+        truth.box = Rect2f((cx - w / 2) * frame_size.width,
+                           (cy - h / 2) * frame_size.height,
+                           w * frame_size.width, h * frame_size.height);
+        truths.push_back(truth);
+    }
+}
+
+float Iou(const Rect2f& a, const Rect2f& b) {
+    float inter = (a & b).area();
+    float sum = a.area() + b.area() - inter;
+    return sum > 0 ? inter / sum : 0;
+}
+
+// Highest confidence first, every detection takes the unmatched ground truth
+// of its class it overlaps most, if IoU >= 0.5.
+void MatchDetections(std::vector<YoloDetection>& detections,
+                     const std::vector<GroundTruth>& truths,
+                     std::vector<std::vector<ScoredDetection>>& scored) {
+    std::sort(detections.begin(), detections.end(),
+              [](const YoloDetection& a, const YoloDetection& b) {
+                  return a.confidence > b.confidence;
+              });
+    std::vector<bool> matched(truths.size(), false);
+    for (const auto& det : detections) {
+        int32_t best = -1;
+        float best_iou = 0.5;
+        for (size_t i = 0; i < truths.size(); i++) {
+            if (truths[i].class_id != det.class_id || matched[i]) continue;
+            float iou = Iou(Rect2f(det.box), truths[i].box);
+            if (iou >= best_iou) {
+                best_iou = iou;
+                best = i;
+            }
+        }
+        if (best >= 0) matched[best] = true;
+        scored[det.class_id].push_back({det.confidence, best >= 0});
+    }
+}
+
+double AveragePrecision(std::vector<ScoredDetection>& scored,
+                        int32_t truth_count) {
+    std::sort(scored.begin(), scored.end(),
+              [](const ScoredDetection& a, const ScoredDetection& b) {
+                  return a.confidence > b.confidence;
+              });
+    std::vector<double> recall(scored.size()), precision(scored.size());
+    int32_t tp = 0;
+    for (size_t i = 0; i < scored.size(); i++) {
+        if (scored[i].true_positive) tp++;
+        recall[i] = (double)tp / truth_count;
+        precision[i] = (double)tp / (i + 1);
+    }
+    // Precision envelope, then area under each unique recall step
+    for (int32_t i = (int32_t)scored.size() - 2; i >= 0; i--) {
+        precision[i] = std::max(precision[i], precision[i + 1]);
+    }
+    double ap = 0, last_recall = 0;
+    for (size_t i = 0; i < scored.size(); i++) {
+        if (recall[i] != last_recall) {
+            ap += (recall[i] - last_recall) * precision[i];
+            last_recall = recall[i];
+        }
+    }
+    return ap;
+}
+
+double ReferenceMap(const std::string& cfg_path,
+                    const std::string& model_name) {
+    auto dir = cfg_path.substr(0, cfg_path.rfind('/') + 1);
+    auto log_path = dir + (model_name.find("-xl") != std::string::npos
+                               ? "xl-mAP_log.txt"
+                               : "mAP_log.txt");
+    std::ifstream log(log_path);
+    std::string line;
+    const char* key = "(mAP@0.50) = ";
+    while (std::getline(log, line)) {
+        auto pos = line.find(key);
+        if (pos != std::string::npos) {
+            return atof(line.c_str() + pos + strlen(key));
+        }
+    }
+    return -1;
+}
+
+int32_t Evaluate(const std::vector<std::string>& images,
+                 const std::vector<std::string>& calibration_images,
+                 const std::string& model_name, const Size& input_size,
+                 EvalResult& result) {
+    dnn::Net net;
+    if (YoloModelCache::Instance()->Load(model_name, net) != 0) {
+        result.error = "cannot load model " + model_name;
+        return -1;
+    }
+    std::vector<Mat> calibration;
+    if (result.precision == kYoloPrecisionInt8 &&
+        LoadYoloCalibrationBlobs(calibration_images, input_size,
+                                 kYoloCalibrationFrameNum, calibration) != 0) {
+        result.error = "no readable calibration image";
+        return -1;
+    }
+    if (ConfigureYoloPrecision(net, result.precision, calibration,
+                               &result.error) != 0) {
+        YoloModelCache::Instance()->Release(model_name, net);
+        return -1;
+    }
+    WarmUpYoloNet(net, input_size);
+
+    // Low threshold: AP integrates over the whole confidence range
+    YoloPostProcessor::Options post_option;
+    post_option.conf_threshold = 0.005;
+    post_option.nms_threshold = 0.45;
+    YoloPostProcessor post_processor(post_option);
+
+    std::vector<std::vector<ScoredDetection>> scored(kYoloClassNum);
+    std::vector<int32_t> truth_count(kYoloClassNum, 0);
+    std::vector<double> latency_ms;
+    std::vector<GroundTruth> truths;
+    std::vector<YoloDetection> detections;
+    std::vector<Mat> outs;
+    Mat blob;
+
+    for (const auto& path : images) {
+        Mat frame = imread(path);
+        if (frame.empty()) {
+            printf("skip unreadable image: %s\n", path.c_str());
+            continue;
+        }
+        auto start = getTickCount();
+        dnn::blobFromImage(frame, blob, 1 / 255.0, input_size, Scalar(0, 0, 0),
+                           true, false);
+        net.setInput(blob);
+        net.forward(outs, net.getUnconnectedOutLayersNames());
+        post_processor.Process(outs, 0, 1, frame.size(), detections);
+        latency_ms.push_back((getTickCount() - start) * 1000.0 /
+                             getTickFrequency());
+
+        LoadGroundTruth(path, frame.size(), truths);
+        for (const auto& truth : truths) {
+            if (truth.class_id >= 0 && truth.class_id < kYoloClassNum) {
+                truth_count[truth.class_id]++;
+            }
+        }
+        MatchDetections(detections, truths, scored);
+    }
+    // The next precision starts from the parsed net, unless quantized
+    if (result.precision != kYoloPrecisionInt8) {
+        YoloModelCache::Instance()->Release(model_name, net);
+    }
+    if (latency_ms.empty()) {
+        result.error = "no readable image";
+        return -1;
+    }
+
+    int32_t classes = 0;
+    for (int32_t i = 0; i < kYoloClassNum; i++) {
+        if (truth_count[i] == 0) continue;
+        result.map += AveragePrecision(scored[i], truth_count[i]);
+        classes++;
+    }
+    result.map = classes > 0 ? result.map / classes : 0;
+
+    double total = 0;
+    for (auto ms : latency_ms) total += ms;
+    result.mean_ms = total / latency_ms.size();
+    std::sort(latency_ms.begin(), latency_ms.end());
+    result.p95_ms = latency_ms[(latency_ms.size() - 1) * 95 / 100];
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::string model_name = "yolo-fastest-1.1-xl";
+    std::string precisions = "fp32,fp16,int8";
+    double budget = 1.0;
+    int32_t limit = 0;
+    int32_t input = 320;
+    std::string calibration_path;
+
+    if (argc < 2) {
+        printf(
+            "Usage: %s [IMAGE_LIST] [--model NAME] [--precision fp32,fp16,int8] "
+            "[--budget POINTS] [--limit N] [--input SIZE] "
+            "[--calibration LIST]\n"
+            " IMAGE_LIST: one image per line, Darknet labels in labels/ next "
+            "to images/\n"
+            " --calibration: int8 calibration images (default: the last %d "
+            "images of IMAGE_LIST, left out of the evaluation)\n"
+            " --budget: accepted mAP@0.50 drop from fp32, in points (default "
+            "1.0)\n",
+            argv[0], (int)kYoloCalibrationFrameNum);
+        return -1;
+    }
+    for (int i = 2; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--model") == 0) {
+            model_name = argv[i + 1];
+        } else if (strcmp(argv[i], "--precision") == 0) {
+            precisions = argv[i + 1];
+        } else if (strcmp(argv[i], "--budget") == 0) {
+            budget = atof(argv[i + 1]);
+        } else if (strcmp(argv[i], "--limit") == 0) {
+            limit = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--input") == 0) {
+            input = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--calibration") == 0) {
+            calibration_path = argv[i + 1];
+        } else {
+            printf("unknown option: %s\n", argv[i]);
+            return -1;
+        }
+    }
+
+    auto images = ReadImageList(argv[1]);
+    std::vector<std::string> calibration_images;
+    if (!calibration_path.empty()) {
+        calibration_images = ReadImageList(calibration_path);
+    } else if (precisions.find("int8") != std::string::npos &&
+               images.size() > (size_t)kYoloCalibrationFrameNum) {
+        // Held out, calibrating on evaluated images would flatter int8
+        calibration_images.assign(images.end() - kYoloCalibrationFrameNum,
+                                  images.end());
+        images.resize(images.size() - kYoloCalibrationFrameNum);
+    }
+    if (limit > 0 && (int32_t)images.size() > limit) {
+        images.resize(limit);
+    }
+    if (images.empty()) {
+        printf("no image in %s\n", argv[1]);
+        return -1;
+    }
+
+    std::vector<EvalResult> results;
+    std::string name;
+    std::istringstream names(precisions);
+    while (std::getline(names, name, ',')) {
+        EvalResult result;
+        if (ParseYoloPrecision(name, result.precision) != 0) {
+            printf("unknown precision: %s\n", name.c_str());
+            return -1;
+        }
+        if (Evaluate(images, calibration_images, model_name,
+                     Size(input, input), result) != 0) {
+            printf("%s: skipped, %s\n", name.c_str(), result.error.c_str());
+            continue;
+        }
+        results.push_back(result);
+    }
+    if (results.empty()) return -1;
+
+    std::string cfg_path, weights_path;
+    GetYoloModelPath(model_name, cfg_path, weights_path);
+    auto reference = ReferenceMap(cfg_path, model_name);
+
+    printf("model %s, input %dx%d, %zu images\n", model_name.c_str(), input,
+           input, images.size());
+    if (reference >= 0) {
+        printf("shipped log (Darknet, COCO val2017): mAP@0.50 %.2f%%\n",
+               reference * 100);
+    }
+    printf("%-6s %10s %10s %10s %10s\n", "mode", "mAP@0.50", "delta", "mean ms",
+           "p95 ms");
+
+    double baseline = results[0].map;
+    for (const auto& result : results) {
+        if (result.precision == kYoloPrecisionFp32) baseline = result.map;
+    }
+    const EvalResult* recommended = nullptr;
+    for (const auto& result : results) {
+        double delta = (result.map - baseline) * 100;
+        printf("%-6s %9.2f%% %+10.2f %10.2f %10.2f\n",
+               YoloPrecisionName(result.precision), result.map * 100, delta,
+               result.mean_ms, result.p95_ms);
+        if (-delta <= budget &&
+            (!recommended || result.mean_ms < recommended->mean_ms)) {
+            recommended = &result;
+        }
+    }
+    if (recommended) {
+        printf("recommended within %.2f points: %s (yolovfastest_%s)\n",
+               budget, YoloPrecisionName(recommended->precision),
+               YoloPrecisionName(recommended->precision));
+    }
+    return 0;
+}
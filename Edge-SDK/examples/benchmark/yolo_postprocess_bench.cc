@@ -0,0 +1,142 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "opencv2/dnn.hpp"
+#include "opencv2/imgcodecs.hpp"
+#include "yolo_detection.h"
+#include "yolo_post_processor.h"
+
+using namespace cv;
+using namespace edge_app;
+
+static int32_t CaptureOutputs(const char* image_path, const char* output_path) {
+    std::string cfg_path, weights_path;
+    if (GetYoloModelPath("yolo-fastest-1.1-xl", cfg_path, weights_path) != 0) {
+        return -1;
+    }
+    auto net = dnn::readNetFromDarknet(cfg_path, weights_path);
+    Mat frame = imread(image_path);
+    if (net.empty() || frame.empty()) {
+        printf("failed to load model or image: %s\n", image_path);
+        return -1;
+    }
+
+    Mat blob;
+    dnn::blobFromImage(frame, blob, 1 / 255.0, Size(320, 320),
+                       Scalar(0, 0, 0), true, false);
+    net.setInput(blob);
+    std::vector<Mat> outs;
+    net.forward(outs, net.getUnconnectedOutLayersNames());
+
+    FileStorage fs(output_path, FileStorage::WRITE);
+    if (!fs.isOpened()) {
+        printf("failed to open %s\n", output_path);
+        return -1;
+    }
+    fs << "frame_width" << frame.cols;
+    fs << "frame_height" << frame.rows;
+    fs << "count" << (int)outs.size();
+    for (size_t i = 0; i < outs.size(); i++) {
+        fs << ("out" + std::to_string(i)) << outs[i];
+    }
+    printf("captured %zu outputs to %s\n", outs.size(), output_path);
+    return 0;
+}
+
+static bool SameDetections(const std::vector<YoloDetection>& a,
+                           const std::vector<YoloDetection>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].class_id != b[i].class_id ||
+            a[i].confidence != b[i].confidence || !(a[i].box == b[i].box)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int32_t RunBenchmark(const char* output_path, int32_t iterations) {
+    FileStorage fs(output_path, FileStorage::READ);
+    if (!fs.isOpened()) {
+        printf("failed to open %s\n", output_path);
+        return -1;
+    }
+    int width = 0, height = 0, count = 0;
+    fs["frame_width"] >> width;
+    fs["frame_height"] >> height;
+    fs["count"] >> count;
+    std::vector<Mat> outs(count);
+    for (int i = 0; i < count; i++) {
+        fs["out" + std::to_string(i)] >> outs[i];
+    }
+    Size frame_size(width, height);
+
+    std::vector<YoloDetection> reference, detections;
+    YoloPostProcessor post_processor;
+
+    auto start = getTickCount();
+    for (int32_t i = 0; i < iterations; i++) {
+        YoloPostProcess(outs, 0, 1, frame_size, 0.5, 0.4, reference);
+    }
+    double reference_us = (getTickCount() - start) * 1e6 /
+                          getTickFrequency() / iterations;
+
+    start = getTickCount();
+    for (int32_t i = 0; i < iterations; i++) {
+        post_processor.Process(outs, 0, 1, frame_size, detections);
+    }
+    double kernel_us = (getTickCount() - start) * 1e6 /
+                       getTickFrequency() / iterations;
+
+    printf("outputs: %s, %d layers, frame %dx%d\n", output_path, count, width,
+           height);
+    printf("minMaxLoc + NMSBoxes: %.2f us/frame, %zu detections\n",
+           reference_us, reference.size());
+    printf("YoloPostProcessor:    %.2f us/frame, %zu detections, %zu "
+           "candidates\n",
+           kernel_us, detections.size(), post_processor.CandidateCount());
+    printf("speedup: %.2fx, results %s\n", reference_us / kernel_us,
+           SameDetections(reference, detections) ? "identical" : "DIFFER");
+    return SameDetections(reference, detections) ? 0 : -1;
+}
+
+int main(int argc, char** argv) {
+    if (argc == 4 && strcmp(argv[1], "capture") == 0) {
+        return CaptureOutputs(argv[2], argv[3]);
+    }
+    if (argc == 2 || argc == 3) {
+        return RunBenchmark(argv[1], argc == 3 ? atoi(argv[2]) : 1000);
+    }
+    printf(
+        "Usage:\n"
+        " %s capture [IMAGE] [OUTPUTS.yml]  run the XL model on IMAGE and "
+        "save its raw outputs\n"
+        " %s [OUTPUTS.yml] [ITERATIONS]     time post-processing on saved "
+        "outputs\n",
+        argv[0], argv[0]);
+    return -1;
+}
@@ -0,0 +1,110 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+
+#include "opencv2/dnn.hpp"
+#include "opencv2/imgcodecs.hpp"
+#include "opencv2/imgproc.hpp"
+#include "yolo_preprocessor.h"
+
+using namespace cv;
+using namespace edge_app;
+
+static double TimeUs(int32_t iterations, const std::function<void()>& run) {
+    run();
+    auto start = getTickCount();
+    for (int32_t i = 0; i < iterations; i++) {
+        run();
+    }
+    return (getTickCount() - start) * 1e6 / getTickFrequency() / iterations;
+}
+
+// Largest difference in input levels (0-255) between two blobs
+static double MaxLevelDiff(const Mat& a, const Mat& b) {
+    return norm(a, b, NORM_INF) * 255;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        printf(
+            "Usage: %s [IMAGE] [ITERATIONS]\n"
+            " time the YOLO input preprocessing of IMAGE, e.g. a 1080p "
+            "frame\n",
+            argv[0]);
+        return -1;
+    }
+    Mat frame = imread(argv[1]);
+    if (frame.empty()) {
+        printf("failed to load image: %s\n", argv[1]);
+        return -1;
+    }
+    int32_t iterations = argc == 3 ? atoi(argv[2]) : 200;
+    Size input_size(320, 320);
+
+    // What the decoder hands over before its BGR conversion
+    Mat i420;
+    cvtColor(frame, i420, COLOR_BGR2YUV_I420);
+    const uint8_t* y = i420.ptr<uint8_t>();
+    const uint8_t* u = y + frame.total();
+    const uint8_t* v = u + frame.total() / 4;
+
+    Mat reference, blob, i420_blob, bgr;
+    YoloPreprocessor preprocessor(input_size);
+
+    double reference_us = TimeUs(iterations, [&] {
+        dnn::blobFromImage(frame, reference, 1 / 255.0, input_size,
+                           Scalar(0, 0, 0), true, false);
+    });
+    double fused_us = TimeUs(iterations, [&] {
+        preprocessor.Process(frame, blob);
+    });
+    double decoder_us = TimeUs(iterations, [&] {
+        cvtColor(i420, bgr, COLOR_YUV2BGR_I420);
+        dnn::blobFromImage(bgr, reference, 1 / 255.0, input_size,
+                           Scalar(0, 0, 0), true, false);
+    });
+    double i420_us = TimeUs(iterations, [&] {
+        preprocessor.ProcessI420(y, frame.cols, u, v, frame.cols / 2,
+                                 frame.size(), i420_blob);
+    });
+
+    Mat bgr_reference;
+    dnn::blobFromImage(frame, bgr_reference, 1 / 255.0, input_size,
+                       Scalar(0, 0, 0), true, false);
+
+    printf("frame %dx%d -> %dx%d, %d iterations\n", frame.cols, frame.rows,
+           input_size.width, input_size.height, iterations);
+    printf("blobFromImage (BGR):          %8.1f us/frame\n", reference_us);
+    printf("YoloPreprocessor (BGR):       %8.1f us/frame, %.2fx, max diff "
+           "%.2f levels\n",
+           fused_us, reference_us / fused_us,
+           MaxLevelDiff(blob, bgr_reference));
+    printf("I420 -> BGR + blobFromImage:  %8.1f us/frame\n", decoder_us);
+    printf("YoloPreprocessor (I420):      %8.1f us/frame, %.2fx, max diff "
+           "%.2f levels\n",
+           i420_us, decoder_us / i420_us, MaxLevelDiff(i420_blob, reference));
+    return 0;
+}
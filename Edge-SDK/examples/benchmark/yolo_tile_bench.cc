@@ -0,0 +1,153 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "opencv2/imgcodecs.hpp"
+#include "yolo_tiler.h"
+
+using namespace cv;
+using namespace edge_app;
+
+struct TileRun {
+    double ms = 0;
+    size_t detections = 0;
+};
+
+static int32_t RunTiler(const YoloTiler::Options& options, const Mat& frame,
+                        int32_t iterations, TileRun& run) {
+    YoloTiler tiler(options);
+    if (tiler.Init() != 0) {
+        return -1;
+    }
+    std::vector<YoloDetection> detections;
+    tiler.Detect(frame, detections);
+
+    auto start = getTickCount();
+    for (int32_t i = 0; i < iterations; i++) {
+        tiler.Detect(frame, detections);
+    }
+    run.ms = (getTickCount() - start) * 1000.0 / getTickFrequency() /
+             iterations;
+    run.detections = detections.size();
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        printf(
+            "Usage: %s [IMAGE] [--tiles 3x2] [--overlap 0.2] [--threads "
+            "1,2,4] [--iterations 20] [--no-full-frame]\n"
+            " time tiled detection on IMAGE for each thread count and in "
+            "batch mode\n",
+            argv[0]);
+        return -1;
+    }
+
+    YoloTiler::Options options;
+    std::string threads;
+    int32_t iterations = 20;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--no-full-frame") == 0) {
+            options.full_frame = false;
+        } else if (i + 1 >= argc) {
+            printf("missing value of %s\n", argv[i]);
+            return -1;
+        } else if (strcmp(argv[i], "--tiles") == 0) {
+            sscanf(argv[++i], "%dx%d", &options.columns, &options.rows);
+        } else if (strcmp(argv[i], "--overlap") == 0) {
+            options.overlap = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            threads = argv[++i];
+        } else if (strcmp(argv[i], "--iterations") == 0) {
+            iterations = atoi(argv[++i]);
+        } else {
+            printf("unknown option: %s\n", argv[i]);
+            return -1;
+        }
+    }
+
+    Mat frame = imread(argv[1]);
+    if (frame.empty()) {
+        printf("failed to load image: %s\n", argv[1]);
+        return -1;
+    }
+
+    std::vector<int32_t> thread_nums;
+    if (threads.empty()) {
+        int32_t cores = std::thread::hardware_concurrency();
+        for (int32_t n = 1; n < cores; n *= 2) thread_nums.push_back(n);
+        thread_nums.push_back(cores);
+    } else {
+        std::istringstream list(threads);
+        std::string n;
+        while (std::getline(list, n, ',')) thread_nums.push_back(atoi(n.c_str()));
+    }
+
+    // Untiled reference: the whole frame at the network input size
+    YoloTiler::Options single = options;
+    single.columns = single.rows = 1;
+    single.full_frame = false;
+    single.thread_num = 1;
+    TileRun baseline;
+    if (RunTiler(single, frame, iterations, baseline) != 0) {
+        return -1;
+    }
+
+    printf("frame %dx%d, %dx%d tiles, overlap %.2f%s, %d iterations\n",
+           frame.cols, frame.rows, options.columns, options.rows,
+           options.overlap, options.full_frame ? " + full frame" : "",
+           iterations);
+    printf("%-10s %8s %10s %8s %9s %11s %11s\n", "mode", "threads",
+           "ms/frame", "fps", "speedup", "efficiency", "detections");
+    printf("%-10s %8d %10.2f %8.1f %9s %11s %11zu\n", "untiled", 1,
+           baseline.ms, 1000 / baseline.ms, "-", "-", baseline.detections);
+
+    double single_thread_ms = 0;
+    for (auto n : thread_nums) {
+        options.thread_num = n;
+        options.batch = false;
+        TileRun run;
+        if (RunTiler(options, frame, iterations, run) != 0) {
+            return -1;
+        }
+        if (single_thread_ms == 0) single_thread_ms = run.ms * n;
+        double speedup = single_thread_ms / run.ms;
+        printf("%-10s %8d %10.2f %8.1f %8.2fx %10.0f%% %11zu\n", "parallel",
+               n, run.ms, 1000 / run.ms, speedup, speedup / n * 100,
+               run.detections);
+    }
+
+    options.batch = true;
+    TileRun run;
+    if (RunTiler(options, frame, iterations, run) == 0) {
+        printf("%-10s %8d %10.2f %8.1f %8.2fx %11s %11zu\n", "batch", 1,
+               run.ms, 1000 / run.ms, single_thread_ms / run.ms, "-",
+               run.detections);
+    }
+    return 0;
+}
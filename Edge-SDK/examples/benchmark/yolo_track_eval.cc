@@ -0,0 +1,201 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include <time.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "opencv2/dnn.hpp"
+#include "opencv2/videoio.hpp"
+#include "yolo_detection.h"
+#include "yolo_post_processor.h"
+#include "yolo_tracker.h"
+
+using namespace cv;
+using namespace edge_app;
+
+namespace {
+
+struct Score {
+    int32_t interval = 0;
+    uint64_t frames = 0;
+    uint64_t detect_frames = 0;
+    double cpu_ms = 0;
+    uint64_t true_positive = 0;
+    uint64_t false_positive = 0;
+    uint64_t false_negative = 0;
+    double iou_sum = 0;
+};
+
+// Whole process: cv::dnn runs the forward on its own worker threads
+double ProcessCpuMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+float Iou(const Rect& a, const Rect& b) {
+    float inter = (float)(a & b).area();
+    float uni = (float)(a.area() + b.area()) - inter;
+    return uni > 0 ? inter / uni : 0;
+}
+
+// Greedy same-class matching at IoU 0.5 against the every-frame detections
+void Compare(const std::vector<YoloDetection>& reference,
+             const std::vector<YoloDetection>& result, Score& score) {
+    std::vector<bool> used(reference.size(), false);
+    for (const auto& det : result) {
+        float best_iou = 0.5f;
+        int best = -1;
+        for (size_t i = 0; i < reference.size(); i++) {
+            if (used[i] || reference[i].class_id != det.class_id) continue;
+            float iou = Iou(reference[i].box, det.box);
+            if (iou >= best_iou) {
+                best_iou = iou;
+                best = (int)i;
+            }
+        }
+        if (best >= 0) {
+            used[best] = true;
+            score.true_positive++;
+            score.iou_sum += best_iou;
+        } else {
+            score.false_positive++;
+        }
+    }
+    for (auto u : used) {
+        if (!u) score.false_negative++;
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        printf(
+            "Usage: %s [VIDEO] [INTERVAL...]\n"
+            " Replays a recorded flight (h264/mp4) and compares detect-every-N "
+            "tracking against detection on every frame.\n"
+            " eg: %s flight.h264 2 3 5 10\n",
+            argv[0], argv[0]);
+        return -1;
+    }
+
+    std::vector<int32_t> intervals;
+    for (int i = 2; i < argc; i++) intervals.push_back(atoi(argv[i]));
+    if (intervals.empty()) intervals = {2, 3, 5, 10};
+
+    std::string cfg_path, weights_path;
+    if (GetYoloModelPath("yolo-fastest-1.1-xl", cfg_path, weights_path) != 0) {
+        return -1;
+    }
+    auto net = dnn::readNetFromDarknet(cfg_path, weights_path);
+    auto out_names = net.getUnconnectedOutLayersNames();
+    YoloPostProcessor post_processor;
+    auto detect = [&](const Mat& frame, std::vector<YoloDetection>& dets) {
+        Mat blob;
+        dnn::blobFromImage(frame, blob, 1 / 255.0, Size(320, 320),
+                           Scalar(0, 0, 0), true, false);
+        net.setInput(blob);
+        std::vector<Mat> outs;
+        net.forward(outs, out_names);
+        post_processor.Process(outs, 0, 1, frame.size(), dets);
+    };
+
+    // Reference pass: detect on every frame
+    std::vector<std::vector<YoloDetection>> reference;
+    Score full;
+    full.interval = 1;
+    {
+        VideoCapture capture(argv[1]);
+        if (!capture.isOpened()) {
+            printf("failed to open %s\n", argv[1]);
+            return -1;
+        }
+        Mat frame;
+        while (capture.read(frame)) {
+            std::vector<YoloDetection> dets;
+            double start = ProcessCpuMs();
+            detect(frame, dets);
+            full.cpu_ms += ProcessCpuMs() - start;
+            full.frames++;
+            full.detect_frames++;
+            full.true_positive += dets.size();
+            full.iou_sum += dets.size();
+            reference.push_back(dets);
+        }
+    }
+    if (reference.empty()) {
+        printf("no frame decoded from %s\n", argv[1]);
+        return -1;
+    }
+
+    std::vector<Score> scores;
+    scores.push_back(full);
+    for (auto interval : intervals) {
+        Score score;
+        score.interval = interval;
+        VideoCapture capture(argv[1]);
+        YoloTracker tracker;
+        SceneChangeDetector scene_change_detector;
+        int32_t frames_since_detect = 0;
+        Mat frame;
+        while (score.frames < reference.size() && capture.read(frame)) {
+            std::vector<YoloDetection> dets;
+            double start = ProcessCpuMs();
+            bool scene_changed = scene_change_detector.Check(frame);
+            if (++frames_since_detect >= interval || scene_changed ||
+                score.frames == 0) {
+                detect(frame, dets);
+                tracker.Update(dets);
+                scene_change_detector.UpdateReference();
+                frames_since_detect = 0;
+                score.detect_frames++;
+            } else {
+                tracker.Predict(dets);
+            }
+            score.cpu_ms += ProcessCpuMs() - start;
+            Compare(reference[score.frames], dets, score);
+            score.frames++;
+        }
+        scores.push_back(score);
+    }
+
+    printf("%s: %zu frames\n", argv[1], reference.size());
+    printf("%8s %10s %12s %10s %10s %10s\n", "interval", "detect%",
+           "cpu ms/frame", "precision", "recall", "mean IoU");
+    for (const auto& s : scores) {
+        double tp = (double)s.true_positive;
+        double precision = tp + s.false_positive > 0
+                               ? tp / (tp + s.false_positive)
+                               : 1.0;
+        double recall = tp + s.false_negative > 0
+                            ? tp / (tp + s.false_negative)
+                            : 1.0;
+        printf("%8d %9.1f%% %12.2f %10.3f %10.3f %10.3f\n", s.interval,
+               100.0 * s.detect_frames / s.frames, s.cpu_ms / s.frames,
+               precision, recall, tp > 0 ? s.iou_sum / tp : 0.0);
+    }
+    return 0;
+}
@@ -0,0 +1,243 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include "detection_sink.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "logger.h"
+
+using namespace edge_sdk;
+
+namespace edge_app {
+
+static void AppendJsonString(const std::string& value, std::string& out) {
+    out += '"';
+    for (auto c : value) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    out += '"';
+}
+
+void EncodeDetectionRecordJson(const DetectionRecord& record,
+                               std::string& out) {
+    char buf[160];
+    out.clear();
+    out += "{\"stream\":";
+    AppendJsonString(record.stream, out);
+    snprintf(buf, sizeof(buf),
+             ",\"seq\":%llu,\"ts_us\":%lld,\"width\":%d,\"height\":%d,"
+             "\"detections\":[",
+             (unsigned long long)record.info.sequence,
+             (long long)record.info.timestamp_us, record.frame_width,
+             record.frame_height);
+    out += buf;
+    for (size_t i = 0; i < record.detections.size(); i++) {
+        const auto& det = record.detections[i];
+        auto class_name = GetYoloClassName(det.class_id);
+        snprintf(buf, sizeof(buf),
+                 "%s{\"cls\":%d,\"name\":\"%s\",\"conf\":%.3f,"
+                 "\"box\":[%d,%d,%d,%d],\"track\":%d}",
+                 i ? "," : "", det.class_id, class_name ? class_name : "",
+                 det.confidence, det.box.x, det.box.y, det.box.width,
+                 det.box.height, det.track_id);
+        out += buf;
+    }
+    out += "]}\n";
+}
+
+void EncodeDetectionRecordBinary(const DetectionRecord& record,
+                                 std::string& out) {
+    DetectionRecordHeader header;
+    header.magic = kDetectionRecordMagic;
+    header.version = kDetectionRecordVersion;
+    header.count = (uint16_t)record.detections.size();
+    header.sequence = record.info.sequence;
+    header.timestamp_us = record.info.timestamp_us;
+    header.frame_width = (uint16_t)record.frame_width;
+    header.frame_height = (uint16_t)record.frame_height;
+
+    out.resize(sizeof(header) +
+               header.count * sizeof(DetectionRecordEntry));
+    memcpy(&out[0], &header, sizeof(header));
+    auto entry_data = &out[sizeof(header)];
+    for (uint16_t i = 0; i < header.count; i++) {
+        const auto& det = record.detections[i];
+        DetectionRecordEntry entry;
+        entry.class_id = (int16_t)det.class_id;
+        entry.reserved = 0;
+        entry.confidence = det.confidence;
+        entry.x = det.box.x;
+        entry.y = det.box.y;
+        entry.width = det.box.width;
+        entry.height = det.box.height;
+        entry.track_id = det.track_id;
+        memcpy(entry_data + i * sizeof(entry), &entry, sizeof(entry));
+    }
+}
+
+class FileDetectionSink : public DetectionSink {
+   public:
+    FileDetectionSink(const std::string& path, bool binary)
+        : path_(path), binary_(binary) {}
+
+    ~FileDetectionSink() override {
+        if (file_) fclose(file_);
+    }
+
+    int32_t Init() override {
+        file_ = fopen(path_.c_str(), binary_ ? "ab" : "a");
+        if (!file_) {
+            ERROR("open %s failed: %s", path_.c_str(), strerror(errno));
+            return -1;
+        }
+        INFO("detection sink: %s", path_.c_str());
+        return 0;
+    }
+
+    int32_t Write(const DetectionRecord& record) override {
+        if (!file_) return -1;
+        if (binary_) {
+            EncodeDetectionRecordBinary(record, buffer_);
+        } else {
+            EncodeDetectionRecordJson(record, buffer_);
+        }
+        if (fwrite(buffer_.data(), buffer_.size(), 1, file_) != 1) {
+            return -1;
+        }
+        // consumers tail the file, don't keep records in the stdio buffer
+        fflush(file_);
+        return 0;
+    }
+
+   private:
+    std::string path_;
+    bool binary_;
+    FILE* file_ = nullptr;
+    std::string buffer_;
+};
+
+class UdpDetectionSink : public DetectionSink {
+   public:
+    UdpDetectionSink(const std::string& address, bool binary)
+        : address_(address), binary_(binary) {}
+
+    ~UdpDetectionSink() override {
+        if (fd_ >= 0) close(fd_);
+    }
+
+    int32_t Init() override {
+        auto pos = address_.rfind(':');
+        if (pos == std::string::npos) {
+            ERROR("invalid udp address: %s", address_.c_str());
+            return -1;
+        }
+        auto host = address_.substr(0, pos);
+        memset(&addr_, 0, sizeof(addr_));
+        addr_.sin_family = AF_INET;
+        addr_.sin_port = htons((uint16_t)atoi(address_.c_str() + pos + 1));
+        if (inet_pton(AF_INET, host.c_str(), &addr_.sin_addr) != 1) {
+            ERROR("invalid udp host: %s", host.c_str());
+            return -1;
+        }
+        fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        if (fd_ < 0) {
+            ERROR("socket failed: %s", strerror(errno));
+            return -1;
+        }
+        INFO("detection sink: udp %s", address_.c_str());
+        return 0;
+    }
+
+    int32_t Write(const DetectionRecord& record) override {
+        if (fd_ < 0) return -1;
+        if (binary_) {
+            EncodeDetectionRecordBinary(record, buffer_);
+        } else {
+            EncodeDetectionRecordJson(record, buffer_);
+        }
+        // never block the processor thread on a slow consumer
+        auto ret = sendto(fd_, buffer_.data(), buffer_.size(), MSG_DONTWAIT,
+                          (const struct sockaddr*)&addr_, sizeof(addr_));
+        return ret < 0 ? -1 : 0;
+    }
+
+   private:
+    std::string address_;
+    bool binary_;
+    int fd_ = -1;
+    struct sockaddr_in addr_;
+    std::string buffer_;
+};
+
+class UndefinedDetectionSink : public DetectionSink {
+   public:
+    UndefinedDetectionSink(const std::string& name) : name_(name) {}
+
+    int32_t Init() override {
+        ERROR("undefine detection sink: %s", name_.c_str());
+        return -1;
+    }
+
+    int32_t Write(const DetectionRecord& record) override { return -1; }
+
+   private:
+    std::string name_;
+};
+
+int32_t ParseDetectionSinkOptions(const std::string& spec,
+                                  DetectionSink::Options& options) {
+    auto pos = spec.find(':');
+    if (pos == std::string::npos) {
+        return -1;
+    }
+    options.name = spec.substr(0, pos);
+    options.address = spec.substr(pos + 1);
+    return 0;
+}
+
+std::shared_ptr<DetectionSink> CreateDetectionSink(
+    const DetectionSink::Options& option) {
+    if (option.name == std::string("json_file")) {
+        return std::make_shared<FileDetectionSink>(option.address, false);
+    }
+    if (option.name == std::string("binary_file")) {
+        return std::make_shared<FileDetectionSink>(option.address, true);
+    }
+    if (option.name == std::string("json_udp")) {
+        return std::make_shared<UdpDetectionSink>(option.address, false);
+    }
+    if (option.name == std::string("binary_udp")) {
+        return std::make_shared<UdpDetectionSink>(option.address, true);
+    }
+    return std::make_shared<UndefinedDetectionSink>(option.name);
+}
+
+}  // namespace edge_app
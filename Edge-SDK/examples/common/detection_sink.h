@@ -0,0 +1,106 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#ifndef __DETECTION_SINK_H__
+#define __DETECTION_SINK_H__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "frame_info.h"
+#include "yolo_detection.h"
+
+namespace edge_app {
+
+struct DetectionRecord {
+    std::string stream;
+    FrameInfo info;
+    int32_t frame_width;
+    int32_t frame_height;
+    std::vector<YoloDetection> detections;
+};
+
+/*
+ * Binary record layout (little endian), one record per frame:
+ *   DetectionRecordHeader, followed by |count| DetectionRecordEntry.
+ */
+#pragma pack(push, 1)
+struct DetectionRecordHeader {
+    uint32_t magic;  // kDetectionRecordMagic
+    uint16_t version;
+    uint16_t count;
+    uint64_t sequence;
+    int64_t timestamp_us;
+    uint16_t frame_width;
+    uint16_t frame_height;
+};
+
+struct DetectionRecordEntry {
+    int16_t class_id;
+    int16_t reserved;
+    float confidence;
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+    int32_t track_id;
+};
+#pragma pack(pop)
+
+enum {
+    kDetectionRecordMagic = 0x54454459,  // "YDET"
+    kDetectionRecordVersion = 1,
+};
+
+class DetectionSink {
+   public:
+    struct Options {
+        // json_file, binary_file, json_udp, binary_udp
+        std::string name;
+        // File path for the file sinks, host:port for the udp sinks
+        std::string address;
+    };
+
+    virtual ~DetectionSink() {}
+
+    virtual int32_t Init() = 0;
+
+    virtual int32_t Write(const DetectionRecord& record) = 0;
+};
+
+// Parse "name:address", e.g. "json_udp:127.0.0.1:9000"
+int32_t ParseDetectionSinkOptions(const std::string& spec,
+                                  DetectionSink::Options& options);
+
+std::shared_ptr<DetectionSink> CreateDetectionSink(
+    const DetectionSink::Options& option);
+
+void EncodeDetectionRecordJson(const DetectionRecord& record,
+                               std::string& out);
+
+void EncodeDetectionRecordBinary(const DetectionRecord& record,
+                                 std::string& out);
+
+}  // namespace edge_app
+
+#endif
@@ -0,0 +1,343 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include "frame_bus.h"
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+#include "logger.h"
+#include "opencv2/imgproc.hpp"
+
+using namespace edge_sdk;
+
+namespace edge_app {
+
+namespace {
+
+// Payload alignment in the slots, keeps rows SIMD and page friendly
+const uint32_t kSlotAlignment = 4096;
+
+uint32_t LoadAcquire(const uint32_t* p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+FrameBusSlot* SlotAt(uint8_t* base, uint64_t frame_number) {
+    auto header = (FrameBusHeader*)base;
+    return (FrameBusSlot*)(base + sizeof(FrameBusHeader) +
+                           (frame_number % header->slot_count) *
+                               (size_t)header->slot_size);
+}
+
+uint32_t PayloadSize(FrameBusFormat format, int32_t width, int32_t height) {
+    return format == kFrameBusFormatI420 ? width * height * 3 / 2
+                                         : width * height * 3;
+}
+
+}  // namespace
+
+FrameBusPublisher::FrameBusPublisher(const Options& options,
+                                     std::shared_ptr<ImageProcessor> next)
+    : options_(options), next_(next) {}
+
+FrameBusPublisher::~FrameBusPublisher() {
+    if (base_) {
+        munmap(base_, mapped_size_);
+        base_ = nullptr;
+    }
+}
+
+int32_t FrameBusPublisher::Init() {
+    if (next_ && next_->Init() < 0) {
+        return -1;
+    }
+    if (base_) {
+        return 0;
+    }
+    if (options_.slot_count < 2) options_.slot_count = 2;
+
+    uint32_t payload = PayloadSize(options_.format, options_.max_width,
+                                   options_.max_height);
+    slot_size_ = (sizeof(FrameBusSlot) + payload + kSlotAlignment - 1) /
+                 kSlotAlignment * kSlotAlignment;
+    mapped_size_ = sizeof(FrameBusHeader) +
+                   (size_t)slot_size_ * options_.slot_count;
+
+    int fd = shm_open(options_.name.c_str(), O_RDWR | O_CREAT, 0666);
+    if (fd < 0) {
+        ERROR("shm_open %s failed: %s", options_.name.c_str(),
+              strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ERROR("stat %s failed: %s", options_.name.c_str(), strerror(errno));
+        close(fd);
+        return -1;
+    }
+    // Readers of a previous layout see the magic go and reopen. Cleared
+    // before any resize, and the object never shrinks: the readers still
+    // mapping it must not fault on their old slot offsets.
+    if ((size_t)st.st_size >= sizeof(FrameBusHeader)) {
+        void* old = mmap(nullptr, sizeof(FrameBusHeader),
+                         PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (old != MAP_FAILED) {
+            __atomic_store_n(&((FrameBusHeader*)old)->magic, 0,
+                             __ATOMIC_RELEASE);
+            munmap(old, sizeof(FrameBusHeader));
+        }
+    }
+    if ((size_t)st.st_size < mapped_size_ && ftruncate(fd, mapped_size_) != 0) {
+        ERROR("sizing %s failed: %s", options_.name.c_str(), strerror(errno));
+        close(fd);
+        return -1;
+    }
+    void* addr = mmap(nullptr, mapped_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        ERROR("mmap %s failed: %s", options_.name.c_str(), strerror(errno));
+        return -1;
+    }
+    base_ = (uint8_t*)addr;
+
+    auto header = (FrameBusHeader*)base_;
+    __atomic_store_n(&header->magic, 0, __ATOMIC_RELEASE);
+    // Frame numbers go on across restarts, so readers waiting for a newer
+    // frame are not confused, but |latest| must not point at a cleared slot
+    frame_number_ = std::max(header->latest, header->last_number);
+    header->last_number = frame_number_;
+    __atomic_store_n(&header->latest, 0, __ATOMIC_RELEASE);
+    memset(base_ + sizeof(FrameBusHeader), 0,
+           mapped_size_ - sizeof(FrameBusHeader));
+    header->version = FrameBusHeader::kVersion;
+    header->slot_count = options_.slot_count;
+    header->slot_size = slot_size_;
+    __atomic_store_n(&header->magic, FrameBusHeader::kMagic, __ATOMIC_RELEASE);
+
+    INFO("frame bus %s: %d slots of %u bytes", options_.name.c_str(),
+         options_.slot_count, slot_size_);
+    return 0;
+}
+
+void FrameBusPublisher::Process(const std::shared_ptr<Image> image) {
+    FrameInfo info;
+    info.timestamp_us = GetMonotonicTimeUs();
+    Process(image, info);
+}
+
+void FrameBusPublisher::Process(const std::shared_ptr<Image> image,
+                                const FrameInfo& info) {
+    if (image && !image->empty() && base_) {
+        Publish(*image, info);
+    }
+    if (next_) {
+        next_->Process(image, info);
+    }
+}
+
+void FrameBusPublisher::Publish(const cv::Mat& frame, const FrameInfo& info) {
+    if (frame.type() != CV_8UC3) {
+        return;
+    }
+    uint32_t size = PayloadSize(options_.format, frame.cols, frame.rows);
+    if (sizeof(FrameBusSlot) + size > slot_size_ ||
+        (options_.format == kFrameBusFormatI420 &&
+         (frame.cols % 2 || frame.rows % 2))) {
+        if (!oversize_reported_) {
+            WARN("frame bus %s: %dx%d frames do not fit, not published",
+                 options_.name.c_str(), frame.cols, frame.rows);
+            oversize_reported_ = true;
+        }
+        return;
+    }
+
+    auto header = (FrameBusHeader*)base_;
+    uint64_t number = ++frame_number_;
+    auto slot = SlotAt(base_, number);
+    uint8_t* payload = (uint8_t*)slot + sizeof(FrameBusSlot);
+
+    uint32_t sequence = slot->sequence;
+    __atomic_store_n(&slot->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    slot->format = options_.format;
+    slot->frame_number = number;
+    slot->timestamp_us = info.timestamp_us;
+    slot->lens = info.lens;
+    slot->width = frame.cols;
+    slot->height = frame.rows;
+    slot->size = size;
+    if (options_.format == kFrameBusFormatI420) {
+        slot->stride = frame.cols;
+        // Converted straight into the slot
+        cv::Mat i420(frame.rows * 3 / 2, frame.cols, CV_8UC1, payload);
+        cv::cvtColor(frame, i420, cv::COLOR_BGR2YUV_I420);
+    } else {
+        slot->stride = frame.cols * 3;
+        cv::Mat bgr(frame.rows, frame.cols, CV_8UC3, payload);
+        frame.copyTo(bgr);
+    }
+
+    __atomic_store_n(&slot->sequence, sequence + 2, __ATOMIC_RELEASE);
+    header->last_number = number;
+    __atomic_store_n(&header->latest, number, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&header->notify, 1, __ATOMIC_RELEASE);
+    syscall(SYS_futex, &header->notify, FUTEX_WAKE, INT_MAX, nullptr, nullptr,
+            0);
+}
+
+FrameBusReader::~FrameBusReader() {
+    if (base_) {
+        munmap(base_, mapped_size_);
+        base_ = nullptr;
+    }
+}
+
+int32_t FrameBusReader::Open() {
+    if (base_) {
+        munmap(base_, mapped_size_);
+        base_ = nullptr;
+    }
+    int fd = shm_open(name_.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(FrameBusHeader)) {
+        close(fd);
+        return -1;
+    }
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return -1;
+    }
+    base_ = (uint8_t*)addr;
+    mapped_size_ = st.st_size;
+
+    auto header = (const FrameBusHeader*)base_;
+    if (LoadAcquire(&header->magic) != FrameBusHeader::kMagic ||
+        header->version != FrameBusHeader::kVersion ||
+        sizeof(FrameBusHeader) +
+                (size_t)header->slot_size * header->slot_count >
+            mapped_size_) {
+        munmap(base_, mapped_size_);
+        base_ = nullptr;
+        return -1;
+    }
+    return 0;
+}
+
+int32_t FrameBusReader::Latest(Frame* frame, uint64_t after) {
+    if (!base_) {
+        return -1;
+    }
+    auto header = (FrameBusHeader*)base_;
+    for (;;) {
+        // Re-created, possibly with bigger slots than mapped here
+        if (LoadAcquire(&header->magic) != FrameBusHeader::kMagic ||
+            sizeof(FrameBusHeader) +
+                    (size_t)header->slot_size * header->slot_count >
+                mapped_size_) {
+            return -1;
+        }
+        uint64_t number = __atomic_load_n(&header->latest, __ATOMIC_ACQUIRE);
+        if (number == 0 || number <= after) {
+            return 1;
+        }
+        auto slot = SlotAt(base_, number);
+        uint32_t sequence = LoadAcquire(&slot->sequence);
+        bool torn = sequence & 1;
+        if (!torn) {
+            frame->header = *slot;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            torn = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) !=
+                       sequence ||
+                   frame->header.frame_number != number;
+        }
+        if (torn) {
+            // Lapped by the writer meanwhile: take the newer frame, if
+            // |latest| moved, otherwise there is no frame to read
+            if (__atomic_load_n(&header->latest, __ATOMIC_ACQUIRE) !=
+                number) {
+                continue;
+            }
+            return 1;
+        }
+        frame->data = (const uint8_t*)slot + sizeof(FrameBusSlot);
+        auto data = const_cast<uint8_t*>(frame->data);
+        if (frame->header.format == kFrameBusFormatI420) {
+            frame->image = cv::Mat(frame->header.height * 3 / 2,
+                                   frame->header.width, CV_8UC1, data,
+                                   frame->header.stride);
+        } else {
+            frame->image = cv::Mat(frame->header.height, frame->header.width,
+                                   CV_8UC3, data, frame->header.stride);
+        }
+        return 0;
+    }
+}
+
+bool FrameBusReader::Valid(const Frame& frame) const {
+    if (!base_ || !frame.data) {
+        return false;
+    }
+    auto header = (const FrameBusHeader*)base_;
+    auto slot = (const FrameBusSlot*)(frame.data - sizeof(FrameBusSlot));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    // A restart resets the sequences: the frame number tells the frames
+    // apart, as the numbering goes on across restarts
+    return __atomic_load_n(&header->magic, __ATOMIC_RELAXED) ==
+               FrameBusHeader::kMagic &&
+           __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) ==
+               frame.header.sequence &&
+           __atomic_load_n(&slot->frame_number, __ATOMIC_RELAXED) ==
+               frame.header.frame_number;
+}
+
+int32_t FrameBusReader::Wait(uint64_t after, int32_t timeout_ms) {
+    if (!base_) {
+        return -1;
+    }
+    auto header = (FrameBusHeader*)base_;
+    struct timespec timeout = {timeout_ms / 1000,
+                               (timeout_ms % 1000) * 1000000L};
+    uint32_t notify = LoadAcquire(&header->notify);
+    if (__atomic_load_n(&header->latest, __ATOMIC_ACQUIRE) > after) {
+        return 0;
+    }
+    syscall(SYS_futex, &header->notify, FUTEX_WAIT, notify, &timeout, nullptr,
+            0);
+    return __atomic_load_n(&header->latest, __ATOMIC_ACQUIRE) > after ? 0 : 1;
+}
+
+}  // namespace edge_app
@@ -0,0 +1,176 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#ifndef __FRAME_BUS_H__
+#define __FRAME_BUS_H__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "frame_info.h"
+#include "image_processor.h"
+#include "opencv2/core.hpp"
+
+namespace edge_app {
+
+/*
+ * Shared memory ring of decoded frames for local consumer processes, see
+ * PythonVIdeoSelector/frame_bus.py for the Python reader. Layout, little
+ * endian:
+ *
+ *   FrameBusHeader | slot 0: FrameBusSlot, payload | slot 1 ...
+ *
+ * Slots are |slot_size| bytes apart, frame N goes to slot N % slot_count.
+ * Each slot is guarded by its seqlock |sequence| (odd while written). The
+ * writer never waits for readers: a reader maps the newest frame in place
+ * and must check that the slot's sequence is unchanged once it is done with
+ * the pixels, or copy them; a lagging reader just skips to the newest frame.
+ */
+struct FrameBusHeader {
+    enum : uint32_t {
+        kMagic = 0x42464A44,  // "DJFB"
+        kVersion = 1,
+    };
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    // Newest complete frame number, frames start at 1. 0 while no frame
+    // has been published since the writer (re)started.
+    uint64_t latest;
+    // Bumped with every frame, readers can FUTEX_WAIT on it
+    uint32_t notify;
+    uint32_t reserved0;
+    // Newest frame number ever published: numbering goes on from there
+    // after a restart, so that readers waiting for a newer frame see them
+    uint64_t last_number;
+    uint32_t reserved[6];
+};
+
+static_assert(sizeof(FrameBusHeader) == 64, "FrameBusHeader layout changed");
+
+enum FrameBusFormat : uint32_t {
+    kFrameBusFormatBgr24 = 0,
+    // Y plane, then U and V planes of half width and height, |stride| is
+    // the Y stride
+    kFrameBusFormatI420 = 1,
+};
+
+struct FrameBusSlot {
+    uint32_t sequence;
+    uint32_t format;
+    uint64_t frame_number;
+    int64_t timestamp_us;
+    int32_t lens;
+    int32_t width;
+    int32_t height;
+    int32_t stride;
+    uint32_t size;
+    uint32_t reserved[5];
+};
+
+static_assert(sizeof(FrameBusSlot) == 64, "FrameBusSlot layout changed");
+
+/*
+ * Publisher stage, an ImageProcessor writing each frame to the bus before
+ * handing it to the optional |next| processor.
+ */
+class FrameBusPublisher : public ImageProcessor {
+   public:
+    struct Options {
+        // POSIX shared memory name, starting with '/'
+        std::string name = "/drone_frames";
+        FrameBusFormat format = kFrameBusFormatBgr24;
+        int32_t slot_count = 4;
+        // Largest frame the slots hold, bigger ones are not published
+        int32_t max_width = 1920;
+        int32_t max_height = 1080;
+    };
+
+    FrameBusPublisher(const Options& options,
+                      std::shared_ptr<ImageProcessor> next = nullptr);
+
+    ~FrameBusPublisher() override;
+
+    int32_t Init() override;
+
+    void Process(const std::shared_ptr<Image> image) override;
+
+    void Process(const std::shared_ptr<Image> image,
+                 const FrameInfo& info) override;
+
+    void SetMetrics(std::shared_ptr<PipelineMetrics> metrics) override {
+        ImageProcessor::SetMetrics(metrics);
+        if (next_) next_->SetMetrics(metrics);
+    }
+
+   private:
+    void Publish(const cv::Mat& frame, const FrameInfo& info);
+
+    Options options_;
+    std::shared_ptr<ImageProcessor> next_;
+    uint8_t* base_ = nullptr;
+    size_t mapped_size_ = 0;
+    uint32_t slot_size_ = 0;
+    uint64_t frame_number_ = 0;
+    bool oversize_reported_ = false;
+};
+
+/*
+ * Reader of a bus, from any process. Not thread safe.
+ */
+class FrameBusReader {
+   public:
+    struct Frame {
+        FrameBusSlot header;
+        // Points into the shared memory, valid while Valid() holds
+        const uint8_t* data = nullptr;
+        // BGR or I420 image over |data|, no copy
+        cv::Mat image;
+    };
+
+    explicit FrameBusReader(const std::string& name) : name_(name) {}
+
+    ~FrameBusReader();
+
+    int32_t Open();
+
+    // Newest frame if newer than |after|: 0 on success, 1 if there is
+    // none, -1 if the bus is gone or was re-created (Open again)
+    int32_t Latest(Frame* frame, uint64_t after = 0);
+
+    // False once the writer has started overwriting the frame's slot
+    bool Valid(const Frame& frame) const;
+
+    // Waits until a frame newer than |after| is published
+    int32_t Wait(uint64_t after, int32_t timeout_ms);
+
+   private:
+    std::string name_;
+    uint8_t* base_ = nullptr;
+    size_t mapped_size_ = 0;
+};
+
+}  // namespace edge_app
+
+#endif
@@ -0,0 +1,283 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include "frame_compositor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "logger.h"
+#include "opencv2/imgproc.hpp"
+
+using namespace edge_sdk;
+
+namespace edge_app {
+
+namespace {
+
+// Margin around the picture-in-picture insets, in pixels
+const int32_t kInsetMargin = 8;
+
+const uint64_t kReportFrameInterval = 300;
+
+class CompositorInputProcessor : public ImageProcessor {
+   public:
+    CompositorInputProcessor(std::shared_ptr<FrameCompositor> compositor,
+                             int32_t tag)
+        : compositor_(compositor), tag_(tag) {}
+
+    void Process(const std::shared_ptr<Image> image) override {
+        if (tag_ != kCompositorTagFromLens) compositor_->Push(tag_, image);
+    }
+
+    void Process(const std::shared_ptr<Image> image,
+                 const FrameInfo& info) override {
+        compositor_->Push(tag_ == kCompositorTagFromLens ? info.lens : tag_,
+                          image);
+    }
+
+   private:
+    std::shared_ptr<FrameCompositor> compositor_;
+    int32_t tag_;
+};
+
+}  // namespace
+
+FrameCompositor::FrameCompositor(const Options& options) : options_(options) {
+    if (options_.output_fps <= 0) options_.output_fps = 15;
+    if (options_.inset_scale <= 0 || options_.inset_scale > 1) {
+        options_.inset_scale = 0.3;
+    }
+}
+
+FrameCompositor::~FrameCompositor() { Stop(); }
+
+int32_t FrameCompositor::AddInput(int32_t tag, TileStyle style) {
+    if (running_) {
+        ERROR("%s: inputs must be added before Start", options_.name.c_str());
+        return -1;
+    }
+    for (const auto& tile : tiles_) {
+        if (tile->tag == tag) {
+            ERROR("%s: input %d added twice", options_.name.c_str(), tag);
+            return -1;
+        }
+    }
+    tiles_.emplace_back(new Tile());
+    tiles_.back()->tag = tag;
+    tiles_.back()->style = style;
+    return 0;
+}
+
+void FrameCompositor::ComputeLayout() {
+    const int32_t n = tiles_.size();
+    const auto& size = options_.output_size;
+
+    if (options_.layout == kCompositorLayoutPictureInPicture) {
+        tiles_[0]->cell = cv::Rect(0, 0, size.width, size.height);
+        int32_t w = size.width * options_.inset_scale;
+        int32_t h = w * size.height / size.width;
+        int32_t x = size.width - kInsetMargin - w;
+        int32_t y = size.height - kInsetMargin - h;
+        for (int32_t i = 1; i < n; i++) {
+            tiles_[i]->cell = cv::Rect(std::max(x, 0), std::max(y, 0), w, h) &
+                              cv::Rect(0, 0, size.width, size.height);
+            x -= w + kInsetMargin;
+        }
+        return;
+    }
+
+    int32_t columns = options_.columns > 0
+                          ? options_.columns
+                          : (int32_t)std::ceil(std::sqrt((double)n));
+    columns = std::min(columns, n);
+    int32_t rows = (n + columns - 1) / columns;
+    int32_t w = size.width / columns;
+    int32_t h = size.height / rows;
+    for (int32_t i = 0; i < n; i++) {
+        tiles_[i]->cell = cv::Rect((i % columns) * w, (i / columns) * h, w, h);
+    }
+}
+
+int32_t FrameCompositor::Start(OutputCallback callback) {
+    if (running_) {
+        WARN("%s: repeat start", options_.name.c_str());
+        return -1;
+    }
+    if (tiles_.empty() || options_.output_size.width <= 0 ||
+        options_.output_size.height <= 0) {
+        ERROR("%s: no input or empty output", options_.name.c_str());
+        return -1;
+    }
+    ComputeLayout();
+    output_ = cv::Mat::zeros(options_.output_size, CV_8UC3);
+    pending_.reserve(tiles_.size());
+
+    // 256 x 1 BGR table, applied in place on the gray tile
+    cv::Mat ramp(1, 256, CV_8UC1);
+    for (int32_t i = 0; i < 256; i++) ramp.at<uint8_t>(0, i) = i;
+    cv::applyColorMap(ramp, inferno_lut_, cv::COLORMAP_INFERNO);
+
+    callback_ = callback;
+    running_ = true;
+    thread_ = std::thread(&FrameCompositor::Run, this);
+    INFO("%s: %zu inputs, %dx%d at %.1f fps", options_.name.c_str(),
+         tiles_.size(), options_.output_size.width,
+         options_.output_size.height, options_.output_fps);
+    return 0;
+}
+
+void FrameCompositor::Stop() {
+    running_ = false;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void FrameCompositor::Push(int32_t tag, const std::shared_ptr<cv::Mat>& frame) {
+    if (!frame || frame->empty()) return;
+    for (auto& tile : tiles_) {
+        if (tile->tag == tag) {
+            std::lock_guard<std::mutex> l(tile->frame_mutex);
+            tile->frame = frame;
+            tile->dirty = true;
+            return;
+        }
+    }
+}
+
+void FrameCompositor::FitRegion(Tile& tile, const cv::Size& source_size) {
+    tile.source_size = source_size;
+    tile.region = tile.cell;
+    if (options_.keep_aspect) {
+        double scale =
+            std::min((double)tile.cell.width / source_size.width,
+                     (double)tile.cell.height / source_size.height);
+        int32_t w = std::max(1, (int32_t)std::lround(source_size.width * scale));
+        int32_t h =
+            std::max(1, (int32_t)std::lround(source_size.height * scale));
+        tile.region = cv::Rect(tile.cell.x + (tile.cell.width - w) / 2,
+                               tile.cell.y + (tile.cell.height - h) / 2, w, h);
+    }
+    // Bars around the region
+    output_(tile.cell).setTo(cv::Scalar(0, 0, 0));
+    if (tile.style != kTileStyleColor) {
+        tile.scratch.create(tile.region.size(), CV_8UC1);
+    }
+}
+
+void FrameCompositor::RenderTile(Tile& tile) {
+    const cv::Mat& source = *tile.rendering;
+    if (source.type() != CV_8UC3 || tile.cell.empty()) return;
+    if (source.size() != tile.source_size) {
+        FitRegion(tile, source.size());
+    }
+
+    // The ROI header has the size and type the functions would create, so
+    // they write straight into the output buffer.
+    cv::Mat region = output_(tile.region);
+    cv::resize(source, region, tile.region.size(), 0, 0,
+               source.cols > tile.region.width ? cv::INTER_AREA
+                                               : cv::INTER_LINEAR);
+    if (tile.style == kTileStyleColor) return;
+
+    cv::cvtColor(region, tile.scratch, cv::COLOR_BGR2GRAY);
+    cv::cvtColor(tile.scratch, region, cv::COLOR_GRAY2BGR);
+    if (tile.style == kTileStyleInferno) {
+        cv::LUT(region, inferno_lut_, region);
+    }
+}
+
+void FrameCompositor::Render() {
+    pending_.clear();
+    for (auto& tile : tiles_) {
+        std::lock_guard<std::mutex> l(tile->frame_mutex);
+        if (tile->dirty) {
+            tile->rendering = tile->frame;
+            tile->dirty = false;
+            pending_.push_back(tile.get());
+        }
+    }
+
+    if (options_.layout == kCompositorLayoutPictureInPicture &&
+        !pending_.empty() && pending_[0] == tiles_[0].get()) {
+        // The main picture covers the insets: draw it alone first, then
+        // every inset again
+        RenderTile(*tiles_[0]);
+        pending_.clear();
+        for (size_t i = 1; i < tiles_.size(); i++) {
+            if (tiles_[i]->rendering) pending_.push_back(tiles_[i].get());
+        }
+    }
+    if (pending_.empty()) return;
+
+    // Tiles cover disjoint regions of the output
+    cv::parallel_for_(cv::Range(0, pending_.size()),
+                      [&](const cv::Range& range) {
+                          for (int32_t i = range.start; i < range.end; i++) {
+                              RenderTile(*pending_[i]);
+                          }
+                      });
+}
+
+void FrameCompositor::Run() {
+    pthread_setname_np(pthread_self(), "compositor");
+    const auto period = std::chrono::microseconds(
+        (int64_t)std::llround(1000000.0 / options_.output_fps));
+    auto next = std::chrono::steady_clock::now();
+    uint64_t reported_late = 0;
+
+    while (running_) {
+        next += period;
+        Render();
+
+        FrameInfo info;
+        info.sequence = ++sequence_;
+        info.timestamp_us = GetMonotonicTimeUs();
+        if (callback_) callback_(output_, info);
+
+        auto now = std::chrono::steady_clock::now();
+        if (now > next) {
+            // Behind schedule: skip the missed ticks instead of bursting
+            late_frames_++;
+            next = now;
+        } else {
+            std::this_thread::sleep_until(next);
+        }
+
+        if (sequence_ % kReportFrameInterval == 0 &&
+            late_frames_ != reported_late) {
+            WARN("%s: %llu of %llu output frames late", options_.name.c_str(),
+                 (unsigned long long)late_frames_.load(),
+                 (unsigned long long)sequence_);
+            reported_late = late_frames_;
+        }
+    }
+}
+
+std::shared_ptr<ImageProcessor> CreateCompositorInput(
+    std::shared_ptr<FrameCompositor> compositor, int32_t tag) {
+    if (!compositor) return nullptr;
+    return std::make_shared<CompositorInputProcessor>(compositor, tag);
+}
+
+}  // namespace edge_app
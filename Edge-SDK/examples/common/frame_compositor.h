@@ -0,0 +1,149 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#ifndef __FRAME_COMPOSITOR_H__
+#define __FRAME_COMPOSITOR_H__
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame_info.h"
+#include "image_processor.h"
+#include "opencv2/core.hpp"
+
+namespace edge_app {
+
+/*
+ * Composes the latest frame of N tagged inputs into one view, a grid or a
+ * picture-in-picture, at a fixed output rate whatever the inputs' rates.
+ * Inputs only swap a frame pointer; the output thread renders each tile
+ * whose input changed into its region of a preallocated output buffer, the
+ * tiles in parallel. In steady state nothing is allocated per frame.
+ */
+class FrameCompositor {
+   public:
+    enum Layout {
+        kCompositorLayoutGrid = 0,
+        // First input full size, the others as insets along the bottom
+        kCompositorLayoutPictureInPicture = 1,
+    };
+
+    enum TileStyle {
+        kTileStyleColor = 0,
+        kTileStyleGray = 1,
+        // False color for thermal inputs
+        kTileStyleInferno = 2,
+    };
+
+    struct Options {
+        std::string name = "compositor";
+        cv::Size output_size = cv::Size(1280, 480);
+        Layout layout = kCompositorLayoutGrid;
+        // Grid columns, 0 picks the most square grid
+        int32_t columns = 0;
+        // Inset width as a share of the output width
+        float inset_scale = 0.3;
+        float output_fps = 15;
+        // Keep the input aspect ratio in its tile, bars in between
+        bool keep_aspect = true;
+    };
+
+    // Called on the compositor thread. |frame| is the output buffer, only
+    // valid during the call.
+    using OutputCallback =
+        std::function<void(const cv::Mat& frame, const FrameInfo& info)>;
+
+    explicit FrameCompositor(const Options& options);
+
+    ~FrameCompositor();
+
+    // Inputs are laid out in the order they are added. Must be called
+    // before Start.
+    int32_t AddInput(int32_t tag, TileStyle style = kTileStyleColor);
+
+    int32_t Start(OutputCallback callback);
+
+    void Stop();
+
+    // Latest frame of the input |tag|, ignored if there is no such input.
+    // The frame is kept by reference: the producer must not write into it
+    // afterwards, as the decoder which allocates a new image per frame.
+    void Push(int32_t tag, const std::shared_ptr<cv::Mat>& frame);
+
+    uint64_t LateFrames() const { return late_frames_; }
+
+   private:
+    struct Tile {
+        int32_t tag;
+        TileStyle style;
+        cv::Rect cell;
+
+        std::mutex frame_mutex;
+        std::shared_ptr<cv::Mat> frame;
+        bool dirty = false;
+
+        // Render state, only touched by the compositor thread
+        std::shared_ptr<cv::Mat> rendering;
+        cv::Size source_size;
+        cv::Rect region;
+        cv::Mat scratch;
+    };
+
+    void ComputeLayout();
+
+    void FitRegion(Tile& tile, const cv::Size& source_size);
+
+    void Run();
+
+    void Render();
+
+    void RenderTile(Tile& tile);
+
+    Options options_;
+    std::vector<std::unique_ptr<Tile>> tiles_;
+    std::vector<Tile*> pending_;
+    cv::Mat output_;
+    cv::Mat inferno_lut_;
+
+    OutputCallback callback_;
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+    uint64_t sequence_ = 0;
+    std::atomic<uint64_t> late_frames_{0};
+};
+
+// Use the input matching each frame's FrameInfo::lens
+enum { kCompositorTagFromLens = -1 };
+
+// Image processor pushing its frames to the input |tag| of |compositor|,
+// for InitLiveviewSample.
+std::shared_ptr<ImageProcessor> CreateCompositorInput(
+    std::shared_ptr<FrameCompositor> compositor, int32_t tag);
+
+}  // namespace edge_app
+
+#endif
@@ -0,0 +1,70 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#ifndef __FRAME_INFO_H__
+#define __FRAME_INFO_H__
+
+#include <time.h>
+
+#include <cstdint>
+#include <memory>
+
+namespace edge_app {
+
+struct MotionSummary;
+
+/*
+ * Metadata travelling with a decoded frame from the decoder thread to the
+ * image processors.
+ */
+struct FrameInfo {
+    // Per-stream counter of decoded frames
+    uint64_t sequence = 0;
+
+    // CLOCK_MONOTONIC time the frame was decoded, or handed to the processor
+    // thread if the decoder does not stamp it
+    int64_t timestamp_us = 0;
+
+    // CLOCK_MONOTONIC time the SDK stream callback delivered the first bytes
+    // of the frame, 0 if the decoder was not told
+    int64_t arrival_us = 0;
+
+    // Set by a decoder exporting motion vectors, see motion_summary.h
+    std::shared_ptr<const MotionSummary> motion;
+
+    // Bumped by the decoder each time the bitstream restarts on a new source
+    // (new SPS, or the IDR after a requested camera source switch)
+    uint32_t source_generation = 0;
+
+    // Camera source the frame was encoded from, edge_sdk::Liveview::
+    // CameraSource values, 0 until the first switch tells it
+    int32_t lens = 0;
+};
+
+inline int64_t GetMonotonicTimeUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+}  // namespace edge_app
+
+#endif
@@ -49,8 +49,22 @@ std::shared_ptr<ImageProcessor> CreateImageProcessor(
     if (option.name == std::string("display")) {
         return std::make_shared<ImageDisplayProcessor>(option.alias, option.userdata);
     }
-    if (option.name == std::string("yolovfastest")) {
-        return std::make_shared<ImageProcessorYolovFastest>(option.alias);
+    YoloPrecision precision = kYoloPrecisionFp32;
+    if (option.name == std::string("yolovfastest") ||
+        (option.name.compare(0, 13, "yolovfastest_") == 0 &&
+         ParseYoloPrecision(option.name.substr(13), precision) == 0)) {
+        std::shared_ptr<DetectionSink> result_sink;
+        if (!option.result_sink.empty()) {
+            DetectionSink::Options sink_option;
+            if (ParseDetectionSinkOptions(option.result_sink, sink_option) !=
+                0) {
+                ERROR("invalid result sink: %s", option.result_sink.c_str());
+            } else {
+                result_sink = CreateDetectionSink(sink_option);
+            }
+        }
+        return std::make_shared<ImageProcessorYolovFastest>(
+            option.alias, option.inference_service, result_sink, precision);
     }
     if (option.name == std::string("stream")) {
         return std::make_shared<ImageStreamProcessor>(option.alias, option.stream_url);
@@ -26,12 +26,17 @@
 #include <memory>
 #include <string>
 
+#include "frame_info.h"
+
 namespace cv {
 class Mat;
 }
 
 namespace edge_app {
 
+class PipelineMetrics;
+class YoloInferenceService;
+
 class ImageProcessor {
    public:
     struct Options {
@@ -39,6 +44,9 @@ class ImageProcessor {
         std::string alias;
         std::shared_ptr<void> userdata;
         std::string stream_url;  // URL for streaming (RTSP/RTMP)
+        std::string result_sink;  // Detection sink, e.g. json_file:/tmp/det.jsonl
+        // yolovfastest: detect through this service, shared by several streams
+        std::shared_ptr<YoloInferenceService> inference_service;
     };
 
     virtual int32_t Init() { return 0; }
@@ -49,6 +57,20 @@ class ImageProcessor {
 
     using Image = cv::Mat;
     virtual void Process(const std::shared_ptr<Image> image) = 0;
+
+    // Processors that need the frame metadata override this one.
+    virtual void Process(const std::shared_ptr<Image> image,
+                         const FrameInfo& info) {
+        Process(image);
+    }
+
+    // Set by the ImageProcessorThread running the processor, before Init()
+    virtual void SetMetrics(std::shared_ptr<PipelineMetrics> metrics) {
+        metrics_ = metrics;
+    }
+
+   protected:
+    std::shared_ptr<PipelineMetrics> metrics_;
 };
 
 std::shared_ptr<ImageProcessor> CreateImageProcessor(
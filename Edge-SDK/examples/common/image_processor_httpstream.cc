@@ -21,6 +21,8 @@
  */
 #include "image_processor_httpstream.h"
 #include "logger.h"
+#include "pipeline_metrics.h"
+#include "pipeline_trace.h"
 
 namespace edge_app {
 
@@ -242,6 +244,9 @@ void ImageHttpStreamProcessor::Process(const std::shared_ptr<Image> image) {
     // Convert BGR to YUV420P
     const uint8_t* src_data[1] = { image->data };
     int src_linesize[1] = { static_cast<int>(image->step[0]) };
+    int64_t encode_start_us = GetMonotonicTimeUs();
+    int64_t write_us = 0;
+    TRACE_SCOPE("encode");
     
     sws_scale(sws_ctx_, src_data, src_linesize, 0, height,
               frame_->data, frame_->linesize);
@@ -271,7 +276,10 @@ void ImageHttpStreamProcessor::Process(const std::shared_ptr<Image> image) {
         packet_->stream_index = stream_->index;
         
         // Write packet
+        TRACE_SCOPE("write", "bytes", packet_->size);
+        int64_t write_start_us = GetMonotonicTimeUs();
         ret = av_interleaved_write_frame(format_ctx_, packet_);
+        write_us += GetMonotonicTimeUs() - write_start_us;
         if (ret < 0) {
             char errbuf[128];
             av_strerror(ret, errbuf, sizeof(errbuf));
@@ -280,6 +288,13 @@ void ImageHttpStreamProcessor::Process(const std::shared_ptr<Image> image) {
         
         av_packet_unref(packet_);
     }
+
+    if (metrics_) {
+        metrics_->Record(kMetricsStageEncode,
+                         GetMonotonicTimeUs() - encode_start_us - write_us);
+        metrics_->Record(kMetricsStageWrite, write_us);
+        metrics_->Add(kMetricsFramesEncoded);
+    }
 }
 
 }  // namespace edge_app
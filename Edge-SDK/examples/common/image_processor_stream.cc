@@ -21,7 +21,11 @@
  */
 #include "image_processor_stream.h"
 
+#include <cstring>
+
 #include "logger.h"
+#include "pipeline_metrics.h"
+#include "pipeline_trace.h"
 
 namespace edge_app {
 
@@ -48,6 +52,8 @@ int32_t ImageStreamProcessor::InitEncoder(int width, int height) {
 
     width_ = width;
     height_ = height;
+    input_width_ = width;
+    input_height_ = height;
 
     INFO("Initializing stream encoder: %dx%d -> %s", width, height, stream_url_.c_str());
 
@@ -63,8 +69,11 @@ int32_t ImageStreamProcessor::InitEncoder(int width, int height) {
     } else if (stream_url_.find("http://") == 0 || stream_url_.find("https://") == 0) {
         // For HTTP(S) URLs, try RTSP as it's commonly used with MediaMTX/WHEP servers
         format_name = "rtsp";
+    } else if (stream_url_.find("udp://") == 0 || stream_url_.find("tcp://") == 0) {
+        // Local sinks, e.g. latency_probe
+        format_name = "mpegts";
     } else {
-        ERROR("Unsupported URL scheme. Supported: rtsp://, rtmp://, http://");
+        ERROR("Unsupported URL scheme. Supported: rtsp://, rtmp://, http://, udp://, tcp://");
         return -1;
     }
 
@@ -104,7 +113,7 @@ int32_t ImageStreamProcessor::InitEncoder(int width, int height) {
     codec_ctx_->time_base = {1, 30};  // 30 fps
     codec_ctx_->framerate = {30, 1};
     codec_ctx_->pix_fmt = AV_PIX_FMT_YUV420P;
-    codec_ctx_->bit_rate = 2000000;  // 2 Mbps
+    codec_ctx_->bit_rate = (int64_t)bitrate_kbps_ * 1000;  // 2 Mbps by default
     codec_ctx_->gop_size = 30;
     codec_ctx_->max_b_frames = 0;
 
@@ -244,7 +253,55 @@ void ImageStreamProcessor::CleanupEncoder() {
     initialized_ = false;
 }
 
+int32_t ImageStreamProcessor::SetBitrate(int32_t kbps) {
+    if (kbps <= 0) {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(encoder_mutex_);
+    bitrate_kbps_ = kbps;
+    if (codec_ctx_) {
+        codec_ctx_->bit_rate = (int64_t)kbps * 1000;
+    }
+    INFO("Stream encoder bitrate: %d kbps", kbps);
+    return 0;
+}
+
+void ImageStreamProcessor::Process(const std::shared_ptr<Image> image,
+                                   const FrameInfo& info) {
+    if (info.lens != lens_) {
+        lens_ = info.lens;
+        force_keyframe_ = true;
+    }
+    Encode(image, info);
+}
+
 void ImageStreamProcessor::Process(const std::shared_ptr<Image> image) {
+    Encode(image, FrameInfo());
+}
+
+void ImageStreamProcessor::StampPacket() {
+    int64_t pts = packet_->pts;
+    if (pts == AV_NOPTS_VALUE || pts < 0) {
+        return;
+    }
+    int32_t slot = pts % kLatencyStampRing;
+    if (stamp_pts_[slot] != pts) {
+        return;
+    }
+    auto sei = MakeLatencySei(stamps_[slot]);
+    size_t offset = LatencySeiOffset(packet_->data, packet_->size);
+    size_t size = packet_->size;
+    if (av_grow_packet(packet_, sei.size()) < 0) {
+        WARN("Could not stamp packet %lld", (long long)pts);
+        return;
+    }
+    memmove(packet_->data + offset + sei.size(), packet_->data + offset,
+            size - offset);
+    memcpy(packet_->data + offset, sei.data(), sei.size());
+}
+
+void ImageStreamProcessor::Encode(const std::shared_ptr<Image>& image,
+                                  const FrameInfo& info) {
     if (!image || image->empty()) {
         return;
     }
@@ -260,19 +317,25 @@ void ImageStreamProcessor::Process(const std::shared_ptr<Image> image) {
         }
     }
 
-    // Check if dimensions changed
-    if (width != width_ || height != height_) {
-        WARN("Frame dimensions changed from %dx%d to %dx%d, reinitializing encoder",
-             width_, height_, width, height);
-        CleanupEncoder();
-        if (InitEncoder(width, height) < 0) {
-            ERROR("Failed to reinitialize encoder");
+    std::lock_guard<std::mutex> lock(encoder_mutex_);
+
+    // A new stream quality: scaled to the encoder's size, so that the
+    // encoder and the connection to the server are kept
+    if (width != input_width_ || height != input_height_) {
+        INFO("Frame dimensions changed from %dx%d to %dx%d, scaled to %dx%d",
+             input_width_, input_height_, width, height, width_, height_);
+        sws_ctx_ = sws_getCachedContext(
+            sws_ctx_, width, height, AV_PIX_FMT_BGR24, width_, height_,
+            AV_PIX_FMT_YUV420P, SWS_BILINEAR, nullptr, nullptr, nullptr);
+        if (!sws_ctx_) {
+            ERROR("Failed to create scaler context");
             return;
         }
+        input_width_ = width;
+        input_height_ = height;
+        force_keyframe_ = true;
     }
 
-    std::lock_guard<std::mutex> lock(encoder_mutex_);
-
     // Make frame writable
     int ret = av_frame_make_writable(frame_);
     if (ret < 0) {
@@ -283,11 +346,26 @@ void ImageStreamProcessor::Process(const std::shared_ptr<Image> image) {
     // Convert BGR to YUV420P
     const uint8_t* src_data[1] = {image->data};
     int src_linesize[1] = {static_cast<int>(image->step[0])};
+    int64_t encode_start_us = GetMonotonicTimeUs();
+    int64_t write_us = 0;
+    TRACE_SCOPE("encode", "frame", info.sequence);
     
     sws_scale(sws_ctx_, src_data, src_linesize, 0, height,
               frame_->data, frame_->linesize);
 
     frame_->pts = frame_count_++;
+    if (latency_probe_) {
+        int32_t slot = frame_->pts % kLatencyStampRing;
+        stamp_pts_[slot] = frame_->pts;
+        stamps_[slot].sequence = info.sequence;
+        stamps_[slot].arrival_us = info.arrival_us;
+        stamps_[slot].decoded_us = info.timestamp_us;
+        stamps_[slot].encode_us = encode_start_us;
+        stamps_[slot].lens = info.lens;
+    }
+    frame_->pict_type =
+        force_keyframe_ ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+    force_keyframe_ = false;
 
     // Encode frame
     ret = avcodec_send_frame(codec_ctx_, frame_);
@@ -307,12 +385,19 @@ void ImageStreamProcessor::Process(const std::shared_ptr<Image> image) {
             break;
         }
 
+        if (latency_probe_) {
+            StampPacket();
+        }
+
         // Rescale packet timestamp
         av_packet_rescale_ts(packet_, codec_ctx_->time_base, stream_->time_base);
         packet_->stream_index = stream_->index;
 
         // Write packet
+        TRACE_SCOPE("write", "bytes", packet_->size);
+        int64_t write_start_us = GetMonotonicTimeUs();
         ret = av_interleaved_write_frame(format_ctx_, packet_);
+        write_us += GetMonotonicTimeUs() - write_start_us;
         if (ret < 0) {
             char errbuf[256];
             av_strerror(ret, errbuf, sizeof(errbuf));
@@ -321,6 +406,13 @@ void ImageStreamProcessor::Process(const std::shared_ptr<Image> image) {
 
         av_packet_unref(packet_);
     }
+
+    if (metrics_) {
+        metrics_->Record(kMetricsStageEncode,
+                         GetMonotonicTimeUs() - encode_start_us - write_us);
+        metrics_->Record(kMetricsStageWrite, write_us);
+        metrics_->Add(kMetricsFramesEncoded);
+    }
 }
 
 }  // namespace edge_app
@@ -29,6 +29,7 @@
 
 #include "opencv2/opencv.hpp"
 #include "image_processor.h"
+#include "latency_probe.h"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -50,10 +51,32 @@ class ImageStreamProcessor : public ImageProcessor {
 
     void Process(const std::shared_ptr<Image> image) override;
 
+    // Starts a new GOP on a lens switch, so viewers see the new lens at once
+    void Process(const std::shared_ptr<Image> image,
+                 const FrameInfo& info) override;
+
+    // Applied from the next frame, libx264 reconfigures without a restart
+    int32_t SetBitrate(int32_t kbps);
+
+    int32_t BitrateKbps() const { return bitrate_kbps_; }
+
+    // Stamps every access unit with a LatencyStamp SEI, for latency_probe
+    void SetLatencyProbe(bool enabled) { latency_probe_ = enabled; }
+
    private:
+    enum {
+        // Frames the encoder may hold before their packet comes out
+        kLatencyStampRing = 16,
+    };
+
     int32_t InitEncoder(int width, int height);
     void CleanupEncoder();
 
+    void Encode(const std::shared_ptr<Image>& image, const FrameInfo& info);
+
+    // Inserts the stamp of the frame with |packet_|'s pts, if kept
+    void StampPacket();
+
     std::string name_;
     std::string stream_url_;
     
@@ -66,8 +89,18 @@ class ImageStreamProcessor : public ImageProcessor {
     AVPacket* packet_ = nullptr;
     
     int frame_count_ = 0;
+    // Encoder size, the one of the first frame
     int width_ = 0;
     int height_ = 0;
+    int input_width_ = 0;
+    int input_height_ = 0;
+    int32_t lens_ = 0;
+    std::atomic<int32_t> bitrate_kbps_{2000};
+    bool force_keyframe_ = false;
+    std::atomic<bool> latency_probe_{false};
+    // Stamps by encoder pts, slot pts % kLatencyStampRing
+    int64_t stamp_pts_[kLatencyStampRing] = {};
+    LatencyStamp stamps_[kLatencyStampRing];
     std::atomic<bool> initialized_{false};
     std::mutex encoder_mutex_;
 };
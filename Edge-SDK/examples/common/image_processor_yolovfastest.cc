@@ -31,7 +31,9 @@
 #include <sstream>
 
 #include "logger.h"
+#include "pipeline_trace.h"
 #include "util_misc.h"
+#include "yolo_model_cache.h"
 
 using namespace cv;
 using namespace dnn;
@@ -40,44 +42,52 @@ using namespace edge_sdk;
 
 namespace edge_app {
 
-static const char* class_names[] = {
-    "person",        "bicycle",       "car",           "motorbike",
-    "aeroplane",     "bus",           "train",         "truck",
-    "boat",          "traffic light", "fire hydrant",  "stop sign",
-    "parking meter", "bench",         "bird",          "cat",
-    "dog",           "horse",         "sheep",         "cow",
-    "elephant",      "bear",          "zebra",         "giraffe",
-    "backpack",      "umbrella",      "handbag",       "tie",
-    "suitcase",      "frisbee",       "skis",          "snowboard",
-    "sports ball",   "kite",          "baseball bat",  "baseball glove",
-    "skateboard",    "surfboard",     "tennis racket", "bottle",
-    "wine glass",    "cup",           "fork",          "knife",
-    "spoon",         "bowl",          "banana",        "apple",
-    "sandwich",      "orange",        "broccoli",      "carrot",
-    "hot dog",       "pizza",         "donut",         "cake",
-    "chair",         "sofa",          "pottedplant",   "bed",
-    "diningtable",   "toilet",        "tvmonitor",     "laptop",
-    "mouse",         "remote",        "keyboard",      "cell phone",
-    "microwave",     "oven",          "toaster",       "sink",
-    "refrigerator",  "book",          "clock",         "vase",
-    "scissors",      "teddy bear",    "hair drier",    "toothbrush",
-};
+static const char* kModelName = "yolo-fastest-1.1-xl";
+
+ImageProcessorYolovFastest::~ImageProcessorYolovFastest() {
+    if (calibration_thread_.joinable()) {
+        calibration_thread_.join();
+    }
+    // A quantized net is not the model any more
+    if (precision_ != kYoloPrecisionInt8) {
+        YoloModelCache::Instance()->Release(kModelName, net_);
+    }
+    if (inference_service_ && inference_stream_id_ >= 0) {
+        inference_service_->UnregisterStream(inference_stream_id_);
+    }
+}
 
 int32_t ImageProcessorYolovFastest::Init() {
-    if (GetCurrentFileDirPath(__FILE__, sizeof(cur_file_dir_path_),
-                              cur_file_dir_path_) != 0) {
-        ERROR("get path failed");
-        return -1;
+    init_start_us_ = GetMonotonicTimeUs();
+    if (tiler_) {
+        if (tiler_->Init() != 0) {
+            return -1;
+        }
+    } else if (cascade_) {
+        if (cascade_->Init() != 0) {
+            return -1;
+        }
+    } else if (inference_service_) {
+        inference_stream_id_ = inference_service_->RegisterStream();
+    } else {
+        if (YoloModelCache::Instance()->Load(kModelName, net_) != 0) {
+            return -1;
+        }
+        if (precision_ == kYoloPrecisionFp16 &&
+            ConfigureYoloPrecision(net_, precision_) != 0) {
+            precision_ = kYoloPrecisionFp32;
+        }
+        auto warm_up_ms = WarmUpYoloNet(net_, Size(320, 320));
+        INFO("%s ready in %.1f ms (%s%s, warm-up %.1f ms)", show_name_.c_str(),
+             (GetMonotonicTimeUs() - init_start_us_) / 1000.0,
+             YoloPrecisionName(precision_),
+             calibrate_int8_ ? ", int8 after calibration" : "", warm_up_ms);
     }
-    snprintf(prototxt_file_dir_path_, kFilePathSizeMax,
-             "%s/data/yolo-fastest-1.1_coco/yolo-fastest-1.1-xl.cfg",
-             cur_file_dir_path_);
-    snprintf(weights_file_dir_path_, kFilePathSizeMax,
-             "%sdata/yolo-fastest-1.1_coco/yolo-fastest-1.1-xl.weights",
-             cur_file_dir_path_);
 
-    DEBUG("%s, %s", prototxt_file_dir_path_, weights_file_dir_path_);
-    net_ = readNetFromDarknet(prototxt_file_dir_path_, weights_file_dir_path_);
+    if (result_sink_) {
+        record_.stream = show_name_;
+        return result_sink_->Init();
+    }
 
     cv::namedWindow(show_name_.c_str(), cv::WINDOW_NORMAL);
     cv::resizeWindow(show_name_.c_str(), 960, 540);
@@ -85,90 +95,222 @@ int32_t ImageProcessorYolovFastest::Init() {
     return 0;
 }
 
-void ImageProcessorYolovFastest::Process(const std::shared_ptr<Image> image) {
-    auto detect = [&](cv::Mat& frame, vector<Mat>& outs) {
-        Mat blob;
-        blobFromImage(frame, blob, 1 / 255.0, Size(320, 320), Scalar(0, 0, 0),
-                      true, false);
-        net_.setInput(blob);
+void ImageProcessorYolovFastest::SetDetectInterval(int32_t interval) {
+    if (interval < 1) interval = 1;
+    INFO("%s: detect every %d frames", show_name_.c_str(), interval);
+    detect_interval_ = interval;
+}
 
-        net_.forward(outs, net_.getUnconnectedOutLayersNames());
-    };
+void ImageProcessorYolovFastest::SetTiling(const YoloTiler::Options& options) {
+    INFO("%s: %dx%d tiles, overlap %.2f", show_name_.c_str(), options.columns,
+         options.rows, options.overlap);
+    tiler_ = std::make_shared<YoloTiler>(options);
+}
 
-    auto draw_pred = [](int class_id, float conf, int left, int top, int right,
-                        int bottom, Mat& frame) {
-        rectangle(frame, Point(left, top), Point(right, bottom),
-                  Scalar(0, 0, 255), 3);
+void ImageProcessorYolovFastest::SetCascade(
+    const YoloCascade::Options& options) {
+    INFO("%s: adaptive cascade, target %.1f fps", show_name_.c_str(),
+         options.target_fps);
+    // The precision applies to the levels, an unsupported one fails Init
+    auto cascade_options = options;
+    cascade_options.precision =
+        calibrate_int8_ ? kYoloPrecisionInt8 : precision_;
+    cascade_ = std::make_shared<YoloCascade>(cascade_options);
+}
+
+void ImageProcessorYolovFastest::SetMotionGate(
+    const MotionGate::Options& options, bool restrict_roi) {
+    INFO("%s: motion gate, %.3f of macroblocks moving by %d px%s",
+         show_name_.c_str(), options.moving_ratio, options.magnitude_threshold,
+         restrict_roi ? ", moving region only" : "");
+    motion_gate_.reset(new MotionGate(show_name_, options));
+    restrict_roi_ = restrict_roi;
+}
+
+cv::Rect ImageProcessorYolovFastest::MotionRoi(const cv::Mat& frame,
+                                               const FrameInfo& info) const {
+    if (!restrict_roi_ || !info.motion || info.motion->intra ||
+        info.motion->width != frame.cols ||
+        info.motion->height != frame.rows) {
+        return cv::Rect();
+    }
+    auto region = info.motion->MovingRegion(
+        motion_gate_->GetOptions().magnitude_threshold);
+    if (region.area() == 0) return cv::Rect();
+
+    // Margin for the parts of the objects that did not move
+    const int32_t margin = 2 * MotionSummary::kMacroblockSize;
+    region = cv::Rect(region.x - margin, region.y - margin,
+                      region.width + 2 * margin, region.height + 2 * margin) &
+             cv::Rect(0, 0, frame.cols, frame.rows);
+    // Not worth it when most of the frame moves
+    if (region.area() * 2 > frame.cols * frame.rows) return cv::Rect();
+    return region;
+}
 
-        string label = format("%.2f", conf);
-        if (class_id < 80) {
-            label = std::string(class_names[class_id]) + ":" + label;
+void ImageProcessorYolovFastest::Detect(cv::Mat& frame,
+                                        std::vector<YoloDetection>& detections) {
+    TRACE_SCOPE("detect");
+    if (tiler_) {
+        tiler_->Detect(frame, detections, &inference_ms_);
+        return;
+    }
+    if (cascade_) {
+        cascade_->Detect(frame, detections, &inference_ms_);
+        return;
+    }
+    if (inference_service_) {
+        if (inference_service_->Detect(inference_stream_id_, frame, detections,
+                                       &inference_ms_) != 0) {
+            detections.clear();
         }
+        return;
+    }
 
-        int base_line;
-        Size label_size =
-            getTextSize(label, FONT_HERSHEY_SIMPLEX, 0.5, 1, &base_line);
-        top = max(top, label_size.height);
-        putText(frame, label, Point(left, top), FONT_HERSHEY_SIMPLEX, 0.75,
-                Scalar(0, 255, 0), 1);
-    };
+    FinishCalibration();
+    {
+        TRACE_SCOPE("preprocess");
+        preprocessor_.Process(frame, blob_);
+    }
+    net_.setInput(blob_);
 
-    auto post_process = [&](Mat& frame, const vector<Mat>& outs) {
-        vector<int> class_ids;
-        vector<float> confidences;
-        vector<Rect> boxes;
-
-        for (size_t i = 0; i < outs.size(); ++i) {
-            float* data = (float*)outs[i].data;
-            for (int j = 0; j < outs[i].rows; ++j, data += outs[i].cols) {
-                Mat scores = outs[i].row(j).colRange(5, outs[i].cols);
-                Point classid_point;
-                double confidence;
-
-                minMaxLoc(scores, 0, &confidence, 0, &classid_point);
-                if (confidence > 0.5) {
-                    int cx = (int)(data[0] * frame.cols);
-                    int cy = (int)(data[1] * frame.rows);
-                    int w = (int)(data[2] * frame.cols);
-                    int h = (int)(data[3] * frame.rows);
-                    int left = cx - (w >> 1);
-                    int top = cy - (h >> 1);
-
-                    class_ids.push_back(classid_point.x);
-                    confidences.push_back((float)confidence);
-                    boxes.push_back(Rect(left, top, w, h));
-                }
-            }
+    vector<Mat> outs;
+    {
+        TRACE_SCOPE("forward");
+        net_.forward(outs, net_.getUnconnectedOutLayersNames());
+    }
+    {
+        TRACE_SCOPE("postprocess");
+        post_processor_.Process(outs, 0, 1, frame.size(), detections);
+    }
+
+    // INT8 is calibrated on the first live frames, the quantization itself
+    // takes seconds and runs on its own thread
+    if (calibrate_int8_) {
+        calibration_blobs_.push_back(blob_.clone());
+        if (calibration_blobs_.size() >= kYoloCalibrationFrameNum) {
+            calibrate_int8_ = false;
+            calibration_thread_ =
+                std::thread(&ImageProcessorYolovFastest::Calibrate, this);
         }
+    }
+
+    vector<double> layers_timings;
+    inference_ms_ =
+        net_.getPerfProfile(layers_timings) / (getTickFrequency() / 1000);
+}
 
-        vector<int> indices;
-        NMSBoxes(boxes, confidences, 0.5, 0.4, indices);
-        for (size_t i = 0; i < indices.size(); ++i) {
-            int idx = indices[i];
-            Rect box = boxes[idx];
-            draw_pred(class_ids[idx], confidences[idx], box.x, box.y,
-                      box.x + box.width, box.y + box.height, frame);
+void ImageProcessorYolovFastest::Calibrate() {
+    Net net;
+    if (YoloModelCache::Instance()->Load(kModelName, net) == 0) {
+        if (ConfigureYoloPrecision(net, kYoloPrecisionInt8,
+                                   calibration_blobs_) == 0) {
+            WarmUpYoloNet(net, Size(320, 320));
+            calibrated_net_ = net;
+        } else {
+            YoloModelCache::Instance()->Release(kModelName, net);
         }
-    };
+    }
+    calibration_blobs_.clear();
+    calibration_done_.store(true, std::memory_order_release);
+}
+
+void ImageProcessorYolovFastest::FinishCalibration() {
+    if (!calibration_thread_.joinable() ||
+        !calibration_done_.load(std::memory_order_acquire)) {
+        return;
+    }
+    calibration_thread_.join();
+    if (calibrated_net_.empty()) {
+        WARN("%s: int8 calibration failed, staying on %s", show_name_.c_str(),
+             YoloPrecisionName(precision_));
+        return;
+    }
+    net_ = calibrated_net_;
+    calibrated_net_ = Net();
+    precision_ = kYoloPrecisionInt8;
+    INFO("%s: switched to int8", show_name_.c_str());
+}
 
-    auto draw_fps = [&](cv::Mat& frame) {
-        vector<double> layers_timings;
-        double freq = getTickFrequency() / 1000;
-        double time = net_.getPerfProfile(layers_timings) / freq;
+void ImageProcessorYolovFastest::ReportFirstDetection() {
+    if (first_detection_done_) return;
+    first_detection_done_ = true;
+    INFO("%s time to first detection: %.1f ms", show_name_.c_str(),
+         (GetMonotonicTimeUs() - init_start_us_) / 1000.0);
+}
+
+void ImageProcessorYolovFastest::Process(const std::shared_ptr<Image> image) {
+    FrameInfo info;
+    info.timestamp_us = GetMonotonicTimeUs();
+    Process(image, info);
+}
+
+void ImageProcessorYolovFastest::Process(const std::shared_ptr<Image> image,
+                                         const FrameInfo& info) {
+    auto draw_fps = [&](cv::Mat& frame, double time, bool tracked) {
         ostringstream ss;
         ss << "FPS: " << 1000 / time << ", time: " << time << " ms";
+        if (tracked) ss << " (tracking)";
         putText(frame, ss.str(), Point(0, 30), FONT_HERSHEY_SIMPLEX, 1,
                 Scalar(0, 0, 255), 2);
     };
 
     auto do_process = [&] {
         Mat& frame = *image;
-        vector<Mat> outs;
-        detect(frame, outs);
-        post_process(frame, outs);
-        draw_fps(frame);
+        vector<YoloDetection> detections;
+
+        if (!detection_enabled_) {
+            if (result_sink_) return;
+            imshow(show_name_.c_str(), frame);
+            cv::waitKey(1);
+            return;
+        }
+
+        int32_t interval = detect_interval_;
+        bool scene_changed =
+            interval > 1 && scene_change_detector_.Check(frame);
+        bool tracked = false;
+        bool moving = !motion_gate_ || motion_gate_->Check(info);
+        if (moving && (interval <= 1 || ++frames_since_detect_ >= interval ||
+                       scene_changed)) {
+            auto roi = MotionRoi(frame, info);
+            if (roi.area() > 0) {
+                Mat crop = frame(roi);
+                Detect(crop, detections);
+                for (auto& det : detections) {
+                    det.box += roi.tl();
+                }
+            } else {
+                Detect(frame, detections);
+            }
+            ReportFirstDetection();
+            TRACE_SCOPE("track", "detections", detections.size());
+            tracker_.Update(detections);
+            frames_since_detect_ = 0;
+            if (interval > 1) scene_change_detector_.UpdateReference();
+        } else {
+            TRACE_SCOPE("predict");
+            tracker_.Predict(detections);
+            tracked = true;
+        }
+
+        if (result_sink_) {
+            TRACE_SCOPE("sink", "detections", detections.size());
+            record_.info = info;
+            record_.frame_width = frame.cols;
+            record_.frame_height = frame.rows;
+            record_.detections.swap(detections);
+            result_sink_->Write(record_);
+            return;
+        }
+
+        // The frame may be shared (LensDemux subscribers), draw on a copy
+        TRACE_SCOPE("draw", "detections", detections.size());
+        frame.copyTo(canvas_);
+        DrawYoloDetections(detections, canvas_);
+        draw_fps(canvas_, inference_ms_, tracked);
 
-        imshow(show_name_.c_str(), frame);
+        imshow(show_name_.c_str(), canvas_);
         cv::waitKey(1);
     };
 
@@ -22,33 +22,130 @@
 #ifndef __IMAGE_PROCESSOR_YOLOV_FASTEST_H__
 #define __IMAGE_PROCESSOR_YOLOV_FASTEST_H__
 
+#include <atomic>
 #include <memory>
+#include <thread>
 
+#include "detection_sink.h"
 #include "image_processor.h"
+#include "motion_summary.h"
 #include "opencv2/dnn.hpp"
+#include "yolo_cascade.h"
+#include "yolo_inference_service.h"
+#include "yolo_post_processor.h"
+#include "yolo_precision.h"
+#include "yolo_preprocessor.h"
+#include "yolo_tiler.h"
+#include "yolo_tracker.h"
 
 namespace edge_app {
 
 class ImageProcessorYolovFastest : public ImageProcessor {
    public:
-    ImageProcessorYolovFastest(const std::string& name) : show_name_(name) {}
+    // With a |result_sink| the processor runs headless: no window and no
+    // drawing, the detections of each frame are written to the sink instead.
+    // |precision| applies to the processor's own net; INT8 quantizes a copy
+    // of the net on the first frames in the background and runs FP32 until
+    // it is ready.
+    ImageProcessorYolovFastest(
+        const std::string& name,
+        std::shared_ptr<YoloInferenceService> service = nullptr,
+        std::shared_ptr<DetectionSink> result_sink = nullptr,
+        YoloPrecision precision = kYoloPrecisionFp32)
+        : show_name_(name),
+          precision_(precision == kYoloPrecisionInt8 ? kYoloPrecisionFp32
+                                                     : precision),
+          calibrate_int8_(precision == kYoloPrecisionInt8),
+          inference_service_(service),
+          result_sink_(result_sink) {}
 
-    ~ImageProcessorYolovFastest() override {}
+    ~ImageProcessorYolovFastest() override;
 
     int32_t Init() override;
 
     void Process(const std::shared_ptr<Image> image) override;
 
+    void Process(const std::shared_ptr<Image> image,
+                 const FrameInfo& info) override;
+
+    // Run the detector every |interval| frames, or earlier on a scene change,
+    // and propagate the tracked boxes in between. 1 detects on every frame.
+    void SetDetectInterval(int32_t interval);
+
+    // Infer overlapping tiles of the frame instead of the downscaled frame,
+    // for small objects. Must be called before Init.
+    void SetTiling(const YoloTiler::Options& options);
+
+    // Switch between the small and XL models and input sizes to hold a frame
+    // rate target, at the precision of the processor (not INT8). Must be
+    // called before Init.
+    void SetCascade(const YoloCascade::Options& options);
+
+    // Skip detection on the frames the decoder's motion vectors show as
+    // static, tracking instead. With |restrict_roi| the detector only sees
+    // the moving region. Needs a decoder exporting motion vectors.
+    void SetMotionGate(const MotionGate::Options& options,
+                       bool restrict_roi = false);
+
+    // Off, frames pass through without detection: shown as is, or nothing
+    // written to the sink
+    void SetDetectionEnabled(bool enabled) { detection_enabled_ = enabled; }
+
+    bool DetectionEnabled() const { return detection_enabled_; }
+
    private:
+    void Detect(cv::Mat& frame, std::vector<YoloDetection>& detections);
+
+    void ReportFirstDetection();
+
+    // Calibration thread: quantizes a new net on calibration_blobs_
+    void Calibrate();
+
+    // Switch net_ to the quantized net once the calibration thread is done
+    void FinishCalibration();
+
+    cv::Rect MotionRoi(const cv::Mat& frame, const FrameInfo& info) const;
+
     std::string show_name_;
-    enum {
-        kFilePathSizeMax = 256,
-        kCurrentFilePathSizeMax = 128,
-    };
     cv::dnn::Net net_;
-    char cur_file_dir_path_[kCurrentFilePathSizeMax];
-    char prototxt_file_dir_path_[kFilePathSizeMax];
-    char weights_file_dir_path_[kFilePathSizeMax];
+    // Precision in effect for net_
+    YoloPrecision precision_;
+    // INT8 requested, calibration frames still being collected
+    bool calibrate_int8_;
+    std::vector<cv::Mat> calibration_blobs_;
+    std::thread calibration_thread_;
+    std::atomic<bool> calibration_done_{false};
+    // Written by the calibration thread before calibration_done_
+    cv::dnn::Net calibrated_net_;
+    YoloPreprocessor preprocessor_;
+    cv::Mat blob_;
+    // Frame with the detections drawn, the input is left untouched
+    cv::Mat canvas_;
+    YoloPostProcessor post_processor_;
+    double inference_ms_ = 0;
+
+    // Startup timing: Init start to the first frame with detections done
+    int64_t init_start_us_ = 0;
+    bool first_detection_done_ = false;
+
+    std::atomic<int32_t> detect_interval_{1};
+    std::atomic<bool> detection_enabled_{true};
+    int32_t frames_since_detect_ = 0;
+    YoloTracker tracker_;
+    SceneChangeDetector scene_change_detector_;
+
+    std::shared_ptr<YoloTiler> tiler_;
+    std::shared_ptr<YoloCascade> cascade_;
+
+    std::unique_ptr<MotionGate> motion_gate_;
+    bool restrict_roi_ = false;
+
+    // When set, frames are inferred by the shared service instead of net_.
+    std::shared_ptr<YoloInferenceService> inference_service_;
+    int32_t inference_stream_id_ = -1;
+
+    std::shared_ptr<DetectionSink> result_sink_;
+    DetectionRecord record_;
 };
 
 }  // namespace edge_app
@@ -0,0 +1,153 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include "latency_probe.h"
+
+#include <cstring>
+
+#include "liveview/h264_bitstream.h"
+
+namespace edge_app {
+
+const uint8_t kLatencyProbeUuid[16] = {'e', 'd', 'g', 'e', '-', 's',
+                                       'd', 'k', '-', 'l', 'a', 't',
+                                       'e', 'n', 'c', 'y'};
+
+namespace {
+
+const uint8_t kSeiUserDataUnregistered = 5;
+const size_t kStampSize = 8 * 4 + 4;
+
+void PutLe(uint8_t* out, uint64_t value, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+uint64_t GetLe(const uint8_t* in, size_t size) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; i++) {
+        value |= (uint64_t)in[i] << (8 * i);
+    }
+    return value;
+}
+
+// SEI messages of one RBSP, emulation prevention removed
+bool ParseSei(const std::vector<uint8_t>& rbsp, LatencyStamp* stamp) {
+    size_t i = 0;
+    // The last byte holds the rbsp_stop_one_bit
+    while (i + 1 < rbsp.size()) {
+        uint32_t type = 0;
+        while (i < rbsp.size() && rbsp[i] == 0xFF) type += rbsp[i++];
+        if (i >= rbsp.size()) return false;
+        type += rbsp[i++];
+        uint32_t size = 0;
+        while (i < rbsp.size() && rbsp[i] == 0xFF) size += rbsp[i++];
+        if (i >= rbsp.size()) return false;
+        size += rbsp[i++];
+        if (i + size > rbsp.size()) return false;
+
+        const uint8_t* payload = rbsp.data() + i;
+        if (type == kSeiUserDataUnregistered &&
+            size >= sizeof(kLatencyProbeUuid) + kStampSize &&
+            memcmp(payload, kLatencyProbeUuid, sizeof(kLatencyProbeUuid)) ==
+                0) {
+            payload += sizeof(kLatencyProbeUuid);
+            stamp->sequence = GetLe(payload, 8);
+            stamp->arrival_us = (int64_t)GetLe(payload + 8, 8);
+            stamp->decoded_us = (int64_t)GetLe(payload + 16, 8);
+            stamp->encode_us = (int64_t)GetLe(payload + 24, 8);
+            stamp->lens = (int32_t)GetLe(payload + 32, 4);
+            return true;
+        }
+        i += size;
+    }
+    return false;
+}
+
+}  // namespace
+
+std::vector<uint8_t> MakeLatencySei(const LatencyStamp& stamp) {
+    uint8_t payload[sizeof(kLatencyProbeUuid) + kStampSize];
+    memcpy(payload, kLatencyProbeUuid, sizeof(kLatencyProbeUuid));
+    uint8_t* p = payload + sizeof(kLatencyProbeUuid);
+    PutLe(p, stamp.sequence, 8);
+    PutLe(p + 8, (uint64_t)stamp.arrival_us, 8);
+    PutLe(p + 16, (uint64_t)stamp.decoded_us, 8);
+    PutLe(p + 24, (uint64_t)stamp.encode_us, 8);
+    PutLe(p + 32, (uint32_t)stamp.lens, 4);
+
+    std::vector<uint8_t> nal = {0, 0, 0, 1, kH264NalSei,
+                                kSeiUserDataUnregistered, sizeof(payload)};
+    // Emulation prevention: no 00 00 0x with x <= 3 in the NAL payload
+    int32_t zeros = 0;
+    for (uint8_t byte : payload) {
+        if (zeros >= 2 && byte <= 3) {
+            nal.push_back(3);
+            zeros = 0;
+        }
+        nal.push_back(byte);
+        zeros = byte == 0 ? zeros + 1 : 0;
+    }
+    // rbsp_trailing_bits
+    nal.push_back(0x80);
+    return nal;
+}
+
+size_t LatencySeiOffset(const uint8_t* data, size_t size) {
+    H264NalReader reader(data, size);
+    H264Nal nal;
+    if (!reader.Next(&nal) || nal.type != kH264NalAud) {
+        return 0;
+    }
+    // A NAL unit ends at the next start code
+    return nal.data + nal.size - data;
+}
+
+bool FindLatencyStamp(const uint8_t* data, size_t size, LatencyStamp* stamp) {
+    H264NalReader reader(data, size);
+    H264Nal nal;
+    std::vector<uint8_t> rbsp;
+    while (reader.Next(&nal)) {
+        if (nal.type != kH264NalSei) {
+            // SEI goes before the slices of its access unit
+            if (nal.type == kH264NalSlice || nal.type == kH264NalIdr) break;
+            continue;
+        }
+        rbsp.clear();
+        int32_t zeros = 0;
+        for (size_t i = 1; i < nal.size; i++) {
+            uint8_t byte = nal.data[i];
+            if (zeros >= 2 && byte == 3) {
+                zeros = 0;
+                continue;
+            }
+            rbsp.push_back(byte);
+            zeros = byte == 0 ? zeros + 1 : 0;
+        }
+        if (ParseSei(rbsp, stamp)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace edge_app
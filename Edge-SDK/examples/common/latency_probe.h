@@ -0,0 +1,68 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#ifndef __LATENCY_PROBE_H__
+#define __LATENCY_PROBE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace edge_app {
+
+/*
+ * Per-frame stamp carried in the output stream to measure the latency from
+ * the SDK stream callback to a viewer. It travels in an H.264 SEI
+ * user_data_unregistered message (payload type 5) tagged with
+ * kLatencyProbeUuid, so it survives remuxing (RTSP, MPEG-TS) but not
+ * transcoding. Times are CLOCK_MONOTONIC: the receiver has to run on the
+ * same host. Payload after the UUID, little endian:
+ *
+ *   uint64 sequence | int64 arrival_us | int64 decoded_us | int64 encode_us
+ *   | int32 lens
+ */
+struct LatencyStamp {
+    // FrameInfo::sequence
+    uint64_t sequence = 0;
+    // FrameInfo::arrival_us, the SDK callback
+    int64_t arrival_us = 0;
+    // FrameInfo::timestamp_us, out of the decoder
+    int64_t decoded_us = 0;
+    // Handed to the output encoder
+    int64_t encode_us = 0;
+    int32_t lens = 0;
+};
+
+extern const uint8_t kLatencyProbeUuid[16];
+
+// SEI NAL unit carrying |stamp|, with a 4 byte start code
+std::vector<uint8_t> MakeLatencySei(const LatencyStamp& stamp);
+
+// Where to insert the SEI in an Annex B access unit: after a leading AUD,
+// otherwise at the start
+size_t LatencySeiOffset(const uint8_t* data, size_t size);
+
+// Looks for a stamp SEI in an Annex B access unit
+bool FindLatencyStamp(const uint8_t* data, size_t size, LatencyStamp* stamp);
+
+}  // namespace edge_app
+
+#endif
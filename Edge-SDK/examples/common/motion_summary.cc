@@ -0,0 +1,110 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include "motion_summary.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "logger.h"
+
+using namespace edge_sdk;
+
+namespace edge_app {
+
+void MotionSummary::Reset(int32_t frame_width, int32_t frame_height) {
+    width = frame_width;
+    height = frame_height;
+    columns = (frame_width + kMacroblockSize - 1) / kMacroblockSize;
+    rows = (frame_height + kMacroblockSize - 1) / kMacroblockSize;
+    magnitude.assign(columns * rows, kNoVector);
+    intra = false;
+}
+
+void MotionSummary::AddVector(int32_t x, int32_t y, float dx, float dy) {
+    if (x < 0 || y < 0 || x >= width || y >= height) return;
+    int32_t length =
+        std::min((int32_t)std::lround(std::sqrt(dx * dx + dy * dy)),
+                 (int32_t)kMaxMagnitude);
+    uint8_t& value =
+        magnitude[(y / kMacroblockSize) * columns + x / kMacroblockSize];
+    if (value == kNoVector || length > value) {
+        value = length;
+    }
+}
+
+float MotionSummary::MovingRatio(int32_t threshold) const {
+    if (magnitude.empty()) return 0;
+    size_t moving = 0;
+    for (auto value : magnitude) {
+        if (value >= threshold) moving++;
+    }
+    return (float)moving / magnitude.size();
+}
+
+cv::Rect MotionSummary::MovingRegion(int32_t threshold) const {
+    int32_t left = columns, top = rows, right = -1, bottom = -1;
+    for (int32_t row = 0; row < rows; row++) {
+        const uint8_t* line = magnitude.data() + row * columns;
+        for (int32_t column = 0; column < columns; column++) {
+            if (line[column] < threshold) continue;
+            left = std::min(left, column);
+            right = std::max(right, column);
+            top = std::min(top, row);
+            bottom = std::max(bottom, row);
+        }
+    }
+    if (right < 0) return cv::Rect();
+    cv::Rect region(left * kMacroblockSize, top * kMacroblockSize,
+                    (right - left + 1) * kMacroblockSize,
+                    (bottom - top + 1) * kMacroblockSize);
+    return region & cv::Rect(0, 0, width, height);
+}
+
+MotionGate::MotionGate(const std::string& name) : name_(name) {}
+
+MotionGate::MotionGate(const std::string& name, const Options& options)
+    : name_(name), options_(options) {}
+
+bool MotionGate::Check(const FrameInfo& info) {
+    bool pass = true;
+    if (info.motion && !info.motion->intra &&
+        consecutive_skipped_ < options_.max_skipped_frames) {
+        pass = info.motion->MovingRatio(options_.magnitude_threshold) >=
+               options_.moving_ratio;
+    }
+
+    if (pass) {
+        consecutive_skipped_ = 0;
+        passed_frames_++;
+    } else {
+        consecutive_skipped_++;
+        skipped_frames_++;
+    }
+    if ((passed_frames_ + skipped_frames_) % 300 == 0) {
+        INFO("%s motion gate: %llu frames skipped, %llu passed", name_.c_str(),
+             (unsigned long long)skipped_frames_,
+             (unsigned long long)passed_frames_);
+    }
+    return pass;
+}
+
+}  // namespace edge_app
@@ -0,0 +1,104 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#ifndef __MOTION_SUMMARY_H__
+#define __MOTION_SUMMARY_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "frame_info.h"
+#include "opencv2/core.hpp"
+
+namespace edge_app {
+
+/*
+ * Per-macroblock motion of a decoded frame, built from the motion vectors
+ * the H.264 decoder exports. One byte per 16x16 macroblock: the length in
+ * pixels of the largest vector pointing into it.
+ */
+struct MotionSummary {
+    enum {
+        kMacroblockSize = 16,
+        // Macroblock coded without a vector (intra): new content, moving
+        kNoVector = 255,
+        kMaxMagnitude = 254,
+    };
+
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t columns = 0;
+    int32_t rows = 0;
+    std::vector<uint8_t> magnitude;
+    // Intra frame or no vector exported: the motion is unknown
+    bool intra = false;
+
+    void Reset(int32_t frame_width, int32_t frame_height);
+
+    // Vector of the block centered on (|x|, |y|), displacement in pixels
+    void AddVector(int32_t x, int32_t y, float dx, float dy);
+
+    // Fraction of the macroblocks moving by |threshold| pixels or more
+    float MovingRatio(int32_t threshold) const;
+
+    // Bounding box in pixels of the moving macroblocks, empty if none
+    cv::Rect MovingRegion(int32_t threshold) const;
+};
+
+/*
+ * Skips the frames a motion summary shows as static, but lets one through
+ * at least every |max_skipped_frames| so static scenes are still refreshed.
+ * Frames without a summary, or with unknown motion, always pass.
+ */
+class MotionGate {
+   public:
+    struct Options {
+        // Per macroblock, in pixels
+        int32_t magnitude_threshold = 1;
+        // Fraction of moving macroblocks for a frame to pass
+        float moving_ratio = 0.005;
+        int32_t max_skipped_frames = 25;
+    };
+
+    explicit MotionGate(const std::string& name);
+
+    MotionGate(const std::string& name, const Options& options);
+
+    bool Check(const FrameInfo& info);
+
+    const Options& GetOptions() const { return options_; }
+
+    uint64_t SkippedFrames() const { return skipped_frames_; }
+
+    uint64_t PassedFrames() const { return passed_frames_; }
+
+   private:
+    std::string name_;
+    Options options_;
+    int32_t consecutive_skipped_ = 0;
+    uint64_t skipped_frames_ = 0;
+    uint64_t passed_frames_ = 0;
+};
+
+}  // namespace edge_app
+
+#endif
@@ -0,0 +1,343 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include "pipeline_metrics.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+#include "logger.h"
+
+using namespace edge_sdk;
+
+namespace edge_app {
+
+namespace {
+
+const char* kStageNames[kMetricsStageCount] = {
+    "queue", "decode", "convert", "process", "encode", "write",
+};
+
+const char* kCounterEvents[kMetricsCounterCount] = {
+    nullptr, "decoded", "processed", "dropped", "encoded",
+};
+
+// Prometheus buckets, in seconds
+const double kExportedBuckets[] = {
+    0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025,
+    0.05,   0.1,     0.25,   0.5,   1,      2.5,   5,     10,
+};
+
+std::mutex registry_mutex;
+std::map<std::string, std::shared_ptr<PipelineMetrics>> registry;
+
+void Append(std::string* out, const char* format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+void Append(std::string* out, const char* format, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (n > 0) {
+        out->append(line, std::min<size_t>(n, sizeof(line) - 1));
+    }
+}
+
+}  // namespace
+
+uint32_t LatencyHistogram::BucketIndex(uint64_t us) {
+    if (us < (1u << kSubBucketBits)) {
+        return us;
+    }
+    uint32_t exponent = 63 - __builtin_clzll(us);
+    if (exponent > kMaxExponent) {
+        return kBucketCount - 1;
+    }
+    uint32_t sub = (us >> (exponent - kSubBucketBits)) &
+                   ((1u << kSubBucketBits) - 1);
+    return ((exponent - kSubBucketBits + 1) << kSubBucketBits) + sub;
+}
+
+int64_t LatencyHistogram::BucketUpperBound(uint32_t index) {
+    if (index < (1u << kSubBucketBits)) {
+        return index + 1;
+    }
+    uint32_t exponent = (index >> kSubBucketBits) + kSubBucketBits - 1;
+    uint32_t sub = index & ((1u << kSubBucketBits) - 1);
+    return (int64_t)((1u << kSubBucketBits) + sub + 1)
+           << (exponent - kSubBucketBits);
+}
+
+void LatencyHistogram::Record(int64_t us) {
+    if (us < 0) us = 0;
+    buckets_[BucketIndex(us)].fetch_add(1, std::memory_order_relaxed);
+    sum_us_.fetch_add(us, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::Count() const {
+    uint64_t count = 0;
+    for (auto& bucket : buckets_) {
+        count += bucket.load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+int64_t LatencyHistogram::Percentile(double quantile) const {
+    uint64_t counts[kBucketCount];
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < kBucketCount; i++) {
+        counts[i] = buckets_[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = std::max<uint64_t>(1, (uint64_t)(quantile * total + 0.5));
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < kBucketCount; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return i < (1u << kSubBucketBits) ? i : BucketUpperBound(i);
+        }
+    }
+    return BucketUpperBound(kBucketCount - 1);
+}
+
+uint64_t LatencyHistogram::CountBelow(int64_t us) const {
+    uint64_t count = 0;
+    for (uint32_t i = 0; i < kBucketCount && BucketUpperBound(i) <= us; i++) {
+        count += buckets_[i].load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+std::shared_ptr<PipelineMetrics> PipelineMetrics::Get(
+    const std::string& name) {
+    std::lock_guard<std::mutex> l(registry_mutex);
+    auto& metrics = registry[name];
+    if (!metrics) {
+        metrics = std::make_shared<PipelineMetrics>(name);
+    }
+    return metrics;
+}
+
+std::string PipelineMetrics::RenderAll() {
+    std::map<std::string, std::shared_ptr<PipelineMetrics>> pipelines;
+    {
+        std::lock_guard<std::mutex> l(registry_mutex);
+        pipelines = registry;
+    }
+
+    std::string out;
+    out += "# HELP edge_stage_latency_seconds Latency of each pipeline "
+           "stage.\n# TYPE edge_stage_latency_seconds histogram\n";
+    for (auto& p : pipelines) {
+        const char* name = p.first.c_str();
+        for (int32_t s = 0; s < kMetricsStageCount; s++) {
+            auto& histogram = p.second->Stage((MetricsStage)s);
+            // Counted once, so that +Inf, _count and the buckets agree
+            uint64_t count = histogram.Count();
+            if (count == 0) {
+                continue;
+            }
+            for (double le : kExportedBuckets) {
+                Append(&out,
+                       "edge_stage_latency_seconds_bucket{pipeline=\"%s\","
+                       "stage=\"%s\",le=\"%g\"} %" PRIu64 "\n",
+                       name, kStageNames[s], le,
+                       std::min(count, histogram.CountBelow(le * 1e6)));
+            }
+            Append(&out,
+                   "edge_stage_latency_seconds_bucket{pipeline=\"%s\","
+                   "stage=\"%s\",le=\"+Inf\"} %" PRIu64 "\n",
+                   name, kStageNames[s], count);
+            Append(&out,
+                   "edge_stage_latency_seconds_sum{pipeline=\"%s\","
+                   "stage=\"%s\"} %.6f\n",
+                   name, kStageNames[s], histogram.SumUs() / 1e6);
+            Append(&out,
+                   "edge_stage_latency_seconds_count{pipeline=\"%s\","
+                   "stage=\"%s\"} %" PRIu64 "\n",
+                   name, kStageNames[s], count);
+        }
+    }
+
+    out += "# HELP edge_frames_total Frames through each pipeline step.\n"
+           "# TYPE edge_frames_total counter\n";
+    for (auto& p : pipelines) {
+        for (int32_t c = kMetricsFramesDecoded; c < kMetricsCounterCount;
+             c++) {
+            Append(&out,
+                   "edge_frames_total{pipeline=\"%s\",event=\"%s\"} %" PRIu64
+                   "\n",
+                   p.first.c_str(), kCounterEvents[c],
+                   p.second->Counter((MetricsCounter)c));
+        }
+    }
+
+    out += "# HELP edge_stream_bytes_total H.264 bytes received from the "
+           "SDK.\n# TYPE edge_stream_bytes_total counter\n";
+    for (auto& p : pipelines) {
+        Append(&out, "edge_stream_bytes_total{pipeline=\"%s\"} %" PRIu64 "\n",
+               p.first.c_str(), p.second->Counter(kMetricsStreamBytes));
+    }
+
+    out += "# HELP edge_queue_depth Images waiting for the processor, and "
+           "bytes waiting for the decoder.\n# TYPE edge_queue_depth gauge\n";
+    for (auto& p : pipelines) {
+        Append(&out,
+               "edge_queue_depth{pipeline=\"%s\",queue=\"images\"} %" PRId64
+               "\n",
+               p.first.c_str(), p.second->Gauge(kMetricsImageQueueDepth));
+        Append(&out,
+               "edge_queue_depth{pipeline=\"%s\",queue=\"decode_bytes\"} "
+               "%" PRId64 "\n",
+               p.first.c_str(), p.second->Gauge(kMetricsDecodeBacklogBytes));
+    }
+    return out;
+}
+
+MetricsServer::~MetricsServer() { Stop(); }
+
+int32_t MetricsServer::Start() {
+    if (running_) {
+        return 0;
+    }
+    listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        ERROR("metrics socket failed: %s", strerror(errno));
+        return -1;
+    }
+    int one = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(options_.port);
+    if (inet_pton(AF_INET, options_.address.c_str(), &addr.sin_addr) != 1 ||
+        bind(listen_fd_, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(listen_fd_, 8) != 0) {
+        ERROR("metrics endpoint %s:%d unavailable: %s",
+              options_.address.c_str(), options_.port, strerror(errno));
+        close(listen_fd_);
+        listen_fd_ = -1;
+        return -1;
+    }
+
+    running_ = true;
+    thread_ = std::thread(&MetricsServer::Run, this);
+    INFO("metrics on http://%s:%d/metrics", options_.address.c_str(),
+         options_.port);
+    return 0;
+}
+
+void MetricsServer::Stop() {
+    running_ = false;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    if (listen_fd_ >= 0) {
+        close(listen_fd_);
+        listen_fd_ = -1;
+    }
+}
+
+void MetricsServer::Run() {
+    pthread_setname_np(pthread_self(), "metrics");
+    while (running_) {
+        struct pollfd pfd = {listen_fd_, POLLIN, 0};
+        if (poll(&pfd, 1, 500) <= 0) {
+            continue;
+        }
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        Serve(fd);
+        close(fd);
+    }
+}
+
+void MetricsServer::Serve(int fd) {
+    // A scraper that stalls must not hold the endpoint
+    struct timeval timeout = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    char request[2048];
+    size_t size = 0;
+    while (size < sizeof(request) - 1) {
+        ssize_t n = recv(fd, request + size, sizeof(request) - 1 - size, 0);
+        if (n <= 0) {
+            break;
+        }
+        size += n;
+        request[size] = 0;
+        if (strstr(request, "\r\n\r\n")) {
+            break;
+        }
+    }
+    request[size] = 0;
+
+    std::string body;
+    const char* status = "200 OK";
+    const char* type = "text/plain; version=0.0.4; charset=utf-8";
+    if (strncmp(request, "GET /metrics", 12) == 0 &&
+        (request[12] == ' ' || request[12] == '?')) {
+        body = PipelineMetrics::RenderAll();
+    } else {
+        status = "404 Not Found";
+        type = "text/plain";
+        body = "try /metrics\n";
+    }
+    char header[256];
+    int n = snprintf(header, sizeof(header),
+                     "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: "
+                     "%zu\r\nConnection: close\r\n\r\n",
+                     status, type, body.size());
+    std::string response(header, n);
+    response += body;
+    for (size_t sent = 0; sent < response.size();) {
+        ssize_t w = send(fd, response.data() + sent, response.size() - sent,
+                         MSG_NOSIGNAL);
+        if (w <= 0) {
+            break;
+        }
+        sent += w;
+    }
+}
+
+}  // namespace edge_app
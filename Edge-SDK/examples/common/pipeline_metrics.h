@@ -0,0 +1,177 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#ifndef __PIPELINE_METRICS_H__
+#define __PIPELINE_METRICS_H__
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace edge_app {
+
+/*
+ * Latency histogram with log-linear buckets: exact below 8 us, then 8
+ * buckets per power of two (12.5% wide) up to 2^36 us. Record() is a few
+ * relaxed atomic adds, safe from any thread.
+ */
+class LatencyHistogram {
+   public:
+    enum : uint32_t {
+        kSubBucketBits = 3,
+        kMaxExponent = 36,
+        kBucketCount = (kMaxExponent - kSubBucketBits + 2) << kSubBucketBits,
+    };
+
+    void Record(int64_t us);
+
+    uint64_t Count() const;
+
+    uint64_t SumUs() const { return sum_us_.load(std::memory_order_relaxed); }
+
+    // Upper bound of the bucket holding the |quantile| (0..1), 0 if empty
+    int64_t Percentile(double quantile) const;
+
+    // Recorded values below |us|, to one bucket
+    uint64_t CountBelow(int64_t us) const;
+
+    // Exclusive upper bound of bucket |index|
+    static int64_t BucketUpperBound(uint32_t index);
+
+   private:
+    static uint32_t BucketIndex(uint64_t us);
+
+    std::atomic<uint64_t> buckets_[kBucketCount] = {};
+    std::atomic<uint64_t> sum_us_{0};
+};
+
+enum MetricsStage {
+    // SDK callback to the start of the decoding of its data
+    kMetricsStageQueue,
+    kMetricsStageDecode,
+    // Decoded YUV to the BGR image
+    kMetricsStageConvert,
+    // ImageProcessor::Process(), encoding and writing included
+    kMetricsStageProcess,
+    // Color conversion and encoding of an output stream
+    kMetricsStageEncode,
+    // Muxing and writing to the output stream's server
+    kMetricsStageWrite,
+    kMetricsStageCount,
+};
+
+enum MetricsCounter {
+    kMetricsStreamBytes,
+    kMetricsFramesDecoded,
+    kMetricsFramesProcessed,
+    // Images the processor fell too far behind for
+    kMetricsFramesDropped,
+    kMetricsFramesEncoded,
+    kMetricsCounterCount,
+};
+
+enum MetricsGauge {
+    kMetricsImageQueueDepth,
+    kMetricsDecodeBacklogBytes,
+    kMetricsGaugeCount,
+};
+
+/*
+ * Metrics of one pipeline instance, shared by its stages through the
+ * registry: Get() with the same name returns the same object.
+ */
+class PipelineMetrics {
+   public:
+    explicit PipelineMetrics(const std::string& name) : name_(name) {}
+
+    static std::shared_ptr<PipelineMetrics> Get(const std::string& name);
+
+    // Prometheus text exposition of every pipeline
+    static std::string RenderAll();
+
+    const std::string& Name() const { return name_; }
+
+    void Record(MetricsStage stage, int64_t us) { stages_[stage].Record(us); }
+
+    void Add(MetricsCounter counter, uint64_t n = 1) {
+        counters_[counter].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void Set(MetricsGauge gauge, int64_t value) {
+        gauges_[gauge].store(value, std::memory_order_relaxed);
+    }
+
+    const LatencyHistogram& Stage(MetricsStage stage) const {
+        return stages_[stage];
+    }
+
+    uint64_t Counter(MetricsCounter counter) const {
+        return counters_[counter].load(std::memory_order_relaxed);
+    }
+
+    int64_t Gauge(MetricsGauge gauge) const {
+        return gauges_[gauge].load(std::memory_order_relaxed);
+    }
+
+   private:
+    std::string name_;
+    LatencyHistogram stages_[kMetricsStageCount];
+    std::atomic<uint64_t> counters_[kMetricsCounterCount] = {};
+    std::atomic<int64_t> gauges_[kMetricsGaugeCount] = {};
+};
+
+/*
+ * Serves PipelineMetrics::RenderAll() on GET /metrics, one connection at a
+ * time on its own thread.
+ */
+class MetricsServer {
+   public:
+    struct Options {
+        // Local only by default
+        std::string address = "127.0.0.1";
+        int32_t port = 9464;
+    };
+
+    explicit MetricsServer(const Options& options) : options_(options) {}
+
+    ~MetricsServer();
+
+    int32_t Start();
+
+    void Stop();
+
+   private:
+    void Run();
+
+    void Serve(int fd);
+
+    Options options_;
+    int listen_fd_ = -1;
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+};
+
+}  // namespace edge_app
+
+#endif
@@ -0,0 +1,322 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include "pipeline_trace.h"
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "logger.h"
+
+using namespace edge_sdk;
+
+namespace edge_app {
+
+std::atomic<bool> PipelineTrace::enabled_{true};
+
+namespace {
+
+struct TraceEvent {
+    const char* name;
+    const char* arg_name;
+    int64_t begin_ns;
+    // -1 for an instant event
+    int64_t duration_ns;
+    uint64_t arg;
+};
+
+/*
+ * Written by its thread only. |head| counts the events ever recorded and
+ * is published after the event, so that the reader knows which slots hold
+ * complete events and which ones the writer may be overwriting.
+ */
+struct ThreadBuffer {
+    std::atomic<uint64_t> head{0};
+    int32_t tid = 0;
+    char name[16] = {};
+    TraceEvent events[PipelineTrace::kEventCount];
+};
+
+// Registered buffers are never freed: the events of threads gone stay
+// in the dumps, and the reader needs no lock against the writers
+ThreadBuffer* g_buffers[PipelineTrace::kMaxThreads];
+std::atomic<uint32_t> g_buffer_count{0};
+std::mutex g_register_mutex;
+
+ThreadBuffer* const kNoBuffer = reinterpret_cast<ThreadBuffer*>(1);
+thread_local ThreadBuffer* t_buffer = nullptr;
+
+ThreadBuffer* RegisterThread() {
+    std::lock_guard<std::mutex> l(g_register_mutex);
+    uint32_t count = g_buffer_count.load(std::memory_order_relaxed);
+    if (count >= PipelineTrace::kMaxThreads) {
+        return kNoBuffer;
+    }
+    auto buffer = new ThreadBuffer();
+    buffer->tid = syscall(SYS_gettid);
+    pthread_getname_np(pthread_self(), buffer->name, sizeof(buffer->name));
+    g_buffers[count] = buffer;
+    g_buffer_count.store(count + 1, std::memory_order_release);
+    return buffer;
+}
+
+void Append(const char* name, const char* arg_name, int64_t begin_ns,
+            int64_t duration_ns, uint64_t arg) {
+    ThreadBuffer* buffer = t_buffer;
+    if (buffer == nullptr) {
+        buffer = t_buffer = RegisterThread();
+    }
+    if (buffer == kNoBuffer) {
+        return;
+    }
+    uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    TraceEvent& event = buffer->events[head % PipelineTrace::kEventCount];
+    event.name = name;
+    event.arg_name = arg_name;
+    event.begin_ns = begin_ns;
+    event.duration_ns = duration_ns;
+    event.arg = arg;
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+// Thread names may be changed after the first event
+void ThreadName(const ThreadBuffer* buffer, char* name, size_t size) {
+    snprintf(name, size, "%s", buffer->name);
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/task/%d/comm", buffer->tid);
+    FILE* file = fopen(path, "r");
+    if (file == nullptr) {
+        return;
+    }
+    if (fgets(name, size, file) != nullptr) {
+        name[strcspn(name, "\n")] = '\0';
+    }
+    fclose(file);
+}
+
+void WriteString(FILE* file, const char* text) {
+    fputc('"', file);
+    for (const char* c = text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fputc('\\', file);
+            fputc(*c, file);
+        } else if ((unsigned char)*c >= 0x20) {
+            fputc(*c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+// Chrome traces count in us
+void WriteTimeUs(FILE* file, int64_t ns) {
+    fprintf(file, "%" PRId64 ".%03d", ns / 1000, (int)(ns % 1000));
+}
+
+sem_t g_dump_semaphore;
+std::atomic<bool> g_dump_on_signal{false};
+
+void OnDumpSignal(int) {
+    // The only async-signal-safe way to wake the dumper
+    sem_post(&g_dump_semaphore);
+}
+
+}  // namespace
+
+int64_t PipelineTrace::NowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void PipelineTrace::Record(const char* name, int64_t begin_ns, int64_t end_ns,
+                           const char* arg_name, uint64_t arg) {
+    if (!Enabled()) {
+        return;
+    }
+    Append(name, arg_name, begin_ns, end_ns - begin_ns, arg);
+}
+
+void PipelineTrace::Instant(const char* name, const char* arg_name,
+                            uint64_t arg) {
+    if (!Enabled()) {
+        return;
+    }
+    Append(name, arg_name, NowNs(), -1, arg);
+}
+
+int32_t PipelineTrace::Dump(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        ERROR("open %s: %s", path.c_str(), strerror(errno));
+        return -1;
+    }
+
+    int pid = getpid();
+    char name[64] = "edge_app";
+    if (FILE* comm = fopen("/proc/self/comm", "r")) {
+        if (fgets(name, sizeof(name), comm) != nullptr) {
+            name[strcspn(name, "\n")] = '\0';
+        }
+        fclose(comm);
+    }
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file,
+            "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,"
+            "\"args\":{\"name\":",
+            pid);
+    WriteString(file, name);
+    fprintf(file, "}}");
+
+    std::vector<TraceEvent> events;
+    uint64_t event_count = 0;
+    uint64_t overwritten = 0;
+    uint32_t buffer_count = g_buffer_count.load(std::memory_order_acquire);
+    for (uint32_t i = 0; i < buffer_count; i++) {
+        const ThreadBuffer* buffer = g_buffers[i];
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t first = head > kEventCount ? head - kEventCount : 0;
+        events.clear();
+        for (uint64_t n = first; n < head; n++) {
+            events.push_back(buffer->events[n % kEventCount]);
+        }
+        // The slots of the events recorded meanwhile, and the one being
+        // written, no longer hold what was copied
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t new_head = buffer->head.load(std::memory_order_relaxed);
+        uint64_t valid = new_head + 1 > kEventCount
+                             ? new_head + 1 - kEventCount
+                             : 0;
+        size_t skip = valid > first ? std::min(valid - first, head - first)
+                                    : 0;
+        overwritten += skip;
+
+        ThreadName(buffer, name, sizeof(name));
+        fprintf(file,
+                ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,"
+                "\"tid\":%d,\"args\":{\"name\":",
+                pid, buffer->tid);
+        WriteString(file, name);
+        fprintf(file, "}}");
+
+        for (size_t n = skip; n < events.size(); n++) {
+            const TraceEvent& event = events[n];
+            fprintf(file, ",\n{\"ph\":\"%s\",\"name\":",
+                    event.duration_ns < 0 ? "i" : "X");
+            WriteString(file, event.name);
+            fprintf(file, ",\"cat\":\"pipeline\",\"pid\":%d,\"tid\":%d,\"ts\":",
+                    pid, buffer->tid);
+            WriteTimeUs(file, event.begin_ns);
+            if (event.duration_ns < 0) {
+                fprintf(file, ",\"s\":\"t\"");
+            } else {
+                fprintf(file, ",\"dur\":");
+                WriteTimeUs(file, event.duration_ns);
+            }
+            if (event.arg_name != nullptr) {
+                fprintf(file, ",\"args\":{");
+                WriteString(file, event.arg_name);
+                fprintf(file, ":%" PRIu64 "}", event.arg);
+            }
+            fputc('}', file);
+        }
+        event_count += events.size() - skip;
+    }
+    fprintf(file, "\n]}\n");
+
+    bool failed = ferror(file) != 0;
+    if (fclose(file) != 0 || failed) {
+        ERROR("write %s failed", path.c_str());
+        return -1;
+    }
+    INFO("trace of %u threads, %" PRIu64 " events written to %s",
+         buffer_count, event_count, path.c_str());
+    if (overwritten != 0) {
+        DEBUG("%" PRIu64 " trace events overwritten during the dump",
+              overwritten);
+    }
+    return 0;
+}
+
+std::string PipelineTrace::DumpToDirectory(const std::string& directory) {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    struct tm local;
+    localtime_r(&tv.tv_sec, &local);
+    char name[64];
+    size_t length = strftime(name, sizeof(name), "edge_trace_%Y%m%d_%H%M%S",
+                             &local);
+    snprintf(name + length, sizeof(name) - length, "_%03d.json",
+             (int)(tv.tv_usec / 1000));
+
+    std::string path = directory.empty() ? "." : directory;
+    path += "/";
+    path += name;
+    return Dump(path) == 0 ? path : std::string();
+}
+
+int32_t PipelineTrace::DumpOnSignal(int signal, const std::string& directory) {
+    if (g_dump_on_signal.exchange(true)) {
+        ERROR("trace dump signal already installed");
+        return -1;
+    }
+    if (sem_init(&g_dump_semaphore, 0, 0) != 0) {
+        ERROR("sem_init: %s", strerror(errno));
+        return -1;
+    }
+    std::thread([directory] {
+        pthread_setname_np(pthread_self(), "tracedump");
+        while (true) {
+            if (sem_wait(&g_dump_semaphore) != 0) {
+                continue;
+            }
+            DumpToDirectory(directory);
+        }
+    }).detach();
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = OnDumpSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    if (sigaction(signal, &action, nullptr) != 0) {
+        ERROR("sigaction %d: %s", signal, strerror(errno));
+        return -1;
+    }
+    INFO("kill -%d %d dumps a pipeline trace to %s", signal, getpid(),
+         directory.c_str());
+    return 0;
+}
+
+}  // namespace edge_app
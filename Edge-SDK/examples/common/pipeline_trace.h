@@ -0,0 +1,129 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#ifndef __PIPELINE_TRACE_H__
+#define __PIPELINE_TRACE_H__
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace edge_app {
+
+/*
+ * Scoped trace events of the pipeline stages, exported on demand as a
+ * Chrome / Perfetto JSON trace (chrome://tracing, ui.perfetto.dev).
+ *
+ * Each thread records into a ring of its own, registered on its first
+ * event: an event costs two clock reads and a few stores, without locks
+ * or allocation, so tracing stays on in production. A ring keeps the
+ * last kEventCount events of its thread; Dump() reads all of them
+ * without stopping the writers and skips the events overwritten while
+ * it copied.
+ *
+ * Event and argument names must be string literals, only their address
+ * is stored.
+ */
+class PipelineTrace {
+   public:
+    enum : uint32_t {
+        kEventCount = 8192,
+        // Threads past this many record nothing
+        kMaxThreads = 256,
+    };
+
+    static bool Enabled() {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    static void SetEnabled(bool enabled) {
+        enabled_.store(enabled, std::memory_order_relaxed);
+    }
+
+    // CLOCK_MONOTONIC, in ns
+    static int64_t NowNs();
+
+    // Complete event on the calling thread. |arg_name| may be nullptr.
+    static void Record(const char* name, int64_t begin_ns, int64_t end_ns,
+                       const char* arg_name = nullptr, uint64_t arg = 0);
+
+    static void Instant(const char* name, const char* arg_name = nullptr,
+                        uint64_t arg = 0);
+
+    // Writes the events of every thread to |path|
+    static int32_t Dump(const std::string& path);
+
+    // Dumps to |directory|/edge_trace_<time>.json, returns the path or an
+    // empty string
+    static std::string DumpToDirectory(const std::string& directory);
+
+    // Dumps to |directory| each time the process receives |signal|, from
+    // a thread of its own. Once per process.
+    static int32_t DumpOnSignal(int signal, const std::string& directory);
+
+   private:
+    static std::atomic<bool> enabled_;
+};
+
+/*
+ * Records the lifetime of the object as one event, or up to End().
+ */
+class TraceScope {
+   public:
+    explicit TraceScope(const char* name, const char* arg_name = nullptr,
+                        uint64_t arg = 0)
+        : name_(name),
+          arg_name_(arg_name),
+          arg_(arg),
+          begin_ns_(PipelineTrace::Enabled() ? PipelineTrace::NowNs() : 0) {}
+
+    ~TraceScope() { End(); }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    void SetArg(uint64_t arg) { arg_ = arg; }
+
+    void End() {
+        if (begin_ns_ != 0) {
+            PipelineTrace::Record(name_, begin_ns_, PipelineTrace::NowNs(),
+                                  arg_name_, arg_);
+            begin_ns_ = 0;
+        }
+    }
+
+   private:
+    const char* name_;
+    const char* arg_name_;
+    uint64_t arg_;
+    int64_t begin_ns_;
+};
+
+}  // namespace edge_app
+
+#define TRACE_SCOPE_CONCAT_(a, b) a##b
+#define TRACE_SCOPE_CONCAT(a, b) TRACE_SCOPE_CONCAT_(a, b)
+// TRACE_SCOPE("decode") or TRACE_SCOPE("process", "frame", info.sequence)
+#define TRACE_SCOPE(...)                                             \
+    edge_app::TraceScope TRACE_SCOPE_CONCAT(trace_scope_, __LINE__)( \
+        __VA_ARGS__)
+
+#endif
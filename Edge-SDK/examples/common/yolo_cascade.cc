@@ -0,0 +1,196 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include "yolo_cascade.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+#include "logger.h"
+#include "yolo_model_cache.h"
+
+using namespace cv;
+using namespace dnn;
+using namespace edge_sdk;
+
+namespace edge_app {
+
+static YoloPostProcessor::Options PostProcessorOptions(
+    const YoloCascade::Options& options) {
+    YoloPostProcessor::Options post_options;
+    post_options.conf_threshold = options.conf_threshold;
+    post_options.nms_threshold = options.nms_threshold;
+    return post_options;
+}
+
+YoloCascade::YoloCascade(const Options& options)
+    : options_(options), post_processor_(PostProcessorOptions(options)) {}
+
+YoloCascade::~YoloCascade() { ReleaseStages(); }
+
+void YoloCascade::ReleaseStages() {
+    for (size_t i = 0; i < stages_.size(); i++) {
+        YoloModelCache::Instance()->Release(options_.levels[i].model_name,
+                                            stages_[i].net);
+    }
+    stages_.clear();
+}
+
+double YoloCascade::BudgetMs() const {
+    return 1000.0 / options_.target_fps * options_.budget_ratio;
+}
+
+int32_t YoloCascade::Init() {
+    if (options_.levels.empty() || options_.target_fps <= 0) {
+        ERROR("invalid cascade options");
+        return -1;
+    }
+    if (options_.precision == kYoloPrecisionInt8) {
+        ERROR("int8 is not supported by the adaptive cascade");
+        return -1;
+    }
+
+    ReleaseStages();
+    for (int32_t i = 0; i < (int32_t)options_.levels.size(); i++) {
+        const auto& level = options_.levels[i];
+        Stage stage;
+        if (YoloModelCache::Instance()->Load(level.model_name, stage.net) !=
+            0) {
+            ReleaseStages();
+            return -1;
+        }
+        if (options_.precision != kYoloPrecisionFp32 &&
+            ConfigureYoloPrecision(stage.net, options_.precision) != 0) {
+            // All the levels at one precision, so that their costs compare:
+            // start over in fp32
+            YoloModelCache::Instance()->Release(level.model_name, stage.net);
+            ReleaseStages();
+            options_.precision = kYoloPrecisionFp32;
+            i = -1;
+            continue;
+        }
+        Size input_size(level.input_size, level.input_size);
+        stage.out_names = stage.net.getUnconnectedOutLayersNames();
+        stage.preprocessor.reset(new YoloPreprocessor(input_size));
+        WarmUpYoloNet(stage.net, input_size);
+        // One more forward, now that the layers are allocated
+        stage.reference_ms =
+            std::max(WarmUpYoloNet(stage.net, input_size, 1, 1), 0.01);
+        stage.average_ms = stage.reference_ms;
+        INFO("cascade level %zu: %s@%d %s, %.1f ms", stages_.size(),
+             level.model_name.c_str(), level.input_size,
+             YoloPrecisionName(options_.precision), stage.reference_ms);
+        stages_.push_back(std::move(stage));
+    }
+
+    // Start on the most accurate level that fits the budget idle
+    current_ = 0;
+    for (int32_t i = 0; i < (int32_t)stages_.size(); i++) {
+        if (stages_[i].reference_ms < BudgetMs() * options_.step_up_margin) {
+            current_ = i;
+        }
+    }
+    INFO("cascade start on %s@%d %s, target %.1f fps, budget %.1f ms",
+         options_.levels[current_].model_name.c_str(),
+         options_.levels[current_].input_size,
+         YoloPrecisionName(options_.precision), options_.target_fps,
+         BudgetMs());
+    return 0;
+}
+
+void YoloCascade::SwitchTo(int32_t index, const char* reason) {
+    auto& from = stages_[current_];
+    auto& to = stages_[index];
+    // Seed the new level with its cost scaled to the current load
+    to.average_ms = from.average_ms * to.reference_ms / from.reference_ms;
+    INFO("cascade: %s@%d -> %s@%d (%s, %.1f ms, budget %.1f ms)",
+         options_.levels[current_].model_name.c_str(),
+         options_.levels[current_].input_size,
+         options_.levels[index].model_name.c_str(),
+         options_.levels[index].input_size, reason, from.average_ms,
+         BudgetMs());
+    current_ = index;
+    frames_on_level_ = 0;
+    switch_counter_++;
+}
+
+void YoloCascade::Adapt(double frame_ms) {
+    auto& stage = stages_[current_];
+    stage.average_ms = stage.average_ms * 0.8 + frame_ms * 0.2;
+    stage.frames++;
+    if (++frames_on_level_ < options_.min_frames_per_level) return;
+
+    double budget = BudgetMs();
+    if (stage.average_ms > budget && current_ > 0) {
+        SwitchTo(current_ - 1, "over budget");
+        return;
+    }
+    if (current_ + 1 < (int32_t)stages_.size()) {
+        double expected = stage.average_ms *
+                          stages_[current_ + 1].reference_ms /
+                          stage.reference_ms;
+        if (expected < budget * options_.step_up_margin) {
+            SwitchTo(current_ + 1, "headroom");
+        }
+    }
+}
+
+void YoloCascade::Report() {
+    std::string shares;
+    for (size_t i = 0; i < stages_.size(); i++) {
+        char share[96];
+        snprintf(share, sizeof(share), "%s%s@%d %.0f%%", i ? ", " : "",
+                 options_.levels[i].model_name.c_str(),
+                 options_.levels[i].input_size,
+                 stages_[i].frames * 100.0 / frame_counter_);
+        shares += share;
+    }
+    INFO("cascade: %llu frames, %llu switches, %s",
+         (unsigned long long)frame_counter_,
+         (unsigned long long)switch_counter_, shares.c_str());
+}
+
+int32_t YoloCascade::Detect(const cv::Mat& frame,
+                            std::vector<YoloDetection>& detections,
+                            double* inference_ms) {
+    if (stages_.empty()) {
+        detections.clear();
+        return -1;
+    }
+
+    auto start = getTickCount();
+    auto& stage = stages_[current_];
+    stage.preprocessor->Process(frame, blob_);
+    stage.net.setInput(blob_);
+    stage.net.forward(outs_, stage.out_names);
+    post_processor_.Process(outs_, 0, 1, frame.size(), detections);
+    double ms = (getTickCount() - start) * 1000.0 / getTickFrequency();
+
+    if (inference_ms) *inference_ms = ms;
+    Adapt(ms);
+    if (++frame_counter_ % 300 == 0) {
+        Report();
+    }
+    return 0;
+}
+
+}  // namespace edge_app
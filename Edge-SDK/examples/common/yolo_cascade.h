@@ -0,0 +1,126 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#ifndef __YOLO_CASCADE_H__
+#define __YOLO_CASCADE_H__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "opencv2/dnn.hpp"
+#include "yolo_detection.h"
+#include "yolo_post_processor.h"
+#include "yolo_precision.h"
+#include "yolo_preprocessor.h"
+
+namespace edge_app {
+
+/*
+ * Load-adaptive detector: a ladder of (model, input size) levels from the
+ * cheapest to the most accurate, each with its own net built and warmed up
+ * at Init so a switch costs nothing. The frame time of every level is
+ * tracked with a moving average; the cascade steps down as soon as the
+ * current level misses the frame budget, and steps up when the next level
+ * is expected to fit with some margin.
+ */
+class YoloCascade {
+   public:
+    struct Level {
+        std::string model_name;
+        int32_t input_size;
+    };
+
+    struct Options {
+        std::vector<Level> levels = {{"yolo-fastest-1.1", 256},
+                                     {"yolo-fastest-1.1", 320},
+                                     {"yolo-fastest-1.1-xl", 320},
+                                     {"yolo-fastest-1.1-xl", 416}};
+        float target_fps = 10;
+        // Share of the frame period the detector may use
+        float budget_ratio = 0.8;
+        // Step up only if the next level is expected below this share of
+        // the budget
+        float step_up_margin = 0.8;
+        // Frames to stay on a level before the next switch
+        int32_t min_frames_per_level = 15;
+        float conf_threshold = 0.5;
+        float nms_threshold = 0.4;
+        // Of every level, all fall back to fp32 if one fails. INT8 is not
+        // supported: it would need a calibration per level.
+        YoloPrecision precision = kYoloPrecisionFp32;
+    };
+
+    explicit YoloCascade(const Options& options);
+
+    ~YoloCascade();
+
+    int32_t Init();
+
+    // |inference_ms| receives the preprocessing, forward and decoding time.
+    int32_t Detect(const cv::Mat& frame, std::vector<YoloDetection>& detections,
+                   double* inference_ms = nullptr);
+
+    int32_t CurrentLevel() const { return current_; }
+
+    const Level& GetLevel(int32_t index) const {
+        return options_.levels[index];
+    }
+
+   private:
+    struct Stage {
+        cv::dnn::Net net;
+        std::vector<cv::String> out_names;
+        std::unique_ptr<YoloPreprocessor> preprocessor;
+        // Forward time measured idle at Init, gives the relative cost of
+        // the levels under the current load
+        double reference_ms = 0;
+        double average_ms = 0;
+        uint64_t frames = 0;
+    };
+
+    double BudgetMs() const;
+
+    // Give the nets back to the model cache
+    void ReleaseStages();
+
+    void Adapt(double frame_ms);
+
+    void SwitchTo(int32_t index, const char* reason);
+
+    void Report();
+
+    Options options_;
+    std::vector<Stage> stages_;
+    YoloPostProcessor post_processor_;
+    cv::Mat blob_;
+    std::vector<cv::Mat> outs_;
+
+    int32_t current_ = 0;
+    int32_t frames_on_level_ = 0;
+    uint64_t frame_counter_ = 0;
+    uint64_t switch_counter_ = 0;
+};
+
+}  // namespace edge_app
+
+#endif
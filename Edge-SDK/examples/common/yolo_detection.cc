@@ -0,0 +1,152 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include "yolo_detection.h"
+
+#include <opencv2/dnn.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "logger.h"
+#include "util_misc.h"
+
+using namespace cv;
+using namespace dnn;
+using namespace std;
+using namespace edge_sdk;
+
+namespace edge_app {
+
+static const char* class_names[] = {
+    "person",        "bicycle",       "car",           "motorbike",
+    "aeroplane",     "bus",           "train",         "truck",
+    "boat",          "traffic light", "fire hydrant",  "stop sign",
+    "parking meter", "bench",         "bird",          "cat",
+    "dog",           "horse",         "sheep",         "cow",
+    "elephant",      "bear",          "zebra",         "giraffe",
+    "backpack",      "umbrella",      "handbag",       "tie",
+    "suitcase",      "frisbee",       "skis",          "snowboard",
+    "sports ball",   "kite",          "baseball bat",  "baseball glove",
+    "skateboard",    "surfboard",     "tennis racket", "bottle",
+    "wine glass",    "cup",           "fork",          "knife",
+    "spoon",         "bowl",          "banana",        "apple",
+    "sandwich",      "orange",        "broccoli",      "carrot",
+    "hot dog",       "pizza",         "donut",         "cake",
+    "chair",         "sofa",          "pottedplant",   "bed",
+    "diningtable",   "toilet",        "tvmonitor",     "laptop",
+    "mouse",         "remote",        "keyboard",      "cell phone",
+    "microwave",     "oven",          "toaster",       "sink",
+    "refrigerator",  "book",          "clock",         "vase",
+    "scissors",      "teddy bear",    "hair drier",    "toothbrush",
+};
+
+const char* GetYoloClassName(int32_t class_id) {
+    if (class_id < 0 || class_id >= kYoloClassNum) {
+        return nullptr;
+    }
+    return class_names[class_id];
+}
+
+int32_t GetYoloModelPath(const std::string& model_name, std::string& cfg_path,
+                         std::string& weights_path) {
+    char cur_file_dir_path[128];
+    if (GetCurrentFileDirPath(__FILE__, sizeof(cur_file_dir_path),
+                              cur_file_dir_path) != 0) {
+        ERROR("get path failed");
+        return -1;
+    }
+    auto model_dir = std::string(cur_file_dir_path) +
+                     std::string("data/yolo-fastest-1.1_coco/");
+    cfg_path = model_dir + model_name + std::string(".cfg");
+    weights_path = model_dir + model_name + std::string(".weights");
+    return 0;
+}
+
+void YoloPostProcess(const std::vector<cv::Mat>& outs, int32_t batch_index,
+                     int32_t batch_size, const cv::Size& frame_size,
+                     float conf_threshold, float nms_threshold,
+                     std::vector<YoloDetection>& detections) {
+    vector<int> class_ids;
+    vector<float> confidences;
+    vector<Rect> boxes;
+
+    for (size_t i = 0; i < outs.size(); ++i) {
+        int rows = outs[i].rows / batch_size;
+        int row_begin = rows * batch_index;
+        float* data = (float*)outs[i].ptr<float>(row_begin);
+        for (int j = row_begin; j < row_begin + rows;
+             ++j, data += outs[i].cols) {
+            Mat scores = outs[i].row(j).colRange(5, outs[i].cols);
+            Point classid_point;
+            double confidence;
+
+            minMaxLoc(scores, 0, &confidence, 0, &classid_point);
+            if (confidence > conf_threshold) {
+                int cx = (int)(data[0] * frame_size.width);
+                int cy = (int)(data[1] * frame_size.height);
+                int w = (int)(data[2] * frame_size.width);
+                int h = (int)(data[3] * frame_size.height);
+                int left = cx - (w >> 1);
+                int top = cy - (h >> 1);
+
+                class_ids.push_back(classid_point.x);
+                confidences.push_back((float)confidence);
+                boxes.push_back(Rect(left, top, w, h));
+            }
+        }
+    }
+
+    vector<int> indices;
+    NMSBoxes(boxes, confidences, conf_threshold, nms_threshold, indices);
+    detections.clear();
+    for (size_t i = 0; i < indices.size(); ++i) {
+        int idx = indices[i];
+        detections.push_back({class_ids[idx], confidences[idx], boxes[idx]});
+    }
+}
+
+void DrawYoloDetections(const std::vector<YoloDetection>& detections,
+                        cv::Mat& frame) {
+    for (const auto& det : detections) {
+        int left = det.box.x;
+        int top = det.box.y;
+        rectangle(frame, Point(left, top),
+                  Point(left + det.box.width, top + det.box.height),
+                  Scalar(0, 0, 255), 3);
+
+        string label = format("%.2f", det.confidence);
+        auto class_name = GetYoloClassName(det.class_id);
+        if (class_name) {
+            label = std::string(class_name) + ":" + label;
+        }
+        if (det.track_id >= 0) {
+            label = format("#%d ", det.track_id) + label;
+        }
+
+        int base_line;
+        Size label_size =
+            getTextSize(label, FONT_HERSHEY_SIMPLEX, 0.5, 1, &base_line);
+        top = max(top, label_size.height);
+        putText(frame, label, Point(left, top), FONT_HERSHEY_SIMPLEX, 0.75,
+                Scalar(0, 255, 0), 1);
+    }
+}
+
+}  // namespace edge_app
@@ -0,0 +1,66 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#ifndef __YOLO_DETECTION_H__
+#define __YOLO_DETECTION_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "opencv2/core.hpp"
+
+namespace edge_app {
+
+struct YoloDetection {
+    int32_t class_id;
+    float confidence;
+    cv::Rect box;
+    // Stable id assigned by YoloTracker, -1 when untracked
+    int32_t track_id = -1;
+};
+
+enum {
+    kYoloClassNum = 80,
+};
+
+const char* GetYoloClassName(int32_t class_id);
+
+// Resolve the cfg/weights pair of a model shipped under
+// common/data/yolo-fastest-1.1_coco, e.g. "yolo-fastest-1.1-xl".
+int32_t GetYoloModelPath(const std::string& model_name, std::string& cfg_path,
+                         std::string& weights_path);
+
+// Decode the Darknet region outputs of one image into frame coordinates and
+// apply NMS with minMaxLoc/NMSBoxes. This is the reference YoloPostProcessor
+// is validated against. The region layer stacks the rows of a batched forward image by
+// image, so |batch_index| of |batch_size| selects the rows of one frame.
+void YoloPostProcess(const std::vector<cv::Mat>& outs, int32_t batch_index,
+                     int32_t batch_size, const cv::Size& frame_size,
+                     float conf_threshold, float nms_threshold,
+                     std::vector<YoloDetection>& detections);
+
+void DrawYoloDetections(const std::vector<YoloDetection>& detections,
+                        cv::Mat& frame);
+
+}  // namespace edge_app
+
+#endif
@@ -0,0 +1,208 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include "yolo_inference_service.h"
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "logger.h"
+#include "pipeline_trace.h"
+#include "yolo_model_cache.h"
+
+using namespace cv;
+using namespace dnn;
+using namespace edge_sdk;
+
+namespace edge_app {
+
+static YoloPostProcessor::Options PostProcessorOptions(
+    const YoloInferenceService::Options& options) {
+    YoloPostProcessor::Options post_options;
+    post_options.conf_threshold = options.conf_threshold;
+    post_options.nms_threshold = options.nms_threshold;
+    return post_options;
+}
+
+YoloInferenceService::YoloInferenceService(const Options& options)
+    : options_(options),
+      preprocessor_(Size(options.input_width, options.input_height)),
+      post_processor_(PostProcessorOptions(options)) {
+    service_start_ = false;
+}
+
+YoloInferenceService::~YoloInferenceService() { DeInit(); }
+
+int32_t YoloInferenceService::Init() {
+    if (service_start_) {
+        WARN("repeat init inference service");
+        return -1;
+    }
+
+    auto start = getTickCount();
+    if (YoloModelCache::Instance()->Load(options_.model_name, net_) != 0) {
+        return -1;
+    }
+    out_names_ = net_.getUnconnectedOutLayersNames();
+    // Warm up at the full batch, so the first batch of all streams does not
+    // pay the layer allocation.
+    auto warm_up_ms =
+        WarmUpYoloNet(net_, Size(options_.input_width, options_.input_height),
+                      options_.max_batch_size);
+    INFO("inference service ready in %.1f ms (warm-up %.1f ms)",
+         (getTickCount() - start) * 1000.0 / getTickFrequency(), warm_up_ms);
+
+    service_start_ = true;
+    inference_thread_ = std::thread(&YoloInferenceService::InferenceLoop, this);
+    INFO("yolo inference service started: %s, %dx%d, max batch %d",
+         options_.model_name.c_str(), options_.input_width,
+         options_.input_height, options_.max_batch_size);
+    return 0;
+}
+
+int32_t YoloInferenceService::DeInit() {
+    {
+        std::lock_guard<std::mutex> l(request_mutex_);
+        service_start_ = false;
+    }
+    request_cv_.notify_all();
+    result_cv_.notify_all();
+    if (inference_thread_.joinable()) {
+        inference_thread_.join();
+    }
+    YoloModelCache::Instance()->Release(options_.model_name, net_);
+    return 0;
+}
+
+int32_t YoloInferenceService::RegisterStream() {
+    std::lock_guard<std::mutex> l(request_mutex_);
+    stream_count_++;
+    return next_stream_id_++;
+}
+
+void YoloInferenceService::UnregisterStream(int32_t stream_id) {
+    std::lock_guard<std::mutex> l(request_mutex_);
+    if (stream_count_ > 0) stream_count_--;
+    request_cv_.notify_one();
+}
+
+int32_t YoloInferenceService::Detect(int32_t stream_id, const cv::Mat& frame,
+                                     std::vector<YoloDetection>& detections,
+                                     double* inference_ms) {
+    auto request = std::make_shared<Request>();
+    request->stream_id = stream_id;
+    request->frame = frame;
+
+    std::unique_lock<std::mutex> l(request_mutex_);
+    if (!service_start_) {
+        return -1;
+    }
+    pending_requests_.push_back(request);
+    request_cv_.notify_one();
+    result_cv_.wait(l, [&] { return request->done || !service_start_; });
+    if (!request->done) {
+        return -1;
+    }
+    detections.swap(request->detections);
+    if (inference_ms) *inference_ms = request->inference_ms;
+    return 0;
+}
+
+void YoloInferenceService::InferBatch(
+    std::vector<std::shared_ptr<Request>>& batch) {
+    int32_t batch_size = (int32_t)batch.size();
+    TRACE_SCOPE("infer_batch", "frames", batch_size);
+    for (int32_t i = 0; i < batch_size; i++) {
+        TRACE_SCOPE("preprocess");
+        preprocessor_.Process(batch[i]->frame, blob_, i, batch_size);
+    }
+    net_.setInput(blob_);
+
+    std::vector<Mat> outs;
+    auto start = getTickCount();
+    {
+        TRACE_SCOPE("forward", "frames", batch_size);
+        net_.forward(outs, out_names_);
+    }
+    double time = (getTickCount() - start) * 1000.0 / getTickFrequency();
+
+    for (int32_t i = 0; i < batch_size; i++) {
+        TRACE_SCOPE("postprocess");
+        auto& request = batch[i];
+        post_processor_.Process(outs, i, batch_size, request->frame.size(),
+                                request->detections);
+        request->inference_ms = time;
+    }
+
+    batch_counter_++;
+    frame_counter_ += batch_size;
+    if (batch_counter_ % 300 == 0) {
+        INFO("inference service: %llu batches, avg batch size %.2f",
+             (unsigned long long)batch_counter_,
+             (double)frame_counter_ / batch_counter_);
+    }
+}
+
+void YoloInferenceService::InferenceLoop() {
+    INFO("start inference service: %s", options_.model_name.c_str());
+    pthread_setname_np(pthread_self(), "yoloinference");
+    std::vector<std::shared_ptr<Request>> batch;
+    while (service_start_) {
+        std::unique_lock<std::mutex> l(request_mutex_);
+        request_cv_.wait(l, [&] {
+            return pending_requests_.size() != 0 || !service_start_;
+        });
+        if (!service_start_) break;
+
+        // Wait for the other streams to catch up, but never longer than the
+        // batch window so that a stalled stream does not block the others.
+        size_t expected = std::min(std::max(stream_count_, 1),
+                                   options_.max_batch_size);
+        auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::milliseconds(options_.batch_window_ms);
+        request_cv_.wait_until(l, deadline, [&] {
+            return pending_requests_.size() >= expected || !service_start_;
+        });
+        if (!service_start_) break;
+
+        size_t n = std::min(pending_requests_.size(),
+                            (size_t)options_.max_batch_size);
+        batch.assign(pending_requests_.begin(), pending_requests_.begin() + n);
+        pending_requests_.erase(pending_requests_.begin(),
+                                pending_requests_.begin() + n);
+        l.unlock();
+
+        InferBatch(batch);
+
+        l.lock();
+        for (auto& request : batch) {
+            request->done = true;
+        }
+        l.unlock();
+        result_cv_.notify_all();
+        batch.clear();
+    }
+    INFO("stop inference service: %s", options_.model_name.c_str());
+}
+
+}  // namespace edge_app
@@ -0,0 +1,114 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#ifndef __YOLO_INFERENCE_SERVICE_H__
+#define __YOLO_INFERENCE_SERVICE_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "opencv2/dnn.hpp"
+#include "yolo_detection.h"
+#include "yolo_post_processor.h"
+#include "yolo_preprocessor.h"
+
+namespace edge_app {
+
+/*
+ * One Darknet net shared by several streams. Frames submitted by the stream
+ * processor threads within |batch_window_ms| are stacked into one blob and
+ * inferred with a single forward, and the detections are routed back to the
+ * submitting stream.
+ */
+class YoloInferenceService {
+   public:
+    struct Options {
+        std::string model_name = "yolo-fastest-1.1-xl";
+        int32_t input_width = 320;
+        int32_t input_height = 320;
+        int32_t max_batch_size = 4;
+        int32_t batch_window_ms = 10;
+        float conf_threshold = 0.5;
+        float nms_threshold = 0.4;
+    };
+
+    explicit YoloInferenceService(const Options& options);
+
+    ~YoloInferenceService();
+
+    int32_t Init();
+
+    int32_t DeInit();
+
+    // Each stream registers once; the number of registered streams is the
+    // batch the service waits for before the window expires.
+    int32_t RegisterStream();
+
+    void UnregisterStream(int32_t stream_id);
+
+    // Blocks the calling stream until the batch containing |frame| has been
+    // inferred. |inference_ms| receives the forward time of that batch.
+    int32_t Detect(int32_t stream_id, const cv::Mat& frame,
+                   std::vector<YoloDetection>& detections,
+                   double* inference_ms = nullptr);
+
+   private:
+    struct Request {
+        int32_t stream_id;
+        cv::Mat frame;
+        std::vector<YoloDetection> detections;
+        double inference_ms = 0;
+        bool done = false;
+    };
+
+    void InferenceLoop();
+
+    void InferBatch(std::vector<std::shared_ptr<Request>>& batch);
+
+    Options options_;
+    cv::dnn::Net net_;
+    std::vector<cv::String> out_names_;
+    YoloPreprocessor preprocessor_;
+    cv::Mat blob_;
+    YoloPostProcessor post_processor_;
+
+    std::mutex request_mutex_;
+    std::condition_variable request_cv_;
+    std::condition_variable result_cv_;
+    std::vector<std::shared_ptr<Request>> pending_requests_;
+    int32_t stream_count_ = 0;
+    int32_t next_stream_id_ = 0;
+
+    std::thread inference_thread_;
+    std::atomic<bool> service_start_;
+
+    uint64_t batch_counter_ = 0;
+    uint64_t frame_counter_ = 0;
+};
+
+}  // namespace edge_app
+
+#endif
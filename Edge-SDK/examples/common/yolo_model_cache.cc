@@ -0,0 +1,150 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include "yolo_model_cache.h"
+
+#include <fstream>
+#include <iterator>
+
+#include "logger.h"
+#include "yolo_detection.h"
+
+using namespace cv;
+using namespace edge_sdk;
+
+namespace edge_app {
+
+static int32_t ReadFile(const std::string& path, std::vector<uchar>& data) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        ERROR("open %s failed", path.c_str());
+        return -1;
+    }
+    data.resize((size_t)file.tellg());
+    file.seekg(0);
+    if (!file.read((char*)data.data(), data.size())) {
+        ERROR("read %s failed", path.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+YoloModelCache* YoloModelCache::Instance() {
+    static YoloModelCache instance;
+    return &instance;
+}
+
+int32_t YoloModelCache::ReadModel(const std::string& model_name,
+                                  Model& model) {
+    std::string cfg_path, weights_path;
+    if (GetYoloModelPath(model_name, cfg_path, weights_path) != 0) {
+        return -1;
+    }
+    auto cfg = std::make_shared<std::vector<uchar>>();
+    auto weights = std::make_shared<std::vector<uchar>>();
+    if (ReadFile(cfg_path, *cfg) != 0 ||
+        ReadFile(weights_path, *weights) != 0) {
+        return -1;
+    }
+    model.cfg = cfg;
+    model.weights = weights;
+    return 0;
+}
+
+int32_t YoloModelCache::Load(const std::string& model_name,
+                             cv::dnn::Net& net) {
+    auto start = getTickCount();
+    std::shared_ptr<const std::vector<uchar>> cfg, weights;
+    bool cached;
+    {
+        // Only the lookups under the lock: reading and parsing run
+        // concurrently for the callers that need them
+        std::lock_guard<std::mutex> l(models_mutex_);
+        auto it = models_.find(model_name);
+        cached = it != models_.end();
+        if (cached && !it->second.idle_nets.empty()) {
+            net = it->second.idle_nets.back();
+            it->second.idle_nets.pop_back();
+            INFO("load %s (reused): %.1f ms", model_name.c_str(),
+                 (getTickCount() - start) * 1000.0 / getTickFrequency());
+            return 0;
+        }
+        if (cached) {
+            cfg = it->second.cfg;
+            weights = it->second.weights;
+        }
+    }
+    if (!cached) {
+        Model model;
+        if (ReadModel(model_name, model) != 0) {
+            return -1;
+        }
+        cfg = model.cfg;
+        weights = model.weights;
+        // A concurrent first load may have added it meanwhile, either is fine
+        std::lock_guard<std::mutex> l(models_mutex_);
+        models_.emplace(model_name, std::move(model));
+    }
+
+    net = dnn::readNetFromDarknet(*cfg, *weights);
+    if (net.empty()) {
+        ERROR("Failed to load model: %s", model_name.c_str());
+        return -1;
+    }
+    INFO("load %s%s: %.1f ms", model_name.c_str(), cached ? " (cached)" : "",
+         (getTickCount() - start) * 1000.0 / getTickFrequency());
+    return 0;
+}
+
+void YoloModelCache::Release(const std::string& model_name,
+                             cv::dnn::Net& net) {
+    if (net.empty()) return;
+    net.setPreferableBackend(dnn::DNN_BACKEND_OPENCV);
+    net.setPreferableTarget(dnn::DNN_TARGET_CPU);
+    std::lock_guard<std::mutex> l(models_mutex_);
+    auto it = models_.find(model_name);
+    if (it != models_.end() &&
+        it->second.idle_nets.size() < (size_t)kMaxIdleNetNum) {
+        it->second.idle_nets.push_back(net);
+    }
+    net = dnn::Net();
+}
+
+void YoloModelCache::Clear() {
+    std::lock_guard<std::mutex> l(models_mutex_);
+    models_.clear();
+}
+
+double WarmUpYoloNet(cv::dnn::Net& net, const cv::Size& input_size,
+                     int32_t batch_size, int32_t count) {
+    auto start = getTickCount();
+    int sizes[] = {batch_size, 3, input_size.height, input_size.width};
+    Mat blob(4, sizes, CV_32F, Scalar(0));
+    auto out_names = net.getUnconnectedOutLayersNames();
+    std::vector<Mat> outs;
+    for (int32_t i = 0; i < count; i++) {
+        net.setInput(blob);
+        net.forward(outs, out_names);
+    }
+    return (getTickCount() - start) * 1000.0 / getTickFrequency();
+}
+
+}  // namespace edge_app
@@ -0,0 +1,88 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#ifndef __YOLO_MODEL_CACHE_H__
+#define __YOLO_MODEL_CACHE_H__
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "opencv2/dnn.hpp"
+
+namespace edge_app {
+
+/*
+ * Keeps the Darknet cfg/weights of each model in memory for the lifetime of
+ * the process, and the parsed nets given back by the detectors that are done
+ * with them. Re-creating a detector (lens switch, processor restart, quality
+ * change) then takes a parsed, already allocated net instead of reading and
+ * parsing the files again. A net must not be shared between threads, so a
+ * parsed net goes to one caller at a time, and concurrent callers (a second
+ * stream, the tiler workers) get a net parsed from the cached bytes.
+ */
+class YoloModelCache {
+   public:
+    static YoloModelCache* Instance();
+
+    // Get a net of |model_name|, e.g. "yolo-fastest-1.1-xl": a released one
+    // if any, else parsed from the cached files.
+    int32_t Load(const std::string& model_name, cv::dnn::Net& net);
+
+    // Give back a net from Load, for the next Load of |model_name|. |net| is
+    // reset to the default CPU target and must not be used afterwards; nets
+    // changed otherwise (quantized) must not be released.
+    void Release(const std::string& model_name, cv::dnn::Net& net);
+
+    void Clear();
+
+   private:
+    YoloModelCache() {}
+
+    enum {
+        kMaxIdleNetNum = 4,
+    };
+
+    struct Model {
+        // Immutable once read, parsed outside |models_mutex_|
+        std::shared_ptr<const std::vector<uchar>> cfg;
+        std::shared_ptr<const std::vector<uchar>> weights;
+        std::vector<cv::dnn::Net> idle_nets;
+    };
+
+    int32_t ReadModel(const std::string& model_name, Model& model);
+
+    std::mutex models_mutex_;
+    std::map<std::string, Model> models_;
+};
+
+// Run |count| forwards on a blank blob of the target input size and batch, so
+// that the layer allocation and backend initialization happen before the
+// first frame. Returns the duration of the warm-up in ms.
+double WarmUpYoloNet(cv::dnn::Net& net, const cv::Size& input_size,
+                     int32_t batch_size = 1, int32_t count = 2);
+
+}  // namespace edge_app
+
+#endif
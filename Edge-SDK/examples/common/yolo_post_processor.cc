@@ -0,0 +1,180 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include "yolo_post_processor.h"
+
+#include <algorithm>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define YOLO_POST_PROCESSOR_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define YOLO_POST_PROCESSOR_SSE2
+#endif
+
+namespace edge_app {
+
+static const int32_t kMinReservedCandidates = 64;
+
+static inline float MaxScore(const float* scores, int32_t n) {
+    int32_t i = 0;
+    float max_score = -1.f;
+#if defined(YOLO_POST_PROCESSOR_NEON)
+    if (n >= 4) {
+        float32x4_t vmax = vld1q_f32(scores);
+        for (i = 4; i + 4 <= n; i += 4) {
+            vmax = vmaxq_f32(vmax, vld1q_f32(scores + i));
+        }
+#if defined(__aarch64__)
+        max_score = vmaxvq_f32(vmax);
+#else
+        float32x2_t m = vpmax_f32(vget_low_f32(vmax), vget_high_f32(vmax));
+        m = vpmax_f32(m, m);
+        max_score = vget_lane_f32(m, 0);
+#endif
+    }
+#elif defined(YOLO_POST_PROCESSOR_SSE2)
+    if (n >= 4) {
+        __m128 vmax = _mm_loadu_ps(scores);
+        for (i = 4; i + 4 <= n; i += 4) {
+            vmax = _mm_max_ps(vmax, _mm_loadu_ps(scores + i));
+        }
+        vmax = _mm_max_ps(vmax, _mm_shuffle_ps(vmax, vmax, 0x4E));
+        vmax = _mm_max_ps(vmax, _mm_shuffle_ps(vmax, vmax, 0xB1));
+        max_score = _mm_cvtss_f32(vmax);
+    }
+#endif
+    for (; i < n; i++) {
+        if (scores[i] > max_score) max_score = scores[i];
+    }
+    return max_score;
+}
+
+YoloPostProcessor::YoloPostProcessor() : YoloPostProcessor(Options()) {}
+
+YoloPostProcessor::YoloPostProcessor(const Options& options)
+    : options_(options) {
+    options_.reserved_candidates =
+        std::max(options_.reserved_candidates, kMinReservedCandidates);
+    Reserve(options_.reserved_candidates);
+}
+
+void YoloPostProcessor::Reserve(size_t size) {
+    left_.resize(size);
+    top_.resize(size);
+    width_.resize(size);
+    height_.resize(size);
+    area_.resize(size);
+    score_.resize(size);
+    class_id_.resize(size);
+    order_.reserve(size);
+    kept_.reserve(size);
+}
+
+void YoloPostProcessor::Process(const std::vector<cv::Mat>& outs,
+                                int32_t batch_index, int32_t batch_size,
+                                const cv::Size& frame_size,
+                                std::vector<YoloDetection>& detections) {
+    const float conf_threshold = options_.conf_threshold;
+    count_ = 0;
+
+    for (size_t i = 0; i < outs.size(); ++i) {
+        const int32_t cols = outs[i].cols;
+        const int32_t class_num = cols - 5;
+        const int32_t rows = outs[i].rows / batch_size;
+        const float* data = outs[i].ptr<float>(rows * batch_index);
+        for (int32_t j = 0; j < rows; ++j, data += cols) {
+            // Class scores are scaled by objectness, so no class of this row
+            // can pass the threshold if the objectness does not.
+            if (!(data[4] > conf_threshold)) continue;
+
+            const float* scores = data + 5;
+            float confidence = MaxScore(scores, class_num);
+            if (!(confidence > conf_threshold)) continue;
+
+            if (count_ == score_.size()) {
+                Reserve(std::max<size_t>(kMinReservedCandidates, count_ * 2));
+            }
+            int32_t class_id = 0;
+            while (scores[class_id] != confidence) class_id++;
+
+            int32_t cx = (int32_t)(data[0] * frame_size.width);
+            int32_t cy = (int32_t)(data[1] * frame_size.height);
+            int32_t w = (int32_t)(data[2] * frame_size.width);
+            int32_t h = (int32_t)(data[3] * frame_size.height);
+            left_[count_] = cx - (w >> 1);
+            top_[count_] = cy - (h >> 1);
+            width_[count_] = w;
+            height_[count_] = h;
+            area_[count_] = w * h;
+            score_[count_] = confidence;
+            class_id_[count_] = class_id;
+            count_++;
+        }
+    }
+
+    Nms(detections);
+}
+
+void YoloPostProcessor::Nms(std::vector<YoloDetection>& detections) {
+    order_.resize(count_);
+    for (size_t i = 0; i < count_; i++) {
+        order_[i] = (int32_t)i;
+    }
+    // Same ordering as cv::dnn::NMSBoxes: stable by descending score
+    std::stable_sort(order_.begin(), order_.end(), [&](int32_t a, int32_t b) {
+        return score_[a] > score_[b];
+    });
+
+    kept_.clear();
+    for (auto idx : order_) {
+        const int32_t l = left_[idx];
+        const int32_t t = top_[idx];
+        const int32_t r = l + width_[idx];
+        const int32_t b = t + height_[idx];
+        bool keep = true;
+        for (auto k : kept_) {
+            int32_t iw = std::min(r, left_[k] + width_[k]) - std::max(l, left_[k]);
+            if (iw <= 0) continue;
+            int32_t ih = std::min(b, top_[k] + height_[k]) - std::max(t, top_[k]);
+            if (ih <= 0) continue;
+            int32_t area_sum = area_[idx] + area_[k];
+            if (area_sum <= 0) continue;
+            double inter = (double)iw * ih;
+            float overlap = (float)(inter / (area_sum - inter));
+            if (overlap > options_.nms_threshold) {
+                keep = false;
+                break;
+            }
+        }
+        if (keep) kept_.push_back(idx);
+    }
+
+    detections.clear();
+    for (auto idx : kept_) {
+        detections.push_back({class_id_[idx], score_[idx],
+                              cv::Rect(left_[idx], top_[idx], width_[idx],
+                                       height_[idx])});
+    }
+}
+
+}  // namespace edge_app
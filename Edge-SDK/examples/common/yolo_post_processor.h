@@ -0,0 +1,81 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#ifndef __YOLO_POST_PROCESSOR_H__
+#define __YOLO_POST_PROCESSOR_H__
+
+#include <cstdint>
+#include <vector>
+
+#include "opencv2/core.hpp"
+#include "yolo_detection.h"
+
+namespace edge_app {
+
+/*
+ * Decodes Darknet region outputs with the same results as YoloPostProcess,
+ * but rejects rows on the objectness column before touching the class scores
+ * (the region layer already multiplies class scores by objectness), takes the
+ * max class score of the survivors with SIMD and looks up its class only when
+ * it passes the threshold, and keeps the candidates in structure-of-arrays
+ * buffers reused across frames.
+ */
+class YoloPostProcessor {
+   public:
+    struct Options {
+        float conf_threshold = 0.5;
+        float nms_threshold = 0.4;
+        // Grown as needed, at least 64
+        int32_t reserved_candidates = 1024;
+    };
+
+    YoloPostProcessor();
+
+    explicit YoloPostProcessor(const Options& options);
+
+    void Process(const std::vector<cv::Mat>& outs, int32_t batch_index,
+                 int32_t batch_size, const cv::Size& frame_size,
+                 std::vector<YoloDetection>& detections);
+
+    size_t CandidateCount() const { return count_; }
+
+   private:
+    void Reserve(size_t size);
+
+    void Nms(std::vector<YoloDetection>& detections);
+
+    Options options_;
+
+    std::vector<int32_t> left_;
+    std::vector<int32_t> top_;
+    std::vector<int32_t> width_;
+    std::vector<int32_t> height_;
+    std::vector<int32_t> area_;
+    std::vector<float> score_;
+    std::vector<int32_t> class_id_;
+    std::vector<int32_t> order_;
+    std::vector<int32_t> kept_;
+    size_t count_ = 0;
+};
+
+}  // namespace edge_app
+
+#endif
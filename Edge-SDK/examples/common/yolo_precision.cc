@@ -0,0 +1,129 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include "yolo_precision.h"
+
+#include <opencv2/imgcodecs.hpp>
+
+#include "logger.h"
+
+using namespace cv;
+using namespace edge_sdk;
+
+namespace edge_app {
+
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 10)
+#define YOLO_PRECISION_HAS_CPU_FP16
+#endif
+
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 6)
+#define YOLO_PRECISION_HAS_INT8
+#endif
+
+const char* YoloPrecisionName(YoloPrecision precision) {
+    switch (precision) {
+        case kYoloPrecisionFp32:
+            return "fp32";
+        case kYoloPrecisionFp16:
+            return "fp16";
+        case kYoloPrecisionInt8:
+            return "int8";
+    }
+    return "unknown";
+}
+
+int32_t ParseYoloPrecision(const std::string& name, YoloPrecision& precision) {
+    if (name == "fp32") {
+        precision = kYoloPrecisionFp32;
+    } else if (name == "fp16") {
+        precision = kYoloPrecisionFp16;
+    } else if (name == "int8") {
+        precision = kYoloPrecisionInt8;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static int32_t Fail(std::string* reason, const std::string& message) {
+    ERROR("%s, using fp32", message.c_str());
+    if (reason) *reason = message;
+    return -1;
+}
+
+int32_t ConfigureYoloPrecision(cv::dnn::Net& net, YoloPrecision precision,
+                               const std::vector<cv::Mat>& calibration_blobs,
+                               std::string* reason) {
+    if (precision == kYoloPrecisionFp16) {
+#ifdef YOLO_PRECISION_HAS_CPU_FP16
+        net.setPreferableBackend(dnn::DNN_BACKEND_OPENCV);
+        net.setPreferableTarget(dnn::DNN_TARGET_CPU_FP16);
+        return 0;
+#else
+        return Fail(reason, "fp16 on cpu needs OpenCV >= 4.10");
+#endif
+    }
+
+    if (precision == kYoloPrecisionInt8) {
+#ifdef YOLO_PRECISION_HAS_INT8
+        if (calibration_blobs.empty()) {
+            return Fail(reason, "int8 needs calibration frames");
+        }
+        // cv::dnn reports unsupported layers by throwing
+        try {
+            auto start = getTickCount();
+            auto quantized = net.quantize(calibration_blobs, CV_32F, CV_32F);
+            quantized.setPreferableBackend(dnn::DNN_BACKEND_OPENCV);
+            quantized.setPreferableTarget(dnn::DNN_TARGET_CPU);
+            net = quantized;
+            INFO("int8 quantization on %zu frames: %.1f ms",
+                 calibration_blobs.size(),
+                 (getTickCount() - start) * 1000.0 / getTickFrequency());
+        } catch (const cv::Exception& e) {
+            return Fail(reason,
+                        std::string("int8 quantization failed: ") + e.what());
+        }
+        return 0;
+#else
+        return Fail(reason, "int8 needs OpenCV >= 4.6");
+#endif
+    }
+
+    return 0;
+}
+
+int32_t LoadYoloCalibrationBlobs(const std::vector<std::string>& paths,
+                                 const cv::Size& input_size, size_t max_count,
+                                 std::vector<cv::Mat>& blobs) {
+    for (const auto& path : paths) {
+        if (blobs.size() >= max_count) break;
+        Mat image = imread(path);
+        if (image.empty()) {
+            WARN("skip unreadable calibration image: %s", path.c_str());
+            continue;
+        }
+        blobs.push_back(dnn::blobFromImage(image, 1 / 255.0, input_size,
+                                           Scalar(0, 0, 0), true, false));
+    }
+    return blobs.empty() ? -1 : 0;
+}
+
+}  // namespace edge_app
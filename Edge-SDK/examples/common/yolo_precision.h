@@ -0,0 +1,65 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#ifndef __YOLO_PRECISION_H__
+#define __YOLO_PRECISION_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "opencv2/dnn.hpp"
+
+namespace edge_app {
+
+enum YoloPrecision {
+    kYoloPrecisionFp32 = 0,
+    // CPU half precision, needs OpenCV >= 4.10 (fast on ARMv8.2+ cores)
+    kYoloPrecisionFp16 = 1,
+    // Quantized with cv::dnn::Net::quantize, needs OpenCV >= 4.6
+    kYoloPrecisionInt8 = 2,
+};
+
+enum {
+    kYoloCalibrationFrameNum = 16,
+};
+
+const char* YoloPrecisionName(YoloPrecision precision);
+
+int32_t ParseYoloPrecision(const std::string& name, YoloPrecision& precision);
+
+// Switch |net| to |precision| on the CPU. INT8 replaces |net| with a net
+// quantized on |calibration_blobs| (inputs as produced by blobFromImage).
+// On failure |net| is left in FP32, -1 is returned and the cause is logged
+// and stored in |reason| if given.
+int32_t ConfigureYoloPrecision(cv::dnn::Net& net, YoloPrecision precision,
+                               const std::vector<cv::Mat>& calibration_blobs =
+                                   std::vector<cv::Mat>(),
+                               std::string* reason = nullptr);
+
+// Blobs of the images at |paths|, at most |max_count|.
+int32_t LoadYoloCalibrationBlobs(const std::vector<std::string>& paths,
+                                 const cv::Size& input_size, size_t max_count,
+                                 std::vector<cv::Mat>& blobs);
+
+}  // namespace edge_app
+
+#endif
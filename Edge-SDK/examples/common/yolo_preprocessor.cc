@@ -0,0 +1,209 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include "yolo_preprocessor.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "logger.h"
+
+using namespace cv;
+using namespace edge_sdk;
+
+namespace edge_app {
+
+static const float kInputScale = 1 / 255.f;
+
+YoloPreprocessor::YoloPreprocessor(const cv::Size& input_size)
+    : input_size_(input_size) {}
+
+void YoloPreprocessor::BuildTaps(int32_t src_len, int32_t dst_len,
+                                 int32_t step, Taps& taps) {
+    taps.offset0.resize(dst_len);
+    taps.offset1.resize(dst_len);
+    taps.weight.resize(dst_len);
+    double scale = (double)src_len / dst_len;
+    for (int32_t i = 0; i < dst_len; i++) {
+        // Pixel centers aligned, clamped at the borders like cv::resize
+        float f = (float)((i + 0.5) * scale - 0.5);
+        int32_t s = (int32_t)std::floor(f);
+        f -= s;
+        if (s < 0) {
+            s = 0;
+            f = 0;
+        }
+        if (s >= src_len - 1) {
+            s = src_len - 1;
+            f = 0;
+        }
+        taps.offset0[i] = s * step;
+        taps.offset1[i] = std::min(s + 1, src_len - 1) * step;
+        taps.weight[i] = f;
+    }
+}
+
+const YoloPreprocessor::Tables& YoloPreprocessor::UpdateTables(
+    const cv::Size& frame_size, bool chroma) {
+    auto it = std::find_if(tables_.begin(), tables_.end(),
+                           [&](const Tables& tables) {
+                               return tables.frame_size == frame_size &&
+                                      tables.chroma == chroma;
+                           });
+    if (it == tables_.end()) {
+        if (tables_.size() < (size_t)kMaxTablesNum) {
+            tables_.emplace_back();
+        }
+        // The least recently used, its buffers are reused
+        it = tables_.end() - 1;
+        it->frame_size = frame_size;
+        it->chroma = chroma;
+        BuildTaps(frame_size.width, input_size_.width, chroma ? 1 : 3, it->x);
+        BuildTaps(frame_size.height, input_size_.height, 1, it->y);
+        if (chroma) {
+            BuildTaps((frame_size.width + 1) / 2, input_size_.width, 1,
+                      it->chroma_x);
+            BuildTaps((frame_size.height + 1) / 2, input_size_.height, 1,
+                      it->chroma_y);
+        }
+    }
+    std::rotate(tables_.begin(), it, it + 1);
+    return tables_.front();
+}
+
+float* YoloPreprocessor::PrepareBlob(cv::Mat& blob, int32_t batch_index,
+                                     int32_t batch_size) {
+    // No-op when the blob already has this shape
+    int sizes[] = {batch_size, 3, input_size_.height, input_size_.width};
+    blob.create(4, sizes, CV_32F);
+    return blob.ptr<float>(batch_index);
+}
+
+void YoloPreprocessor::Process(const cv::Mat& frame, cv::Mat& blob,
+                               int32_t batch_index, int32_t batch_size) {
+    if (frame.type() != CV_8UC3 || frame.empty()) {
+        ERROR("unsupported frame type: %d", frame.type());
+        return;
+    }
+    const auto& tables = UpdateTables(frame.size(), false);
+    const auto& y_taps = tables.y;
+    float* dst = PrepareBlob(blob, batch_index, batch_size);
+
+    const int32_t width = input_size_.width;
+    const int32_t plane = input_size_.area();
+    const int32_t* x0 = tables.x.offset0.data();
+    const int32_t* x1 = tables.x.offset1.data();
+    const float* wx = tables.x.weight.data();
+
+    for (int32_t dy = 0; dy < input_size_.height; dy++) {
+        const uint8_t* row0 = frame.ptr<uint8_t>(y_taps.offset0[dy]);
+        const uint8_t* row1 = frame.ptr<uint8_t>(y_taps.offset1[dy]);
+        const float wy = y_taps.weight[dy];
+        float* r = dst + dy * width;
+        float* g = r + plane;
+        float* b = g + plane;
+        for (int32_t dx = 0; dx < width; dx++) {
+            const uint8_t* p00 = row0 + x0[dx];
+            const uint8_t* p01 = row0 + x1[dx];
+            const uint8_t* p10 = row1 + x0[dx];
+            const uint8_t* p11 = row1 + x1[dx];
+            const float w = wx[dx];
+            float c[3];
+            for (int32_t k = 0; k < 3; k++) {
+                float top = p00[k] + (p01[k] - p00[k]) * w;
+                float bottom = p10[k] + (p11[k] - p10[k]) * w;
+                c[k] = (top + (bottom - top) * wy) * kInputScale;
+            }
+            r[dx] = c[2];
+            g[dx] = c[1];
+            b[dx] = c[0];
+        }
+    }
+}
+
+static inline float SampleBilinear(const uint8_t* row0, const uint8_t* row1,
+                                   int32_t x0, int32_t x1, float wx, float wy) {
+    float top = row0[x0] + (row0[x1] - row0[x0]) * wx;
+    float bottom = row1[x0] + (row1[x1] - row1[x0]) * wx;
+    return top + (bottom - top) * wy;
+}
+
+static inline float ClampUnit(float value) {
+    return value < 0.f ? 0.f : (value > 1.f ? 1.f : value);
+}
+
+void YoloPreprocessor::ProcessI420(const uint8_t* y, int32_t y_stride,
+                                   const uint8_t* u, const uint8_t* v,
+                                   int32_t uv_stride,
+                                   const cv::Size& frame_size, cv::Mat& blob,
+                                   int32_t batch_index, int32_t batch_size) {
+    if (!y || !u || !v || frame_size.area() == 0) {
+        ERROR("invalid i420 frame");
+        return;
+    }
+    const auto& tables = UpdateTables(frame_size, true);
+    const auto& x_taps = tables.x;
+    const auto& y_taps = tables.y;
+    const auto& chroma_x_taps = tables.chroma_x;
+    const auto& chroma_y_taps = tables.chroma_y;
+    float* dst = PrepareBlob(blob, batch_index, batch_size);
+
+    // BT.601 limited range, with the 1/255 input scale folded in
+    const float ky = 1.164f * kInputScale;
+    const float kvr = 1.596f * kInputScale;
+    const float kug = 0.392f * kInputScale;
+    const float kvg = 0.813f * kInputScale;
+    const float kub = 2.017f * kInputScale;
+
+    const int32_t width = input_size_.width;
+    const int32_t plane = input_size_.area();
+
+    for (int32_t dy = 0; dy < input_size_.height; dy++) {
+        const uint8_t* y0 = y + y_taps.offset0[dy] * y_stride;
+        const uint8_t* y1 = y + y_taps.offset1[dy] * y_stride;
+        const uint8_t* u0 = u + chroma_y_taps.offset0[dy] * uv_stride;
+        const uint8_t* u1 = u + chroma_y_taps.offset1[dy] * uv_stride;
+        const uint8_t* v0 = v + chroma_y_taps.offset0[dy] * uv_stride;
+        const uint8_t* v1 = v + chroma_y_taps.offset1[dy] * uv_stride;
+        const float wy = y_taps.weight[dy];
+        const float cwy = chroma_y_taps.weight[dy];
+        float* r = dst + dy * width;
+        float* g = r + plane;
+        float* b = g + plane;
+        for (int32_t dx = 0; dx < width; dx++) {
+            float luma = SampleBilinear(y0, y1, x_taps.offset0[dx],
+                                        x_taps.offset1[dx],
+                                        x_taps.weight[dx], wy) -
+                         16.f;
+            int32_t cx0 = chroma_x_taps.offset0[dx];
+            int32_t cx1 = chroma_x_taps.offset1[dx];
+            float cwx = chroma_x_taps.weight[dx];
+            float cb = SampleBilinear(u0, u1, cx0, cx1, cwx, cwy) - 128.f;
+            float cr = SampleBilinear(v0, v1, cx0, cx1, cwx, cwy) - 128.f;
+            float l = luma * ky;
+            r[dx] = ClampUnit(l + cr * kvr);
+            g[dx] = ClampUnit(l - cb * kug - cr * kvg);
+            b[dx] = ClampUnit(l + cb * kub);
+        }
+    }
+}
+
+}  // namespace edge_app
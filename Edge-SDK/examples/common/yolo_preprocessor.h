@@ -0,0 +1,96 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#ifndef __YOLO_PREPROCESSOR_H__
+#define __YOLO_PREPROCESSOR_H__
+
+#include <cstdint>
+#include <vector>
+
+#include "opencv2/core.hpp"
+
+namespace edge_app {
+
+/*
+ * Builds the network input of a frame in a single pass: bilinear downscale
+ * (same sampling as cv::resize INTER_LINEAR), BGR to RGB, 1/255 scaling and
+ * float conversion are fused per output pixel and written straight into the
+ * planes of a caller-owned blob. The blob is only reallocated when the batch
+ * changes, and the sampling tables are kept for the last few frame sizes (the
+ * inference service alternates lenses, the tiler tiles and full frames), so
+ * steady state is allocation free. Equivalent to
+ * blobFromImage(frame, 1 / 255.0, input_size, Scalar(), true, false).
+ */
+class YoloPreprocessor {
+   public:
+    explicit YoloPreprocessor(const cv::Size& input_size = cv::Size(320, 320));
+
+    // Write |frame| (CV_8UC3 BGR) as image |batch_index| of |blob|
+    // (batch_size x 3 x H x W, CV_32F).
+    void Process(const cv::Mat& frame, cv::Mat& blob, int32_t batch_index = 0,
+                 int32_t batch_size = 1);
+
+    // Same from the I420 planes of a decoded frame of |frame_size|, BT.601
+    // limited range as converted by the decoder, skipping the BGR frame.
+    void ProcessI420(const uint8_t* y, int32_t y_stride, const uint8_t* u,
+                     const uint8_t* v, int32_t uv_stride,
+                     const cv::Size& frame_size, cv::Mat& blob,
+                     int32_t batch_index = 0, int32_t batch_size = 1);
+
+    const cv::Size& InputSize() const { return input_size_; }
+
+   private:
+    // Source offsets and weight of the two taps of every output coordinate
+    struct Taps {
+        std::vector<int32_t> offset0;
+        std::vector<int32_t> offset1;
+        std::vector<float> weight;
+    };
+
+    struct Tables {
+        cv::Size frame_size;
+        bool chroma = false;
+        Taps x;
+        Taps y;
+        Taps chroma_x;
+        Taps chroma_y;
+    };
+
+    enum {
+        kMaxTablesNum = 4,
+    };
+
+    static void BuildTaps(int32_t src_len, int32_t dst_len, int32_t step,
+                          Taps& taps);
+
+    // Tables of |frame_size|, built if not among the last kMaxTablesNum used
+    const Tables& UpdateTables(const cv::Size& frame_size, bool chroma);
+
+    float* PrepareBlob(cv::Mat& blob, int32_t batch_index, int32_t batch_size);
+
+    cv::Size input_size_;
+    // Most recently used first
+    std::vector<Tables> tables_;
+};
+
+}  // namespace edge_app
+
+#endif
@@ -0,0 +1,351 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include "yolo_tiler.h"
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include "logger.h"
+#include "yolo_model_cache.h"
+
+using namespace cv;
+using namespace dnn;
+using namespace edge_sdk;
+
+namespace edge_app {
+
+static YoloPostProcessor::Options PostProcessorOptions(
+    const YoloTiler::Options& options) {
+    YoloPostProcessor::Options post_options;
+    post_options.conf_threshold = options.conf_threshold;
+    post_options.nms_threshold = options.nms_threshold;
+    return post_options;
+}
+
+// |count| spans of equal length covering |length|, neighbours sharing
+// |overlap| of a span.
+static void SplitSpans(int32_t length, int32_t count, float overlap,
+                       std::vector<std::pair<int32_t, int32_t>>& spans) {
+    spans.clear();
+    int32_t span = cvRound(length / (count - (count - 1) * overlap));
+    span = std::min(std::max(span, 1), length);
+    float step = count > 1 ? (float)(length - span) / (count - 1) : 0;
+    for (int32_t i = 0; i < count; i++) {
+        spans.push_back(std::make_pair(cvRound(i * step), span));
+    }
+}
+
+YoloTiler::Worker::Worker(const Options& options)
+    : preprocessor(Size(options.input_width, options.input_height)),
+      post_processor(PostProcessorOptions(options)) {}
+
+YoloTiler::YoloTiler(const Options& options) : options_(options) {
+    options_.columns = std::max(options_.columns, 1);
+    options_.rows = std::max(options_.rows, 1);
+    options_.overlap = std::min(std::max(options_.overlap, 0.f), 0.9f);
+    next_job_ = 0;
+}
+
+YoloTiler::~YoloTiler() { DeInit(); }
+
+int32_t YoloTiler::Init() {
+    if (!workers_.empty()) {
+        WARN("repeat init yolo tiler");
+        return -1;
+    }
+
+    int32_t job_num =
+        options_.columns * options_.rows + (options_.full_frame ? 1 : 0);
+    int32_t thread_num = options_.thread_num > 0
+                             ? options_.thread_num
+                             : (int32_t)std::thread::hardware_concurrency();
+    thread_num = options_.batch ? 1 : std::min(std::max(thread_num, 1), job_num);
+
+    auto start = getTickCount();
+    for (int32_t i = 0; i < thread_num; i++) {
+        std::unique_ptr<Worker> worker(new Worker(options_));
+        if (YoloModelCache::Instance()->Load(options_.model_name,
+                                             worker->net) != 0) {
+            DeInit();
+            return -1;
+        }
+        worker->out_names = worker->net.getUnconnectedOutLayersNames();
+        WarmUpYoloNet(worker->net,
+                      Size(options_.input_width, options_.input_height),
+                      options_.batch ? job_num : 1);
+        workers_.push_back(std::move(worker));
+    }
+
+    {
+        std::lock_guard<std::mutex> l(worker_mutex_);
+        worker_start_ = true;
+    }
+    // The thread calling Detect is worker 0
+    for (int32_t i = 1; i < thread_num; i++) {
+        workers_[i]->thread = std::thread(&YoloTiler::WorkerLoop, this, i);
+    }
+    INFO("yolo tiler ready in %.1f ms: %dx%d tiles, overlap %.2f, %s, %d "
+         "threads, budget %.1f ms",
+         (getTickCount() - start) * 1000.0 / getTickFrequency(),
+         options_.columns, options_.rows, options_.overlap,
+         options_.batch ? "batched" : "parallel", thread_num,
+         options_.time_budget_ms);
+    return 0;
+}
+
+int32_t YoloTiler::DeInit() {
+    {
+        std::lock_guard<std::mutex> l(worker_mutex_);
+        worker_start_ = false;
+    }
+    start_cv_.notify_all();
+    for (auto& worker : workers_) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+        YoloModelCache::Instance()->Release(options_.model_name, worker->net);
+    }
+    workers_.clear();
+    return 0;
+}
+
+void YoloTiler::UpdateTiles(const cv::Size& frame_size) {
+    if (frame_size == frame_size_) return;
+    frame_size_ = frame_size;
+    first_tile_ = 0;
+
+    std::vector<std::pair<int32_t, int32_t>> columns, rows;
+    SplitSpans(frame_size.width, options_.columns, options_.overlap, columns);
+    SplitSpans(frame_size.height, options_.rows, options_.overlap, rows);
+    tiles_.clear();
+    for (const auto& row : rows) {
+        for (const auto& column : columns) {
+            tiles_.push_back(
+                Rect(column.first, row.first, column.second, row.second));
+        }
+    }
+}
+
+// The full frame and the first tile always run, so that every frame gets a
+// result and the tile rotation always moves forward.
+int32_t YoloTiler::RequiredJobs() const {
+    return std::min((int32_t)jobs_.size(), options_.full_frame ? 2 : 1);
+}
+
+void YoloTiler::PrepareJobs() {
+    size_t job_num = tiles_.size() + (options_.full_frame ? 1 : 0);
+    jobs_.resize(job_num);
+    size_t index = 0;
+    if (options_.full_frame) {
+        jobs_[index].rect = Rect(Point(0, 0), frame_size_);
+        jobs_[index].is_tile = false;
+        index++;
+    }
+    for (size_t i = 0; i < tiles_.size(); i++, index++) {
+        jobs_[index].rect = tiles_[(first_tile_ + i) % tiles_.size()];
+        jobs_[index].is_tile = true;
+    }
+    for (auto& job : jobs_) {
+        job.done = false;
+        job.detections.clear();
+    }
+}
+
+static void OffsetDetections(const Point& offset,
+                             std::vector<YoloDetection>& detections) {
+    for (auto& det : detections) {
+        det.box += offset;
+    }
+}
+
+void YoloTiler::RunJobs(Worker& worker) {
+    while (true) {
+        int32_t index = next_job_++;
+        if (index >= (int32_t)jobs_.size()) break;
+        if (deadline_tick_ != 0 && index >= RequiredJobs() &&
+            getTickCount() > deadline_tick_) {
+            continue;
+        }
+        Job& job = jobs_[index];
+        worker.preprocessor.Process((*frame_)(job.rect), worker.blob);
+        worker.net.setInput(worker.blob);
+        worker.net.forward(worker.outs, worker.out_names);
+        worker.post_processor.Process(worker.outs, 0, 1, job.rect.size(),
+                                      job.detections);
+        OffsetDetections(job.rect.tl(), job.detections);
+        job.done = true;
+    }
+}
+
+void YoloTiler::InferBatch(Worker& worker) {
+    int32_t batch_size = (int32_t)jobs_.size();
+    if (options_.time_budget_ms > 0 && tile_ms_ > 0) {
+        batch_size = std::min(
+            batch_size, std::max(RequiredJobs(),
+                                 (int32_t)(options_.time_budget_ms / tile_ms_)));
+    }
+    for (int32_t i = 0; i < batch_size; i++) {
+        worker.preprocessor.Process((*frame_)(jobs_[i].rect), worker.blob, i,
+                                    batch_size);
+    }
+
+    auto start = getTickCount();
+    worker.net.setInput(worker.blob);
+    worker.net.forward(worker.outs, worker.out_names);
+    double ms = (getTickCount() - start) * 1000.0 / getTickFrequency();
+    tile_ms_ = tile_ms_ == 0 ? ms / batch_size
+                             : tile_ms_ * 0.8 + ms / batch_size * 0.2;
+
+    for (int32_t i = 0; i < batch_size; i++) {
+        Job& job = jobs_[i];
+        worker.post_processor.Process(worker.outs, i, batch_size,
+                                      job.rect.size(), job.detections);
+        OffsetDetections(job.rect.tl(), job.detections);
+        job.done = true;
+    }
+}
+
+void YoloTiler::WorkerLoop(int32_t index) {
+    char name[16];
+    snprintf(name, sizeof(name), "yolotile%d", index);
+    pthread_setname_np(pthread_self(), name);
+
+    uint64_t generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> l(worker_mutex_);
+            start_cv_.wait(l, [&] {
+                return generation_ != generation || !worker_start_;
+            });
+            if (!worker_start_) break;
+            generation = generation_;
+        }
+        RunJobs(*workers_[index]);
+        {
+            std::lock_guard<std::mutex> l(worker_mutex_);
+            if (--pending_workers_ == 0) done_cv_.notify_one();
+        }
+    }
+}
+
+void YoloTiler::Merge(std::vector<YoloDetection>& detections) {
+    candidates_.clear();
+    for (const auto& job : jobs_) {
+        if (job.done) {
+            candidates_.insert(candidates_.end(), job.detections.begin(),
+                               job.detections.end());
+        }
+    }
+    std::stable_sort(candidates_.begin(), candidates_.end(),
+                     [](const YoloDetection& a, const YoloDetection& b) {
+                         return a.confidence > b.confidence;
+                     });
+
+    detections.clear();
+    for (const auto& candidate : candidates_) {
+        bool keep = true;
+        for (const auto& kept : detections) {
+            if (kept.class_id != candidate.class_id) continue;
+            float inter = (kept.box & candidate.box).area();
+            if (inter <= 0) continue;
+            float area = candidate.box.area();
+            float kept_area = kept.box.area();
+            float iou = inter / (area + kept_area - inter);
+            float ios = inter / std::min(area, kept_area);
+            if (iou > options_.nms_threshold ||
+                ios > options_.merge_threshold) {
+                keep = false;
+                break;
+            }
+        }
+        if (keep) detections.push_back(candidate);
+    }
+}
+
+int32_t YoloTiler::Detect(const cv::Mat& frame,
+                          std::vector<YoloDetection>& detections,
+                          double* inference_ms) {
+    if (workers_.empty() || frame.empty()) {
+        detections.clear();
+        return -1;
+    }
+
+    auto start = getTickCount();
+    UpdateTiles(frame.size());
+    PrepareJobs();
+    frame_ = &frame;
+    deadline_tick_ =
+        options_.time_budget_ms > 0
+            ? start + (int64_t)(options_.time_budget_ms *
+                                getTickFrequency() / 1000)
+            : 0;
+
+    if (options_.batch) {
+        InferBatch(*workers_[0]);
+    } else {
+        next_job_ = 0;
+        {
+            std::lock_guard<std::mutex> l(worker_mutex_);
+            generation_++;
+            pending_workers_ = (int32_t)workers_.size() - 1;
+        }
+        start_cv_.notify_all();
+        RunJobs(*workers_[0]);
+        std::unique_lock<std::mutex> l(worker_mutex_);
+        done_cv_.wait(l, [&] { return pending_workers_ == 0; });
+    }
+    frame_ = nullptr;
+
+    // Start the next frame with the first tile the budget cut off
+    int32_t tile_index = 0;
+    int32_t first_skipped = -1;
+    for (const auto& job : jobs_) {
+        if (!job.is_tile) continue;
+        if (job.done) {
+            tile_counter_++;
+        } else {
+            skipped_tile_counter_++;
+            if (first_skipped < 0) first_skipped = tile_index;
+        }
+        tile_index++;
+    }
+    if (first_skipped > 0) {
+        first_tile_ = (first_tile_ + first_skipped) % tiles_.size();
+    }
+
+    Merge(detections);
+
+    double ms = (getTickCount() - start) * 1000.0 / getTickFrequency();
+    if (inference_ms) *inference_ms = ms;
+    if (++frame_counter_ % 300 == 0) {
+        INFO("yolo tiler: %llu frames, %.2f tiles/frame, %llu tiles skipped",
+             (unsigned long long)frame_counter_,
+             (double)tile_counter_ / frame_counter_,
+             (unsigned long long)skipped_tile_counter_);
+    }
+    return 0;
+}
+
+}  // namespace edge_app
@@ -0,0 +1,156 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#ifndef __YOLO_TILER_H__
+#define __YOLO_TILER_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "opencv2/dnn.hpp"
+#include "yolo_detection.h"
+#include "yolo_post_processor.h"
+#include "yolo_preprocessor.h"
+
+namespace edge_app {
+
+/*
+ * Tiled inference for small objects: the frame is split into a grid of
+ * overlapping tiles, each inferred at the full network input size, and the
+ * detections are merged back with a cross-tile NMS. Tiles are inferred either
+ * in parallel, one net per worker thread (the calling thread being worker 0),
+ * or stacked into one batch on a single net.
+ *
+ * With a time budget, the tiles not started in time are skipped and become
+ * the first ones of the next frame, so the whole frame is still covered over
+ * a few frames.
+ */
+class YoloTiler {
+   public:
+    struct Options {
+        std::string model_name = "yolo-fastest-1.1-xl";
+        int32_t input_width = 320;
+        int32_t input_height = 320;
+        int32_t columns = 3;
+        int32_t rows = 2;
+        // Fraction of a tile shared with its neighbour
+        float overlap = 0.2;
+        // Also infer the whole frame, for the objects larger than a tile
+        bool full_frame = true;
+        // Parallel workers, 0 is one per core, capped by the tile count
+        int32_t thread_num = 0;
+        // One batched forward on a single net instead of parallel workers
+        bool batch = false;
+        // 0 infers every tile on every frame
+        float time_budget_ms = 0;
+        float conf_threshold = 0.5;
+        float nms_threshold = 0.4;
+        // Boxes cut by a tile border are merged into the full box when this
+        // fraction of the smaller one lies inside the other.
+        float merge_threshold = 0.7;
+    };
+
+    explicit YoloTiler(const Options& options);
+
+    ~YoloTiler();
+
+    int32_t Init();
+
+    int32_t DeInit();
+
+    // |inference_ms| receives the wall time of the whole frame.
+    int32_t Detect(const cv::Mat& frame, std::vector<YoloDetection>& detections,
+                   double* inference_ms = nullptr);
+
+    const Options& GetOptions() const { return options_; }
+
+   private:
+    struct Worker {
+        explicit Worker(const Options& options);
+
+        cv::dnn::Net net;
+        std::vector<cv::String> out_names;
+        YoloPreprocessor preprocessor;
+        YoloPostProcessor post_processor;
+        cv::Mat blob;
+        std::vector<cv::Mat> outs;
+        std::thread thread;
+    };
+
+    struct Job {
+        cv::Rect rect;
+        bool is_tile;
+        bool done;
+        std::vector<YoloDetection> detections;
+    };
+
+    void UpdateTiles(const cv::Size& frame_size);
+
+    void PrepareJobs();
+
+    int32_t RequiredJobs() const;
+
+    void RunJobs(Worker& worker);
+
+    void InferBatch(Worker& worker);
+
+    void WorkerLoop(int32_t index);
+
+    void Merge(std::vector<YoloDetection>& detections);
+
+    Options options_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+
+    cv::Size frame_size_;
+    std::vector<cv::Rect> tiles_;
+    // Tile the next frame starts with, rotated when the budget cuts a frame
+    int32_t first_tile_ = 0;
+    std::vector<Job> jobs_;
+    std::vector<YoloDetection> candidates_;
+
+    // Current frame, shared with the worker threads
+    const cv::Mat* frame_ = nullptr;
+    int64_t deadline_tick_ = 0;
+    std::atomic<int32_t> next_job_;
+
+    std::mutex worker_mutex_;
+    std::condition_variable start_cv_;
+    std::condition_variable done_cv_;
+    uint64_t generation_ = 0;
+    int32_t pending_workers_ = 0;
+    bool worker_start_ = false;
+
+    // Batch mode: tiles a budget affords, from the measured cost per tile
+    double tile_ms_ = 0;
+
+    uint64_t frame_counter_ = 0;
+    uint64_t tile_counter_ = 0;
+    uint64_t skipped_tile_counter_ = 0;
+};
+
+}  // namespace edge_app
+
+#endif
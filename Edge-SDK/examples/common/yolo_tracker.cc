@@ -0,0 +1,169 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include "yolo_tracker.h"
+
+#include <algorithm>
+#include <opencv2/imgproc.hpp>
+
+namespace edge_app {
+
+static float BoxIou(const cv::Rect2f& a, const cv::Rect2f& b) {
+    float iw = std::min(a.x + a.width, b.x + b.width) - std::max(a.x, b.x);
+    float ih = std::min(a.y + a.height, b.y + b.height) - std::max(a.y, b.y);
+    if (iw <= 0 || ih <= 0) return 0;
+    float inter = iw * ih;
+    float uni = a.width * a.height + b.width * b.height - inter;
+    return uni > 0 ? inter / uni : 0;
+}
+
+YoloTracker::YoloTracker() : YoloTracker(Options()) {}
+
+YoloTracker::YoloTracker(const Options& options) : options_(options) {}
+
+void YoloTracker::Reset() { tracks_.clear(); }
+
+void YoloTracker::Step() {
+    for (auto& track : tracks_) {
+        track.cx += track.vx;
+        track.cy += track.vy;
+        track.frames_since_update++;
+    }
+}
+
+void YoloTracker::Predict(std::vector<YoloDetection>& detections) {
+    Step();
+    detections.clear();
+    for (const auto& track : tracks_) {
+        if (track.missed > 0) continue;
+        YoloDetection det;
+        det.class_id = track.class_id;
+        det.confidence = track.confidence;
+        det.box = cv::Rect((int)(track.cx - track.w / 2),
+                           (int)(track.cy - track.h / 2), (int)track.w,
+                           (int)track.h);
+        det.track_id = track.id;
+        detections.push_back(det);
+    }
+}
+
+void YoloTracker::Update(std::vector<YoloDetection>& detections) {
+    Step();
+
+    struct Match {
+        float iou;
+        size_t track;
+        size_t detection;
+    };
+    std::vector<Match> matches;
+    for (size_t t = 0; t < tracks_.size(); t++) {
+        const auto& track = tracks_[t];
+        cv::Rect2f predicted(track.cx - track.w / 2, track.cy - track.h / 2,
+                             track.w, track.h);
+        for (size_t d = 0; d < detections.size(); d++) {
+            if (detections[d].class_id != track.class_id) continue;
+            const auto& box = detections[d].box;
+            float iou = BoxIou(predicted, cv::Rect2f((float)box.x, (float)box.y,
+                                                     (float)box.width,
+                                                     (float)box.height));
+            if (iou > options_.iou_threshold) {
+                matches.push_back({iou, t, d});
+            }
+        }
+    }
+    std::sort(matches.begin(), matches.end(),
+              [](const Match& a, const Match& b) { return a.iou > b.iou; });
+
+    std::vector<bool> track_matched(tracks_.size(), false);
+    std::vector<bool> detection_matched(detections.size(), false);
+    for (const auto& match : matches) {
+        if (track_matched[match.track] || detection_matched[match.detection]) {
+            continue;
+        }
+        track_matched[match.track] = true;
+        detection_matched[match.detection] = true;
+
+        auto& track = tracks_[match.track];
+        auto& det = detections[match.detection];
+        float mx = det.box.x + det.box.width / 2.f;
+        float my = det.box.y + det.box.height / 2.f;
+        float rx = mx - track.cx;
+        float ry = my - track.cy;
+        track.cx += options_.position_gain * rx;
+        track.cy += options_.position_gain * ry;
+        track.vx += options_.velocity_gain * rx / track.frames_since_update;
+        track.vy += options_.velocity_gain * ry / track.frames_since_update;
+        track.w += options_.position_gain * (det.box.width - track.w);
+        track.h += options_.position_gain * (det.box.height - track.h);
+        track.confidence = det.confidence;
+        track.frames_since_update = 0;
+        track.missed = 0;
+        det.track_id = track.id;
+    }
+
+    for (size_t t = 0; t < tracks_.size(); t++) {
+        if (!track_matched[t]) tracks_[t].missed++;
+    }
+    tracks_.erase(std::remove_if(tracks_.begin(), tracks_.end(),
+                                 [&](const Track& track) {
+                                     return track.missed >
+                                            options_.max_missed_detections;
+                                 }),
+                  tracks_.end());
+
+    for (size_t d = 0; d < detections.size(); d++) {
+        if (detection_matched[d]) continue;
+        auto& det = detections[d];
+        Track track;
+        track.id = next_track_id_++;
+        track.class_id = det.class_id;
+        track.confidence = det.confidence;
+        track.cx = det.box.x + det.box.width / 2.f;
+        track.cy = det.box.y + det.box.height / 2.f;
+        track.w = (float)det.box.width;
+        track.h = (float)det.box.height;
+        track.vx = 0;
+        track.vy = 0;
+        track.frames_since_update = 0;
+        track.missed = 0;
+        tracks_.push_back(track);
+        det.track_id = track.id;
+    }
+}
+
+bool SceneChangeDetector::Check(const cv::Mat& frame) {
+    cv::Mat thumbnail;
+    cv::resize(frame, thumbnail, cv::Size(64, 36), 0, 0, cv::INTER_AREA);
+    if (thumbnail.channels() == 3) {
+        cv::cvtColor(thumbnail, current_, cv::COLOR_BGR2GRAY);
+    } else {
+        current_ = thumbnail;
+    }
+    if (reference_.empty() || reference_.size() != current_.size()) {
+        return true;
+    }
+    cv::absdiff(current_, reference_, diff_);
+    return cv::mean(diff_)[0] > threshold_;
+}
+
+void SceneChangeDetector::UpdateReference() { current_.copyTo(reference_); }
+
+}  // namespace edge_app
@@ -0,0 +1,110 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#ifndef __YOLO_TRACKER_H__
+#define __YOLO_TRACKER_H__
+
+#include <cstdint>
+#include <vector>
+
+#include "opencv2/core.hpp"
+#include "yolo_detection.h"
+
+namespace edge_app {
+
+/*
+ * IoU tracker with a constant-velocity (alpha-beta) motion model. It keeps
+ * stable track ids across detections and propagates the boxes on the frames
+ * where the detector is skipped.
+ */
+class YoloTracker {
+   public:
+    struct Options {
+        float iou_threshold = 0.3;
+        // Detection rounds a track survives without being matched
+        int32_t max_missed_detections = 2;
+        float position_gain = 0.6;
+        float velocity_gain = 0.3;
+    };
+
+    YoloTracker();
+
+    explicit YoloTracker(const Options& options);
+
+    // Advance the tracks to the current frame, associate them with fresh
+    // detections and write the track ids into |detections|.
+    void Update(std::vector<YoloDetection>& detections);
+
+    // Advance the tracks to the current frame without a detection;
+    // |detections| receives the predicted boxes of the live tracks.
+    void Predict(std::vector<YoloDetection>& detections);
+
+    void Reset();
+
+    size_t TrackCount() const { return tracks_.size(); }
+
+   private:
+    struct Track {
+        int32_t id;
+        int32_t class_id;
+        float confidence;
+        float cx, cy, w, h;
+        float vx, vy;
+        int32_t frames_since_update;
+        int32_t missed;
+    };
+
+    void Step();
+
+    Options options_;
+    std::vector<Track> tracks_;
+    int32_t next_track_id_ = 0;
+};
+
+/*
+ * Compares a small grayscale thumbnail of each frame with the one taken at
+ * the last detection, so that the detector can be re-run early when the view
+ * changes (lens switch, fast gimbal move).
+ */
+class SceneChangeDetector {
+   public:
+    explicit SceneChangeDetector(double threshold = 20.0)
+        : threshold_(threshold) {}
+
+    // Returns true when |frame| differs from the reference by more than the
+    // threshold (mean absolute difference on 0..255).
+    bool Check(const cv::Mat& frame);
+
+    // Use the thumbnail of the last checked frame as the new reference.
+    void UpdateReference();
+
+    void SetThreshold(double threshold) { threshold_ = threshold; }
+
+   private:
+    double threshold_;
+    cv::Mat reference_;
+    cv::Mat current_;
+    cv::Mat diff_;
+};
+
+}  // namespace edge_app
+
+#endif
@@ -0,0 +1,296 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include "async_log_sink.h"
+
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace edge_sdk {
+
+namespace {
+
+// Writer's sleep when idle, a missed wake only delays the output this long
+const int64_t kWriterIdleNs = 100 * 1000 * 1000;
+
+int64_t CoarseTimeUs() {
+    // vDSO, no system call
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void FutexWait(std::atomic<uint32_t>* word, uint32_t value, int64_t ns) {
+    struct timespec ts = {(time_t)(ns / 1000000000), (long)(ns % 1000000000)};
+    syscall(SYS_futex, (uint32_t*)word, FUTEX_WAIT_PRIVATE, value, &ts,
+            nullptr, 0);
+}
+
+void FutexWake(std::atomic<uint32_t>* word) {
+    syscall(SYS_futex, (uint32_t*)word, FUTEX_WAKE_PRIVATE, 1, nullptr,
+            nullptr, 0);
+}
+
+}  // namespace
+
+AsyncLogSink::AsyncLogSink(const Options& options) : options_(options) {
+    uint64_t size = 1;
+    while (size < options_.ring_size) size <<= 1;
+    mask_ = size - 1;
+    options_.line_size = std::max<uint32_t>(options_.line_size, 64);
+    if (options_.lines_per_second == 0) options_.lines_per_second = 1;
+    if (options_.burst == 0) options_.burst = 1;
+
+    slots_.reset(new Slot[size]);
+    for (uint64_t i = 0; i < size; i++) {
+        slots_[i].sequence.store(i, std::memory_order_relaxed);
+        slots_[i].length = 0;
+    }
+    lines_.reset(new char[size * options_.line_size]);
+    writer_ = std::thread(&AsyncLogSink::WriterLoop, this);
+}
+
+AsyncLogSink::~AsyncLogSink() {
+    stop_ = true;
+    wake_.fetch_add(1);
+    FutexWake(&wake_);
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+}
+
+ErrorCode AsyncLogSink::Write(const uint8_t* data, uint32_t length) {
+    const char* text = (const char*)data;
+    // The SDK hands C strings, possibly with their terminator
+    length = strnlen(text, length);
+    if (length == 0) {
+        return kOk;
+    }
+
+    uint32_t suppressed = 0;
+    Site* site = FindSite(text, length);
+    if (site && !Admit(site, &suppressed)) {
+        return kOk;
+    }
+    if (!Push(text, length, suppressed)) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return kOk;
+    }
+
+    // Pairs with the fence of the writer going to sleep
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    WakeWriter();
+    return kOk;
+}
+
+void AsyncLogSink::WakeWriter() {
+    // One system call per sleep of the writer, not per line
+    if (sleeping_.load(std::memory_order_relaxed) &&
+        sleeping_.exchange(false)) {
+        wake_.fetch_add(1);
+        FutexWake(&wake_);
+    }
+}
+
+void AsyncLogSink::Flush(int32_t timeout_ms) {
+    uint64_t target = enqueue_position_.load();
+    for (int32_t i = 0; i < timeout_ms && written_.load() < target; i++) {
+        WakeWriter();
+        usleep(1000);
+    }
+}
+
+AsyncLogSink::Site* AsyncLogSink::FindSite(const char* text,
+                                           uint32_t length) {
+    // "[function:line)" as written by the logger macros, after whatever
+    // the SDK prefixes
+    const char* end = (const char*)memchr(text, ')', length);
+    const char* begin = nullptr;
+    if (end) {
+        for (const char* p = end; p > text; p--) {
+            if (p[-1] == '[') {
+                begin = p;
+                break;
+            }
+        }
+    }
+    if (!begin || !memchr(begin, ':', end - begin)) {
+        return nullptr;
+    }
+
+    // FNV-1a, 0 marks a free slot
+    uint64_t key = 14695981039346656037ull;
+    for (const char* p = begin; p < end; p++) {
+        key = (key ^ (uint8_t)*p) * 1099511628211ull;
+    }
+    if (key == 0) key = 1;
+
+    for (uint32_t i = 0; i < kSiteProbes; i++) {
+        Site& site = sites_[(key + i) % kSiteCount];
+        uint64_t current = site.key.load(std::memory_order_acquire);
+        if (current == key) {
+            return &site;
+        }
+        if (current == 0 && site.key.compare_exchange_strong(current, key)) {
+            return &site;
+        }
+        // Claimed meanwhile, maybe by another thread on the same site
+        if (current == key) {
+            return &site;
+        }
+    }
+    return nullptr;
+}
+
+bool AsyncLogSink::Admit(Site* site, uint32_t* suppressed) {
+    int64_t interval_us = 1000000 / options_.lines_per_second;
+    int64_t tolerance_us = interval_us * (options_.burst - 1);
+    int64_t now_us = CoarseTimeUs();
+    int64_t tat_us = site->tat_us.load(std::memory_order_relaxed);
+    while (true) {
+        int64_t base_us = std::max(tat_us, now_us);
+        if (base_us - now_us > tolerance_us) {
+            site->suppressed.fetch_add(1, std::memory_order_relaxed);
+            suppressed_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if (site->tat_us.compare_exchange_weak(tat_us, base_us + interval_us,
+                                               std::memory_order_relaxed)) {
+            break;
+        }
+    }
+    *suppressed = site->suppressed.exchange(0, std::memory_order_relaxed);
+    return true;
+}
+
+bool AsyncLogSink::Push(const char* text, uint32_t length,
+                        uint32_t suppressed) {
+    // Bounded MPMC queue of D. Vyukov, with one consumer
+    uint64_t position = enqueue_position_.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+        slot = &slots_[position & mask_];
+        uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+        int64_t diff = (int64_t)(sequence - position);
+        if (diff == 0) {
+            if (enqueue_position_.compare_exchange_weak(
+                    position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            position = enqueue_position_.load(std::memory_order_relaxed);
+        }
+    }
+
+    char* line = &lines_[(position & mask_) * options_.line_size];
+    uint32_t size = options_.line_size;
+    // The newline stays last, after the notes added here
+    uint32_t newline = text[length - 1] == '\n' ? 1 : 0;
+    uint32_t body = length - newline;
+    // Room for the notes
+    bool truncated = body > size - 48;
+    if (truncated) body = size - 48;
+    memcpy(line, text, body);
+    uint32_t used = body;
+    if (suppressed) {
+        used += snprintf(line + used, size - used, " (%u similar suppressed)",
+                         suppressed);
+    }
+    if (truncated) {
+        used += snprintf(line + used, size - used, "...");
+    }
+    if (newline || truncated) {
+        line[used++] = '\n';
+    }
+    slot->length = used;
+
+    slot->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+bool AsyncLogSink::Pop(char* text, uint32_t* length) {
+    Slot& slot = slots_[dequeue_position_ & mask_];
+    uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence != dequeue_position_ + 1) {
+        return false;
+    }
+    *length = slot.length;
+    memcpy(text, &lines_[(dequeue_position_ & mask_) * options_.line_size],
+           slot.length);
+    slot.sequence.store(dequeue_position_ + mask_ + 1,
+                        std::memory_order_release);
+    dequeue_position_++;
+    return true;
+}
+
+void AsyncLogSink::WriterLoop() {
+    pthread_setname_np(pthread_self(), "logwriter");
+    // Not inheriting SCHED_FIFO from the thread that created the sink
+    sched_param param = {};
+    pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), options_.writer_nice);
+
+    std::unique_ptr<char[]> line(new char[options_.line_size]);
+    uint32_t length = 0;
+    uint64_t dropped_reported = 0;
+    while (true) {
+        if (Pop(line.get(), &length)) {
+            fwrite(line.get(), 1, length, options_.output);
+            written_.fetch_add(1);
+            continue;
+        }
+
+        uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+        if (dropped != dropped_reported) {
+            fprintf(options_.output, "[log] %llu lines dropped, ring full\n",
+                    (unsigned long long)(dropped - dropped_reported));
+            dropped_reported = dropped;
+        }
+        fflush(options_.output);
+        if (stop_) {
+            break;
+        }
+
+        uint32_t wake = wake_.load();
+        sleeping_.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint64_t sequence = slots_[dequeue_position_ & mask_].sequence.load(
+            std::memory_order_relaxed);
+        if (sequence == dequeue_position_ + 1 || stop_) {
+            sleeping_.store(false);
+            continue;
+        }
+        FutexWait(&wake_, wake, kWriterIdleNs);
+        sleeping_.store(false);
+    }
+}
+
+}  // namespace edge_sdk
@@ -0,0 +1,137 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#ifndef __ASYNC_LOG_SINK_H__
+#define __ASYNC_LOG_SINK_H__
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <thread>
+
+#include "error_code.h"
+
+namespace edge_sdk {
+
+/*
+ * Console output of the SDK logger that never blocks the logging thread,
+ * which may be a SCHED_FIFO decode or processing thread. Write() copies the
+ * line into a lock-free ring (many producers, one consumer) and returns; a
+ * writer thread at low priority prints it.
+ *
+ * Lines are rate limited per call site, the "[function:line)" prefix of the
+ * logger macros: a burst, then a steady rate. The next line let through
+ * tells how many were suppressed, and the writer reports lines dropped
+ * because the ring was full.
+ */
+class AsyncLogSink {
+   public:
+    struct Options {
+        // Lines buffered, rounded up to a power of two
+        uint32_t ring_size = 1024;
+        // Longer lines are truncated
+        uint32_t line_size = 512;
+        // Per call site
+        uint32_t burst = 10;
+        uint32_t lines_per_second = 2;
+        // Nice value of the writer thread
+        int32_t writer_nice = 10;
+        FILE* output = stdout;
+    };
+
+    explicit AsyncLogSink(const Options& options);
+
+    // Writes what is queued and stops the writer
+    ~AsyncLogSink();
+
+    // From any thread, never blocks
+    ErrorCode Write(const uint8_t* data, uint32_t length);
+
+    // Waits up to |timeout_ms| for the lines queued so far to be written
+    void Flush(int32_t timeout_ms = 1000);
+
+    // Lines lost to a full ring
+    uint64_t Dropped() const { return dropped_; }
+
+    // Lines held back by the per call site limit
+    uint64_t Suppressed() const { return suppressed_; }
+
+   private:
+    enum {
+        kSiteCount = 256,
+        // Slots of the site table tried for one call site
+        kSiteProbes = 16,
+    };
+
+    struct Slot {
+        std::atomic<uint64_t> sequence;
+        uint32_t length;
+    };
+
+    struct Site {
+        std::atomic<uint64_t> key{0};
+        // Theoretical arrival time of the next line, GCRA
+        std::atomic<int64_t> tat_us{0};
+        std::atomic<uint32_t> suppressed{0};
+    };
+
+    // Site of the line, nullptr if the table is full
+    Site* FindSite(const char* text, uint32_t length);
+
+    // Whether the site may log now; |suppressed| is set to the lines held
+    // back before this one
+    bool Admit(Site* site, uint32_t* suppressed);
+
+    bool Push(const char* text, uint32_t length, uint32_t suppressed);
+
+    bool Pop(char* text, uint32_t* length);
+
+    void WakeWriter();
+
+    void WriterLoop();
+
+    Options options_;
+    uint64_t mask_;
+    std::unique_ptr<Slot[]> slots_;
+    std::unique_ptr<char[]> lines_;
+    Site sites_[kSiteCount];
+
+    std::atomic<uint64_t> enqueue_position_{0};
+    // Keeps the producers' and the writer's positions on separate cache
+    // lines (no over-aligned new in C++14)
+    char padding_[64];
+    uint64_t dequeue_position_ = 0;
+    std::atomic<uint64_t> written_{0};
+
+    // The writer sleeps on |wake_| (futex) while |sleeping_|
+    std::atomic<uint32_t> wake_{0};
+    std::atomic<bool> sleeping_{false};
+    std::atomic<bool> stop_{false};
+    std::thread writer_;
+
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> suppressed_{0};
+};
+
+}  // namespace edge_sdk
+
+#endif
@@ -23,15 +23,27 @@
 #include <iostream>
 
 #include "app_info.h"
+#include "async_log_sink.h"
 #include "init.h"
 #include "key_store_default.h"
 #include "logger.h"
 
 using namespace edge_sdk;
 
-static ErrorCode PrintConsoleFunc(const uint8_t* data, uint16_t dataLen) {
-    printf("%s", data);
-    return kOk;
+// The SDK logs from any thread, the SCHED_FIFO decode and processing ones
+// included: the console output goes through a ring to a low priority
+// writer. Never destroyed, SDK threads may log until the process exits.
+static AsyncLogSink* ConsoleSink() {
+    static AsyncLogSink* sink = [] {
+        auto sink = new AsyncLogSink(AsyncLogSink::Options());
+        atexit([] { ConsoleSink()->Flush(); });
+        return sink;
+    }();
+    return sink;
+}
+
+static ErrorCode PrintConsoleFunc(const uint8_t* data, uint32_t dataLen) {
+    return ConsoleSink()->Write(data, dataLen);
 }
 
 static ErrorCode InitOptions(Options& option) {
@@ -49,6 +61,8 @@ static ErrorCode InitOptions(Options& option) {
         std::string((char*)USER_APP_LICENSE, strlen(USER_APP_LICENSE));
 
     option.app_info = app_info;
+    // Created here, not by the first thread to log
+    ConsoleSink();
     LoggerConsole console = {kLevelDebug, PrintConsoleFunc, true};
     option.logger_console_lists.push_back(console);
 
@@ -67,5 +81,9 @@ ErrorCode ESDKInit() {
     return rc;
 }
 
-ErrorCode ESDKDeInit() { return ESDKInit::Instance()->DeInit(); }
+ErrorCode ESDKDeInit() {
+    auto rc = ESDKInit::Instance()->DeInit();
+    ConsoleSink()->Flush();
+    return rc;
+}
 
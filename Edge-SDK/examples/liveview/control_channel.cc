@@ -0,0 +1,247 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include "control_channel.h"
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+#include "logger.h"
+
+using namespace edge_sdk;
+
+namespace edge_app {
+
+namespace {
+
+uint32_t LoadAcquire(const uint32_t* p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+void StoreRelease(uint32_t* p, uint32_t v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+// Shared, not FUTEX_PRIVATE: the writer is another process
+long Futex(uint32_t* addr, int op, uint32_t value) {
+    return syscall(SYS_futex, addr, op, value, nullptr, nullptr, 0);
+}
+
+}  // namespace
+
+ControlChannel::ControlChannel(const std::string& name) : name_(name) {}
+
+ControlChannel::~ControlChannel() {
+    Stop();
+    if (block_) {
+        munmap(block_, sizeof(ControlBlock));
+        block_ = nullptr;
+    }
+}
+
+int32_t ControlChannel::Open() {
+    if (block_) {
+        return 0;
+    }
+    int fd = shm_open(name_.c_str(), O_RDWR | O_CREAT, 0666);
+    if (fd < 0) {
+        ERROR("shm_open %s failed: %s", name_.c_str(), strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        ((size_t)st.st_size < sizeof(ControlBlock) &&
+         ftruncate(fd, sizeof(ControlBlock)) != 0)) {
+        ERROR("sizing %s failed: %s", name_.c_str(), strerror(errno));
+        close(fd);
+        return -1;
+    }
+    void* addr = mmap(nullptr, sizeof(ControlBlock), PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+    // The mapping stays valid without the descriptor
+    close(fd);
+    if (addr == MAP_FAILED) {
+        ERROR("mmap %s failed: %s", name_.c_str(), strerror(errno));
+        return -1;
+    }
+    block_ = (ControlBlock*)addr;
+
+    if (LoadAcquire(&block_->magic) != ControlBlock::kMagic ||
+        block_->version != ControlBlock::kVersion) {
+        // Fresh block, the former single int, or an older layout left in
+        // /dev/shm by a previous run: none holds a pending command
+        if (block_->magic == ControlBlock::kMagic) {
+            WARN("%s: control block version %u reset to %u", name_.c_str(),
+                 block_->version, (uint32_t)ControlBlock::kVersion);
+        }
+        memset(block_, 0, sizeof(ControlBlock));
+        block_->version = ControlBlock::kVersion;
+        StoreRelease(&block_->magic, ControlBlock::kMagic);
+    }
+    INFO("control channel %s mapped", name_.c_str());
+    return 0;
+}
+
+ControlStatus ControlChannel::ReadStatus() const {
+    ControlStatus status;
+    if (!block_) {
+        return status;
+    }
+    for (;;) {
+        uint32_t begin = LoadAcquire(&block_->status_sequence);
+        if (begin & 1) {
+            // Update in progress, a few stores away
+            sched_yield();
+            continue;
+        }
+        status.lens = __atomic_load_n(&block_->lens, __ATOMIC_RELAXED);
+        status.quality = __atomic_load_n(&block_->quality, __ATOMIC_RELAXED);
+        status.bitrate_kbps =
+            __atomic_load_n(&block_->bitrate_kbps, __ATOMIC_RELAXED);
+        status.detection =
+            __atomic_load_n(&block_->detection, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&block_->status_sequence, __ATOMIC_RELAXED) ==
+            begin) {
+            return status;
+        }
+    }
+}
+
+void ControlChannel::PublishStatus(const ControlStatus& status) {
+    if (!block_) {
+        return;
+    }
+    std::lock_guard<std::mutex> l(status_mutex_);
+    uint32_t sequence = block_->status_sequence;
+    __atomic_store_n(&block_->status_sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&block_->lens, status.lens, __ATOMIC_RELAXED);
+    __atomic_store_n(&block_->quality, status.quality, __ATOMIC_RELAXED);
+    __atomic_store_n(&block_->bitrate_kbps, status.bitrate_kbps,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&block_->detection, status.detection, __ATOMIC_RELAXED);
+    StoreRelease(&block_->status_sequence, sequence + 2);
+}
+
+uint32_t ControlChannel::Submit(uint32_t id, int32_t arg) {
+    if (!block_) {
+        return 0;
+    }
+    uint32_t index = block_->write_index;
+    if (index - LoadAcquire(&block_->read_index) >= ControlBlock::kRingSize) {
+        return 0;
+    }
+    auto& command = block_->commands[index % ControlBlock::kRingSize];
+    command.id = id;
+    memset(command.args, 0, sizeof(command.args));
+    command.args[0] = arg;
+    command.result = 0;
+    command.done = 0;
+    StoreRelease(&command.sequence, index + 1);
+    StoreRelease(&block_->write_index, index + 1);
+    Wake(&block_->notify);
+    return index + 1;
+}
+
+void ControlChannel::Wake(uint32_t* futex) {
+    __atomic_fetch_add(futex, 1, __ATOMIC_RELEASE);
+    Futex(futex, FUTEX_WAKE, INT_MAX);
+}
+
+int32_t ControlChannel::Start(CommandHandler handler) {
+    if (!block_ && Open() != 0) {
+        return -1;
+    }
+    if (running_) {
+        WARN("repeat start control channel");
+        return -1;
+    }
+    handler_ = handler;
+    running_ = true;
+    thread_ = std::thread(&ControlChannel::Run, this);
+    return 0;
+}
+
+void ControlChannel::Stop() {
+    if (!running_) {
+        return;
+    }
+    running_ = false;
+    Wake(&block_->notify);
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void ControlChannel::Run() {
+    pthread_setname_np(pthread_self(), "controlchannel");
+    uint32_t seen = LoadAcquire(&block_->notify);
+
+    while (running_) {
+        // Also drains the commands sent before Start
+        bool unpublished = false;
+        uint32_t index = LoadAcquire(&block_->read_index);
+        while (running_ && index != LoadAcquire(&block_->write_index)) {
+            auto& command = block_->commands[index % ControlBlock::kRingSize];
+            if (LoadAcquire(&command.sequence) != index + 1) {
+                // The Python writer's stores are not ordered: |write_index|
+                // can show up before the slot's sequence
+                unpublished = true;
+                break;
+            }
+            int32_t result = handler_ ? handler_(command)
+                                      : (int32_t)kControlResultUnsupported;
+            __atomic_store_n(&command.result, result, __ATOMIC_RELAXED);
+            StoreRelease(&command.done, index + 1);
+            index++;
+            StoreRelease(&block_->read_index, index);
+            Wake(&block_->ack_notify);
+        }
+        if (unpublished) {
+            // Its wake may be consumed already: retry, the sequence is
+            // stored before |write_index| and shows up right after it
+            sched_yield();
+            continue;
+        }
+
+        // Returns at once if |notify| moved since |seen|, the kernel orders
+        // the writer's stores before the wake with our reads after it
+        if (Futex(&block_->notify, FUTEX_WAIT, seen) != 0 &&
+            errno != EAGAIN && errno != EINTR) {
+            ERROR("futex wait on %s failed: %s", name_.c_str(),
+                  strerror(errno));
+            break;
+        }
+        seen = LoadAcquire(&block_->notify);
+    }
+}
+
+}  // namespace edge_app
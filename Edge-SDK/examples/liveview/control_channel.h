@@ -0,0 +1,162 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#ifndef __CONTROL_CHANNEL_H__
+#define __CONTROL_CHANNEL_H__
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace edge_app {
+
+enum ControlCommandId : uint32_t {
+    // args[0]: edge_sdk::Liveview::CameraSource
+    kControlCommandSetLens = 1,
+    // args[0]: edge_sdk::Liveview::StreamQuality
+    kControlCommandSetQuality = 2,
+    // args[0]: output encoder bitrate in kbps
+    kControlCommandSetBitrate = 3,
+    // args[0]: 0 off, 1 on
+    kControlCommandSetDetection = 4,
+    // Writes the pipeline trace events to the --trace-dir directory
+    kControlCommandDumpTrace = 5,
+};
+
+enum ControlResult : int32_t {
+    kControlResultOk = 0,
+    kControlResultFailed = -1,
+    kControlResultUnsupported = -2,
+    kControlResultInvalidArgument = -3,
+};
+
+/*
+ * One slot of the command ring. The writer fills it and publishes it by
+ * storing |sequence| last; the C++ side stores |result| then |done| =
+ * |sequence| once the command is applied.
+ */
+struct ControlCommand {
+    uint32_t sequence;
+    uint32_t id;
+    int32_t args[4];
+    int32_t result;
+    uint32_t done;
+};
+
+static_assert(sizeof(ControlCommand) == 32, "ControlCommand layout changed");
+
+/*
+ * Control block shared with PythonVIdeoSelector/video_selector.py, mapped
+ * once for the process lifetime. Fixed little endian layout, any change
+ * bumps |version|.
+ *
+ * Commands: a single writer appends to the ring, bumps |write_index| and
+ * |notify|, and wakes the futex waiting on |notify|. A command is applied
+ * in microseconds, and no system call is made while nothing is sent. The
+ * writer must not run more than kRingSize commands ahead of |read_index|;
+ * it can wait for acknowledgments on the futex |ack_notify|.
+ *
+ * Status: the configuration in effect, written by the C++ side under the
+ * seqlock |status_sequence| (odd while writing).
+ */
+struct ControlBlock {
+    enum : uint32_t {
+        kMagic = 0x43564A44,  // "DJVC"
+        kVersion = 2,
+        kRingSize = 16,
+    };
+
+    uint32_t magic;
+    uint32_t version;
+
+    uint32_t status_sequence;
+    int32_t lens;
+    int32_t quality;
+    int32_t bitrate_kbps;
+    int32_t detection;
+
+    uint32_t notify;
+    uint32_t ack_notify;
+    uint32_t write_index;
+    uint32_t read_index;
+    uint32_t reserved[5];
+
+    ControlCommand commands[kRingSize];
+};
+
+static_assert(sizeof(ControlBlock) == 64 + 32 * ControlBlock::kRingSize,
+              "ControlBlock layout changed");
+
+struct ControlStatus {
+    int32_t lens = 0;
+    int32_t quality = 0;
+    int32_t bitrate_kbps = 0;
+    int32_t detection = 0;
+};
+
+class ControlChannel {
+   public:
+    // Applies a command, returns a ControlResult
+    using CommandHandler = std::function<int32_t(const ControlCommand& command)>;
+
+    // |name| is the POSIX shared memory name, starting with '/'
+    explicit ControlChannel(const std::string& name);
+
+    ~ControlChannel();
+
+    // Maps the block, creating it if no writer did yet
+    int32_t Open();
+
+    // Calls |handler| for every command on the channel thread, the ones
+    // sent before Start included
+    int32_t Start(CommandHandler handler);
+
+    void Stop();
+
+    // From any thread
+    void PublishStatus(const ControlStatus& status);
+
+    ControlStatus ReadStatus() const;
+
+    // For writers in C++, same protocol as video_selector.py. Returns the
+    // command sequence, 0 if the ring is full.
+    uint32_t Submit(uint32_t id, int32_t arg);
+
+   private:
+    void Run();
+
+    void Wake(uint32_t* futex);
+
+    std::string name_;
+    ControlBlock* block_ = nullptr;
+    CommandHandler handler_;
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+    // One status writer at a time
+    std::mutex status_mutex_;
+};
+
+}  // namespace edge_app
+
+#endif
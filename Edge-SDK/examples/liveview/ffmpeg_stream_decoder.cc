@@ -23,15 +23,23 @@
 
 #include <unistd.h>
 
+#include <cstring>
+
+#include "h264_bitstream.h"
 #include "logger.h"
+#include "motion_summary.h"
 #include "opencv2/opencv.hpp"
+#include "pipeline_metrics.h"
+#include "pipeline_trace.h"
 
 using namespace edge_sdk;
 
 namespace edge_app {
 
-FFmpegStreamDecoder::FFmpegStreamDecoder(const std::string &name)
-    : StreamDecoder(name) {}
+FFmpegStreamDecoder::FFmpegStreamDecoder(const Options &option)
+    : StreamDecoder(option.name),
+      export_motion_vectors_(option.export_motion_vectors),
+      thread_count_(option.thread_count) {}
 
 FFmpegStreamDecoder::~FFmpegStreamDecoder() {}
 
@@ -50,14 +58,17 @@ int32_t FFmpegStreamDecoder::Init() {
     }
 
     pCodecCtx = avcodec_alloc_context3(pCodec);
+    if (!pCodecCtx) {
+        return -1;
+    }
     pCodecCtx->pix_fmt = AV_PIX_FMT_YUV420P;
     pCodecCtx->width = 1920;
     pCodecCtx->height = 1080;
     pCodecCtx->flags2 |= AV_CODEC_FLAG2_SHOW_ALL;
-    if (!pCodecCtx) {
-        return -1;
+    if (export_motion_vectors_) {
+        pCodecCtx->flags2 |= AV_CODEC_FLAG2_EXPORT_MVS;
     }
-    pCodecCtx->thread_count = 4;
+    pCodecCtx->thread_count = thread_count_;
 
     auto ret = avcodec_open2(pCodecCtx, pCodec, nullptr);
     if (ret < 0) {
@@ -120,8 +131,87 @@ int32_t FFmpegStreamDecoder::DeInit() {
     return 0;
 }
 
+std::shared_ptr<MotionSummary> FFmpegStreamDecoder::RecycledMotionSummary() {
+    // Only the decoder copies from the pool: a summary it alone holds is
+    // released by the frames and stays so
+    for (auto &summary : motion_pool_) {
+        if (summary.use_count() == 1) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return summary;
+        }
+    }
+    auto summary = std::make_shared<MotionSummary>();
+    if (motion_pool_.size() < (size_t)kMotionSummaryPoolSize) {
+        motion_pool_.push_back(summary);
+    }
+    return summary;
+}
+
+std::shared_ptr<MotionSummary> FFmpegStreamDecoder::SummarizeMotion() {
+    auto summary = RecycledMotionSummary();
+    summary->Reset(pFrameYUV->width, pFrameYUV->height);
+
+    auto side_data =
+        av_frame_get_side_data(pFrameYUV, AV_FRAME_DATA_MOTION_VECTORS);
+    if (pFrameYUV->pict_type == AV_PICTURE_TYPE_I || !side_data) {
+        summary->intra = true;
+        return summary;
+    }
+    auto mvs = (const AVMotionVector *)side_data->data;
+    size_t count = side_data->size / sizeof(AVMotionVector);
+    for (size_t i = 0; i < count; i++) {
+        const auto &mv = mvs[i];
+        float scale = mv.motion_scale ? (float)mv.motion_scale : 1.f;
+        summary->AddVector(mv.dst_x, mv.dst_y, mv.motion_x / scale,
+                           mv.motion_y / scale);
+    }
+    return summary;
+}
+
+void FFmpegStreamDecoder::CheckSourceChange(const uint8_t *data,
+                                            size_t length) {
+    bool has_sps = false;
+    bool has_idr = false;
+    bool sps_changed = false;
+    H264NalReader reader(data, length);
+    H264Nal nal;
+    while (reader.Next(&nal)) {
+        if (nal.type == kH264NalIdr) {
+            has_idr = true;
+        } else if (nal.type == kH264NalSps) {
+            has_sps = true;
+            if (nal.size != last_sps_.size() ||
+                memcmp(nal.data, last_sps_.data(), nal.size) != 0) {
+                sps_changed = !last_sps_.empty();
+                last_sps_.assign(nal.data, nal.data + nal.size);
+            }
+        }
+    }
+
+    // Same resolution and encoder settings keep the SPS unchanged across a
+    // switch: then the first keyframe after the request starts the source.
+    bool expected = source_change_expected_ && (has_sps || has_idr);
+    if (!sps_changed && !expected) {
+        return;
+    }
+    source_change_expected_ = false;
+
+    // Frames still delayed in the decoder belong to the previous source and
+    // would be referenced by nothing of the new one.
+    avcodec_flush_buffers(pCodecCtx);
+    source_generation_++;
+    INFO("H264 source change %u: %s", source_generation_,
+         sps_changed ? "new SPS" : "keyframe after switch");
+}
+
 int32_t FFmpegStreamDecoder::Decode(const uint8_t *data, size_t length,
                                     DecodeResultCallback result_callback) {
+    return Decode(data, length, 0, result_callback);
+}
+
+int32_t FFmpegStreamDecoder::Decode(const uint8_t *data, size_t length,
+                                    int64_t arrival_us,
+                                    DecodeResultCallback result_callback) {
     const uint8_t *pData = data;
     int remainingLen = length;
     int processedLen = 0;
@@ -135,17 +225,32 @@ int32_t FFmpegStreamDecoder::Decode(const uint8_t *data, size_t length,
         }
         processedLen = av_parser_parse2(
             pCodecParserCtx, pCodecCtx, &pkt.data, &pkt.size, pData,
-            remainingLen, AV_NOPTS_VALUE, AV_NOPTS_VALUE, AV_NOPTS_VALUE);
+            remainingLen, arrival_us ? arrival_us : AV_NOPTS_VALUE,
+            AV_NOPTS_VALUE, AV_NOPTS_VALUE);
         remainingLen -= processedLen;
         pData += processedLen;
 
         if (pkt.size > 0) {
+            pkt.pts = pCodecParserCtx->pts;
+            CheckSourceChange(pkt.data, pkt.size);
+
             int gotPicture = 0;
-            avcodec_decode_video2(pCodecCtx, pFrameYUV, &gotPicture, &pkt);
+            int64_t decode_start_us = GetMonotonicTimeUs();
+            {
+                TRACE_SCOPE("decode", "bytes", pkt.size);
+                avcodec_decode_video2(pCodecCtx, pFrameYUV, &gotPicture,
+                                      &pkt);
+            }
+            int64_t convert_start_us = GetMonotonicTimeUs();
+            if (metrics_) {
+                metrics_->Record(kMetricsStageDecode,
+                                 convert_start_us - decode_start_us);
+            }
 
             if (!gotPicture) {
                 continue;
             } else {
+                TraceScope convert_trace("convert");
                 if (pFrameYUV->width != decode_width ||
                     pFrameYUV->height != decode_hight) {
                     decode_width = pFrameYUV->width;
@@ -190,7 +295,22 @@ int32_t FFmpegStreamDecoder::Decode(const uint8_t *data, size_t length,
                         cv::Mat cvtmp;
                         cvtColor(tmp, cvtmp, cv::COLOR_RGB2BGR);
                         auto mat = std::make_shared<cv::Mat>(cvtmp);
-                        result_callback(mat);
+                        FrameInfo info;
+                        info.timestamp_us = GetMonotonicTimeUs();
+                        if (metrics_) {
+                            metrics_->Record(
+                                kMetricsStageConvert,
+                                info.timestamp_us - convert_start_us);
+                        }
+                        if (pFrameYUV->pts != AV_NOPTS_VALUE) {
+                            info.arrival_us = pFrameYUV->pts;
+                        }
+                        info.source_generation = source_generation_;
+                        if (export_motion_vectors_) {
+                            info.motion = SummarizeMotion();
+                        }
+                        convert_trace.End();
+                        result_callback(mat, info);
                     }
                 }
             }
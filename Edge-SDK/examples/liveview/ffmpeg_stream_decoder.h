@@ -22,8 +22,10 @@
 #ifndef __FFMPEG_STREAM_DECODER_H__
 #define __FFMPEG_STREAM_DECODER_H__
 
+#include <atomic>
 #include <memory>
 #include <mutex>
+#include <vector>
 
 #include "error_code.h"
 #include "stream_decoder.h"
@@ -31,14 +33,17 @@
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
+#include <libavutil/motion_vector.h>
 #include <libswscale/swscale.h>
 }
 
 namespace edge_app {
 
+struct MotionSummary;
+
 class FFmpegStreamDecoder : public StreamDecoder {
    public:
-    explicit FFmpegStreamDecoder(const std::string &name);
+    explicit FFmpegStreamDecoder(const Options &option);
     virtual ~FFmpegStreamDecoder();
 
     int32_t Init() override;
@@ -48,7 +53,29 @@ class FFmpegStreamDecoder : public StreamDecoder {
     int32_t Decode(const uint8_t *data, size_t length,
                    DecodeResultCallback result_callback) override;
 
+    // The parser carries |arrival_us| as the pts of the frames starting in
+    // |data|, through the decoder's reordering
+    int32_t Decode(const uint8_t *data, size_t length, int64_t arrival_us,
+                   DecodeResultCallback result_callback) override;
+
+    void ExpectSourceChange() override { source_change_expected_ = true; }
+
    private:
+    enum {
+        // Summaries still held by the queued frames, reused once released
+        kMotionSummaryPoolSize = 8,
+    };
+
+    std::shared_ptr<MotionSummary> SummarizeMotion();
+
+    std::shared_ptr<MotionSummary> RecycledMotionSummary();
+
+    // Flushes the decoder before an access unit starting a new source
+    void CheckSourceChange(const uint8_t *data, size_t length);
+
+    bool export_motion_vectors_;
+    int32_t thread_count_;
+    std::vector<std::shared_ptr<MotionSummary>> motion_pool_;
     std::mutex decode_mutex;
     AVCodecContext *pCodecCtx = nullptr;
     AVCodec *pCodec = nullptr;
@@ -62,6 +89,10 @@ class FFmpegStreamDecoder : public StreamDecoder {
     int32_t decode_width;
     int32_t decode_hight;
 
+    std::atomic<bool> source_change_expected_{false};
+    std::vector<uint8_t> last_sps_;
+    uint32_t source_generation_ = 0;
+
     std::mutex image_mutex;
 };
 
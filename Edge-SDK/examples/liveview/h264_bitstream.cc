@@ -0,0 +1,134 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include "h264_bitstream.h"
+
+namespace edge_app {
+
+namespace {
+
+// Longest access unit buffered, anything longer is not H.264 from the camera
+const size_t kMaxAccessUnitSize = 8 * 1024 * 1024;
+
+}  // namespace
+
+size_t H264NalReader::FindPayload(size_t from,
+                                  size_t* start_code_offset) const {
+    for (size_t i = from; i + 3 <= length_; i++) {
+        if (data_[i + 2] > 1) {
+            // No start code can end before i + 3
+            i += 2;
+            continue;
+        }
+        if (data_[i] == 0 && data_[i + 1] == 0 && data_[i + 2] == 1) {
+            *start_code_offset = (i > from && data_[i - 1] == 0) ? i - 1 : i;
+            return i + 3;
+        }
+    }
+    *start_code_offset = length_;
+    return length_;
+}
+
+bool H264NalReader::Next(H264Nal* nal) {
+    size_t start_code = 0;
+    size_t begin = FindPayload(offset_, &start_code);
+    if (begin >= length_) {
+        offset_ = length_;
+        return false;
+    }
+    size_t end = length_;
+    FindPayload(begin, &end);
+    offset_ = end;
+
+    nal->data = data_ + begin;
+    nal->size = end - begin;
+    nal->type = data_[begin] & 0x1f;
+    return true;
+}
+
+void H264AccessUnitSplitter::Input(const uint8_t* data, size_t length,
+                                   const Callback& callback) {
+    buffer_.insert(buffer_.end(), data, data + length);
+
+    size_t i = scan_;
+    // A start code is only handled with the NAL header and the byte after
+    // it, which holds first_mb_in_slice for slices
+    while (i + 5 <= buffer_.size()) {
+        if (buffer_[i + 2] > 1) {
+            i += 3;
+            continue;
+        }
+        if (buffer_[i] != 0 || buffer_[i + 1] != 0 || buffer_[i + 2] != 1) {
+            i++;
+            continue;
+        }
+        size_t start = (i > 0 && buffer_[i - 1] == 0) ? i - 1 : i;
+        size_t payload = i + 3;
+        uint8_t type = buffer_[payload] & 0x1f;
+        bool slice = type == kH264NalSlice || type == kH264NalIdr;
+
+        if (!has_nal_ && start > 0) {
+            // Bytes before the first start code
+            buffer_.erase(buffer_.begin(), buffer_.begin() + start);
+            payload -= start;
+            start = 0;
+        }
+        bool begins_unit = type == kH264NalAud || type == kH264NalSps ||
+                           type == kH264NalPps || type == kH264NalSei ||
+                           (slice && (buffer_[payload + 1] & 0x80));
+        if (begins_unit && has_slice_ && start > 0) {
+            AccessUnit unit;
+            unit.data = buffer_.data();
+            unit.size = start;
+            unit.keyframe = keyframe_;
+            unit.parameter_sets = parameter_sets_;
+            callback(unit);
+
+            buffer_.erase(buffer_.begin(), buffer_.begin() + start);
+            payload -= start;
+            has_slice_ = false;
+            keyframe_ = false;
+            parameter_sets_ = false;
+        }
+
+        has_nal_ = true;
+        has_slice_ = has_slice_ || slice;
+        keyframe_ = keyframe_ || type == kH264NalIdr;
+        parameter_sets_ = parameter_sets_ || type == kH264NalSps;
+        i = payload + 1;
+    }
+    scan_ = i;
+
+    if (buffer_.size() > kMaxAccessUnitSize) {
+        Reset();
+    }
+}
+
+void H264AccessUnitSplitter::Reset() {
+    buffer_.clear();
+    scan_ = 0;
+    has_nal_ = false;
+    has_slice_ = false;
+    keyframe_ = false;
+    parameter_sets_ = false;
+}
+
+}  // namespace edge_app
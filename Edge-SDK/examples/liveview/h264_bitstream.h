@@ -0,0 +1,108 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#ifndef __H264_BITSTREAM_H__
+#define __H264_BITSTREAM_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace edge_app {
+
+enum H264NalType {
+    kH264NalSlice = 1,
+    kH264NalIdr = 5,
+    kH264NalSei = 6,
+    kH264NalSps = 7,
+    kH264NalPps = 8,
+    kH264NalAud = 9,
+};
+
+struct H264Nal {
+    uint8_t type = 0;
+    // From the NAL header byte, without the start code
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+/*
+ * Walks the NAL units of an Annex B buffer (00 00 01 or 00 00 00 01 start
+ * codes) without copying it.
+ */
+class H264NalReader {
+   public:
+    H264NalReader(const uint8_t* data, size_t length)
+        : data_(data), length_(length) {}
+
+    bool Next(H264Nal* nal);
+
+   private:
+    // Offset of the first byte after the next start code at or after |from|,
+    // |length_| if there is none
+    size_t FindPayload(size_t from, size_t* start_code_offset) const;
+
+    const uint8_t* data_;
+    size_t length_;
+    size_t offset_ = 0;
+};
+
+/*
+ * Reassembles the access units of an Annex B stream delivered in arbitrary
+ * chunks. An access unit ends where the next one begins: at an AUD, SPS, PPS
+ * or SEI following a slice, or at a slice starting a new picture
+ * (first_mb_in_slice == 0). So each one is returned once the first NAL of
+ * the next has arrived.
+ */
+class H264AccessUnitSplitter {
+   public:
+    struct AccessUnit {
+        // Start code included
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        // Has an IDR slice
+        bool keyframe = false;
+        // Carries an SPS
+        bool parameter_sets = false;
+    };
+
+    using Callback = std::function<void(const AccessUnit& unit)>;
+
+    // Calls |callback| for every access unit completed by |data|
+    void Input(const uint8_t* data, size_t length, const Callback& callback);
+
+    // Drops the access unit in progress, e.g. when the stream restarts
+    void Reset();
+
+   private:
+    std::vector<uint8_t> buffer_;
+    // Next offset of |buffer_| to look for a start code at
+    size_t scan_ = 0;
+    bool has_nal_ = false;
+    bool has_slice_ = false;
+    bool keyframe_ = false;
+    bool parameter_sets_ = false;
+};
+
+}  // namespace edge_app
+
+#endif
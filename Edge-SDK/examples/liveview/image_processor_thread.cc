@@ -26,6 +26,8 @@
 
 #include "image_processor.h"
 #include "logger.h"
+#include "pipeline_metrics.h"
+#include "pipeline_trace.h"
 
 using namespace edge_sdk;
 
@@ -39,7 +41,7 @@ class NullImageProcessor : public ImageProcessor {
 };
 
 ImageProcessorThread::ImageProcessorThread(const std::string& name)
-    : processor_name_(name) {
+    : processor_name_(name), metrics_(PipelineMetrics::Get(name)) {
     processor_start_ = false;
     image_processor_ = std::make_shared<NullImageProcessor>();
 }
@@ -52,20 +54,77 @@ int32_t ImageProcessorThread::SetImageProcessor(
         return -1;
     }
     image_processor_ = image_processor;
+    image_processor_->SetMetrics(metrics_);
     return 0;
 }
 
 void ImageProcessorThread::InputImage(const std::shared_ptr<Image> image) {
+    FrameInfo info;
+    info.timestamp_us = GetMonotonicTimeUs();
+    InputImage(image, info);
+}
+
+void ImageProcessorThread::InputImage(const std::shared_ptr<Image> image,
+                                      const FrameInfo& info) {
     std::lock_guard<std::mutex> l(image_queue_mutex_);
-    image_queue_.push(image);
+    image_queue_.push({image, info});
+    if (info.sequence == 0) {
+        image_queue_.back().info.sequence = ++image_sequence_;
+    }
     if (image_queue_.size() > kImageQueueSizeLimit) {
+        PipelineTrace::Instant("drop", "frame",
+                               image_queue_.front().info.sequence);
         image_queue_.pop();
+        dropped_images_++;
+        metrics_->Add(kMetricsFramesDropped);
     }
+    metrics_->Set(kMetricsImageQueueDepth, image_queue_.size());
     image_queue_cv_.notify_one();
+    if (process_strand_ && !process_posted_) {
+        process_posted_ = true;
+        process_strand_->Post([this] { ProcessPending(); });
+    }
+}
+
+size_t ImageProcessorThread::DropQueuedImages() {
+    std::lock_guard<std::mutex> l(image_queue_mutex_);
+    size_t dropped = image_queue_.size();
+    std::queue<QueuedImage>().swap(image_queue_);
+    return dropped;
 }
 
-void ImageProcessorThread::DoProcess(const std::shared_ptr<Image> image) {
-    if (image_processor_) image_processor_->Process(image);
+void ImageProcessorThread::ProcessPending() {
+    std::unique_lock<std::mutex> l(image_queue_mutex_);
+    if (image_queue_.empty() || !processor_start_) {
+        process_posted_ = false;
+        return;
+    }
+    auto img = image_queue_.front();
+    image_queue_.pop();
+    metrics_->Set(kMetricsImageQueueDepth, image_queue_.size());
+    l.unlock();
+
+    DoProcess(img.image, img.info);
+
+    // One image per task, so that the other strands get their turn
+    l.lock();
+    if (image_queue_.empty() || !process_strand_) {
+        process_posted_ = false;
+    } else {
+        process_strand_->Post([this] { ProcessPending(); });
+    }
+}
+
+void ImageProcessorThread::DoProcess(const std::shared_ptr<Image> image,
+                                     const FrameInfo& info) {
+    if (!image_processor_) {
+        return;
+    }
+    TRACE_SCOPE("process", "frame", info.sequence);
+    int64_t start_us = GetMonotonicTimeUs();
+    image_processor_->Process(image, info);
+    metrics_->Record(kMetricsStageProcess, GetMonotonicTimeUs() - start_us);
+    metrics_->Add(kMetricsFramesProcessed);
 }
 
 int32_t ImageProcessorThread::Start() {
@@ -82,6 +141,16 @@ int32_t ImageProcessorThread::Start() {
             return -1;
         }
     }
+    auto runtime = PipelineRuntime::Instance();
+    if (runtime->Running()) {
+        auto strand =
+            runtime->CreateStrand(processor_name_, "process", priority_);
+        std::lock_guard<std::mutex> l(image_queue_mutex_);
+        process_strand_ = strand;
+        process_posted_ = false;
+        return 0;
+    }
+
     image_processor_thread_ =
         std::thread(&ImageProcessorThread::ImageProcess, this);
 
@@ -101,10 +170,21 @@ int32_t ImageProcessorThread::Start() {
 }
 
 int32_t ImageProcessorThread::Stop() {
-    processor_start_ = false;
+    std::shared_ptr<PipelineStrand> strand;
+    {
+        // Wakes the processing thread waiting for an image
+        std::lock_guard<std::mutex> l(image_queue_mutex_);
+        processor_start_ = false;
+        strand.swap(process_strand_);
+    }
+    image_queue_cv_.notify_all();
     if (image_processor_thread_.joinable()) {
         image_processor_thread_.join();
     }
+    // The process tasks hold |this|: none may run once Stop() returns
+    if (strand) {
+        strand->Close();
+    }
 
     return 0;
 }
@@ -114,11 +194,17 @@ void ImageProcessorThread::ImageProcess() {
     pthread_setname_np(pthread_self(), "opencvimshow");
     while (processor_start_) {
         std::unique_lock<std::mutex> l(image_queue_mutex_);
-        image_queue_cv_.wait(l, [&] { return image_queue_.size() != 0; });
+        image_queue_cv_.wait(l, [&] {
+            return image_queue_.size() != 0 || !processor_start_;
+        });
+        if (!processor_start_) {
+            break;
+        }
         auto img = image_queue_.front();
         image_queue_.pop();
+        metrics_->Set(kMetricsImageQueueDepth, image_queue_.size());
         l.unlock();
-        DoProcess(img);
+        DoProcess(img.image, img.info);
     }
     INFO("stop image processor: %s", processor_name_.c_str());
 }
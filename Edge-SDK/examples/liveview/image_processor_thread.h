@@ -30,6 +30,8 @@
 #include <thread>
 
 #include "error_code.h"
+#include "frame_info.h"
+#include "pipeline_runtime.h"
 
 namespace cv {
 class Mat;
@@ -38,6 +40,7 @@ class Mat;
 namespace edge_app {
 
 class ImageProcessor;
+class PipelineMetrics;
 
 class ImageProcessorThread {
    public:
@@ -51,8 +54,19 @@ class ImageProcessorThread {
 
     void InputImage(const std::shared_ptr<Image> image);
 
+    void InputImage(const std::shared_ptr<Image> image, const FrameInfo& info);
+
     int32_t SetImageProcessor(std::shared_ptr<ImageProcessor> image_processor);
 
+    // Discards the images not processed yet, returns how many
+    size_t DropQueuedImages();
+
+    // Images dropped because the processor fell kImageQueueSizeLimit behind
+    uint64_t DroppedImages() const { return dropped_images_; }
+
+    // Priority of the process strand when running on the pipeline runtime
+    void SetPriority(PipelinePriority priority) { priority_ = priority; }
+
     int32_t Start();
 
     int32_t Stop();
@@ -64,17 +78,35 @@ class ImageProcessorThread {
 
     void ImageProcess();
 
-    virtual void DoProcess(const std::shared_ptr<Image> image);
+    // Process task of the pipeline runtime, one image per task
+    void ProcessPending();
+
+    virtual void DoProcess(const std::shared_ptr<Image> image,
+                           const FrameInfo& info);
+
+    struct QueuedImage {
+        std::shared_ptr<Image> image;
+        FrameInfo info;
+    };
 
     std::string processor_name_;
 
     std::mutex image_queue_mutex_;
     std::condition_variable image_queue_cv_;
-    std::queue<std::shared_ptr<Image>> image_queue_;
+    std::queue<QueuedImage> image_queue_;
+    uint64_t image_sequence_ = 0;
+    std::atomic<uint64_t> dropped_images_{0};
 
     std::thread image_processor_thread_;
     std::atomic<bool> processor_start_;
     std::shared_ptr<ImageProcessor> image_processor_;
+
+    // Set instead of image_processor_thread_ when the pipeline runtime runs
+    std::shared_ptr<PipelineStrand> process_strand_;
+    PipelinePriority priority_ = kPipelinePriorityNormal;
+    bool process_posted_ = false;
+
+    std::shared_ptr<PipelineMetrics> metrics_;
 };
 
 }  // namespace edge_app
@@ -0,0 +1,251 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include "lens_demux.h"
+
+#include <algorithm>
+
+#include "logger.h"
+
+using namespace edge_sdk;
+
+namespace edge_app {
+
+namespace {
+
+// Weight of the newest interval in the frame rate estimate
+const float kFrameIntervalAlpha = 0.1;
+
+}  // namespace
+
+LensDemux::LensDemux(const Options& options) : options_(options) {
+    options_.history_frames = std::max(options_.history_frames, 1);
+}
+
+LensDemux::~LensDemux() {
+    for (auto& subscriber : Subscribers()) {
+        subscriber->Stop();
+    }
+}
+
+std::vector<std::shared_ptr<ImageProcessorThread>> LensDemux::Subscribers()
+    const {
+    // Lock order: streams_mutex_, then the stream's mutex guarding its list
+    std::vector<std::shared_ptr<ImageProcessorThread>> subscribers;
+    std::lock_guard<std::mutex> l(streams_mutex_);
+    for (auto& it : streams_) {
+        std::lock_guard<std::mutex> sl(it.second->mutex);
+        subscribers.insert(subscribers.end(), it.second->subscribers.begin(),
+                           it.second->subscribers.end());
+    }
+    return subscribers;
+}
+
+LensDemux::VirtualStream* LensDemux::FindStream(int32_t lens) const {
+    std::lock_guard<std::mutex> l(streams_mutex_);
+    auto it = streams_.find(lens);
+    return it != streams_.end() ? it->second.get() : nullptr;
+}
+
+LensDemux::VirtualStream* LensDemux::GetStream(int32_t lens) {
+    std::lock_guard<std::mutex> l(streams_mutex_);
+    auto it = streams_.find(lens);
+    if (it != streams_.end()) {
+        return it->second.get();
+    }
+    auto stream = std::unique_ptr<VirtualStream>(new VirtualStream());
+    stream->lens = lens;
+    stream->history.resize(options_.history_frames);
+    auto raw = stream.get();
+    streams_[lens] = std::move(stream);
+    return raw;
+}
+
+std::shared_ptr<ImageProcessorThread> LensDemux::CreateSubscriber(
+    VirtualStream& stream, std::shared_ptr<ImageProcessor> processor,
+    PipelinePriority priority) {
+    auto thread = std::make_shared<ImageProcessorThread>(
+        options_.name + "-lens" + std::to_string(stream.lens));
+    thread->SetImageProcessor(processor);
+    thread->SetPriority(priority);
+    return thread;
+}
+
+int32_t LensDemux::Init() {
+    {
+        std::lock_guard<std::mutex> l(streams_mutex_);
+        if (started_) {
+            return 0;
+        }
+        started_ = true;
+    }
+    // Subscribers added from now on start themselves
+    int32_t rc = 0;
+    for (auto& subscriber : Subscribers()) {
+        if (subscriber->Start() != 0) {
+            ERROR("%s: subscriber %s start failed", options_.name.c_str(),
+                  subscriber->Name().c_str());
+            rc = -1;
+        }
+    }
+    return rc;
+}
+
+int32_t LensDemux::Subscribe(int32_t lens,
+                             std::shared_ptr<ImageProcessor> processor,
+                             PipelinePriority priority) {
+    if (!processor) {
+        return -1;
+    }
+    auto stream = GetStream(lens);
+    auto subscriber = CreateSubscriber(*stream, processor, priority);
+
+    {
+        // Added under streams_mutex_, so that Init either sees it or has
+        // already set started_
+        std::lock_guard<std::mutex> l(streams_mutex_);
+        if (!started_) {
+            std::lock_guard<std::mutex> sl(stream->mutex);
+            stream->subscribers.push_back(subscriber);
+            INFO("%s: %s subscribed to lens %d", options_.name.c_str(),
+                 subscriber->Name().c_str(), lens);
+            return 0;
+        }
+    }
+    if (subscriber->Start() != 0) {
+        ERROR("%s: subscriber %s start failed", options_.name.c_str(),
+              subscriber->Name().c_str());
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> l(stream->mutex);
+    stream->subscribers.push_back(subscriber);
+    // Late subscriber: show the lens at once rather than at its next frame
+    if (stream->count > 0) {
+        int32_t last = (stream->head + options_.history_frames - 1) %
+                       options_.history_frames;
+        const auto& held = stream->history[last];
+        subscriber->InputImage(held.image, held.info);
+    }
+    INFO("%s: %s subscribed to lens %d", options_.name.c_str(),
+         subscriber->Name().c_str(), lens);
+    return 0;
+}
+
+void LensDemux::Process(const std::shared_ptr<Image> image) {
+    FrameInfo info;
+    info.timestamp_us = GetMonotonicTimeUs();
+    Process(image, info);
+}
+
+void LensDemux::Process(const std::shared_ptr<Image> image,
+                        const FrameInfo& info) {
+    if (!image) {
+        return;
+    }
+    auto stream = GetStream(info.lens);
+
+    std::lock_guard<std::mutex> l(stream->mutex);
+    auto& held = stream->history[stream->head];
+    held.image = image;
+    held.info = info;
+    // Per virtual stream numbering, for the subscribers counting frames
+    held.info.sequence = ++stream->sequence;
+    stream->head = (stream->head + 1) % options_.history_frames;
+    stream->count = std::min(stream->count + 1, options_.history_frames);
+
+    int64_t interval_us = info.timestamp_us - stream->last_frame_us;
+    if (stream->last_frame_us == 0 ||
+        interval_us > (int64_t)options_.inactive_after_ms * 1000) {
+        // First frame since the lens became active again
+        stream->frame_interval_us = 0;
+    } else if (stream->frame_interval_us == 0) {
+        stream->frame_interval_us = interval_us;
+    } else {
+        stream->frame_interval_us +=
+            kFrameIntervalAlpha * (interval_us - stream->frame_interval_us);
+    }
+    stream->last_frame_us = info.timestamp_us;
+
+    for (auto& subscriber : stream->subscribers) {
+        subscriber->InputImage(image, held.info);
+    }
+}
+
+std::shared_ptr<LensDemux::Image> LensDemux::LastFrame(int32_t lens,
+                                                       FrameInfo* info) const {
+    auto stream = FindStream(lens);
+    if (!stream) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> l(stream->mutex);
+    if (stream->count == 0) {
+        return nullptr;
+    }
+    int32_t last =
+        (stream->head + options_.history_frames - 1) % options_.history_frames;
+    if (info) {
+        *info = stream->history[last].info;
+    }
+    return stream->history[last].image;
+}
+
+int32_t LensDemux::History(int32_t lens,
+                           std::vector<std::shared_ptr<Image>>& frames) const {
+    frames.clear();
+    auto stream = FindStream(lens);
+    if (!stream) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> l(stream->mutex);
+    int32_t first = (stream->head + options_.history_frames - stream->count) %
+                    options_.history_frames;
+    for (int32_t i = 0; i < stream->count; i++) {
+        frames.push_back(
+            stream->history[(first + i) % options_.history_frames].image);
+    }
+    return stream->count;
+}
+
+float LensDemux::FrameRate(int32_t lens) const {
+    auto stream = FindStream(lens);
+    if (!stream) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> l(stream->mutex);
+    if (stream->frame_interval_us <= 0) {
+        return 0;
+    }
+    return 1000000.0f / stream->frame_interval_us;
+}
+
+bool LensDemux::Active(int32_t lens) const {
+    auto stream = FindStream(lens);
+    if (!stream) {
+        return false;
+    }
+    std::lock_guard<std::mutex> l(stream->mutex);
+    return stream->last_frame_us != 0 &&
+           GetMonotonicTimeUs() - stream->last_frame_us <=
+               (int64_t)options_.inactive_after_ms * 1000;
+}
+
+}  // namespace edge_app
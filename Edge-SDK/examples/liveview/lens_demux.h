@@ -0,0 +1,132 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#ifndef __LENS_DEMUX_H__
+#define __LENS_DEMUX_H__
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "frame_info.h"
+#include "image_processor.h"
+#include "image_processor_thread.h"
+
+namespace edge_app {
+
+/*
+ * Splits a stream time-shared between lenses (the payload camera switched
+ * with SetCameraSource) into one virtual stream per FrameInfo::lens. Each
+ * virtual stream holds its last frames, estimates its own frame rate and
+ * feeds its subscribers, each on its own processor thread, so that they see
+ * a plain stream of one lens and nothing of the switching. The subscribers
+ * share every frame, with each other and with the history: they must not
+ * write to it.
+ *
+ * The demux is itself the ImageProcessor of the shared stream.
+ */
+class LensDemux : public ImageProcessor {
+   public:
+    struct Options {
+        std::string name = "demux";
+        // Frames retained per lens for redisplay
+        int32_t history_frames = 8;
+        // A lens without frames for this long is inactive and its frame
+        // rate estimate restarts on its next frame
+        int32_t inactive_after_ms = 1000;
+    };
+
+    explicit LensDemux(const Options& options);
+
+    ~LensDemux() override;
+
+    // Starts the subscribers added so far
+    int32_t Init() override;
+
+    // Frames without metadata go to the lens 0 (unknown)
+    void Process(const std::shared_ptr<Image> image) override;
+
+    void Process(const std::shared_ptr<Image> image,
+                 const FrameInfo& info) override;
+
+    // Feeds |processor| with the frames of |lens|. Added after Init, the
+    // subscriber starts right away with the last frame held for the lens.
+    int32_t Subscribe(int32_t lens, std::shared_ptr<ImageProcessor> processor,
+                      PipelinePriority priority = kPipelinePriorityNormal);
+
+    // Last frame of |lens|, nullptr if none yet. |info| is the frame's
+    // metadata with the sequence counted per lens.
+    std::shared_ptr<Image> LastFrame(int32_t lens,
+                                     FrameInfo* info = nullptr) const;
+
+    // Frames held for |lens|, oldest first, returns how many
+    int32_t History(int32_t lens,
+                    std::vector<std::shared_ptr<Image>>& frames) const;
+
+    // Frame rate of |lens| while active, 0 if unknown
+    float FrameRate(int32_t lens) const;
+
+    bool Active(int32_t lens) const;
+
+   private:
+    struct HeldFrame {
+        std::shared_ptr<Image> image;
+        FrameInfo info;
+    };
+
+    struct VirtualStream {
+        int32_t lens;
+        mutable std::mutex mutex;
+        // Ring of the last frames, |head| is the next slot written
+        std::vector<HeldFrame> history;
+        int32_t head = 0;
+        int32_t count = 0;
+        uint64_t sequence = 0;
+        int64_t last_frame_us = 0;
+        float frame_interval_us = 0;
+        std::vector<std::shared_ptr<ImageProcessorThread>> subscribers;
+    };
+
+    VirtualStream* FindStream(int32_t lens) const;
+
+    // Creates the stream of |lens| on its first frame or subscriber
+    VirtualStream* GetStream(int32_t lens);
+
+    // Every stream's subscribers, copied under the stream mutexes
+    std::vector<std::shared_ptr<ImageProcessorThread>> Subscribers() const;
+
+    std::shared_ptr<ImageProcessorThread> CreateSubscriber(
+        VirtualStream& stream, std::shared_ptr<ImageProcessor> processor,
+        PipelinePriority priority);
+
+    Options options_;
+    bool started_ = false;
+
+    mutable std::mutex streams_mutex_;
+    std::map<int32_t, std::unique_ptr<VirtualStream>> streams_;
+};
+
+}  // namespace edge_app
+
+#endif
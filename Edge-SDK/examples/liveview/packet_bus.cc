@@ -0,0 +1,411 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include "packet_bus.h"
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+
+#include "frame_info.h"
+#include "logger.h"
+
+using namespace edge_sdk;
+
+namespace edge_app {
+
+namespace {
+
+const uint32_t kStartCode = 0x01000000;
+
+uint32_t LoadAcquire(const uint32_t* p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+PacketBusParameterSets* ParameterSetsOf(uint8_t* base) {
+    return (PacketBusParameterSets*)(base + sizeof(PacketBusHeader));
+}
+
+PacketBusEntry* EntryAt(uint8_t* base, uint64_t number) {
+    auto header = (PacketBusHeader*)base;
+    auto entries = (PacketBusEntry*)(base + sizeof(PacketBusHeader) +
+                                     sizeof(PacketBusParameterSets));
+    return entries + number % header->index_count;
+}
+
+// The payload ring starts page aligned after the entries
+size_t PayloadOffset(uint32_t index_count) {
+    size_t size = sizeof(PacketBusHeader) + sizeof(PacketBusParameterSets) +
+                  (size_t)index_count * sizeof(PacketBusEntry);
+    return (size + 4095) / 4096 * 4096;
+}
+
+size_t BusSize(const PacketBusHeader* header) {
+    return PayloadOffset(header->index_count) + header->data_size;
+}
+
+// Stores |nal| with a 4 byte start code in |dst|, returns the size written
+uint32_t CopyParameterSet(const H264Nal& nal, uint8_t* dst) {
+    memcpy(dst, &kStartCode, sizeof(kStartCode));
+    memcpy(dst + sizeof(kStartCode), nal.data, nal.size);
+    return sizeof(kStartCode) + nal.size;
+}
+
+}  // namespace
+
+PacketBusPublisher::~PacketBusPublisher() {
+    if (base_) {
+        munmap(base_, mapped_size_);
+        base_ = nullptr;
+    }
+}
+
+int32_t PacketBusPublisher::Init() {
+    if (base_) {
+        return 0;
+    }
+    if (options_.index_count < 16) options_.index_count = 16;
+    mapped_size_ = PayloadOffset(options_.index_count) + options_.data_size;
+
+    int fd = shm_open(options_.name.c_str(), O_RDWR | O_CREAT, 0666);
+    if (fd < 0) {
+        ERROR("shm_open %s failed: %s", options_.name.c_str(),
+              strerror(errno));
+        return -1;
+    }
+    if (ftruncate(fd, mapped_size_) != 0) {
+        ERROR("sizing %s failed: %s", options_.name.c_str(), strerror(errno));
+        close(fd);
+        return -1;
+    }
+    void* addr = mmap(nullptr, mapped_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        ERROR("mmap %s failed: %s", options_.name.c_str(), strerror(errno));
+        return -1;
+    }
+    base_ = (uint8_t*)addr;
+
+    // Readers of a previous layout see the magic go and reopen
+    auto header = (PacketBusHeader*)base_;
+    bool restart = header->magic == PacketBusHeader::kMagic &&
+                   header->version == PacketBusHeader::kVersion;
+    __atomic_store_n(&header->magic, 0, __ATOMIC_RELEASE);
+    // Numbers and offsets go on across restarts, a reader that missed the
+    // magic change then only sees its packets overwritten
+    if (restart) {
+        packet_number_ = header->write_index;
+        write_offset_ = header->write_offset;
+    }
+    memset(base_ + sizeof(PacketBusHeader), 0,
+           PayloadOffset(options_.index_count) - sizeof(PacketBusHeader));
+    header->version = PacketBusHeader::kVersion;
+    header->index_count = options_.index_count;
+    header->data_size = options_.data_size;
+    header->last_keyframe = 0;
+    __atomic_store_n(&header->magic, PacketBusHeader::kMagic,
+                     __ATOMIC_RELEASE);
+
+    INFO("packet bus %s: %u packets, %u bytes", options_.name.c_str(),
+         options_.index_count, options_.data_size);
+    return 0;
+}
+
+void PacketBusPublisher::Input(const uint8_t* data, size_t length) {
+    if (!base_) {
+        return;
+    }
+    if (reset_pending_.exchange(false)) {
+        splitter_.Reset();
+        unit_timestamp_us_ = 0;
+    }
+    int64_t now = GetMonotonicTimeUs();
+    if (unit_timestamp_us_ == 0) {
+        unit_timestamp_us_ = now;
+    }
+    splitter_.Input(data, length,
+                    [&](const H264AccessUnitSplitter::AccessUnit& unit) {
+                        Publish(unit, unit_timestamp_us_);
+                        // The next one starts in this chunk
+                        unit_timestamp_us_ = now;
+                    });
+}
+
+void PacketBusPublisher::Publish(
+    const H264AccessUnitSplitter::AccessUnit& unit, int64_t timestamp_us) {
+    auto header = (PacketBusHeader*)base_;
+    if (unit.size > options_.data_size / 2) {
+        if (!oversize_reported_) {
+            WARN("packet bus %s: %zu byte access unit does not fit, not "
+                 "published",
+                 options_.name.c_str(), unit.size);
+            oversize_reported_ = true;
+        }
+        return;
+    }
+    if (unit.keyframe || unit.parameter_sets) {
+        int32_t lens = pending_lens_.exchange(0);
+        if (lens != 0) {
+            lens_ = lens;
+        }
+    }
+    if (unit.parameter_sets) {
+        UpdateParameterSets(unit);
+    }
+
+    // Reserve the bytes first: readers copying a packet there notice it
+    uint64_t offset = write_offset_;
+    uint32_t position = offset % options_.data_size;
+    if (position + unit.size > options_.data_size) {
+        offset += options_.data_size - position;
+        position = 0;
+    }
+    write_offset_ = offset + unit.size;
+    __atomic_store_n(&header->write_offset, write_offset_, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(base_ + PayloadOffset(options_.index_count) + position, unit.data,
+           unit.size);
+
+    uint64_t number = ++packet_number_;
+    auto entry = EntryAt(base_, number);
+    __atomic_store_n(&entry->number, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    entry->offset = offset;
+    entry->timestamp_us = timestamp_us;
+    entry->size = unit.size;
+    entry->flags = (unit.keyframe ? kPacketBusKeyframe : 0) |
+                   (unit.parameter_sets ? kPacketBusParameterSets : 0);
+    entry->lens = lens_;
+    __atomic_store_n(&entry->number, number, __ATOMIC_RELEASE);
+
+    if (unit.keyframe) {
+        __atomic_store_n(&header->last_keyframe, number, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&header->write_index, number, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&header->notify, 1, __ATOMIC_RELEASE);
+    syscall(SYS_futex, &header->notify, FUTEX_WAKE, INT_MAX, nullptr, nullptr,
+            0);
+}
+
+void PacketBusPublisher::UpdateParameterSets(
+    const H264AccessUnitSplitter::AccessUnit& unit) {
+    H264Nal sps, pps;
+    H264Nal nal;
+    H264NalReader reader(unit.data, unit.size);
+    while (reader.Next(&nal)) {
+        if (nal.type == kH264NalSps) sps = nal;
+        if (nal.type == kH264NalPps) pps = nal;
+    }
+    const size_t max = PacketBusParameterSets::kMaxSize - sizeof(kStartCode);
+    if (!sps.data || !pps.data || sps.size > max || pps.size > max) {
+        return;
+    }
+
+    auto header = (PacketBusHeader*)base_;
+    auto sets = ParameterSetsOf(base_);
+    if (sets->sps_size == sizeof(kStartCode) + sps.size &&
+        sets->pps_size == sizeof(kStartCode) + pps.size &&
+        memcmp(sets->sps + sizeof(kStartCode), sps.data, sps.size) == 0 &&
+        memcmp(sets->pps + sizeof(kStartCode), pps.data, pps.size) == 0) {
+        return;
+    }
+    uint32_t sequence = header->parameter_sequence;
+    __atomic_store_n(&header->parameter_sequence, sequence + 1,
+                     __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    sets->sps_size = CopyParameterSet(sps, sets->sps);
+    sets->pps_size = CopyParameterSet(pps, sets->pps);
+    __atomic_store_n(&header->parameter_sequence, sequence + 2,
+                     __ATOMIC_RELEASE);
+}
+
+PacketBusReader::~PacketBusReader() {
+    if (base_) {
+        munmap(base_, mapped_size_);
+        base_ = nullptr;
+    }
+}
+
+int32_t PacketBusReader::Open(bool from_last_keyframe) {
+    if (base_) {
+        munmap(base_, mapped_size_);
+        base_ = nullptr;
+    }
+    from_last_keyframe_ = from_last_keyframe;
+    int fd = shm_open(name_.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(PacketBusHeader)) {
+        close(fd);
+        return -1;
+    }
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return -1;
+    }
+    base_ = (uint8_t*)addr;
+    mapped_size_ = st.st_size;
+
+    auto header = (const PacketBusHeader*)base_;
+    if (LoadAcquire(&header->magic) != PacketBusHeader::kMagic ||
+        header->version != PacketBusHeader::kVersion ||
+        header->index_count == 0 || header->data_size == 0 ||
+        BusSize(header) > mapped_size_) {
+        munmap(base_, mapped_size_);
+        base_ = nullptr;
+        return -1;
+    }
+    Attach();
+    return 0;
+}
+
+void PacketBusReader::Attach() {
+    auto header = (const PacketBusHeader*)base_;
+    uint64_t written = __atomic_load_n(&header->write_index, __ATOMIC_ACQUIRE);
+    uint64_t keyframe =
+        __atomic_load_n(&header->last_keyframe, __ATOMIC_ACQUIRE);
+    next_ = written + 1;
+    if (from_last_keyframe_ && keyframe != 0 &&
+        written - keyframe < header->index_count) {
+        next_ = keyframe;
+    }
+    synced_ = false;
+}
+
+int32_t PacketBusReader::ReadParameterSets(
+    std::vector<uint8_t>* data) const {
+    auto header = (PacketBusHeader*)base_;
+    auto sets = ParameterSetsOf(base_);
+    // Bounded, in case the writer died in the middle of an update
+    for (int32_t i = 0; i < 1000; i++) {
+        uint32_t sequence = LoadAcquire(&header->parameter_sequence);
+        if (sequence & 1) {
+            continue;
+        }
+        uint32_t sps_size = sets->sps_size;
+        uint32_t pps_size = sets->pps_size;
+        if (sps_size > PacketBusParameterSets::kMaxSize ||
+            pps_size > PacketBusParameterSets::kMaxSize) {
+            continue;
+        }
+        data->assign(sets->sps, sets->sps + sps_size);
+        data->insert(data->end(), sets->pps, sets->pps + pps_size);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&header->parameter_sequence, __ATOMIC_RELAXED) ==
+            sequence) {
+            return 0;
+        }
+    }
+    data->clear();
+    return -1;
+}
+
+int32_t PacketBusReader::Next(Packet* packet) {
+    if (!base_) {
+        return -1;
+    }
+    auto header = (PacketBusHeader*)base_;
+    for (;;) {
+        // Re-created, possibly bigger than mapped here
+        if (LoadAcquire(&header->magic) != PacketBusHeader::kMagic ||
+            header->index_count == 0 || header->data_size == 0 ||
+            BusSize(header) > mapped_size_) {
+            return -1;
+        }
+        uint64_t written =
+            __atomic_load_n(&header->write_index, __ATOMIC_ACQUIRE);
+        if (next_ > written) {
+            return 1;
+        }
+        auto entry = EntryAt(base_, next_);
+        uint64_t number = __atomic_load_n(&entry->number, __ATOMIC_ACQUIRE);
+        PacketBusEntry copy = *entry;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (written - next_ >= header->index_count || number != next_ ||
+            __atomic_load_n(&entry->number, __ATOMIC_RELAXED) != next_ ||
+            copy.size > header->data_size / 2) {
+            // Lapped by the writer
+            lagged_++;
+            Attach();
+            continue;
+        }
+        if (!synced_ && !(copy.flags & kPacketBusKeyframe)) {
+            next_++;
+            continue;
+        }
+
+        packet->data.clear();
+        if (!synced_ && !(copy.flags & kPacketBusParameterSets)) {
+            ReadParameterSets(&packet->data);
+        }
+        size_t prefix = packet->data.size();
+        packet->data.resize(prefix + copy.size);
+        memcpy(packet->data.data() + prefix,
+               base_ + PayloadOffset(header->index_count) +
+                   copy.offset % header->data_size,
+               copy.size);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&header->write_offset, __ATOMIC_RELAXED) >
+            copy.offset + header->data_size) {
+            lagged_++;
+            Attach();
+            continue;
+        }
+
+        packet->header = copy;
+        packet->discontinuity = !synced_;
+        synced_ = true;
+        next_++;
+        return 0;
+    }
+}
+
+int32_t PacketBusReader::Wait(int32_t timeout_ms) {
+    if (!base_) {
+        return -1;
+    }
+    auto header = (PacketBusHeader*)base_;
+    struct timespec timeout = {timeout_ms / 1000,
+                               (timeout_ms % 1000) * 1000000L};
+    uint32_t notify = LoadAcquire(&header->notify);
+    if (__atomic_load_n(&header->write_index, __ATOMIC_ACQUIRE) >= next_) {
+        return 0;
+    }
+    syscall(SYS_futex, &header->notify, FUTEX_WAIT, notify, &timeout, nullptr,
+            0);
+    return __atomic_load_n(&header->write_index, __ATOMIC_ACQUIRE) >= next_
+               ? 0
+               : 1;
+}
+
+}  // namespace edge_app
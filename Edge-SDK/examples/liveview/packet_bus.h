@@ -0,0 +1,219 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#ifndef __PACKET_BUS_H__
+#define __PACKET_BUS_H__
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "h264_bitstream.h"
+
+namespace edge_app {
+
+/*
+ * Shared memory ring of the compressed H.264 stream, one packet per access
+ * unit, for local processes that want the stream itself (recording, uplink,
+ * forwarding) while the Liveview callback stays with this process. Layout,
+ * little endian:
+ *
+ *   PacketBusHeader | PacketBusParameterSets | PacketBusEntry[index_count]
+ *   | payload ring of data_size bytes
+ *
+ * Packet N (from 1) is described by entry N % index_count, guarded by its
+ * |number| (0 while written). Its payload is at |offset| % data_size and
+ * never wraps: |offset| is a running byte count, and the writer reserves
+ * the bytes in |write_offset| before overwriting them. A payload copied out
+ * is intact if |write_offset| is still at most |offset| + data_size after
+ * the copy. The writer never waits for readers; a lagging reader starts
+ * again at a keyframe.
+ */
+struct PacketBusHeader {
+    enum : uint32_t {
+        kMagic = 0x42504A44,  // "DJPB"
+        kVersion = 1,
+    };
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t index_count;
+    uint32_t data_size;
+    // Newest complete packet number, 0 before the first
+    uint64_t write_index;
+    // Payload bytes reserved so far
+    uint64_t write_offset;
+    // Newest keyframe packet number, 0 before the first
+    uint64_t last_keyframe;
+    // Bumped with every packet, readers can FUTEX_WAIT on it
+    uint32_t notify;
+    // Seqlock of PacketBusParameterSets
+    uint32_t parameter_sequence;
+    uint32_t reserved[4];
+};
+
+static_assert(sizeof(PacketBusHeader) == 64, "PacketBusHeader layout changed");
+
+/*
+ * Latest SPS and PPS seen in the stream, with a 4 byte start code each, so
+ * that a reader can start decoding at an IDR that does not repeat them.
+ */
+struct PacketBusParameterSets {
+    enum : uint32_t {
+        kMaxSize = 248,
+    };
+
+    uint32_t sps_size;
+    uint32_t pps_size;
+    uint8_t sps[kMaxSize];
+    uint8_t pps[kMaxSize];
+};
+
+static_assert(sizeof(PacketBusParameterSets) == 504,
+              "PacketBusParameterSets layout changed");
+
+enum PacketBusFlags : uint32_t {
+    // Starts with an IDR picture, decoding can begin here
+    kPacketBusKeyframe = 1 << 0,
+    // Carries its own SPS and PPS
+    kPacketBusParameterSets = 1 << 1,
+};
+
+struct PacketBusEntry {
+    uint64_t number;
+    uint64_t offset;
+    // CLOCK_MONOTONIC arrival time of the access unit's first bytes
+    int64_t timestamp_us;
+    uint32_t size;
+    uint32_t flags;
+    // edge_sdk::Liveview::CameraSource, 0 until the first switch
+    int32_t lens;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(PacketBusEntry) == 40, "PacketBusEntry layout changed");
+
+/*
+ * Publisher, fed with the Liveview stream as it arrives. Input() is called
+ * from the stream callback thread only, Reset() and SwitchSource() from any
+ * thread.
+ */
+class PacketBusPublisher {
+   public:
+    struct Options {
+        // POSIX shared memory name, starting with '/'
+        std::string name = "/drone_packets";
+        // A few seconds of 1080p, bigger access units are not published
+        uint32_t data_size = 8 * 1024 * 1024;
+        uint32_t index_count = 1024;
+    };
+
+    explicit PacketBusPublisher(const Options& options) : options_(options) {}
+
+    ~PacketBusPublisher();
+
+    int32_t Init();
+
+    void Input(const uint8_t* data, size_t length);
+
+    // Drops the access unit in progress, when the stream is resubscribed.
+    // Done by the next Input(), on the callback thread.
+    void Reset() { reset_pending_ = true; }
+
+    // The camera acknowledged a switch to |lens|: packets are tagged with it
+    // from the next keyframe or SPS on
+    void SwitchSource(int32_t lens) { pending_lens_ = lens; }
+
+    uint64_t Published() const { return packet_number_; }
+
+   private:
+    void Publish(const H264AccessUnitSplitter::AccessUnit& unit,
+                 int64_t timestamp_us);
+
+    void UpdateParameterSets(const H264AccessUnitSplitter::AccessUnit& unit);
+
+    Options options_;
+    uint8_t* base_ = nullptr;
+    size_t mapped_size_ = 0;
+    H264AccessUnitSplitter splitter_;
+    int64_t unit_timestamp_us_ = 0;
+    uint64_t packet_number_ = 0;
+    uint64_t write_offset_ = 0;
+    int32_t lens_ = 0;
+    std::atomic<int32_t> pending_lens_{0};
+    std::atomic<bool> reset_pending_{false};
+    bool oversize_reported_ = false;
+};
+
+/*
+ * Reader of a bus, from any process. Packets are copied out of the ring.
+ * Not thread safe.
+ */
+class PacketBusReader {
+   public:
+    struct Packet {
+        PacketBusEntry header;
+        // The access unit, Annex B. On a keyframe following a discontinuity
+        // the SPS and PPS snapshot is prepended when the unit lacks them,
+        // so the data can always be fed to a decoder as is.
+        std::vector<uint8_t> data;
+        // First packet after attaching or after falling behind the writer
+        bool discontinuity = false;
+    };
+
+    explicit PacketBusReader(const std::string& name) : name_(name) {}
+
+    ~PacketBusReader();
+
+    // Attaches at the next keyframe, or with |from_last_keyframe| at the
+    // newest one still in the ring, which starts without waiting for a GOP
+    // at the price of its latency
+    int32_t Open(bool from_last_keyframe = false);
+
+    // Next packet: 0 on success, 1 if there is none yet, -1 if the bus is
+    // gone or was re-created (Open again)
+    int32_t Next(Packet* packet);
+
+    // Waits until a packet is published after the ones already read
+    int32_t Wait(int32_t timeout_ms);
+
+    // Times the reader fell behind and skipped to a keyframe
+    uint64_t Lagged() const { return lagged_; }
+
+   private:
+    // Positions |next_| where the reader starts again
+    void Attach();
+
+    int32_t ReadParameterSets(std::vector<uint8_t>* data) const;
+
+    std::string name_;
+    uint8_t* base_ = nullptr;
+    size_t mapped_size_ = 0;
+    bool from_last_keyframe_ = false;
+    uint64_t next_ = 0;
+    bool synced_ = false;
+    uint64_t lagged_ = 0;
+};
+
+}  // namespace edge_app
+
+#endif
@@ -0,0 +1,314 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include "pipeline_runtime.h"
+
+#include <pthread.h>
+#include <time.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+#include "frame_info.h"
+#include "logger.h"
+
+using namespace edge_sdk;
+
+namespace edge_app {
+
+static thread_local int32_t current_worker = -1;
+
+static int64_t GetThreadCpuTimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+PipelineStrand::PipelineStrand(PipelineRuntime* runtime,
+                               const std::string& stream,
+                               const std::string& stage,
+                               PipelinePriority priority)
+    : runtime_(runtime), stream_(stream), stage_(stage), priority_(priority) {
+    cpu_ns_ = 0;
+    task_count_ = 0;
+}
+
+void PipelineStrand::Post(std::function<void()> task) {
+    bool schedule = false;
+    {
+        std::lock_guard<std::mutex> l(task_mutex_);
+        if (closed_) return;
+        tasks_.push_back(std::move(task));
+        if (!scheduled_) {
+            scheduled_ = true;
+            schedule = true;
+        }
+    }
+    if (schedule) runtime_->Schedule(shared_from_this());
+}
+
+void PipelineStrand::Close() {
+    std::unique_lock<std::mutex> l(task_mutex_);
+    closed_ = true;
+    tasks_.clear();
+    if (running_thread_ == std::this_thread::get_id()) return;
+    idle_cv_.wait(l, [&] { return !running_; });
+}
+
+void PipelineStrand::RunOne() {
+    std::function<void()> task;
+    {
+        std::lock_guard<std::mutex> l(task_mutex_);
+        // Closed, or tasks dropped, while queued
+        if (tasks_.empty()) {
+            scheduled_ = false;
+            return;
+        }
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+        running_ = true;
+        running_thread_ = std::this_thread::get_id();
+    }
+
+    auto start = GetThreadCpuTimeNs();
+    task();
+    cpu_ns_ += GetThreadCpuTimeNs() - start;
+    task_count_++;
+
+    bool reschedule = false;
+    {
+        std::lock_guard<std::mutex> l(task_mutex_);
+        running_ = false;
+        running_thread_ = std::thread::id();
+        reschedule = !tasks_.empty();
+        if (!reschedule) scheduled_ = false;
+    }
+    idle_cv_.notify_all();
+    // Back to the end of the queue, behind the other strands
+    if (reschedule) runtime_->Schedule(shared_from_this());
+}
+
+PipelineRuntime* PipelineRuntime::Instance() {
+    static PipelineRuntime runtime;
+    return &runtime;
+}
+
+int32_t PipelineRuntime::Start(const Options& options) {
+    if (runtime_start_) {
+        WARN("repeat start pipeline runtime");
+        return -1;
+    }
+    options_ = options;
+    int32_t thread_num =
+        options.thread_num > 0
+            ? options.thread_num
+            : (int32_t)std::thread::hardware_concurrency() - 1;
+    thread_num = std::max(thread_num, 1);
+
+    {
+        std::lock_guard<std::mutex> l(workers_mutex_);
+        for (int32_t i = 0; i < thread_num; i++) {
+            workers_.push_back(std::unique_ptr<Worker>(new Worker()));
+        }
+        next_worker_ = 0;
+        queued_ = 0;
+        last_report_us_ = GetMonotonicTimeUs();
+        runtime_start_ = true;
+    }
+
+    for (int32_t i = 0; i < thread_num; i++) {
+        auto& thread = workers_[i]->thread;
+        thread = std::thread(&PipelineRuntime::WorkerLoop, this, i);
+        if (options.realtime_priority > 0) {
+            sched_param sch;
+            int policy;
+            pthread_getschedparam(thread.native_handle(), &policy, &sch);
+            sch.sched_priority = options.realtime_priority;
+            if (pthread_setschedparam(thread.native_handle(), SCHED_FIFO,
+                                      &sch)) {
+                ERROR("Failed to setschedparam: %s", strerror(errno));
+            }
+        }
+    }
+    INFO("pipeline runtime started: %d workers", thread_num);
+    return 0;
+}
+
+int32_t PipelineRuntime::Stop() {
+    {
+        // No Schedule() enqueues anything past this point
+        std::lock_guard<std::mutex> workers_lock(workers_mutex_);
+        std::lock_guard<std::mutex> l(idle_mutex_);
+        runtime_start_ = false;
+    }
+    idle_cv_.notify_all();
+    for (auto& worker : workers_) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+
+    // Strands left in the queues are no longer scheduled: a later Post()
+    // schedules them again
+    std::lock_guard<std::mutex> workers_lock(workers_mutex_);
+    for (auto& worker : workers_) {
+        for (auto& queue : worker->queues) {
+            for (auto& strand : queue) {
+                std::lock_guard<std::mutex> l(strand->task_mutex_);
+                strand->scheduled_ = false;
+            }
+            queue.clear();
+        }
+    }
+    workers_.clear();
+    return 0;
+}
+
+std::shared_ptr<PipelineStrand> PipelineRuntime::CreateStrand(
+    const std::string& stream, const std::string& stage,
+    PipelinePriority priority) {
+    auto strand =
+        std::make_shared<PipelineStrand>(this, stream, stage, priority);
+    std::lock_guard<std::mutex> l(strands_mutex_);
+    strands_.push_back(strand);
+    return strand;
+}
+
+void PipelineRuntime::Schedule(std::shared_ptr<PipelineStrand> strand) {
+    {
+        std::lock_guard<std::mutex> workers_lock(workers_mutex_);
+        if (!runtime_start_ || workers_.empty()) {
+            std::lock_guard<std::mutex> l(strand->task_mutex_);
+            strand->scheduled_ = false;
+            return;
+        }
+        // Keep the strand on the worker that ran it last, for locality
+        int32_t index = current_worker >= 0
+                            ? current_worker
+                            : (int32_t)(next_worker_++ % workers_.size());
+        auto& worker = *workers_[index];
+        std::lock_guard<std::mutex> l(worker.queue_mutex);
+        worker.queues[strand->Priority()].push_back(std::move(strand));
+    }
+    {
+        std::lock_guard<std::mutex> l(idle_mutex_);
+        queued_++;
+    }
+    idle_cv_.notify_one();
+}
+
+std::shared_ptr<PipelineStrand> PipelineRuntime::Take(int32_t index) {
+    int32_t worker_num = (int32_t)workers_.size();
+    std::shared_ptr<PipelineStrand> strand;
+    for (int32_t priority = 0; priority < kPipelinePriorityNum && !strand;
+         priority++) {
+        // Own queue first, oldest strand first for fairness
+        {
+            auto& queue = workers_[index]->queues[priority];
+            std::lock_guard<std::mutex> l(workers_[index]->queue_mutex);
+            if (!queue.empty()) {
+                strand = std::move(queue.front());
+                queue.pop_front();
+            }
+        }
+        // Then steal the newest strand of another worker
+        for (int32_t i = 1; i < worker_num && !strand; i++) {
+            auto& victim = *workers_[(index + i) % worker_num];
+            std::lock_guard<std::mutex> l(victim.queue_mutex);
+            auto& queue = victim.queues[priority];
+            if (!queue.empty()) {
+                strand = std::move(queue.back());
+                queue.pop_back();
+            }
+        }
+    }
+    if (strand) {
+        std::lock_guard<std::mutex> l(idle_mutex_);
+        queued_--;
+    }
+    return strand;
+}
+
+void PipelineRuntime::WorkerLoop(int32_t index) {
+    char name[16];
+    snprintf(name, sizeof(name), "pipeline%d", index);
+    pthread_setname_np(pthread_self(), name);
+    current_worker = index;
+
+    while (runtime_start_) {
+        auto strand = Take(index);
+        if (!strand) {
+            std::unique_lock<std::mutex> l(idle_mutex_);
+            idle_cv_.wait(l, [&] { return queued_ > 0 || !runtime_start_; });
+            continue;
+        }
+        strand->RunOne();
+
+        auto now = GetMonotonicTimeUs();
+        int64_t last = last_report_us_;
+        if (now - last >= options_.report_interval_s * 1000000LL &&
+            last_report_us_.compare_exchange_strong(last, now)) {
+            Report(now - last);
+        }
+    }
+    current_worker = -1;
+}
+
+void PipelineRuntime::Report(int64_t elapsed_us) {
+    struct StreamUsage {
+        int64_t cpu_ns = 0;
+        std::string stages;
+    };
+    std::map<std::string, StreamUsage> streams;
+    double capacity_ns = (double)elapsed_us * 1000 * workers_.size();
+
+    {
+        std::lock_guard<std::mutex> l(strands_mutex_);
+        for (auto it = strands_.begin(); it != strands_.end();) {
+            auto strand = it->lock();
+            if (!strand) {
+                it = strands_.erase(it);
+                continue;
+            }
+            int64_t cpu_ns = strand->cpu_ns_.exchange(0);
+            uint64_t tasks = strand->task_count_.exchange(0);
+            auto& usage = streams[strand->Stream()];
+            usage.cpu_ns += cpu_ns;
+            char stage[96];
+            snprintf(stage, sizeof(stage), "%s%s %.1f%% %llu tasks",
+                     usage.stages.empty() ? "" : ", ",
+                     strand->Stage().c_str(), cpu_ns * 100.0 / capacity_ns,
+                     (unsigned long long)tasks);
+            usage.stages += stage;
+            ++it;
+        }
+    }
+    for (const auto& stream : streams) {
+        INFO("pipeline %s: %.1f%% of %zu workers (%s)", stream.first.c_str(),
+             stream.second.cpu_ns * 100.0 / capacity_ns, workers_.size(),
+             stream.second.stages.c_str());
+    }
+}
+
+}  // namespace edge_app
@@ -0,0 +1,176 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#ifndef __PIPELINE_RUNTIME_H__
+#define __PIPELINE_RUNTIME_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace edge_app {
+
+enum PipelinePriority {
+    kPipelinePriorityHigh = 0,
+    kPipelinePriorityNormal = 1,
+    kPipelinePriorityLow = 2,
+    kPipelinePriorityNum = 3,
+};
+
+class PipelineRuntime;
+
+/*
+ * Serial task queue of one pipeline stage of one stream (e.g. the payload
+ * decoder). Tasks of a strand run in order and never concurrently, on any
+ * worker of the runtime; a strand runs one task each time it is scheduled,
+ * so the strands of the same priority share the workers round robin.
+ */
+class PipelineStrand : public std::enable_shared_from_this<PipelineStrand> {
+   public:
+    PipelineStrand(PipelineRuntime* runtime, const std::string& stream,
+                   const std::string& stage, PipelinePriority priority);
+
+    // Dropped once the strand is closed
+    void Post(std::function<void()> task);
+
+    // Drops the pending tasks and waits for the running one, unless called
+    // from it: no task of the strand runs after Close() returns, so tasks
+    // may capture the raw pointer of an object that closes the strand
+    // before it is destroyed.
+    void Close();
+
+    const std::string& Stream() const { return stream_; }
+
+    const std::string& Stage() const { return stage_; }
+
+    PipelinePriority Priority() const { return priority_; }
+
+   private:
+    friend class PipelineRuntime;
+
+    void RunOne();
+
+    PipelineRuntime* runtime_;
+    std::string stream_;
+    std::string stage_;
+    PipelinePriority priority_;
+
+    std::mutex task_mutex_;
+    std::condition_variable idle_cv_;
+    std::deque<std::function<void()>> tasks_;
+    // In a worker queue or running
+    bool scheduled_ = false;
+    bool running_ = false;
+    bool closed_ = false;
+    std::thread::id running_thread_;
+
+    // Thread CPU time spent in the tasks, reset by each report
+    std::atomic<int64_t> cpu_ns_;
+    std::atomic<uint64_t> task_count_;
+};
+
+/*
+ * One worker pool for the decode, process and encode work of all the
+ * streams, sized to the machine, instead of a decode and a process thread
+ * per stream. Every worker owns one deque per priority; scheduled strands go
+ * to the deque of the scheduling worker (round robin from other threads),
+ * workers serve the highest priority first and steal from the others when
+ * their own deques are empty. The CPU share of each stream is logged
+ * periodically.
+ */
+class PipelineRuntime {
+   public:
+    struct Options {
+        // 0 is one worker per core but one, left to the SDK callbacks and
+        // the other threads
+        int32_t thread_num = 0;
+        // SCHED_FIFO priority of the workers, 0 keeps SCHED_OTHER. The tasks
+        // include long forwards and file writes: a saturated realtime pool
+        // would starve every other thread.
+        int32_t realtime_priority = 0;
+        int32_t report_interval_s = 10;
+    };
+
+    static PipelineRuntime* Instance();
+
+    int32_t Start(const Options& options);
+
+    int32_t Stop();
+
+    bool Running() const { return runtime_start_; }
+
+    int32_t ThreadNum() const {
+        std::lock_guard<std::mutex> l(workers_mutex_);
+        return (int32_t)workers_.size();
+    }
+
+    std::shared_ptr<PipelineStrand> CreateStrand(const std::string& stream,
+                                                 const std::string& stage,
+                                                 PipelinePriority priority);
+
+   private:
+    friend class PipelineStrand;
+
+    struct Worker {
+        std::mutex queue_mutex;
+        std::deque<std::shared_ptr<PipelineStrand>>
+            queues[kPipelinePriorityNum];
+        std::thread thread;
+    };
+
+    PipelineRuntime() { runtime_start_ = false; }
+
+    // Rejected, and the strand unscheduled, once the runtime is stopping
+    void Schedule(std::shared_ptr<PipelineStrand> strand);
+
+    std::shared_ptr<PipelineStrand> Take(int32_t index);
+
+    void WorkerLoop(int32_t index);
+
+    void Report(int64_t elapsed_us);
+
+    Options options_;
+    // Changed by Start() and Stop() only; Schedule() reads it under
+    // |workers_mutex_|, the workers while they run
+    mutable std::mutex workers_mutex_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<bool> runtime_start_;
+    std::atomic<uint32_t> next_worker_;
+
+    // Scheduled strands not taken yet, to park idle workers
+    std::mutex idle_mutex_;
+    std::condition_variable idle_cv_;
+    int32_t queued_ = 0;
+
+    std::mutex strands_mutex_;
+    std::vector<std::weak_ptr<PipelineStrand>> strands_;
+    std::atomic<int64_t> last_report_us_;
+};
+
+}  // namespace edge_app
+
+#endif
@@ -23,35 +23,55 @@
 
 #include <unistd.h>
 
+#include <algorithm>
+
 #include "liveview/liveview.h"
 
-#define BITRATE_CALCULATE_BITS_PER_BYTE 8
-#define BITRATE_CALCULATE_INTERVAL_TIME_MS 2000
+namespace {
+
+// StartH264Stream retries after a quality change, 5 s in total
+const int32_t kRestartRetryNum = 50;
+const int32_t kRestartRetryIntervalMs = 100;
+
+// Period of the downstream overload check
+const int32_t kQualityCheckIntervalMs = 500;
+// Before trying again a quality the stream failed to restart with
+const int64_t kQualityRetryUs = 10 * 1000000;
+
+}  // namespace
 
 using namespace edge_sdk;
 
 namespace edge_app {
 
-LiveviewSample::LiveviewSample(const std::string& name) {
+LiveviewSample::LiveviewSample(const std::string& name) : name_(name) {
     liveview_ = edge_sdk::CreateLiveview();
     liveview_status_ = 0;
 }
 
+LiveviewSample::~LiveviewSample() {
+    {
+        std::lock_guard<std::mutex> l(status_mutex_);
+        quality_thread_stop_ = true;
+    }
+    status_cv_.notify_all();
+    if (quality_thread_.joinable()) {
+        quality_thread_.join();
+    }
+}
+
 ErrorCode LiveviewSample::StreamCallback(const uint8_t* data, size_t len) {
-    auto now =  std::chrono::system_clock::now();
+    auto stalled_ms = stream_statistics_.Input(data, len);
+    if (stalled_ms > 0) {
+        WARN("%s: no stream data for %lld ms", name_.c_str(),
+             (long long)stalled_ms);
+    }
+    if (packet_bus_) {
+        packet_bus_->Input(data, len);
+    }
     if (stream_processor_thread_) {
         stream_processor_thread_->InputStream(data, len);
     }
-
-    // for bitrate calculate
-    receive_stream_data_total_size_ += len;
-    auto duration  = std::chrono::duration_cast<std::chrono::milliseconds>(now - receive_stream_data_time_).count();
-    if (duration >= BITRATE_CALCULATE_INTERVAL_TIME_MS) {
-        auto kbps = receive_stream_data_total_size_ * BITRATE_CALCULATE_BITS_PER_BYTE / (BITRATE_CALCULATE_INTERVAL_TIME_MS / 1000) / 1024;
-        stream_bitrate_kbps_ = kbps;
-        receive_stream_data_total_size_  = 0;
-        receive_stream_data_time_  = now;
-    }
     return kOk;
 }
 
@@ -59,6 +79,8 @@ ErrorCode LiveviewSample::Init(
     Liveview::CameraType type, Liveview::StreamQuality quality,
     std::shared_ptr<StreamProcessorThread> processor) {
     stream_processor_thread_ = processor;
+    type_ = type;
+    quality_ = quality;
 
     auto stream_callback =
         std::bind(&LiveviewSample::StreamCallback, this, std::placeholders::_1,
@@ -74,39 +96,170 @@ ErrorCode LiveviewSample::Init(
 }
 
 ErrorCode LiveviewSample::Start() {
+    if (quality_thread_.joinable()) {
+        return kErrorInvalidOperation;
+    }
     if (stream_processor_thread_->Start() != 0) {
         ERROR("stream processor start failed");
         return kErrorInvalidOperation;
     }
-    std::thread([&] {
-        // Waiting for the liveview to be available before starting,
-        // otherwise the StartH264Stream() will fail.
-        while (liveview_status_ == 0) sleep(1);
-        auto rc = liveview_->StartH264Stream();
-        if (rc != kOk) {
-            ERROR("Failed to start liveview: %d", rc);
-        }
-    }).detach();
+    quality_thread_ = std::thread(&LiveviewSample::QualityControl, this);
     return kOk;
 }
 
 void LiveviewSample::LiveviewStatusCallback(
     const Liveview::LiveviewStatus& status) {
-    liveview_status_ = status;
+    {
+        std::lock_guard<std::mutex> l(status_mutex_);
+        if (status == liveview_status_) {
+            return;
+        }
+        liveview_status_ = status;
+    }
     DEBUG("status: %d", status);
+    status_cv_.notify_all();
+}
+
+int32_t LiveviewSample::BestAvailableQuality(int32_t limit) const {
+    // Bit N is StreamQuality N, bit 0 the adaptive stream not offered here
+    Liveview::LiveviewStatus status = liveview_status_;
+    for (int32_t quality = limit; quality >= Liveview::kStreamQuality540p;
+         quality--) {
+        if (status & (1u << quality)) {
+            return quality;
+        }
+    }
+    return 0;
+}
+
+void LiveviewSample::QualityControl() {
+    // Waiting for the liveview to be available before starting, otherwise
+    // the StartH264Stream() will fail.
+    QualityPolicy policy;
+    {
+        std::unique_lock<std::mutex> l(status_mutex_);
+        status_cv_.wait(l, [&] {
+            return liveview_status_ != 0 || quality_thread_stop_;
+        });
+        policy = policy_;
+    }
+    if (quality_thread_stop_) {
+        return;
+    }
+    int32_t failed_quality = 0;
+    int64_t failed_us = 0;
+    int32_t best = policy.automatic
+                       ? BestAvailableQuality(policy.max_quality)
+                       : 0;
+    if (best != 0 && best != quality_) {
+        // Subscribed with another quality in Init(), not started yet
+        if (ChangeQuality((Liveview::StreamQuality)best) != kOk) {
+            failed_quality = best;
+            failed_us = GetMonotonicTimeUs();
+        }
+    } else {
+        std::lock_guard<std::mutex> l(liveview_mutex_);
+        auto rc = liveview_->StartH264Stream();
+        if (rc != kOk) {
+            ERROR("Failed to start liveview: %d", rc);
+        }
+    }
+
+    auto dropped = [&] {
+        return stream_processor_thread_->DroppedImages() +
+               overload_reports_.load();
+    };
+    uint64_t drops = dropped();
+    int64_t overload_since_us = 0;
+    int64_t calm_since_us = GetMonotonicTimeUs();
+
+    while (!quality_thread_stop_) {
+        int32_t target = 0;
+        {
+            std::unique_lock<std::mutex> l(status_mutex_);
+            status_cv_.wait_for(
+                l, std::chrono::milliseconds(kQualityCheckIntervalMs));
+            if (quality_thread_stop_) {
+                break;
+            }
+
+            int64_t now = GetMonotonicTimeUs();
+            uint64_t total = dropped();
+            if (total != drops) {
+                if (overload_since_us == 0) overload_since_us = now;
+                calm_since_us = now;
+            } else {
+                overload_since_us = 0;
+            }
+            drops = total;
+            if (!policy_.automatic) {
+                continue;
+            }
+
+            int32_t current = quality_;
+            if (overload_since_us != 0 &&
+                now - overload_since_us >=
+                    (int64_t)policy_.overload_ms * 1000 &&
+                current > Liveview::kStreamQuality540p) {
+                quality_limit_ = current - 1;
+                overload_since_us = 0;
+                WARN("%s: frames dropped downstream for %d ms, quality "
+                     "limited to %d",
+                     name_.c_str(), policy_.overload_ms, quality_limit_);
+            } else if (now - calm_since_us >=
+                           (int64_t)policy_.recover_ms * 1000 &&
+                       quality_limit_ < policy_.max_quality) {
+                quality_limit_++;
+                calm_since_us = now;
+                INFO("%s: no drops for %d ms, quality limited to %d",
+                     name_.c_str(), policy_.recover_ms, quality_limit_);
+            }
+            target = BestAvailableQuality(
+                std::min(quality_limit_, (int32_t)policy_.max_quality));
+            if (target == failed_quality &&
+                now - failed_us < kQualityRetryUs) {
+                target = 0;
+            }
+        }
+        if (target == 0 || target == quality_) {
+            continue;
+        }
+
+        if (ChangeQuality((Liveview::StreamQuality)target) != kOk) {
+            failed_quality = target;
+            failed_us = GetMonotonicTimeUs();
+        }
+        // Frames dropped around the restart are not an overload
+        drops = dropped();
+        overload_since_us = 0;
+        calm_since_us = GetMonotonicTimeUs();
+    }
+}
+
+void LiveviewSample::SetQualityPolicy(const QualityPolicy& policy) {
+    {
+        std::lock_guard<std::mutex> l(status_mutex_);
+        policy_ = policy;
+        quality_limit_ = policy.max_quality;
+    }
+    INFO("%s: %s quality, up to %d", name_.c_str(),
+         policy.automatic ? "automatic" : "fixed", policy.max_quality);
+    status_cv_.notify_all();
 }
 
 int32_t InitLiveviewSample(std::shared_ptr<LiveviewSample>& liveview_sample, edge_sdk::Liveview::CameraType type,
     edge_sdk::Liveview::StreamQuality quality,
     std::shared_ptr<StreamDecoder> stream_decoder,
-    std::shared_ptr<ImageProcessor> image_processor)
+    std::shared_ptr<ImageProcessor> image_processor,
+    PipelinePriority priority)
 {
-    auto image_processor_thread = std::make_shared<ImageProcessorThread>(stream_decoder->Name());
+    auto image_processor_thread = std::make_shared<ImageProcessorThread>(liveview_sample->Name());
     image_processor_thread->SetImageProcessor(image_processor);
 
     auto stream_processor_thread =
-        std::make_shared<StreamProcessorThread>(stream_decoder->Name());
+        std::make_shared<StreamProcessorThread>(liveview_sample->Name());
     stream_processor_thread->SetStreamDecoder(stream_decoder);
+    stream_processor_thread->SetPriority(priority);
     stream_processor_thread->SetImageProcessorThread(image_processor_thread);
 
     auto rc = liveview_sample->Init(type, quality, stream_processor_thread);
@@ -118,9 +271,131 @@ int32_t InitLiveviewSample(std::shared_ptr<LiveviewSample>& liveview_sample, edg
     return 0;
 }
 
+ErrorCode LiveviewSample::SetStreamQuality(Liveview::StreamQuality quality) {
+    {
+        std::lock_guard<std::mutex> l(status_mutex_);
+        policy_.automatic = false;
+    }
+    return ChangeQuality(quality);
+}
+
+ErrorCode LiveviewSample::ChangeQuality(Liveview::StreamQuality quality) {
+    // One restart at a time, without blocking the other liveview calls
+    std::lock_guard<std::mutex> restart_lock(restart_mutex_);
+    auto previous = quality_.load();
+    if (quality == previous) {
+        return kOk;
+    }
+    INFO("%s: stream quality %d -> %d", name_.c_str(), previous, quality);
+    auto request_us = GetMonotonicTimeUs();
+
+    auto rc = Restart(quality, request_us);
+    if (rc != kOk) {
+        // Back to the stream that was running rather than none at all
+        WARN("%s: restoring quality %d", name_.c_str(), previous);
+        if (Restart(previous, GetMonotonicTimeUs()) != kOk) {
+            ERROR("%s: quality %d could not be restored, no stream",
+                  name_.c_str(), previous);
+        }
+        return rc;
+    }
+    quality_ = quality;
+
+    INFO("%s: restarted with quality %d in %.1f ms", name_.c_str(), quality,
+         (GetMonotonicTimeUs() - request_us) / 1000.0);
+    if (quality_callback_) {
+        quality_callback_(quality);
+    }
+    return kOk;
+}
+
+ErrorCode LiveviewSample::Restart(Liveview::StreamQuality quality,
+                                  int64_t request_us) {
+    {
+        std::lock_guard<std::mutex> l(liveview_mutex_);
+        // SetCameraSource() only records the lens until the restart is over
+        restarting_ = true;
+        restart_lens_ = Lens();
+        liveview_->StopH264Stream();
+        liveview_->DeInit();
+    }
+    // Takes effect on the first stream callback of the new subscription
+    if (packet_bus_) {
+        packet_bus_->Reset();
+    }
+    stream_statistics_.Restart();
+    // The decoder and the image processors keep running: the first frame
+    // of the new stream starts a source generation with the same lens
+    if (stream_processor_thread_) {
+        stream_processor_thread_->ExpectRestart(request_us);
+    }
+
+    auto stream_callback =
+        std::bind(&LiveviewSample::StreamCallback, this, std::placeholders::_1,
+                  std::placeholders::_2);
+    Liveview::Options option = {type_, quality, stream_callback};
+    ErrorCode rc;
+    {
+        std::lock_guard<std::mutex> l(liveview_mutex_);
+        rc = liveview_->Init(option);
+        if (rc == kOk) {
+            liveview_->SubscribeLiveviewStatus(
+                std::bind(&LiveviewSample::LiveviewStatusCallback, this,
+                          std::placeholders::_1));
+        }
+    }
+    if (rc != kOk) {
+        ERROR("%s: liveview init with quality %d failed: %d", name_.c_str(),
+              quality, rc);
+    } else {
+        // The stream becomes available again a moment after the init
+        for (int32_t i = 0; i < kRestartRetryNum; i++) {
+            {
+                std::lock_guard<std::mutex> l(liveview_mutex_);
+                rc = liveview_->StartH264Stream();
+            }
+            if (rc == kOk) break;
+            usleep(kRestartRetryIntervalMs * 1000);
+        }
+        if (rc != kOk) {
+            ERROR("%s: restart with quality %d failed: %d", name_.c_str(),
+                  quality, rc);
+        }
+    }
+
+    std::lock_guard<std::mutex> l(liveview_mutex_);
+    restarting_ = false;
+    if (rc == kOk && restart_lens_ != 0) {
+        ApplyCameraSource((Liveview::CameraSource)restart_lens_,
+                          GetMonotonicTimeUs());
+    }
+    return rc;
+}
+
 ErrorCode LiveviewSample::SetCameraSource(
     edge_sdk::Liveview::CameraSource source) {
-    return liveview_->SetCameraSource(source);
+    std::lock_guard<std::mutex> l(liveview_mutex_);
+    if (restarting_) {
+        // Applied by Restart() once the stream is back
+        restart_lens_ = (int32_t)source;
+        return kOk;
+    }
+    return ApplyCameraSource(source, GetMonotonicTimeUs());
+}
+
+ErrorCode LiveviewSample::ApplyCameraSource(
+    edge_sdk::Liveview::CameraSource source, int64_t request_us) {
+    auto rc = liveview_->SetCameraSource(source);
+    // Armed once the camera has acknowledged, so that a periodic keyframe of
+    // the previous lens is not taken for the start of the new one.
+    if (rc == kOk && stream_processor_thread_ &&
+        stream_processor_thread_->Lens() != (int32_t)source) {
+        stream_processor_thread_->SwitchSource((int32_t)source, request_us);
+    }
+    if (rc == kOk && packet_bus_) {
+        packet_bus_->SwitchSource((int32_t)source);
+    }
+    return rc;
 }
 
 }  // namespace edge_app
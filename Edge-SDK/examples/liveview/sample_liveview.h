@@ -24,20 +24,43 @@
 
 #include <chrono>
 #include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
 #include "error_code.h"
 #include "image_processor.h"
 #include "image_processor_thread.h"
 #include "liveview.h"
 #include "logger.h"
+#include "packet_bus.h"
 #include "stream_decoder.h"
 #include "stream_processor_thread.h"
+#include "stream_statistics.h"
 
 namespace edge_app {
 
 class LiveviewSample {
    public:
+    // How the stream quality is chosen at runtime, see SetQualityPolicy()
+    struct QualityPolicy {
+        // Take the best quality LiveviewStatus reports available, up to
+        // |max_quality|, instead of a fixed one
+        bool automatic = false;
+        edge_sdk::Liveview::StreamQuality max_quality =
+            edge_sdk::Liveview::kStreamQuality1080pHigh;
+        // Step one quality down once frames were dropped downstream for
+        // this long
+        int32_t overload_ms = 3000;
+        // Step back up after this long without drops
+        int32_t recover_ms = 60000;
+    };
+
+    using QualityCallback =
+        std::function<void(edge_sdk::Liveview::StreamQuality quality)>;
+
     explicit LiveviewSample(const std::string& name);
-    ~LiveviewSample() {}
+    ~LiveviewSample();
 
     edge_sdk::ErrorCode Init(edge_sdk::Liveview::CameraType type,
                              edge_sdk::Liveview::StreamQuality quality,
@@ -45,11 +68,57 @@ class LiveviewSample {
 
     edge_sdk::ErrorCode Start();
 
+    // Frames decoded from the new source on carry it in FrameInfo::lens.
+    // During a quality change it is applied once the stream is back.
     edge_sdk::ErrorCode SetCameraSource(
         edge_sdk::Liveview::CameraSource source);
 
+    int32_t Lens() const {
+        return stream_processor_thread_ ? stream_processor_thread_->Lens() : 0;
+    }
+
+    // Resubscribes the stream with |quality| without restarting the process,
+    // keeping the lens, the decoder and the image processors. Turns the
+    // automatic quality off.
+    edge_sdk::ErrorCode SetStreamQuality(
+        edge_sdk::Liveview::StreamQuality quality);
+
+    edge_sdk::Liveview::StreamQuality Quality() const { return quality_; }
+
+    // Applied from the next LiveviewStatus or overload check on
+    void SetQualityPolicy(const QualityPolicy& policy);
+
+    // Called after every quality change, from the thread making it
+    void SetQualityCallback(QualityCallback callback) {
+        quality_callback_ = callback;
+    }
+
+    // A downstream stage could not keep up with a frame, counted with the
+    // images dropped by the image processor thread
+    void ReportOverload() { overload_reports_++; }
+
+    // Resubscription request to first frame decoded, -1 before any
+    double LastRestartLatencyMs() const {
+        return stream_processor_thread_
+                   ? stream_processor_thread_->LastRestartLatencyMs()
+                   : -1;
+    }
+
+    const std::string& Name() const { return name_; }
+
+    // Also publishes the compressed stream to |packet_bus|, set before
+    // Start()
+    void SetPacketBus(std::shared_ptr<PacketBusPublisher> packet_bus) {
+        packet_bus_ = packet_bus;
+    }
+
+    // Received bitrate over the last second
     uint32_t GetStreamBitrate() const {
-        return stream_bitrate_kbps_.load();
+        return (uint32_t)(stream_statistics_.Get().bitrate_kbps + 0.5);
+    }
+
+    StreamStatistics::Snapshot GetStreamStatistics() const {
+        return stream_statistics_.Get();
     }
 
    private:
@@ -58,18 +127,55 @@ class LiveviewSample {
     void LiveviewStatusCallback(
         const edge_sdk::Liveview::LiveviewStatus& status);
 
+    // Falls back to the previous quality if the new one cannot start
+    edge_sdk::ErrorCode ChangeQuality(
+        edge_sdk::Liveview::StreamQuality quality);
+
+    // Resubscribes with |quality|, called with |restart_mutex_| held
+    edge_sdk::ErrorCode Restart(edge_sdk::Liveview::StreamQuality quality,
+                                int64_t request_us);
+
+    // Called with |liveview_mutex_| held
+    edge_sdk::ErrorCode ApplyCameraSource(
+        edge_sdk::Liveview::CameraSource source, int64_t request_us);
+
+    // Best quality up to |limit| that the last status reports, 0 if none
+    int32_t BestAvailableQuality(int32_t limit) const;
+
+    // Starts the stream once available, then applies the quality policy
+    void QualityControl();
+
+    std::string name_;
     std::shared_ptr<edge_sdk::Liveview> liveview_;
+    edge_sdk::Liveview::CameraType type_;
+    // Quality of the running stream, set once a restart has succeeded
+    std::atomic<edge_sdk::Liveview::StreamQuality> quality_;
+    // Held for each liveview_ call, never across a restart
+    std::mutex liveview_mutex_;
+    std::mutex restart_mutex_;
+    // Under liveview_mutex_: lens to apply once the restart is over
+    bool restarting_ = false;
+    int32_t restart_lens_ = 0;
     std::shared_ptr<StreamProcessorThread> stream_processor_thread_;
-    edge_sdk::Liveview::LiveviewStatus liveview_status_;
-    std::atomic<uint32_t> stream_bitrate_kbps_;
-    std::chrono::system_clock::time_point receive_stream_data_time_ = std::chrono::system_clock::now();
-    uint32_t receive_stream_data_total_size_;
+    std::shared_ptr<PacketBusPublisher> packet_bus_;
+    std::atomic<edge_sdk::Liveview::LiveviewStatus> liveview_status_;
+    std::mutex status_mutex_;
+    std::condition_variable status_cv_;
+    std::thread quality_thread_;
+    std::atomic<bool> quality_thread_stop_{false};
+    QualityPolicy policy_;
+    // Highest quality allowed by the overload steps, under policy_ too
+    int32_t quality_limit_ = edge_sdk::Liveview::kStreamQuality1080pHigh;
+    std::atomic<uint64_t> overload_reports_{0};
+    QualityCallback quality_callback_;
+    StreamStatistics stream_statistics_;
 };
 
 int32_t InitLiveviewSample(std::shared_ptr<LiveviewSample>& liveview_sample, edge_sdk::Liveview::CameraType type,
                            edge_sdk::Liveview::StreamQuality quality,
                            std::shared_ptr<StreamDecoder> stream_decoder,
-                           std::shared_ptr<ImageProcessor> image_processor);
+                           std::shared_ptr<ImageProcessor> image_processor,
+                           PipelinePriority priority = kPipelinePriorityNormal);
 
 }  // namespace edge_app
 
@@ -21,8 +21,11 @@
  */
 #include <unistd.h>
 
+#include <cstdio>
+
 #include "error_code.h"
 #include "image_processor.h"
+#include "image_processor_yolovfastest.h"
 #include "logger.h"
 #include "sample_liveview.h"
 
@@ -51,6 +54,24 @@ int main(int argc, char** argv) {
         .alias = std::string("PlayloadCamera: Yolovfastest")};
     auto payload_image_processor = CreateImageProcessor(image_processor_option);
 
+    // optional: run the detector every N frames and track in between
+    auto yolo = std::static_pointer_cast<ImageProcessorYolovFastest>(
+        payload_image_processor);
+    if (argc > 1) {
+        yolo->SetDetectInterval(atoi(argv[1]));
+    }
+
+    // optional: tiled detection for small objects, COLSxROWS[@BUDGET_MS]
+    if (argc > 2) {
+        YoloTiler::Options tiler_option;
+        if (sscanf(argv[2], "%dx%d@%f", &tiler_option.columns,
+                   &tiler_option.rows, &tiler_option.time_budget_ms) >= 2) {
+            yolo->SetTiling(tiler_option);
+        } else {
+            ERROR("invalid tiling: %s, e.g. 3x2 or 3x2@80", argv[2]);
+        }
+    }
+
     if (0 != InitLiveviewSample(
         payload_liveview, Liveview::kCameraTypePayload, Liveview::kStreamQuality1080pHigh,
         payload_decoder, payload_image_processor)) {
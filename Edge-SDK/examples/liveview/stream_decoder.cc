@@ -54,7 +54,7 @@ class UndefinedStreamDecoder : public StreamDecoder {
 std::shared_ptr<StreamDecoder> CreateStreamDecoder(
     const StreamDecoder::Options& option) {
     if (option.name == std::string("ffmpeg")) {
-        return std::make_shared<FFmpegStreamDecoder>(option.name);
+        return std::make_shared<FFmpegStreamDecoder>(option);
     }
 
     return std::make_shared<UndefinedStreamDecoder>(option.name);
@@ -26,6 +26,7 @@
 #include <functional>
 
 #include "error_code.h"
+#include "frame_info.h"
 
 namespace cv {
 class Mat;
@@ -33,10 +34,16 @@ class Mat;
 
 namespace edge_app {
 
+class PipelineMetrics;
+
 class StreamDecoder {
    public:
     struct Options {
         std::string name;
+        // Attach a per-macroblock MotionSummary to each frame's FrameInfo
+        bool export_motion_vectors = false;
+        // Decoder internal threads, 1 when running on the pipeline runtime
+        int32_t thread_count = 4;
     };
 
     explicit StreamDecoder(const std::string& name) : decoder_name_(name) {}
@@ -50,11 +57,31 @@ class StreamDecoder {
     virtual int32_t DeInit() = 0;
 
     using Image = cv::Mat;
-    using DecodeResultCallback =
-        std::function<void(std::shared_ptr<Image>& result)>;
+    using DecodeResultCallback = std::function<void(
+        std::shared_ptr<Image>& result, const FrameInfo& info)>;
     virtual int32_t Decode(const uint8_t* data, size_t length,
                            DecodeResultCallback result_callback) = 0;
 
+    // |arrival_us| is the CLOCK_MONOTONIC time |data| came from the stream
+    // callback, reported in FrameInfo::arrival_us by decoders tracking it
+    virtual int32_t Decode(const uint8_t* data, size_t length,
+                           int64_t arrival_us,
+                           DecodeResultCallback result_callback) {
+        return Decode(data, length, result_callback);
+    }
+
+    // The camera source has been switched: flush on the next SPS or IDR
+    // and start a new FrameInfo::source_generation there.
+    virtual void ExpectSourceChange() {}
+
+    // Decode and color conversion times go there
+    void SetMetrics(std::shared_ptr<PipelineMetrics> metrics) {
+        metrics_ = metrics;
+    }
+
+   protected:
+    std::shared_ptr<PipelineMetrics> metrics_;
+
    private:
     std::string decoder_name_;
 };
@@ -21,11 +21,14 @@
  */
 #include "stream_processor_thread.h"
 
+#include <algorithm>
 #include <cerrno>
 #include <cstring>
 
 #include "image_processor_thread.h"
 #include "logger.h"
+#include "pipeline_metrics.h"
+#include "pipeline_trace.h"
 #include "stream_decoder.h"
 
 using namespace edge_sdk;
@@ -33,7 +36,7 @@ using namespace edge_sdk;
 namespace edge_app {
 
 StreamProcessorThread::StreamProcessorThread(const std::string& name)
-    : processor_name_(name) {
+    : processor_name_(name), metrics_(PipelineMetrics::Get(name)) {
     processor_start_ = false;
 }
 
@@ -45,6 +48,7 @@ int32_t StreamProcessorThread::SetStreamDecoder(
         return -1;
     }
     stream_decoder_ = decoder;
+    stream_decoder_->SetMetrics(metrics_);
     return 0;
 }
 
@@ -58,9 +62,147 @@ int32_t StreamProcessorThread::SetImageProcessorThread(
 }
 
 void StreamProcessorThread::InputStream(const uint8_t* data, size_t length) {
-    std::lock_guard<std::mutex> l(decode_vector_mutex_);
-    decode_vector_.insert(decode_vector_.end(), data, data + length);
-    decode_vector_cv_.notify_one();
+    TRACE_SCOPE("input", "bytes", length);
+    std::shared_ptr<PipelineStrand> post;
+    metrics_->Add(kMetricsStreamBytes, length);
+    {
+        std::lock_guard<std::mutex> l(decode_vector_mutex_);
+        int64_t now_us = GetMonotonicTimeUs();
+        if (decode_vector_.empty()) {
+            decode_vector_since_us_ = now_us;
+        }
+        decode_chunks_.emplace_back(decode_vector_.size(), now_us);
+        decode_vector_.insert(decode_vector_.end(), data, data + length);
+        metrics_->Set(kMetricsDecodeBacklogBytes, decode_vector_.size());
+        if (decode_strand_ && !decode_posted_) {
+            decode_posted_ = true;
+            post = decode_strand_;
+        }
+        decode_vector_cv_.notify_one();
+    }
+    if (post) {
+        post->Post([this] { DecodePending(); });
+    }
+}
+
+void StreamProcessorThread::DecodePending() {
+    int64_t since_us = 0;
+    {
+        std::lock_guard<std::mutex> l(decode_vector_mutex_);
+        pending_data_.swap(decode_vector_);
+        decode_vector_.clear();
+        pending_chunks_.swap(decode_chunks_);
+        decode_chunks_.clear();
+        decode_posted_ = false;
+        since_us = decode_vector_since_us_;
+    }
+    metrics_->Record(kMetricsStageQueue, GetMonotonicTimeUs() - since_us);
+    if (processor_start_ && !pending_data_.empty()) {
+        Decode(pending_data_, pending_chunks_);
+    }
+}
+
+void StreamProcessorThread::Decode(
+    std::vector<uint8_t>& decode_data,
+    const std::vector<std::pair<size_t, int64_t>>& chunks) {
+    auto callback = [&](std::shared_ptr<Image>& result,
+                        const FrameInfo& info) -> void {
+        if (info.source_generation != source_generation_) {
+            OnSourceChange(info);
+        } else if (switch_request_us_ != 0) {
+            frames_since_request_++;
+        }
+        if (result != nullptr) {
+            metrics_->Add(kMetricsFramesDecoded);
+        }
+        if (result != nullptr && image_processor_thread_) {
+            FrameInfo tagged = info;
+            tagged.lens = lens_;
+            image_processor_thread_->InputImage(result, tagged);
+        }
+    };
+    // Decoded chunk by chunk, so that each frame gets the arrival time of
+    // its own first bytes
+    for (size_t i = 0; i < chunks.size(); i++) {
+        size_t begin = chunks[i].first;
+        size_t end =
+            i + 1 < chunks.size() ? chunks[i + 1].first : decode_data.size();
+        TRACE_SCOPE("decode_chunk", "bytes", end - begin);
+        stream_decoder_->Decode(decode_data.data() + begin, end - begin,
+                                chunks[i].second, callback);
+    }
+}
+
+void StreamProcessorThread::SwitchSource(int32_t lens, int64_t request_us) {
+    {
+        std::lock_guard<std::mutex> l(switch_mutex_);
+        pending_lens_ = lens;
+        switch_request_us_ = request_us;
+        restart_pending_ = false;
+    }
+    if (stream_decoder_) {
+        stream_decoder_->ExpectSourceChange();
+    }
+}
+
+void StreamProcessorThread::ExpectRestart(int64_t request_us) {
+    {
+        std::lock_guard<std::mutex> l(switch_mutex_);
+        // A switch still pending wins, its lens is restored after restart
+        if (switch_request_us_ == 0) {
+            pending_lens_ = lens_;
+        }
+        switch_request_us_ = request_us;
+        restart_pending_ = true;
+    }
+    if (stream_decoder_) {
+        stream_decoder_->ExpectSourceChange();
+    }
+}
+
+uint64_t StreamProcessorThread::DroppedImages() const {
+    return image_processor_thread_ ? image_processor_thread_->DroppedImages()
+                                   : 0;
+}
+
+void StreamProcessorThread::OnSourceChange(const FrameInfo& info) {
+    source_generation_ = info.source_generation;
+
+    int32_t lens = 0;
+    int64_t request_us = 0;
+    bool restart = false;
+    {
+        std::lock_guard<std::mutex> l(switch_mutex_);
+        std::swap(lens, pending_lens_);
+        std::swap(restart, restart_pending_);
+        request_us = switch_request_us_.exchange(0);
+    }
+    // A change nobody requested here, e.g. from the cloud: lens unknown
+    lens_ = lens;
+
+    // Frames of the previous source still queued would only delay the
+    // first frame of this one.
+    size_t dropped = 0;
+    if (image_processor_thread_) {
+        dropped = image_processor_thread_->DropQueuedImages();
+    }
+
+    if (request_us == 0) {
+        WARN("%s: unrequested source change, lens unknown",
+             processor_name_.c_str());
+    } else if (restart) {
+        restart_latency_ms_ = (info.timestamp_us - request_us) / 1000.0;
+        INFO("%s: stream resumed %.1f ms after the restart request, %zu "
+             "queued dropped",
+             processor_name_.c_str(), restart_latency_ms_.load(), dropped);
+    } else {
+        switch_latency_ms_ = (info.timestamp_us - request_us) / 1000.0;
+        INFO("%s: lens %d first frame %.1f ms after the request, %llu frames "
+             "of the previous lens decoded meanwhile, %zu queued dropped",
+             processor_name_.c_str(), lens, switch_latency_ms_.load(),
+             (unsigned long long)frames_since_request_, dropped);
+    }
+    frames_since_request_ = 0;
 }
 
 int32_t StreamProcessorThread::Start() {
@@ -78,6 +220,27 @@ int32_t StreamProcessorThread::Start() {
         }
     }
 
+    // Decoding keeps the reference frames flowing: it goes before the
+    // processing of the same stream.
+    if (image_processor_thread_) {
+        image_processor_thread_->SetPriority((PipelinePriority)std::min(
+            (int32_t)priority_ + 1, (int32_t)kPipelinePriorityLow));
+    }
+
+    // On the shared runtime, the decoding runs as tasks of a strand
+    auto runtime = PipelineRuntime::Instance();
+    if (runtime->Running()) {
+        auto strand =
+            runtime->CreateStrand(processor_name_, "decode", priority_);
+        {
+            std::lock_guard<std::mutex> l(decode_vector_mutex_);
+            decode_strand_ = strand;
+            decode_posted_ = false;
+        }
+        if (image_processor_thread_) image_processor_thread_->Start();
+        return 0;
+    }
+
     stream_processor_thread_ =
         std::thread(&StreamProcessorThread::ImageProcess, this);
     {
@@ -97,10 +260,21 @@ int32_t StreamProcessorThread::Start() {
 }
 
 int32_t StreamProcessorThread::Stop() {
-    processor_start_ = false;
+    std::shared_ptr<PipelineStrand> strand;
+    {
+        // Wakes the decoding thread waiting for data
+        std::lock_guard<std::mutex> l(decode_vector_mutex_);
+        processor_start_ = false;
+        strand.swap(decode_strand_);
+    }
+    decode_vector_cv_.notify_all();
     if (stream_processor_thread_.joinable()) {
         stream_processor_thread_.join();
     }
+    // The decode tasks hold |this|: none may run once Stop() returns
+    if (strand) {
+        strand->Close();
+    }
 
     return 0;
 }
@@ -109,20 +283,24 @@ void StreamProcessorThread::ImageProcess() {
     INFO("start image processor: %s", processor_name_.c_str());
     pthread_setname_np(pthread_self(), "streamdecoder");
     std::vector<uint8_t> decode_data;
+    std::vector<std::pair<size_t, int64_t>> decode_chunks;
     while (processor_start_) {
         std::unique_lock<std::mutex> l(decode_vector_mutex_);
 
-        decode_vector_cv_.wait(l, [&] { return decode_vector_.size() != 0; });
+        decode_vector_cv_.wait(l, [&] {
+            return decode_vector_.size() != 0 || !processor_start_;
+        });
+        if (!processor_start_) {
+            break;
+        }
         decode_data = decode_vector_;
         decode_vector_.clear();
+        decode_chunks.swap(decode_chunks_);
+        decode_chunks_.clear();
+        int64_t since_us = decode_vector_since_us_;
         l.unlock();
-        stream_decoder_->Decode(
-            decode_data.data(), decode_data.size(),
-            [&](std::shared_ptr<Image>& result) -> void {
-                if (result != nullptr && image_processor_thread_) {
-                    image_processor_thread_->InputImage(result);
-                }
-            });
+        metrics_->Record(kMetricsStageQueue, GetMonotonicTimeUs() - since_us);
+        Decode(decode_data, decode_chunks);
     }
     INFO("stop image processor: %s", processor_name_.c_str());
 }
@@ -28,8 +28,12 @@
 #include <queue>
 #include <string>
 #include <thread>
+#include <utility>
+#include <vector>
 
 #include "error_code.h"
+#include "frame_info.h"
+#include "pipeline_runtime.h"
 
 namespace cv {
 class Mat;
@@ -39,6 +43,7 @@ namespace edge_app {
 
 class StreamDecoder;
 class ImageProcessorThread;
+class PipelineMetrics;
 
 class StreamProcessorThread {
    public:
@@ -57,6 +62,29 @@ class StreamProcessorThread {
     int32_t SetImageProcessorThread(
         std::shared_ptr<ImageProcessorThread> image_processor);
 
+    // Priority of the decode strand when running on the pipeline runtime
+    void SetPriority(PipelinePriority priority) { priority_ = priority; }
+
+    // The camera has acknowledged a switch to |lens|, requested at
+    // |request_us| (CLOCK_MONOTONIC). Frames are tagged with |lens| from the
+    // decoder's next source generation on.
+    void SwitchSource(int32_t lens, int64_t request_us);
+
+    int32_t Lens() const { return lens_; }
+
+    // Request to first decoded frame of the new source, -1 before any switch
+    double LastSwitchLatencyMs() const { return switch_latency_ms_; }
+
+    // The stream is being resubscribed (new quality) from |request_us| on:
+    // the lens is kept across the decoder's next source generation
+    void ExpectRestart(int64_t request_us);
+
+    // Request to first decoded frame of the restarted stream, -1 before any
+    double LastRestartLatencyMs() const { return restart_latency_ms_; }
+
+    // Decoded images the image processor thread could not keep up with
+    uint64_t DroppedImages() const;
+
     int32_t Start();
 
     int32_t Stop();
@@ -68,9 +96,24 @@ class StreamProcessorThread {
 
     void ImageProcess();
 
+    // |chunks| holds the offset in |decode_data| and the arrival time of
+    // each InputStream() call
+    void Decode(std::vector<uint8_t>& decode_data,
+                const std::vector<std::pair<size_t, int64_t>>& chunks);
+
+    // Called on the decoding thread with the first frame of a new source
+    void OnSourceChange(const FrameInfo& info);
+
+    // Decode task of the pipeline runtime, coalescing the pending input
+    void DecodePending();
+
     std::string processor_name_;
 
     std::vector<uint8_t> decode_vector_;
+    // Arrival of the oldest bytes in decode_vector_
+    int64_t decode_vector_since_us_ = 0;
+    // Offset and arrival time of each chunk in decode_vector_
+    std::vector<std::pair<size_t, int64_t>> decode_chunks_;
     std::mutex decode_vector_mutex_;
     std::condition_variable decode_vector_cv_;
 
@@ -78,6 +121,26 @@ class StreamProcessorThread {
     std::atomic<bool> processor_start_;
     std::shared_ptr<StreamDecoder> stream_decoder_;
     std::shared_ptr<ImageProcessorThread> image_processor_thread_;
+
+    // Set instead of stream_processor_thread_ when the pipeline runtime runs
+    std::shared_ptr<PipelineStrand> decode_strand_;
+    PipelinePriority priority_ = kPipelinePriorityNormal;
+    bool decode_posted_ = false;
+    std::vector<uint8_t> pending_data_;
+    std::vector<std::pair<size_t, int64_t>> pending_chunks_;
+
+    // Source switch state, the decoding side only runs on one thread
+    std::mutex switch_mutex_;
+    int32_t pending_lens_ = 0;
+    bool restart_pending_ = false;
+    std::atomic<int64_t> switch_request_us_{0};
+    uint32_t source_generation_ = 0;
+    uint64_t frames_since_request_ = 0;
+    std::atomic<int32_t> lens_{0};
+    std::atomic<double> switch_latency_ms_{-1};
+    std::atomic<double> restart_latency_ms_{-1};
+
+    std::shared_ptr<PipelineMetrics> metrics_;
 };
 
 }  // namespace edge_app
@@ -0,0 +1,247 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#include "stream_statistics.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "frame_info.h"
+#include "h264_bitstream.h"
+
+namespace edge_app {
+
+namespace {
+
+const int64_t kBucketUs = 100 * 1000;
+// Buckets of the instantaneous values, one second
+const size_t kInstantBuckets = 10;
+// Weight of a new sample in the jitter and mean interval, as in RFC 3550
+const double kJitterGain = 1.0 / 16;
+
+}  // namespace
+
+StreamStatistics::StreamStatistics(const Options& options)
+    : options_(options),
+      buckets_(std::max<size_t>(kInstantBuckets,
+                                options.window_ms / (kBucketUs / 1000))) {}
+
+int64_t StreamStatistics::Input(const uint8_t* data, size_t length) {
+    return Input(data, length, GetMonotonicTimeUs());
+}
+
+int64_t StreamStatistics::Input(const uint8_t* data, size_t length,
+                                int64_t now_us) {
+    std::lock_guard<std::mutex> l(mutex_);
+    int64_t stalled_us = 0;
+    if (last_input_us_ != 0 &&
+        now_us - last_input_us_ > (int64_t)options_.stall_ms * 1000) {
+        stalled_us = now_us - last_input_us_;
+        stalls_++;
+        longest_stall_us_ = std::max(longest_stall_us_, stalled_us);
+    }
+    if (first_input_us_ == 0) {
+        first_input_us_ = now_us;
+    }
+    last_input_us_ = now_us;
+    CurrentBucket(now_us).bytes += length;
+
+    uint64_t base = bytes_;
+    bytes_ += length;
+    const uint8_t* end = data + length;
+    const uint8_t* p = data;
+    while (p < end) {
+        if (expect_ == 0 && zeros_ == 0) {
+            // Only a zero byte can begin a start code
+            p = (const uint8_t*)memchr(p, 0, end - p);
+            if (p == nullptr) {
+                break;
+            }
+        }
+        uint8_t byte = *p;
+        uint64_t position = base + (p - data);
+        p++;
+
+        if (expect_ == 1) {
+            uint8_t type = byte & 0x1f;
+            if (type == kH264NalSlice || type == kH264NalIdr) {
+                // first_mb_in_slice is in the next byte
+                expect_ = 2;
+                pending_type_ = type;
+                pending_position_ = position;
+            } else {
+                expect_ = 0;
+                OnNal(type, false, position, now_us);
+            }
+            zeros_ = byte == 0 ? 1 : 0;
+        } else if (expect_ == 2) {
+            expect_ = 0;
+            OnNal(pending_type_, byte & 0x80, pending_position_, now_us);
+            zeros_ = byte == 0 ? 1 : 0;
+        } else if (byte == 0) {
+            zeros_++;
+        } else {
+            if (byte == 1 && zeros_ >= 2) {
+                expect_ = 1;
+            }
+            zeros_ = 0;
+        }
+    }
+    return stalled_us / 1000;
+}
+
+void StreamStatistics::Restart() {
+    std::lock_guard<std::mutex> l(mutex_);
+    zeros_ = 0;
+    expect_ = 0;
+    in_unit_ = false;
+    has_slice_ = false;
+    keyframe_ = false;
+    last_input_us_ = 0;
+    last_frame_us_ = 0;
+    has_idr_ = false;
+    frames_since_idr_ = 0;
+}
+
+StreamStatistics::Bucket& StreamStatistics::CurrentBucket(int64_t now_us) {
+    int64_t index = now_us / kBucketUs;
+    Bucket& bucket = buckets_[index % buckets_.size()];
+    if (bucket.index != index) {
+        bucket = Bucket();
+        bucket.index = index;
+    }
+    return bucket;
+}
+
+void StreamStatistics::OnNal(uint8_t type, bool first_mb, uint64_t position,
+                             int64_t now_us) {
+    bool slice = type == kH264NalSlice || type == kH264NalIdr;
+    bool begins_unit = type == kH264NalAud || type == kH264NalSps ||
+                       type == kH264NalPps || type == kH264NalSei ||
+                       (slice && first_mb);
+    // The start code is counted with the access unit it opens
+    uint64_t start = position >= 3 ? position - 3 : 0;
+
+    if (begins_unit && has_slice_) {
+        CompleteUnit(start, now_us);
+    }
+    if (!in_unit_) {
+        if (!begins_unit) {
+            // Middle of a picture, after a restart
+            return;
+        }
+        in_unit_ = true;
+        unit_begin_ = start;
+    }
+    if (slice) {
+        has_slice_ = true;
+        keyframe_ |= type == kH264NalIdr;
+    }
+}
+
+void StreamStatistics::CompleteUnit(uint64_t end, int64_t now_us) {
+    uint64_t size = end - unit_begin_;
+    frames_++;
+    CurrentBucket(now_us).frames++;
+
+    if (keyframe_) {
+        if (has_idr_) {
+            gop_length_ = frames_since_idr_;
+            gop_total_ += frames_since_idr_;
+            gop_count_++;
+        }
+        has_idr_ = true;
+        frames_since_idr_ = 0;
+        idr_bytes_ = (uint32_t)std::min<uint64_t>(size, UINT32_MAX);
+        keyframes_++;
+    }
+    frames_since_idr_++;
+
+    if (last_frame_us_ != 0) {
+        double interval = now_us - last_frame_us_;
+        if (mean_interval_us_ < 0) {
+            mean_interval_us_ = interval;
+        }
+        double deviation = interval - mean_interval_us_;
+        jitter_us_ += (std::fabs(deviation) - jitter_us_) * kJitterGain;
+        mean_interval_us_ += deviation * kJitterGain;
+    }
+    last_frame_us_ = now_us;
+
+    in_unit_ = true;
+    has_slice_ = false;
+    keyframe_ = false;
+    unit_begin_ = end;
+}
+
+void StreamStatistics::Sum(int64_t now_us, size_t count, double* kbps,
+                           double* fps) const {
+    int64_t current = now_us / kBucketUs;
+    int64_t first = current - (int64_t)count + 1;
+    uint64_t bytes = 0;
+    uint64_t frames = 0;
+    for (const auto& bucket : buckets_) {
+        if (bucket.index >= first && bucket.index <= current) {
+            bytes += bucket.bytes;
+            frames += bucket.frames;
+        }
+    }
+    // The oldest bucket may predate the stream, the newest is still filling
+    int64_t begin = std::max(first * kBucketUs, first_input_us_);
+    double seconds = std::max(now_us - begin, kBucketUs) / 1e6;
+    *kbps = bytes * 8 / 1000.0 / seconds;
+    *fps = frames / seconds;
+}
+
+StreamStatistics::Snapshot StreamStatistics::Get() const {
+    return Get(GetMonotonicTimeUs());
+}
+
+StreamStatistics::Snapshot StreamStatistics::Get(int64_t now_us) const {
+    std::lock_guard<std::mutex> l(mutex_);
+    Snapshot snapshot;
+    Sum(now_us, kInstantBuckets, &snapshot.bitrate_kbps, &snapshot.fps);
+    Sum(now_us, buckets_.size(), &snapshot.window_bitrate_kbps,
+        &snapshot.window_fps);
+
+    snapshot.gop_length = gop_length_;
+    snapshot.average_gop_length =
+        gop_count_ ? (double)gop_total_ / gop_count_ : 0;
+    snapshot.idr_bytes = idr_bytes_;
+    snapshot.jitter_ms = jitter_us_ / 1000;
+
+    int64_t longest_us = longest_stall_us_;
+    if (last_input_us_ != 0 &&
+        now_us - last_input_us_ > (int64_t)options_.stall_ms * 1000) {
+        snapshot.stalled_ms = (now_us - last_input_us_) / 1000.0;
+        longest_us = std::max(longest_us, now_us - last_input_us_);
+    }
+    snapshot.stalls = stalls_;
+    snapshot.longest_stall_ms = longest_us / 1000.0;
+    snapshot.bytes = bytes_;
+    snapshot.frames = frames_;
+    snapshot.keyframes = keyframes_;
+    return snapshot;
+}
+
+}  // namespace edge_app
@@ -0,0 +1,150 @@
+/**
+ ********************************************************************
+ *
+ * @copyright (c) 2023 DJI. All rights reserved.
+ *
+ * All information contained herein is, and remains, the property of DJI.
+ * The intellectual and technical concepts contained herein are proprietary
+ * to DJI and may be covered by U.S. and foreign patents, patents in process,
+ * and protected by trade secret or copyright law.  Dissemination of this
+ * information, including but not limited to data and other proprietary
+ * material(s) incorporated within the information, in any form, is strictly
+ * prohibited without the express written consent of DJI.
+ *
+ * If you receive this source code without DJI’s authorization, you may not
+ * further disseminate the information, and you must immediately remove the
+ * source code and notify DJI of its removal. DJI reserves the right to pursue
+ * legal actions against you for any loss(es) or damage(s) caused by your
+ * failure to do so.
+ *
+ *********************************************************************
+ */
+#ifndef __STREAM_STATISTICS_H__
+#define __STREAM_STATISTICS_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace edge_app {
+
+/*
+ * Statistics of the H.264 stream received from the Liveview callback, on
+ * CLOCK_MONOTONIC. Rates are kept in 100 ms buckets over a sliding window:
+ * the instantaneous values cover the last second, the windowed ones the
+ * whole window, both divided by the time actually elapsed. Frames are
+ * counted from the NAL headers as the access units complete, without
+ * buffering or copying the stream.
+ *
+ * Input() and Restart() come from the stream callback thread, Get() from
+ * any thread.
+ */
+class StreamStatistics {
+   public:
+    struct Options {
+        // Span of the windowed values
+        int32_t window_ms = 10000;
+        // No data for longer than this is a stall
+        int32_t stall_ms = 500;
+    };
+
+    struct Snapshot {
+        // Last second
+        double bitrate_kbps = 0;
+        double fps = 0;
+        // Over Options::window_ms
+        double window_bitrate_kbps = 0;
+        double window_fps = 0;
+        // Frames between the last two IDRs, 0 until the second one
+        int32_t gop_length = 0;
+        double average_gop_length = 0;
+        // Size of the last IDR access unit, parameter sets included
+        uint32_t idr_bytes = 0;
+        // Smoothed deviation of the frame inter-arrival time from its mean,
+        // as RFC 3550 does for packets
+        double jitter_ms = 0;
+        uint64_t stalls = 0;
+        double longest_stall_ms = 0;
+        // Time without data so far, 0 unless stalled now
+        double stalled_ms = 0;
+        uint64_t bytes = 0;
+        uint64_t frames = 0;
+        uint64_t keyframes = 0;
+    };
+
+    StreamStatistics() : StreamStatistics(Options()) {}
+
+    explicit StreamStatistics(const Options& options);
+
+    // Returns how long the stream had stalled before |data|, in ms, 0 if it
+    // had not
+    int64_t Input(const uint8_t* data, size_t length);
+    int64_t Input(const uint8_t* data, size_t length, int64_t now_us);
+
+    // The stream is resubscribed: the gap until its next data is not a
+    // stall, and the access unit in progress is dropped
+    void Restart();
+
+    Snapshot Get() const;
+    Snapshot Get(int64_t now_us) const;
+
+   private:
+    struct Bucket {
+        int64_t index = -1;
+        uint64_t bytes = 0;
+        uint32_t frames = 0;
+    };
+
+    Bucket& CurrentBucket(int64_t now_us);
+
+    // A NAL header at stream byte |position|, |first_mb| from the slice
+    // header of slices
+    void OnNal(uint8_t type, bool first_mb, uint64_t position,
+               int64_t now_us);
+
+    void CompleteUnit(uint64_t end, int64_t now_us);
+
+    // Totals of the last |count| buckets, over the time they cover
+    void Sum(int64_t now_us, size_t count, double* kbps, double* fps) const;
+
+    Options options_;
+    mutable std::mutex mutex_;
+    std::vector<Bucket> buckets_;
+
+    // NAL scanner state carried across chunks: zero bytes seen, and whether
+    // the next byte is a NAL header (1) or a slice's first byte (2)
+    int32_t zeros_ = 0;
+    int32_t expect_ = 0;
+    uint8_t pending_type_ = 0;
+    uint64_t pending_position_ = 0;
+
+    // Access unit in progress
+    bool in_unit_ = false;
+    bool has_slice_ = false;
+    bool keyframe_ = false;
+    uint64_t unit_begin_ = 0;
+
+    int64_t first_input_us_ = 0;
+    int64_t last_input_us_ = 0;
+    int64_t last_frame_us_ = 0;
+    double mean_interval_us_ = -1;
+    double jitter_us_ = 0;
+
+    bool has_idr_ = false;
+    int32_t frames_since_idr_ = 0;
+    int32_t gop_length_ = 0;
+    uint64_t gop_total_ = 0;
+    uint64_t gop_count_ = 0;
+    uint32_t idr_bytes_ = 0;
+
+    uint64_t stalls_ = 0;
+    int64_t longest_stall_us_ = 0;
+    uint64_t bytes_ = 0;
+    uint64_t frames_ = 0;
+    uint64_t keyframes_ = 0;
+};
+
+}  // namespace edge_app
+
+#endif
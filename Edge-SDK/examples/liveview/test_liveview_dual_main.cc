@@ -1,8 +1,11 @@
 #include <unistd.h>
+#include <cstring>
 #include <memory>
 
 #include "logger.h"
+#include "pipeline_runtime.h"
 #include "sample_liveview.h"
+#include "yolo_inference_service.h"
 
 using namespace edge_sdk;
 using namespace edge_app;
@@ -12,7 +15,7 @@ ErrorCode ESDKInit();
 int main(int argc, char **argv) {
 
     if (argc < 3) {
-        ERROR("Usage: %s [ZOOM_QUALITY] [IR_QUALITY]", argv[0]);
+        ERROR("Usage: %s [ZOOM_QUALITY] [IR_QUALITY] [yolo]", argv[0]);
         return -1;
     }
 
@@ -26,13 +29,31 @@ int main(int argc, char **argv) {
 
     INFO("Starting dual liveview: Zoom + IR");
 
+    // Both streams decode and process on one pool sized to the machine,
+    // with single-threaded decoders
+    PipelineRuntime::Options runtime_opt;
+    PipelineRuntime::Instance()->Start(runtime_opt);
+
+    // Optional detection on both streams through one batched net
+    std::shared_ptr<YoloInferenceService> yolo_service;
+    if (argc > 3 && strcmp(argv[3], "yolo") == 0) {
+        YoloInferenceService::Options service_opt;
+        service_opt.max_batch_size = 2;
+        yolo_service = std::make_shared<YoloInferenceService>(service_opt);
+        if (yolo_service->Init() != 0) {
+            ERROR("yolo inference service init failed");
+            yolo_service = nullptr;
+        }
+    }
+
 
     /*********************************************************
      *  ZOOM STREAM
      *********************************************************/
     auto zoom_sample = std::make_shared<LiveviewSample>("ZoomView");
 
-    StreamDecoder::Options zoom_dec_opt = {.name = "ffmpeg"};
+    StreamDecoder::Options zoom_dec_opt = {.name = "ffmpeg",
+                                           .thread_count = 1};
     auto zoom_decoder = CreateStreamDecoder(zoom_dec_opt);
 
     ImageProcessor::Options zoom_proc_opt = {
@@ -40,6 +61,10 @@ int main(int argc, char **argv) {
         .alias = "ZoomView",      // <-- UNICO e NON “PayloadCamera”
         .userdata = zoom_sample
     };
+    if (yolo_service) {
+        zoom_proc_opt.name = "yolovfastest";
+        zoom_proc_opt.inference_service = yolo_service;
+    }
 
     auto zoom_processor = CreateImageProcessor(zoom_proc_opt);
 
@@ -62,7 +87,7 @@ int main(int argc, char **argv) {
      *********************************************************/
     auto ir_sample = std::make_shared<LiveviewSample>("IRView");
 
-    StreamDecoder::Options ir_dec_opt = {.name = "ffmpeg"};
+    StreamDecoder::Options ir_dec_opt = {.name = "ffmpeg", .thread_count = 1};
     auto ir_decoder = CreateStreamDecoder(ir_dec_opt);
 
     ImageProcessor::Options ir_proc_opt = {
@@ -70,6 +95,10 @@ int main(int argc, char **argv) {
         .alias = "IRView",        // <-- UNICO e NON “PayloadCamera”
         .userdata = ir_sample
     };
+    if (yolo_service) {
+        ir_proc_opt.name = "yolovfastest";
+        ir_proc_opt.inference_service = yolo_service;
+    }
 
     auto ir_processor = CreateImageProcessor(ir_proc_opt);
 
@@ -106,20 +106,22 @@
  *
  *********************************************************************
  */
+#include <signal.h>
 #include <unistd.h>
 #include <iostream>
 #include <thread> // Required for multithreading
 #include <cstring>
 
+#include "control_channel.h"
+#include "frame_bus.h"
+#include "image_processor_stream.h"
+#include "image_processor_yolovfastest.h"
 #include "logger.h"
+#include "packet_bus.h"
+#include "pipeline_metrics.h"
+#include "pipeline_trace.h"
 #include "sample_liveview.h"
 
-#include <iostream>
-#include <sys/mman.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <unistd.h>
-
 // Nome POSIX: deve iniziare con '/'
 constexpr const char* SHM_NAME = "/my_shm";
 
@@ -131,60 +133,99 @@ ErrorCode ESDKInit();
 
 #define LENS 1     // Wide lens by default
 
-int video_type = 0;
-int old_video_type = -1;
-bool memory_initialized = false;
-
 // Forward declaration of the liveview_sample shared pointer
 std::shared_ptr<LiveviewSample> g_liveview_sample;
 
-// --- New Thread Function for Input Monitoring ---
-void input_monitor_thread() {
+std::shared_ptr<ImageProcessor> g_image_processor;
 
-    while (true) {
-        
-        INFO("----------------------------------------------------------------------------------------------------------Waiting for lens change command in shared memory...");
+ControlChannel g_control_channel(SHM_NAME);
 
-        sleep(2); // Polling interval
+std::string g_trace_dir = "/tmp";
 
-        // Apri la shared memory creata da Python
-        int fd = shm_open(SHM_NAME, O_RDONLY, 0666);
-        if (fd == -1) {
-            memory_initialized = false;
-            ERROR("shm_not_initialized");
-        }
-        else {
-            memory_initialized = true;
-        }
+void PublishControlStatus() {
+    ControlStatus status;
+    status.lens = g_liveview_sample->Lens();
+    status.quality = g_liveview_sample->Quality();
+    auto stream = std::dynamic_pointer_cast<ImageStreamProcessor>(g_image_processor);
+    status.bitrate_kbps = stream ? stream->BitrateKbps() : 0;
+    auto yolo = std::dynamic_pointer_cast<ImageProcessorYolovFastest>(g_image_processor);
+    status.detection = yolo ? yolo->DetectionEnabled() : 0;
+    g_control_channel.PublishStatus(status);
+}
 
-        if (memory_initialized) {
-            // Mappiamo 4 byte (1 int)
-            void* addr = mmap(nullptr, sizeof(int), PROT_READ, MAP_SHARED, fd, 0);
-            if (addr == MAP_FAILED) {
-                ERROR("address_mapping_failed");
-                close(fd);
-            } else {
-                // Cast e lettura del valore
-                old_video_type = video_type;
-                video_type = *reinterpret_cast<int*>(addr);
-                    
-                if (old_video_type != video_type) {
-                    INFO("Detected lens change request: %d", video_type);
-                    g_liveview_sample->SetCameraSource((edge_sdk::Liveview::CameraSource)video_type);
-                }
+void LogStreamStatistics() {
+    auto stats = g_liveview_sample->GetStreamStatistics();
+    INFO("%s stream: %.0f kbps (%.0f over 10 s), %.1f fps, GOP %d, "
+         "IDR %u bytes, jitter %.1f ms, %llu stalls (longest %.0f ms)",
+         g_liveview_sample->Name().c_str(), stats.bitrate_kbps,
+         stats.window_bitrate_kbps, stats.fps, stats.gop_length,
+         stats.idr_bytes, stats.jitter_ms, (unsigned long long)stats.stalls,
+         stats.longest_stall_ms);
+}
 
-                if (video_type != 1 && video_type != 2 && video_type != 3) {
-                    INFO("Error: Invalid video_type %d. Valid values are 1 (wide), 2 (zoom), or 3 (IR).", video_type);
-                }
+// --- Commands written by video_selector.py ---
+int32_t OnControlCommand(const ControlCommand& command) {
+    int32_t arg = command.args[0];
+    int32_t result = kControlResultOk;
 
-                // Clean up resources
-                munmap(addr, sizeof(int));
-                close(fd);
+    switch (command.id) {
+        case kControlCommandSetLens:
+            if (arg < 1 || arg > 3) {
+                WARN("Invalid lens %d. Valid values are 1 (wide), 2 (zoom), or 3 (IR).", arg);
+                return kControlResultInvalidArgument;
+            }
+            INFO("Lens change request: %d", arg);
+            if (g_liveview_sample->SetCameraSource((edge_sdk::Liveview::CameraSource)arg) != kOk) {
+                result = kControlResultFailed;
+            }
+            break;
+        case kControlCommandSetQuality:
+            if (arg < 0 || arg > 5) {
+                return kControlResultInvalidArgument;
+            }
+            INFO("Quality change request: %d", arg);
+            if (arg == 0) {
+                LiveviewSample::QualityPolicy policy;
+                policy.automatic = true;
+                g_liveview_sample->SetQualityPolicy(policy);
+            } else if (g_liveview_sample->SetStreamQuality((edge_sdk::Liveview::StreamQuality)arg) != kOk) {
+                result = kControlResultFailed;
             }
+            break;
+        case kControlCommandSetBitrate: {
+            auto stream = std::dynamic_pointer_cast<ImageStreamProcessor>(g_image_processor);
+            if (!stream) {
+                return kControlResultUnsupported;
+            }
+            if (stream->SetBitrate(arg) != 0) {
+                return kControlResultInvalidArgument;
+            }
+            break;
         }
-
-        
+        case kControlCommandSetDetection: {
+            auto yolo = std::dynamic_pointer_cast<ImageProcessorYolovFastest>(g_image_processor);
+            if (!yolo) {
+                return kControlResultUnsupported;
+            }
+            INFO("Detection %s", arg ? "on" : "off");
+            yolo->SetDetectionEnabled(arg != 0);
+            break;
+        }
+        case kControlCommandDumpTrace:
+            if (!PipelineTrace::Enabled()) {
+                return kControlResultUnsupported;
+            }
+            if (PipelineTrace::DumpToDirectory(g_trace_dir).empty()) {
+                return kControlResultFailed;
+            }
+            return kControlResultOk;
+        default:
+            WARN("Unknown control command %u", command.id);
+            return kControlResultUnsupported;
     }
+
+    PublishControlStatus();
+    return result;
 }
 // --------------------------------------------------
 
@@ -199,30 +240,66 @@ int main(int argc, char **argv) {
     int quality = 0;
     int source = 0;
     std::string stream_url = "";
-
-    // Check for --stream-url option
-    for (int i = 1; i < argc; i++) {
-        if (strcmp(argv[i], "--stream-url") == 0 && i + 1 < argc) {
-            stream_url = argv[i + 1];
-            // Shift remaining arguments
-            for (int j = i; j < argc - 2; j++) {
-                argv[j] = argv[j + 2];
+    std::string detect_sink = "";
+    std::string detect_precision = "";
+    std::string motion_gate = "";
+    std::string detect_fps = "";
+    std::string frame_bus = "";
+    std::string packet_bus = "";
+    std::string metrics_port = "9464";
+    std::string latency_probe = "";
+    std::string trace_dir = g_trace_dir;
+
+    // Extract "--option VALUE" pairs and shift the remaining arguments
+    auto take_option = [&](const char* option, std::string& value) {
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], option) == 0 && i + 1 < argc) {
+                value = argv[i + 1];
+                for (int j = i; j < argc - 2; j++) {
+                    argv[j] = argv[j + 2];
+                }
+                argc -= 2;
+                break;
             }
-            argc -= 2;
-            break;
         }
-    }
+    };
+    take_option("--stream-url", stream_url);
+    take_option("--detect-sink", detect_sink);
+    take_option("--detect-precision", detect_precision);
+    take_option("--motion-gate", motion_gate);
+    take_option("--detect-fps", detect_fps);
+    take_option("--frame-bus", frame_bus);
+    take_option("--packet-bus", packet_bus);
+    take_option("--metrics-port", metrics_port);
+    take_option("--latency-probe", latency_probe);
+    take_option("--trace-dir", trace_dir);
 
     // --- Input Validation Loop (Same as previous solution) ---
     while (argc < 3 || (type = atoi(argv[1])) > 1 || (quality = atoi(argv[2])) > 5 ||
            (argc == 4 && ((source = atoi(argv[3])) < 1 || source > 3))) {
         ERROR(
-            "Usage: %s [CAMERA_TYPE] [QUALITY] [LENS] [--stream-url URL]\nDESCRIPTION:\n "
+            "Usage: %s [CAMERA_TYPE] [QUALITY] [LENS] [--stream-url URL] [--detect-sink SINK] [--detect-precision fp32|fp16|int8] [--motion-gate RATIO[:roi]] [--detect-fps FPS] [--frame-bus NAME[:i420]] [--packet-bus NAME] [--metrics-port PORT] [--latency-probe on] [--trace-dir DIR|off]\nDESCRIPTION:\n "
             "CAMERA_TYPE: "
-            "0-FPV. 1-Payload \n QUALITY: 1-540p. 2-720p. 3-720pHigh. "
+            "0-FPV. 1-Payload \n QUALITY: 0-automatic. 1-540p. 2-720p. 3-720pHigh. "
             "4-1080p. 5-1080pHigh"
             "\n LENS (Optional): 1-wide 2-zoom 3-IR"
             "\n --stream-url (Optional): RTSP/RTMP URL to stream video (e.g., rtsp://localhost:8554/drone)"
+            "\n --detect-sink (Optional): run headless YOLO detection and write the results to SINK"
+            "\n   (json_file:PATH, binary_file:PATH, json_udp:HOST:PORT, binary_udp:HOST:PORT)"
+            "\n --detect-precision (Optional): YOLO inference precision, see yolo_map_eval"
+            "\n --motion-gate (Optional, with --detect-sink): skip detection unless RATIO of the macroblocks move,"
+            "\n   ':roi' only detects in the moving region"
+            "\n --detect-fps (Optional): adapt the YOLO model and input size to hold FPS"
+            "\n --frame-bus (Optional): also publish the decoded frames to the shared memory NAME"
+            "\n   for local readers (PythonVIdeoSelector/frame_bus.py), BGR or ':i420'"
+            "\n --packet-bus (Optional): also publish the H.264 stream to the shared memory NAME,"
+            "\n   one packet per access unit (PythonVIdeoSelector/packet_bus.py)"
+            "\n --metrics-port (Optional): serve the pipeline metrics on http://127.0.0.1:PORT/metrics,"
+            "\n   9464 by default, 0 to disable"
+            "\n --latency-probe (Optional): 'on' stamps each frame of --stream-url with its sequence"
+            "\n   and SDK callback time in an SEI, read back by latency_probe"
+            "\n --trace-dir (Optional): where SIGUSR2 and the dump trace command write the"
+            "\n   Chrome/Perfetto trace of the pipeline stages, /tmp by default, 'off' to disable"
             "\n eg: \n %s 1 4 2 --stream-url rtsp://localhost:8554/drone (Payload, 1080p, Zoom, stream to URL)",
             argv[0], argv[0]);
         sleep(1);
@@ -232,18 +309,55 @@ int main(int argc, char **argv) {
         }
     }
 
+    // The gate skips detections, there are none without a sink
+    if (!motion_gate.empty() && detect_sink.empty()) {
+        ERROR("--motion-gate needs --detect-sink");
+        return -1;
+    }
+    if (!detect_fps.empty() && detect_precision == "int8") {
+        ERROR("--detect-fps does not support --detect-precision int8");
+        return -1;
+    }
+
     const char type_to_str[2][16] = {"FPVCamera", "PayloadCamera"};
 
     // create liveview sample, assign to global pointer
     auto camera = std::string(type_to_str[type]);
     g_liveview_sample = std::make_shared<LiveviewSample>(std::string(camera)); // Use the global pointer
 
-    StreamDecoder::Options decoder_option = {.name = std::string("ffmpeg")};
+    StreamDecoder::Options decoder_option = {
+        .name = std::string("ffmpeg"),
+        .export_motion_vectors = !motion_gate.empty()};
     auto stream_decoder = CreateStreamDecoder(decoder_option);
 
     // Create image processor based on whether streaming URL is provided
     std::shared_ptr<ImageProcessor> image_processor;
-    if (!stream_url.empty()) {
+    if (!detect_sink.empty()) {
+        INFO("Writing detections to: %s", detect_sink.c_str());
+        ImageProcessor::Options image_processor_option = {
+            .name = detect_precision.empty()
+                        ? std::string("yolovfastest")
+                        : std::string("yolovfastest_") + detect_precision,
+            .alias = camera,
+            .userdata = nullptr,
+            .stream_url = "",
+            .result_sink = detect_sink
+        };
+        image_processor = CreateImageProcessor(image_processor_option);
+        auto yolo = std::dynamic_pointer_cast<ImageProcessorYolovFastest>(
+            image_processor);
+        if (yolo && !detect_fps.empty()) {
+            YoloCascade::Options cascade_option;
+            cascade_option.target_fps = atof(detect_fps.c_str());
+            yolo->SetCascade(cascade_option);
+        }
+        if (yolo && decoder_option.export_motion_vectors) {
+            MotionGate::Options gate_option;
+            gate_option.moving_ratio = atof(motion_gate.c_str());
+            yolo->SetMotionGate(gate_option,
+                                motion_gate.find(":roi") != std::string::npos);
+        }
+    } else if (!stream_url.empty()) {
         INFO("Streaming video to: %s", stream_url.c_str());
         ImageProcessor::Options image_processor_option = {
             .name = std::string("stream"),
@@ -252,6 +366,11 @@ int main(int argc, char **argv) {
             .stream_url = stream_url
         };
         image_processor = CreateImageProcessor(image_processor_option);
+        auto stream = std::dynamic_pointer_cast<ImageStreamProcessor>(image_processor);
+        if (stream && latency_probe == "on") {
+            INFO("Stamping the stream for latency_probe");
+            stream->SetLatencyProbe(true);
+        }
     } else {
         ImageProcessor::Options image_processor_option = {
             .name = std::string("display"),
@@ -261,6 +380,42 @@ int main(int argc, char **argv) {
         image_processor = CreateImageProcessor(image_processor_option);
     }
 
+    g_image_processor = image_processor;
+    if (!frame_bus.empty()) {
+        FrameBusPublisher::Options bus_option;
+        bus_option.name = frame_bus.substr(0, frame_bus.find(':'));
+        if (bus_option.name[0] != '/') bus_option.name = "/" + bus_option.name;
+        if (frame_bus.find(":i420") != std::string::npos) {
+            bus_option.format = kFrameBusFormatI420;
+        }
+        INFO("Publishing frames to: %s", bus_option.name.c_str());
+        image_processor = std::make_shared<FrameBusPublisher>(bus_option, image_processor);
+    }
+    if (!packet_bus.empty()) {
+        PacketBusPublisher::Options bus_option;
+        bus_option.name = packet_bus[0] == '/' ? packet_bus : "/" + packet_bus;
+        auto publisher = std::make_shared<PacketBusPublisher>(bus_option);
+        if (publisher->Init() == 0) {
+            INFO("Publishing packets to: %s", bus_option.name.c_str());
+            g_liveview_sample->SetPacketBus(publisher);
+        }
+    }
+    // Opened first, so that automatic quality changes are published too
+    bool control_channel = g_control_channel.Open() == 0;
+    if (!control_channel) {
+        ERROR("Control channel %s unavailable, configuration fixed", SHM_NAME);
+    }
+    g_liveview_sample->SetQualityCallback(
+        [](Liveview::StreamQuality) { PublishControlStatus(); });
+
+    // Automatic: the best quality the liveview status reports, subscribed
+    // at 720p until it is known
+    if (quality == 0) {
+        LiveviewSample::QualityPolicy policy;
+        policy.automatic = true;
+        g_liveview_sample->SetQualityPolicy(policy);
+        quality = Liveview::kStreamQuality720p;
+    }
     if (0 != InitLiveviewSample(
         g_liveview_sample, (Liveview::CameraType)type, (Liveview::StreamQuality)quality,
         stream_decoder, image_processor)) {
@@ -275,14 +430,36 @@ int main(int argc, char **argv) {
         g_liveview_sample->SetCameraSource((edge_sdk::Liveview::CameraSource)source);
     }
 
-    // --- Start the new input monitoring thread ---
-    std::thread input_thread(input_monitor_thread);
+    // Last kEventCount stage events of each thread, dumped on demand
+    if (trace_dir == "off") {
+        PipelineTrace::SetEnabled(false);
+    } else {
+        g_trace_dir = trace_dir;
+        PipelineTrace::DumpOnSignal(SIGUSR2, g_trace_dir);
+    }
+
+    // Prometheus text format, local only
+    MetricsServer::Options metrics_option;
+    metrics_option.port = atoi(metrics_port.c_str());
+    MetricsServer metrics_server(metrics_option);
+    if (metrics_option.port > 0) {
+        metrics_server.Start();
+    }
+
+    // --- Apply the commands of the shared memory control block ---
+    if (control_channel) {
+        PublishControlStatus();
+        g_control_channel.Start(OnControlCommand);
+    }
 
     // Main thread keeps running to prevent the program from exiting
-    // and keeps the liveview active.
-    while (1) sleep(3);
+    // and keeps the liveview active, logging the stream every 30 s.
+    for (int32_t i = 1;; i++) {
+        sleep(3);
+        if (i % 10 == 0) LogStreamStatistics();
+    }
 
     // Clean up (though unreachable in an infinite loop, good practice)
-    input_thread.join();
+    g_control_channel.Stop();
     return 0;
 }
\ No newline at end of file
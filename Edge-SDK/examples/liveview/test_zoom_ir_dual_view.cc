@@ -7,11 +7,14 @@
 #include <unistd.h>
 #include <atomic>
 #include <thread>
-#include <mutex>
 #include <chrono>
+#include <cstring>
 
 #include "error_code.h"
+#include "frame_compositor.h"
+#include "lens_demux.h"
 #include "logger.h"
+#include "pipeline_runtime.h"
 #include "sample_liveview.h"
 #include "stream_decoder.h"
 #include "image_processor.h"
@@ -23,66 +26,8 @@ using namespace edge_app;
 
 ErrorCode ESDKInit();
 
-static std::atomic<int> g_current_lens{1};   // 1 = wide, 3 = IR
 static std::atomic<bool> g_run{true};
 
-// Ignora i frame subito dopo lo switch
-static std::atomic<bool> g_accept_frames{false};
-static const int IGNORE_FRAMES_AFTER_SWITCH = 12;
-
-// ImageProcessor: unica finestra split
-class WideIrProcessor : public ImageProcessor {
-public:
-    WideIrProcessor(const std::string& name) : name_(name) {}
-
-    void Process(const std::shared_ptr<Image> image) override {
-        if (!g_accept_frames.load()) return;
-
-        auto mat_ptr = std::static_pointer_cast<cv::Mat>(image);
-        if (!mat_ptr || mat_ptr->empty()) return;
-
-        cv::Mat frame = *mat_ptr;
-        int lens = g_current_lens.load();
-
-        static cv::Mat last_wide, last_ir;
-        static std::mutex m;
-
-        {
-            std::lock_guard<std::mutex> lk(m);
-
-            if (lens == 1) {
-                last_wide = frame.clone();
-            } else if (lens == 3) {
-                last_ir = frame.clone();
-            }
-
-            if (last_wide.empty() || last_ir.empty()) return;
-
-            // IR → grayscale
-            cv::Mat ir_gray;
-            cv::cvtColor(last_ir, ir_gray, cv::COLOR_BGR2GRAY);
-            cv::cvtColor(ir_gray, ir_gray, cv::COLOR_GRAY2BGR);
-
-            // Resize
-            cv::Size target(640, 480);
-            cv::Mat wide_r, ir_r;
-            cv::resize(last_wide, wide_r, target);
-            cv::resize(ir_gray,  ir_r,    target);
-
-            // Split view
-            cv::Mat combined;
-            cv::hconcat(wide_r, ir_r, combined);
-
-            cv::imshow("Wide & IR Split View", combined);
-        }
-
-        cv::waitKey(1);
-    }
-
-private:
-    std::string name_;
-};
-
 // Thread di switch Wide ↔ IR
 void LensSwitchThread(std::shared_ptr<LiveviewSample> liveview,
                       int wide_ms = 10000,
@@ -94,18 +39,10 @@ void LensSwitchThread(std::shared_ptr<LiveviewSample> liveview,
 
         // WIDE
         liveview->SetCameraSource((Liveview::CameraSource)1);
-        g_current_lens.store(1);
-        g_accept_frames.store(false);
-        usleep(150000); // 150ms per evitare frame corrotti
-        g_accept_frames.store(true);
         std::this_thread::sleep_for(std::chrono::milliseconds(wide_ms));
 
         // IR
         liveview->SetCameraSource((Liveview::CameraSource)3);
-        g_current_lens.store(3);
-        g_accept_frames.store(false);
-        usleep(150000);
-        g_accept_frames.store(true);
         std::this_thread::sleep_for(std::chrono::milliseconds(ir_ms));
     }
 
@@ -115,7 +52,7 @@ void LensSwitchThread(std::shared_ptr<LiveviewSample> liveview,
 int main(int argc, char** argv)
 {
     if (argc < 2) {
-        ERROR("Usage: %s [QUALITY]", argv[0]);
+        ERROR("Usage: %s [QUALITY] [yolo]", argv[0]);
         return -1;
     }
 
@@ -130,10 +67,38 @@ int main(int argc, char** argv)
 
     auto liveview = std::make_shared<LiveviewSample>("WideIR");
 
-    StreamDecoder::Options decoder_option = {.name = "ffmpeg"};
+    // Decoding, the split view inputs and detection on one pool sized to
+    // the machine, with a single-threaded decoder
+    PipelineRuntime::Options runtime_option;
+    PipelineRuntime::Instance()->Start(runtime_option);
+
+    StreamDecoder::Options decoder_option = {.name = "ffmpeg",
+                                             .thread_count = 1};
     auto decoder = CreateStreamDecoder(decoder_option);
 
-    auto processor = std::make_shared<WideIrProcessor>("WideIrProcessor");
+    // Split view: ogni frame va nella metà della sua lente, IR in grigio
+    FrameCompositor::Options compositor_option;
+    compositor_option.name = "WideIR";
+    compositor_option.output_size = cv::Size(1280, 480);
+    compositor_option.keep_aspect = false;
+    auto compositor = std::make_shared<FrameCompositor>(compositor_option);
+    compositor->AddInput(1, FrameCompositor::kTileStyleColor);
+    compositor->AddInput(3, FrameCompositor::kTileStyleGray);
+
+    // Demux: ogni lente diventa uno stream virtuale con i suoi subscriber
+    LensDemux::Options demux_option;
+    demux_option.name = "WideIR";
+    auto processor = std::make_shared<LensDemux>(demux_option);
+    processor->Subscribe(1, CreateCompositorInput(compositor, 1));
+    processor->Subscribe(3, CreateCompositorInput(compositor, 3));
+
+    // Detection solo sull'IR, senza sapere dello switch
+    if (argc > 2 && strcmp(argv[2], "yolo") == 0) {
+        ImageProcessor::Options yolo_option = {.name = "yolovfastest",
+                                               .alias = "IR detection"};
+        processor->Subscribe(3, CreateImageProcessor(yolo_option),
+                             kPipelinePriorityLow);
+    }
 
     if (0 != InitLiveviewSample(
             liveview,
@@ -147,6 +112,11 @@ int main(int argc, char** argv)
 
     liveview->Start();
 
+    compositor->Start([](const cv::Mat& frame, const FrameInfo& info) {
+        cv::imshow("Wide & IR Split View", frame);
+        cv::waitKey(1);
+    });
+
     // 🎯 Switch ogni 10 secondi
     std::thread switch_thread(LensSwitchThread, liveview, 10000, 10000);
 
@@ -154,6 +124,7 @@ int main(int argc, char** argv)
 
     g_run.store(false);
     if (switch_thread.joinable()) switch_thread.join();
+    compositor->Stop();
 
     return 0;
 }
@@ -28,6 +28,7 @@
 #include <thread>
 
 #include "../liveview/image_processor_thread.h"
+#include "../liveview/pipeline_runtime.h"
 #include "../liveview/sample_liveview.h"
 #include "../liveview/stream_decoder.h"
 #include "../liveview/stream_processor_thread.h"
@@ -35,6 +36,7 @@
 #include "liveview.h"
 #include "logger.h"
 #include "media_manager.h"
+#include "motion_summary.h"
 #include "opencv2/dnn.hpp"
 #include "opencv2/highgui/highgui.hpp"
 #include "opencv2/opencv.hpp"
@@ -183,7 +185,7 @@ static void StartDumpMediaFiles() {
 class JpegRecordProcessor : public ImageProcessor {
    public:
     JpegRecordProcessor(const std::string& name, std::shared_ptr<LiveviewSample> live_sample) : name_(name),
-        liveview_sample_(live_sample) {
+        liveview_sample_(live_sample), motion_gate_(name) {
         snprintf(file_path_, sizeof(file_path_), "%s../../build/%s",
                  current_path_, "video2jpeg");
         char cmd[532];
@@ -198,6 +200,15 @@ class JpegRecordProcessor : public ImageProcessor {
 
     ~JpegRecordProcessor() override {}
 
+    // Frames the decoder's motion vectors show as static are not recorded,
+    // except one every MotionGate::Options::max_skipped_frames.
+    void Process(const std::shared_ptr<Image> image,
+                 const FrameInfo& info) override {
+        if (motion_gate_.Check(info)) {
+            Process(image);
+        }
+    }
+
     void Process(const std::shared_ptr<Image> image) override {
         std::string h = std::to_string(image->size().width);
         std::string w = std::to_string(image->size().height);
@@ -227,6 +238,7 @@ class JpegRecordProcessor : public ImageProcessor {
     uint32_t frame_counter_ = 0;
     std::string name_;
     char file_path_[256];
+    MotionGate motion_gate_;
 };
 
 class StreamDecodeRecorder : public StreamDecoder {
@@ -317,16 +329,25 @@ int main(int argc, char** argv) {
 
     StartDumpMediaFiles();
 
+    // All the decode and process work on one SCHED_OTHER pool sized to the
+    // machine, instead of two SCHED_FIFO threads and 4 decoder threads per
+    // stream.
+    PipelineRuntime::Options runtime_option;
+    PipelineRuntime::Instance()->Start(runtime_option);
+
     auto payload_liveview = std::make_shared<LiveviewSample>("Payload");
     auto image_processor = std::make_shared<JpegRecordProcessor>("Payload", payload_liveview);
-    StreamDecoder::Options decoder_option = {.name = std::string("ffmpeg")};
+    StreamDecoder::Options decoder_option = {
+        .name = std::string("ffmpeg"),
+        .export_motion_vectors = true,
+        .thread_count = 1};
     auto payload_decoder = CreateStreamDecoder(decoder_option);
     std::shared_ptr<StreamDecoder> payload_stream_decoder = std::make_shared<StreamDecodeRecorder>("Payload",
                                                                                                  payload_decoder);
 
     if (0 != InitLiveviewSample(
         payload_liveview, Liveview::kCameraTypePayload, Liveview::kStreamQuality1080pHigh,
-        payload_stream_decoder, image_processor)) {
+        payload_stream_decoder, image_processor, kPipelinePriorityHigh)) {
         ERROR("liveview payload init failed");
     } else {
         rc = payload_liveview->Start();
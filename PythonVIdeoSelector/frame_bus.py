@@ -0,0 +1,184 @@
+"""Lettore del frame bus pubblicato da test_liveview (--frame-bus).
+
+Layout in Edge-SDK/examples/common/frame_bus.h. I frame sono mappati come
+array numpy senza copia: la memoria resta del writer, che non aspetta mai i
+lettori. Dopo aver usato i pixel va controllato valid(), oppure vanno
+copiati subito; un lettore in ritardo salta semplicemente al frame più
+recente.
+
+    reader = FrameBusReader("drone_frames")
+    last = 0
+    while True:
+        reader.wait(last, 1.0)
+        frame = reader.latest(last)
+        if frame is None:
+            continue
+        ...usa frame.image...
+        if reader.valid(frame):
+            last = frame.number
+"""
+import ctypes
+import mmap
+import os
+import platform
+import struct
+import sys
+import time
+
+import numpy as np
+
+MAGIC = 0x42464A44
+VERSION = 1
+HEADER = struct.Struct("<IIIIQI")          # magic, version, slot_count, slot_size, latest, notify
+HEADER_SIZE = 64
+SLOT = struct.Struct("<IIQqiiiiI")         # sequence, format, frame_number, timestamp_us,
+SLOT_SIZE = 64                              # lens, width, height, stride, size
+OFF_NOTIFY = 24
+
+FORMAT_BGR24 = 0
+FORMAT_I420 = 1
+
+FUTEX_WAIT = 0
+SYS_FUTEX = {"x86_64": 202, "aarch64": 98}.get(platform.machine())
+
+
+class Timespec(ctypes.Structure):
+    _fields_ = [("tv_sec", ctypes.c_long), ("tv_nsec", ctypes.c_long)]
+
+
+class Frame:
+    __slots__ = ("number", "timestamp_us", "lens", "width", "height",
+                 "format", "image", "_slot", "_sequence")
+
+
+class FrameBusReader:
+    def __init__(self, name="drone_frames"):
+        self._path = os.path.join("/dev/shm", name.lstrip("/"))
+        self._mm = None
+        self._libc = ctypes.CDLL(None, use_errno=True)
+        self.open()
+
+    def open(self):
+        """Mappa il bus; da richiamare se latest() solleva ConnectionError."""
+        self.close()
+        fd = os.open(self._path, os.O_RDONLY)
+        try:
+            size = os.fstat(fd).st_size
+            self._mm = mmap.mmap(fd, size, mmap.MAP_SHARED, mmap.PROT_READ)
+        finally:
+            os.close(fd)
+        self._buf = np.frombuffer(self._mm, dtype=np.uint8)
+        magic, version, count, slot_size, _, _ = HEADER.unpack_from(self._mm, 0)
+        if magic != MAGIC or version != VERSION:
+            raise ConnectionError(f"{self._path}: frame bus non valido")
+
+    def _header(self):
+        magic, version, count, slot_size, latest, notify = HEADER.unpack_from(self._mm, 0)
+        if magic != MAGIC or HEADER_SIZE + count * slot_size > len(self._mm):
+            raise ConnectionError(f"{self._path}: frame bus ricreato")
+        return count, slot_size, latest, notify
+
+    def latest(self, after=0):
+        """Frame più recente se più nuovo di `after`, altrimenti None."""
+        while True:
+            count, slot_size, latest, _ = self._header()
+            if latest == 0 or latest <= after:
+                return None
+            slot = HEADER_SIZE + (latest % count) * slot_size
+            sequence = SLOT.unpack_from(self._mm, slot)[0]
+            (_, fmt, number, timestamp_us, lens, width, height, stride,
+             size) = SLOT.unpack_from(self._mm, slot)
+            if (sequence & 1 or number != latest
+                    or SLOT.unpack_from(self._mm, slot)[0] != sequence):
+                # Superato dal writer: si riprova solo se `latest` è andato
+                # avanti, altrimenti non c'è un frame da leggere
+                if self._header()[2] != latest:
+                    continue
+                return None
+
+            data = slot + SLOT_SIZE
+            if fmt == FORMAT_I420:
+                rows = height * 3 // 2
+                image = self._buf[data:data + rows * stride].reshape(rows, stride)[:, :width]
+            else:
+                image = self._buf[data:data + height * stride].reshape(
+                    height, stride)[:, :width * 3].reshape(height, width, 3)
+
+            frame = Frame()
+            frame.number = number
+            frame.timestamp_us = timestamp_us
+            frame.lens = lens
+            frame.width = width
+            frame.height = height
+            frame.format = fmt
+            frame.image = image
+            frame._slot = slot
+            frame._sequence = sequence
+            return frame
+
+    def valid(self, frame):
+        """False se il writer ha già iniziato a sovrascrivere lo slot, o se è
+        ripartito (le sequenze ripartono, i numeri dei frame no)."""
+        sequence, _, number = struct.unpack_from("<IIQ", self._mm, frame._slot)
+        magic = struct.unpack_from("<I", self._mm, 0)[0]
+        return (magic == MAGIC and sequence == frame._sequence
+                and number == frame.number)
+
+    def wait(self, after, timeout_s=1.0):
+        """Attende un frame più nuovo di `after`, True se c'è."""
+        _, _, latest, notify = self._header()
+        if latest > after:
+            return True
+        if SYS_FUTEX is None:
+            time.sleep(0.005)
+        else:
+            # FUTEX_WAIT legge soltanto il futex word: va bene su una
+            # mappatura in sola lettura
+            address = ctypes.c_void_p(self._buf.ctypes.data + OFF_NOTIFY)
+            ts = Timespec(int(timeout_s), int((timeout_s % 1) * 1e9))
+            self._libc.syscall(SYS_FUTEX, address, FUTEX_WAIT, notify,
+                               ctypes.byref(ts), None, 0)
+        return self._header()[2] > after
+
+    def close(self):
+        if self._mm is not None:
+            self._buf = None
+            try:
+                self._mm.close()
+            except BufferError:
+                # Frame ancora in uso: la mappatura si chiude con loro
+                pass
+            self._mm = None
+
+
+def main():
+    name = sys.argv[1] if len(sys.argv) > 1 else "drone_frames"
+    reader = FrameBusReader(name)
+    last = 0
+    frames = torn = 0
+    start = time.monotonic()
+    while True:
+        if not reader.wait(last, 1.0):
+            continue
+        frame = reader.latest(last)
+        if frame is None:
+            continue
+        mean = float(frame.image.mean())
+        if not reader.valid(frame):
+            torn += 1
+            continue
+        if last and frame.number > last + 1:
+            print(f"[Python] saltati {frame.number - last - 1} frame")
+        last = frame.number
+        frames += 1
+        elapsed = time.monotonic() - start
+        if elapsed >= 2:
+            print(f"[Python] frame {frame.number} {frame.width}x{frame.height} "
+                  f"lente {frame.lens}: {frames / elapsed:.1f} fps, media {mean:.1f}, "
+                  f"{torn} sovrascritti durante la lettura")
+            frames = torn = 0
+            start = time.monotonic()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,217 @@
+"""Lettore del packet bus pubblicato da test_liveview (--packet-bus).
+
+Layout in Edge-SDK/examples/liveview/packet_bus.h: un pacchetto per access
+unit H.264, con flag keyframe, timestamp e lente. Il lettore parte dal
+prossimo keyframe (o dall'ultimo ancora nel ring con from_last_keyframe) e,
+se resta indietro rispetto al writer, riparte da un keyframe; al primo
+pacchetto dopo una discontinuità SPS e PPS vengono anteposti se mancano,
+quindi i dati vanno bene così come sono per un decoder o un file .h264.
+
+    reader = PacketBusReader("drone_packets")
+    while True:
+        packet = reader.next()
+        if packet is None:
+            reader.wait(1.0)
+            continue
+        ...usa packet.data...
+"""
+import ctypes
+import mmap
+import os
+import platform
+import struct
+import sys
+import time
+
+import numpy as np
+
+MAGIC = 0x42504A44
+VERSION = 1
+HEADER = struct.Struct("<IIIIQQQII")       # magic, version, index_count, data_size,
+HEADER_SIZE = 64                            # write_index, write_offset, last_keyframe,
+OFF_NOTIFY = 40                             # notify, parameter_sequence
+PARAMETER_SETS = struct.Struct("<II")       # sps_size, pps_size, poi sps[248], pps[248]
+PARAMETER_SETS_SIZE = 504
+MAX_PARAMETER_SET = 248
+ENTRY = struct.Struct("<QQqIIi")            # number, offset, timestamp_us, size, flags, lens
+ENTRY_SIZE = 40
+
+FLAG_KEYFRAME = 1
+FLAG_PARAMETER_SETS = 2
+
+FUTEX_WAIT = 0
+SYS_FUTEX = {"x86_64": 202, "aarch64": 98}.get(platform.machine())
+
+
+class Timespec(ctypes.Structure):
+    _fields_ = [("tv_sec", ctypes.c_long), ("tv_nsec", ctypes.c_long)]
+
+
+class Packet:
+    __slots__ = ("number", "timestamp_us", "lens", "flags", "keyframe",
+                 "discontinuity", "data")
+
+
+def _payload_offset(index_count):
+    size = HEADER_SIZE + PARAMETER_SETS_SIZE + index_count * ENTRY_SIZE
+    return (size + 4095) // 4096 * 4096
+
+
+class PacketBusReader:
+    def __init__(self, name="drone_packets", from_last_keyframe=False):
+        self._path = os.path.join("/dev/shm", name.lstrip("/"))
+        self._from_last_keyframe = from_last_keyframe
+        self._mm = None
+        self._libc = ctypes.CDLL(None, use_errno=True)
+        self.lagged = 0
+        self.open()
+
+    def open(self):
+        """Mappa il bus; da richiamare se next() solleva ConnectionError."""
+        self.close()
+        fd = os.open(self._path, os.O_RDONLY)
+        try:
+            size = os.fstat(fd).st_size
+            self._mm = mmap.mmap(fd, size, mmap.MAP_SHARED, mmap.PROT_READ)
+        finally:
+            os.close(fd)
+        # Solo per l'indirizzo del futex word
+        self._buf = np.frombuffer(self._mm, dtype=np.uint8)
+        self._header()
+        self._attach()
+
+    def _header(self):
+        (magic, version, index_count, data_size, write_index, write_offset,
+         last_keyframe, notify, _) = HEADER.unpack_from(self._mm, 0)
+        if (magic != MAGIC or version != VERSION or index_count == 0 or
+                _payload_offset(index_count) + data_size > len(self._mm)):
+            raise ConnectionError(f"{self._path}: packet bus non valido o ricreato")
+        return index_count, data_size, write_index, write_offset, last_keyframe, notify
+
+    def _attach(self):
+        index_count, _, written, _, keyframe, _ = self._header()
+        self._next = written + 1
+        if self._from_last_keyframe and keyframe and written - keyframe < index_count:
+            self._next = keyframe
+        self._synced = False
+
+    def _parameter_sets(self):
+        base = HEADER_SIZE
+        for _ in range(1000):
+            sequence = struct.unpack_from("<I", self._mm, OFF_NOTIFY + 4)[0]
+            if sequence & 1:
+                continue
+            sps_size, pps_size = PARAMETER_SETS.unpack_from(self._mm, base)
+            if sps_size > MAX_PARAMETER_SET or pps_size > MAX_PARAMETER_SET:
+                continue
+            sps = base + 8
+            pps = sps + MAX_PARAMETER_SET
+            data = self._mm[sps:sps + sps_size] + self._mm[pps:pps + pps_size]
+            if struct.unpack_from("<I", self._mm, OFF_NOTIFY + 4)[0] == sequence:
+                return data
+        return b""
+
+    def next(self):
+        """Prossimo pacchetto, None se non ce n'è ancora uno."""
+        while True:
+            index_count, data_size, written, _, _, _ = self._header()
+            if self._next > written:
+                return None
+            entry = (HEADER_SIZE + PARAMETER_SETS_SIZE +
+                     (self._next % index_count) * ENTRY_SIZE)
+            number, offset, timestamp_us, size, flags, lens = ENTRY.unpack_from(
+                self._mm, entry)
+            if (written - self._next >= index_count or number != self._next or
+                    size > data_size // 2):
+                self.lagged += 1
+                self._attach()
+                continue
+            if not self._synced and not flags & FLAG_KEYFRAME:
+                self._next += 1
+                continue
+
+            prefix = b""
+            if not self._synced and not flags & FLAG_PARAMETER_SETS:
+                prefix = self._parameter_sets()
+            start = _payload_offset(index_count) + offset % data_size
+            data = prefix + self._mm[start:start + size]
+            # Intatto se il writer non ha ancora riservato quei byte
+            write_offset = self._header()[3]
+            if (write_offset > offset + data_size or
+                    ENTRY.unpack_from(self._mm, entry)[0] != number):
+                self.lagged += 1
+                self._attach()
+                continue
+
+            packet = Packet()
+            packet.number = number
+            packet.timestamp_us = timestamp_us
+            packet.lens = lens
+            packet.flags = flags
+            packet.keyframe = bool(flags & FLAG_KEYFRAME)
+            packet.discontinuity = not self._synced
+            packet.data = data
+            self._synced = True
+            self._next += 1
+            return packet
+
+    def wait(self, timeout_s=1.0):
+        """Attende un pacchetto dopo quelli già letti, True se c'è."""
+        _, _, written, _, _, notify = self._header()
+        if written >= self._next:
+            return True
+        if SYS_FUTEX is None:
+            time.sleep(0.005)
+        else:
+            # FUTEX_WAIT legge soltanto il futex word: va bene su una
+            # mappatura in sola lettura
+            address = ctypes.c_void_p(self._buf.ctypes.data + OFF_NOTIFY)
+            ts = Timespec(int(timeout_s), int((timeout_s % 1) * 1e9))
+            self._libc.syscall(SYS_FUTEX, address, FUTEX_WAIT, notify,
+                               ctypes.byref(ts), None, 0)
+        return self._header()[2] >= self._next
+
+    def close(self):
+        if self._mm is not None:
+            self._buf = None
+            self._mm.close()
+            self._mm = None
+
+
+def main():
+    """Scrive lo stream su stdout (o su un file), es. per ffplay o un .h264."""
+    name = sys.argv[1] if len(sys.argv) > 1 else "drone_packets"
+    out = open(sys.argv[2], "wb") if len(sys.argv) > 2 else sys.stdout.buffer
+    reader = PacketBusReader(name)
+    packets = size = 0
+    start = time.monotonic()
+    try:
+        while True:
+            try:
+                packet = reader.next()
+            except ConnectionError:
+                time.sleep(0.5)
+                reader.open()
+                continue
+            if packet is None:
+                reader.wait(1.0)
+                continue
+            out.write(packet.data)
+            packets += 1
+            size += len(packet.data)
+            elapsed = time.monotonic() - start
+            if elapsed >= 2:
+                print(f"[Python] pacchetto {packet.number} lente {packet.lens}: "
+                      f"{packets / elapsed:.1f} pacchetti/s, "
+                      f"{size * 8 / elapsed / 1000:.0f} kbps, "
+                      f"{reader.lagged} ripartenze", file=sys.stderr)
+                packets = size = 0
+                start = time.monotonic()
+    except (KeyboardInterrupt, BrokenPipeError):
+        pass
+    finally:
+        reader.close()
+
+
+if __name__ == "__main__":
+    main()
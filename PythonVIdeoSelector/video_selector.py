@@ -1,72 +1,217 @@
-from multiprocessing import shared_memory
+import ctypes
+import mmap
+import os
+import platform
 import struct
-import atexit
-import signal
 import sys
+import time
 
 SHM_NAME = "my_shm"
-SIZE = 4  # 1 int32
-
-shm = None  # riferimento globale per il cleanup
-
-
-def cleanup(*_):
-    """Chiude e rimuove la shared memory se esiste."""
-    global shm
-    if shm is not None:
-        try:
-            shm.close()
-        except FileNotFoundError:
-            pass
-        except Exception as e:
-            print(f"[Python] Errore in shm.close(): {e}")
 
+# Layout di ControlBlock in Edge-SDK/examples/liveview/control_channel.h
+MAGIC = 0x43564A44
+VERSION = 2
+RING_SIZE = 16
+HEADER_SIZE = 64
+COMMAND_SIZE = 32
+BLOCK_SIZE = HEADER_SIZE + COMMAND_SIZE * RING_SIZE
+
+OFF_MAGIC = 0
+OFF_VERSION = 4
+OFF_STATUS_SEQUENCE = 8
+OFF_STATUS = 12          # lens, quality, bitrate_kbps, detection
+OFF_NOTIFY = 28
+OFF_ACK_NOTIFY = 32
+OFF_WRITE_INDEX = 36
+OFF_READ_INDEX = 40
+
+# Campi di ControlCommand
+CMD_SEQUENCE = 0
+CMD_ID = 4
+CMD_ARGS = 8
+CMD_RESULT = 24
+CMD_DONE = 28
+
+CMD_SET_LENS = 1
+CMD_SET_QUALITY = 2
+CMD_SET_BITRATE = 3
+CMD_SET_DETECTION = 4
+CMD_DUMP_TRACE = 5
+
+RESULTS = {0: "ok", -1: "fallito", -2: "non supportato", -3: "argomento non valido"}
+
+FUTEX_WAIT = 0
+FUTEX_WAKE = 1
+SYS_FUTEX = {"x86_64": 202, "aarch64": 98}.get(platform.machine())
+
+
+class Timespec(ctypes.Structure):
+    _fields_ = [("tv_sec", ctypes.c_long), ("tv_nsec", ctypes.c_long)]
+
+
+class ControlChannel:
+    """Writer dei comandi del control block condiviso con test_liveview.
+
+    Un solo writer alla volta. Il blocco resta in /dev/shm tra un avvio e
+    l'altro: qui non viene mai rimosso, il processo C++ lo tiene mappato
+    per tutta la sua vita.
+    """
+
+    def __init__(self, name=SHM_NAME):
+        path = os.path.join("/dev/shm", name.lstrip("/"))
+        fd = os.open(path, os.O_RDWR | os.O_CREAT, 0o666)
         try:
-            shm.unlink()
-        except FileNotFoundError:
-            pass
-        except Exception as e:
-            print(f"[Python] Errore in shm.unlink(): {e}")
-
-        print("[Python] Shared memory chiusa e rimossa.")
-        shm = None
+            if os.fstat(fd).st_size < BLOCK_SIZE:
+                os.ftruncate(fd, BLOCK_SIZE)
+            self._mm = mmap.mmap(fd, BLOCK_SIZE, mmap.MAP_SHARED,
+                                 mmap.PROT_READ | mmap.PROT_WRITE)
+        finally:
+            os.close(fd)
+
+        magic, version = struct.unpack_from("<II", self._mm, OFF_MAGIC)
+        if magic != MAGIC or version != VERSION:
+            self._mm[:BLOCK_SIZE] = bytes(BLOCK_SIZE)
+            struct.pack_into("<I", self._mm, OFF_VERSION, VERSION)
+            struct.pack_into("<I", self._mm, OFF_MAGIC, MAGIC)
+
+        self._libc = ctypes.CDLL(None, use_errno=True)
+        self._notify = ctypes.c_uint32.from_buffer(self._mm, OFF_NOTIFY)
+        self._ack_notify = ctypes.c_uint32.from_buffer(self._mm, OFF_ACK_NOTIFY)
+        if SYS_FUTEX is None:
+            print(f"[Python] futex non supportato su {platform.machine()}, "
+                  "il C++ non verrà svegliato")
+
+    def _u32(self, offset):
+        return struct.unpack_from("<I", self._mm, offset)[0]
+
+    def _futex(self, word, op, value, timeout_s=None):
+        if SYS_FUTEX is None:
+            return
+        ts = None
+        if timeout_s is not None:
+            ts = ctypes.byref(Timespec(int(timeout_s), int((timeout_s % 1) * 1e9)))
+        self._libc.syscall(SYS_FUTEX, ctypes.byref(word), op, value, ts, None, 0)
+
+    def submit(self, command_id, arg):
+        """Accoda un comando, ritorna la sua sequenza o None se il ring è pieno."""
+        index = self._u32(OFF_WRITE_INDEX)
+        if (index - self._u32(OFF_READ_INDEX)) & 0xFFFFFFFF >= RING_SIZE:
+            return None
+        sequence = (index + 1) & 0xFFFFFFFF
+        slot = HEADER_SIZE + (index % RING_SIZE) * COMMAND_SIZE
+        struct.pack_into("<I4iiI", self._mm, slot + CMD_ID,
+                         command_id, arg, 0, 0, 0, 0, 0)
+        # La sequenza pubblica lo slot. Gli store di Python non sono ordinati
+        # su aarch64: il C++ può vedere il nuovo write_index prima della
+        # sequenza, e in quel caso aspetta la sequenza senza saltare lo slot.
+        struct.pack_into("<I", self._mm, slot + CMD_SEQUENCE, sequence)
+        struct.pack_into("<I", self._mm, OFF_WRITE_INDEX, sequence)
+        self._notify.value = (self._notify.value + 1) & 0xFFFFFFFF
+        self._futex(self._notify, FUTEX_WAKE, 0x7FFFFFFF)
+        return sequence
+
+    def wait_done(self, sequence, timeout_s=10.0):
+        """Attende l'ack del comando, ritorna il risultato o None al timeout."""
+        slot = HEADER_SIZE + ((sequence - 1) % RING_SIZE) * COMMAND_SIZE
+        deadline = time.monotonic() + timeout_s
+        while True:
+            seen = self._ack_notify.value
+            if self._u32(slot + CMD_DONE) == sequence:
+                return struct.unpack_from("<i", self._mm, slot + CMD_RESULT)[0]
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                return None
+            self._futex(self._ack_notify, FUTEX_WAIT, seen, remaining)
+
+    def send(self, command_id, arg, timeout_s=10.0):
+        sequence = self.submit(command_id, arg)
+        if sequence is None:
+            return None
+        return self.wait_done(sequence, timeout_s)
+
+    def read_status(self):
+        """Configurazione in uso scritta dal C++ (seqlock)."""
+        while True:
+            begin = self._u32(OFF_STATUS_SEQUENCE)
+            if begin & 1:
+                continue
+            lens, quality, bitrate, detection = struct.unpack_from(
+                "<4i", self._mm, OFF_STATUS)
+            if self._u32(OFF_STATUS_SEQUENCE) == begin:
+                return {"lens": lens, "quality": quality,
+                        "bitrate_kbps": bitrate, "detection": detection}
+
+    def close(self):
+        # I buffer ctypes tengono un export sulla mappatura
+        del self._notify
+        del self._ack_notify
+        self._mm.close()
+
+
+COMMANDS = {
+    "l": (CMD_SET_LENS, "lente: 1 wide, 2 zoom, 3 IR"),
+    "q": (CMD_SET_QUALITY, "qualità: 0 automatica, 1 540p ... 5 1080pHigh"),
+    "b": (CMD_SET_BITRATE, "bitrate dello stream in uscita, kbps"),
+    "d": (CMD_SET_DETECTION, "detection: 0 off, 1 on"),
+}
+
+
+def usage():
+    print("Comandi:")
+    for key, (_, text) in COMMANDS.items():
+        print(f"  {key} N   {text}")
+    print("  N     come 'l N'")
+    print("  t     salva la trace della pipeline (in --trace-dir)")
+    print("  s     stato attuale")
+    print("  0     esci")
 
 
 def main():
-    global shm
-
-    # Crea la shared memory
-    shm = shared_memory.SharedMemory(name=SHM_NAME, create=True, size=SIZE)
-    print(f"[Python] Shared memory '{SHM_NAME}' creata (SIZE={SIZE} byte).")
-
-    # Registra cleanup all'uscita normale
-    atexit.register(cleanup)
-
-    # Se arriva Ctrl+C o SIGTERM → esci in modo che atexit esegua cleanup()
-    signal.signal(signal.SIGINT, lambda sig, frame: sys.exit(0))
-    signal.signal(signal.SIGTERM, lambda sig, frame: sys.exit(0))
-
-    while True:
-        try:
-            s = input("Inserisci un intero da scrivere in shared memory (0 per uscire): ")
-        except EOFError:
-            # es. chiusura stdin → esci pulito
-            break
-
-        try:
-            value = int(s)
-        except ValueError:
-            print("Valore non valido, riprova.")
-            continue
-
-        # Scrivi l'intero (int32) in shared memory
-        shm.buf[:4] = struct.pack("i", value)
-        print(f"[Python] Scritto valore = {value} in shared memory '{SHM_NAME}'")
-
-        # Se l'utente digita 0 → esci e lascia fare cleanup
-        if value == 0:
-            break
+    channel = ControlChannel(SHM_NAME)
+    print(f"[Python] Control block '/dev/shm/{SHM_NAME}' mappato, "
+          f"stato = {channel.read_status()}.")
+    usage()
+
+    try:
+        while True:
+            try:
+                s = input("> ").split()
+            except EOFError:
+                # es. chiusura stdin → esci pulito
+                break
+            if not s:
+                continue
+            if s[0] == "s":
+                print(f"[Python] {channel.read_status()}")
+                continue
+            if s[0] == "0":
+                break
+
+            try:
+                if s[0] == "t":
+                    command_id, value = CMD_DUMP_TRACE, 0
+                elif s[0] in COMMANDS and len(s) == 2:
+                    command_id, value = COMMANDS[s[0]][0], int(s[1])
+                else:
+                    command_id, value = CMD_SET_LENS, int(s[0])
+            except ValueError:
+                usage()
+                continue
+
+            start = time.monotonic()
+            result = channel.send(command_id, value)
+            elapsed_ms = (time.monotonic() - start) * 1000
+            if result is None:
+                print("[Python] Nessun ack: test_liveview non in esecuzione?")
+            else:
+                print(f"[Python] {RESULTS.get(result, result)} in {elapsed_ms:.1f} ms, "
+                      f"stato = {channel.read_status()}")
+    except KeyboardInterrupt:
+        pass
+    finally:
+        channel.close()
+    sys.exit(0)
 
 
 if __name__ == "__main__":
-    main()
\ No newline at end of file
+    main()